@@ -26,10 +26,12 @@ message(STATUS "Fetch renderer dependencies")
 
 ## vulkan
 message(CHECK_START "Check dependency: ${DEPENDENCY_NAME_VULKAN}")
-set(Vulkan_INCLUDE_DIR ${VENDOR_DIR}/VulkanSDK/Include)
-find_library(Vulkan_LIBRARY NAMES vulkan-1 PATHS ${VENDOR_DIR}/VulkanSDK/Lib)
-find_program(Vulkan_GLSLANG_VALIDATOR_EXECUTABLE glslangValidator PATHS ${VENDOR_DIR}/VulkanSDK/Bin)
-find_program(Vulkan_GLSLC_EXECUTABLE glslc PATHS ${VENDOR_DIR}/VulkanSDK/Bin)
+if(WIN32)
+	set(Vulkan_INCLUDE_DIR ${VENDOR_DIR}/VulkanSDK/Include)
+	find_library(Vulkan_LIBRARY NAMES vulkan-1 PATHS ${VENDOR_DIR}/VulkanSDK/Lib)
+	find_program(Vulkan_GLSLANG_VALIDATOR_EXECUTABLE glslangValidator PATHS ${VENDOR_DIR}/VulkanSDK/Bin)
+	find_program(Vulkan_GLSLC_EXECUTABLE glslc PATHS ${VENDOR_DIR}/VulkanSDK/Bin)
+endif() # WIN32, otherwise use the system vulkan loader & headers (e.g. libvulkan-dev)
 find_package(Vulkan REQUIRED)
 if(NOT Vulkan_FOUND)
 	message(CHECK_FAIL "Can not find dependency: ${DEPENDENCY_NAME_VULKAN}")
@@ -38,18 +40,21 @@ endif() # NOT Vulkan_FOUND
 message(CHECK_PASS "Complete")
 
 
-message(CHECK_START "Fetch dependency: ${DEPENDENCY_NAME_GLFW}")
-FetchContent_Declare(${DEPENDENCY_NAME_GLFW}
-	GIT_REPOSITORY https://github.com/glfw/glfw
-	GIT_TAG ${DEPENDENCY_TAG_GLFW})
-set(GLFW_BUILD_EXAMPLES OFF CACHE INTERNAL "")
-set(GLFW_BUILD_TESTS OFF CACHE INTERNAL "")
-set(GLFW_BUILD_DOCS OFF CACHE INTERNAL "")
-set(GLFW_INSTALL OFF CACHE INTERNAL "")
-FetchContent_MakeAvailable(${DEPENDENCY_NAME_GLFW})
-set_target_properties(${DEPENDENCY_NAME_GLFW} PROPERTIES FOLDER dependencies)
-set_target_properties(update_mappings PROPERTIES FOLDER dependencies)
-message(CHECK_PASS "Complete")
+## glfw
+if(ENABLE_WINDOW)
+	message(CHECK_START "Fetch dependency: ${DEPENDENCY_NAME_GLFW}")
+	FetchContent_Declare(${DEPENDENCY_NAME_GLFW}
+		GIT_REPOSITORY https://github.com/glfw/glfw
+		GIT_TAG ${DEPENDENCY_TAG_GLFW})
+	set(GLFW_BUILD_EXAMPLES OFF CACHE INTERNAL "")
+	set(GLFW_BUILD_TESTS OFF CACHE INTERNAL "")
+	set(GLFW_BUILD_DOCS OFF CACHE INTERNAL "")
+	set(GLFW_INSTALL OFF CACHE INTERNAL "")
+	FetchContent_MakeAvailable(${DEPENDENCY_NAME_GLFW})
+	set_target_properties(${DEPENDENCY_NAME_GLFW} PROPERTIES FOLDER dependencies)
+	set_target_properties(update_mappings PROPERTIES FOLDER dependencies)
+	message(CHECK_PASS "Complete")
+endif() # ENABLE_WINDOW
 
 
 # support
@@ -64,7 +69,7 @@ FetchContent_MakeAvailable(${DEPENDENCY_NAME_GLM})
 message(CHECK_PASS "Complete")
 
 ## imgui
-if(ENABLE_IMGUI)
+if(ENABLE_IMGUI AND ENABLE_WINDOW) # imgui backend uses glfw
 	message(CHECK_START "Fetch dependency: ${DEPENDENCY_NAME_IMGUI}")
 
 
@@ -98,7 +103,7 @@ if(ENABLE_IMGUI)
 
 
 	message(CHECK_PASS "Complete")
-endif() # ENABLE_IMGUI
+endif() # ENABLE_IMGUI AND ENABLE_WINDOW
 
 ## stb (header only)
 message(CHECK_START "Fetch dependency: ${DEPENDENCY_NAME_STB}")
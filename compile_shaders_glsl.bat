@@ -14,8 +14,8 @@ for /R "bin/data/shaders/glsl" %%f in (.) do (
 		for %%i in (*) do (
 			set temp=%%i
 			if "!temp:~-4!" neq ".spv" if "!temp:~-6!" neq ".embed" (
-				rem found shader
-				%VULKAN_SHADER_COMPILER_FILE% -V %%i -o "!temp!.spv"
+				rem found shader, spir-v for vulkan 1.2 so subgroup ops compile
+				%VULKAN_SHADER_COMPILER_FILE% -V --target-env vulkan1.2 %%i -o "!temp!.spv"
 			)
 		)
 	popd
@@ -0,0 +1,15 @@
+#!/bin/sh
+# linux equivalent of compile_shaders_glsl.bat
+# uses glslangValidator from the PATH (e.g. glslang-tools or the vulkan sdk setup-env.sh)
+
+
+if ! command -v glslangValidator > /dev/null 2>&1; then
+	echo "glslangValidator not found"
+	exit 1
+fi
+
+
+find "bin/data/shaders/glsl" -type f ! -name "*.spv" ! -name "*.embed" | while read -r f; do
+	# found shader, spir-v for vulkan 1.2 (what the device is created with) so subgroup ops compile
+	glslangValidator -V --target-env vulkan1.2 "$f" -o "$f.spv" || exit 1
+done
@@ -0,0 +1,1377 @@
+// benchmark suite:
+// runs the samples' kernels headless over a sweep of problem sizes, and writes the timings out for regression tracking
+//
+// fma      - vulkan_compute_buffer's fused multiply add, 2^10 .. 2^28 elements
+// fma_cpu  - the same on the cpu backend (cpu_compute.h), 2^10 .. 2^26 elements, its 'gpu ms' columns are cpu time
+//            compare its times to fma's wall times for where 'choose_compute_backend' should switch over
+// texture  - vulkan_compute_texture's greyscale filter, 256x256 .. 8192x8192 pixels
+// particle - vulkan_compute_particle's whole step (integrate, grid count/scan/scatter, collide), 2^10 .. 2^24 particles
+//            spread over bounds grown with the count, at the sample's density, so the grid cells hold as many particles
+// sort       - 'gpu_sort' (vulkan_primitives.h) of random u32 keys, 2^10 .. 2^26 keys
+// sort_pairs - 'gpu_sort_by_key', the same keys with a u32 value each
+//              both copy the unsorted keys in first each run, that copy is in the time (and the bytes)
+// sort_cpu   - std::sort of the same keys, 2^10 .. 2^26 keys, its 'gpu ms' columns are cpu time
+// gemm       - 'gemm_vulkan_buffer' (vulkan_gemm.h) of square f32 matrices, 64 .. 4096 wide, the tiles can be set
+//              with 'gemm_tile_m' .. 'gemm_thread_n' (see 'vulkan_gemm_tiles')
+// gemm_cpu   - 'run_cpu_gemm' (cpu_compute.h) of the same, 64 .. 2048 wide, its 'gpu ms' columns are cpu time
+//
+// every size is run 'warmup' times untimed (first touch of the memory, clocks ramping up), then 'repeats' times timed
+// each run is its own submit + fence wait, timed on the gpu (timestamps around the dispatch) and on the cpu (submit to wait)
+// bandwidth and throughput (and GFLOP/s for gemm) are worked out from the median gpu time, sizes that don't fit the device are skipped
+//
+// options are 'key=value' pairs on the command line, e.g.
+// vulkan_compute_bench output=bench.csv repeats=20 kernels=fma,particle fma_max_log2=24
+// the output format follows the extension of 'output', '.csv' or anything else for json
+// no window is needed, so it runs on compute nodes and software drivers (e.g. lavapipe, with VK_ICD_FILENAMES pointing at it)
+
+
+#include "../maths.h"             // for standard types
+#include "../utility.h"           // for DBG_ASSERT
+#include "../vulkan_context.h"
+#include "../vulkan_pipeline.h"
+#include "../vulkan_resources.h"
+#include "../vulkan_memory.h"
+#include "../vulkan_autotune.h"
+#include "../cpu_compute.h"
+#include "../vulkan_primitives.h"
+#include "../vulkan_gemm.h"
+#include "../vulkan_elementwise.h"
+#include "../vulkan_upload.h"
+
+#include <algorithm>              // for std::sort, std::max
+#include <array>                  // for std::array
+#include <chrono>                 // for std::chrono
+#include <cmath>                  // for std::sqrt, std::ceil
+#include <cstdio>                 // for std::fopen, std::fprintf, std::fclose
+#include <cstdlib>                // for std::strtoul
+#include <cstring>                // for std::memcpy
+#include <functional>             // for std::function
+#include <random>                 // for std::mt19937
+#include <span>                   // for std::span
+#include <string>                 // for std::string
+#include <vector>                 // for std::vector
+
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_FMA = "data/shaders/glsl/vulkan_compute_buffer/vulkan_compute_buffer.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GREYSCALE = "data/shaders/glsl/vulkan_compute_texture/vulkan_compute_texture.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_INTEGRATE = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_particle.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_COUNT = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_count.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scan.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_BLOCKS = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scan_blocks.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_ADD = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scan_add.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCATTER = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scatter.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_COLLISION = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_collision.comp.spv";
+
+// same defaults (and autotuner entries) as the samples, so the numbers match what they run with
+constexpr u32 THREAD_GROUP_SIZE_FMA = 256u;
+constexpr u32 THREAD_GROUP_DIM_GREYSCALE = 16u;
+constexpr u32 THREAD_GROUP_SIZE_PARTICLE = 256u;
+constexpr u32 THREAD_GROUP_SIZE_GRID_SCAN = 256u; // cells per scan block, the sample's 'scan_block_size'
+constexpr char const* AUTOTUNE_KERNEL_NAME_FMA = "vulkan_compute_buffer.fma";
+constexpr char const* AUTOTUNE_KERNEL_NAME_GREYSCALE = "vulkan_compute_texture.greyscale";
+constexpr char const* AUTOTUNE_KERNEL_NAME_PARTICLE = "vulkan_compute_particle.collision";
+
+constexpr u32 MAX_BENCH_BINDINGS = 10u;
+constexpr u32 MAX_BENCH_LOG2 = 30u;     // sizes are 1u << log2, and a gemm's dim^2 floats must still fit in a u64 of bytes
+constexpr u32 MAX_CPU_BENCH_LOG2 = 26u; // 3 x 256MB of host memory
+constexpr u32 MAX_CPU_GEMM_LOG2 = 11u;  // 2 x 2048^3 flops, seconds per run on the cpu already
+
+// the particle sample's defaults (see 'particle_config' in particle/main.cpp), the bounds grow with the count to keep the density
+constexpr u32 BASE_NUM_PARTICLES = 1u << 8u;
+constexpr f32 BASE_BOUNDS_WIDTH = 58.f, BASE_BOUNDS_HEIGHT = 32.f;
+constexpr f32 PARTICLE_RADIUS = 8.f * 4.f / 5.4f; // 'PARTICLE_SIZE'
+constexpr f32 MAX_PARTICLE_SPEED = 1.f / (1u << 6u);
+
+
+struct bench_config
+{
+  std::string output_path = "bench.json";
+  std::string kernels = "fma,fma_cpu,texture,particle,sort,sort_pairs,sort_cpu,gemm,gemm_cpu";
+  u32 warmup = 2u;
+  u32 repeats = 10u;
+  u32 fma_min_log2 = 10u, fma_max_log2 = 28u;           // elements
+  u32 image_min_log2 = 8u, image_max_log2 = 13u;        // width = height
+  u32 particle_min_log2 = 10u, particle_max_log2 = 24u; // particles
+  u32 sort_min_log2 = 10u, sort_max_log2 = 26u;         // keys
+  u32 gemm_min_log2 = 6u, gemm_max_log2 = 12u;          // m = n = k
+  vulkan_gemm_tiles gemm_tiles;
+};
+
+// one line of the output
+struct bench_result
+{
+  char const* kernel = nullptr;
+  std::string size;       // human readable, e.g. '1048576' or '1024x1024'
+  u64 elements = {};      // elements/pixels/particles processed per run
+  u64 bytes = {};         // bytes read + written per run
+  u64 flops = {};         // floating point operations per run, gemm only
+  f32 gpu_ms_min = {}, gpu_ms_median = {}, gpu_ms_mean = {};
+  f32 wall_ms_median = {};
+};
+
+// one pipeline with a single descriptor set, re-pointed at each size's resources
+struct bench_kernel
+{
+  VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+  vulkan_descriptor_set desc_set_0;
+};
+
+struct compute_push_constants_fma
+{
+  f32 multiplier;
+};
+
+// layout of vulkan_compute_particle.comp's uniform buffers, see 'compute_UBO_info_buffer' in particle/main.cpp
+struct compute_UBO_info_buffer_particle
+{
+  u32 num_particles;
+  f32 bounds[4u]; // origin x, origin y, width, height
+  u32 num_cells[2u];
+  f32 cell_dim;
+  f32 particle_radius;
+};
+struct compute_UBO_step_buffer_particle
+{
+  f32 deltatime;
+};
+
+
+// apply one 'key=value' pair, false if the key is unknown or the value doesn't parse
+static bool set_bench_config_value (std::string const& key, std::string const& value,
+  bench_config& config)
+{
+  if (key == "output" || key == "kernels")
+  {
+    (key == "output" ? config.output_path : config.kernels) = value;
+    return DBG_ASSERT_MSG (!value.empty (), "bench config key '%s' needs a value\n", key.c_str ());
+  }
+
+  char* end = nullptr;
+  u32 const as_u32 = (u32)std::strtoul (value.c_str (), &end, 0);
+  if (end == value.c_str () || *end != '\0')
+  {
+    return DBG_ASSERT_MSG (false, "bad value '%s' for bench config key '%s'\n", value.c_str (), key.c_str ());
+  }
+
+  // past 31 the shifts are undefined, and 'log2 <= max' never ends at UINT32_MAX
+  u32 const as_log2 = std::min (as_u32, MAX_BENCH_LOG2);
+
+  if (key == "warmup") config.warmup = as_u32;
+  else if (key == "repeats") config.repeats = std::max (as_u32, 1u);
+  else if (key == "fma_min_log2") config.fma_min_log2 = as_log2;
+  else if (key == "fma_max_log2") config.fma_max_log2 = as_log2;
+  else if (key == "image_min_log2") config.image_min_log2 = as_log2;
+  else if (key == "image_max_log2") config.image_max_log2 = as_log2;
+  else if (key == "particle_min_log2") config.particle_min_log2 = as_log2;
+  else if (key == "particle_max_log2") config.particle_max_log2 = as_log2;
+  else if (key == "sort_min_log2") config.sort_min_log2 = as_log2;
+  else if (key == "sort_max_log2") config.sort_max_log2 = as_log2;
+  else if (key == "gemm_min_log2") config.gemm_min_log2 = as_log2;
+  else if (key == "gemm_max_log2") config.gemm_max_log2 = as_log2;
+  else if (key == "gemm_tile_m") config.gemm_tiles.tile_m = as_u32;
+  else if (key == "gemm_tile_n") config.gemm_tiles.tile_n = as_u32;
+  else if (key == "gemm_tile_k") config.gemm_tiles.tile_k = as_u32;
+  else if (key == "gemm_thread_m") config.gemm_tiles.thread_m = as_u32;
+  else if (key == "gemm_thread_n") config.gemm_tiles.thread_n = as_u32;
+  else
+  {
+    return DBG_ASSERT_MSG (false, "unknown bench config key '%s'\n", key.c_str ());
+  }
+  return true;
+}
+
+static bool is_kernel_enabled (bench_config const& config, char const* kernel)
+{
+  return (',' + config.kernels + ',').find (',' + std::string (kernel) + ',') != std::string::npos;
+}
+
+// record 'record_dispatch' once between a pair of timestamps, then submit it 'warmup' + 'repeats' times
+static bool run_bench (vulkan_gpu_timer const& timer, bench_config const& config,
+  std::function <void (VkCommandBuffer command_buffer)> record_dispatch,
+  bench_result& out_result)
+{
+  if (!record_vulkan_gpu_timer (timer, 0u, record_dispatch))
+  {
+    return false;
+  }
+
+  std::vector <f32> gpu_ms, wall_ms;
+  for (u32 run = 0u; run < config.warmup + config.repeats; ++run)
+  {
+    f32 time_ms = {};
+    auto const submit_time = std::chrono::steady_clock::now ();
+    if (!run_vulkan_gpu_timer (timer, time_ms))
+    {
+      return DBG_ASSERT_MSG (false, "bench: submit failed\n");
+    }
+    auto const complete_time = std::chrono::steady_clock::now ();
+
+    if (run < config.warmup)
+    {
+      continue;
+    }
+    gpu_ms.push_back (time_ms);
+    wall_ms.push_back (std::chrono::duration <f32, std::milli> (complete_time - submit_time).count ());
+  }
+
+  std::sort (gpu_ms.begin (), gpu_ms.end ());
+  std::sort (wall_ms.begin (), wall_ms.end ());
+  f32 gpu_ms_total = 0.f;
+  for (f32 const ms : gpu_ms)
+  {
+    gpu_ms_total += ms;
+  }
+  out_result.gpu_ms_min = gpu_ms.front ();
+  out_result.gpu_ms_median = gpu_ms [gpu_ms.size () / 2u];
+  out_result.gpu_ms_mean = gpu_ms_total / (f32)gpu_ms.size ();
+  out_result.wall_ms_median = wall_ms [wall_ms.size () / 2u];
+
+  return true;
+}
+
+
+// another pipeline for a kernel's layout, for shaders that share one set of bindings
+static bool create_bench_pipeline (VkDevice device,
+  char const* compiled_shader_path, vulkan_specialization const& specialization, VkPipelineLayout pipeline_layout,
+  VkPipeline& out_pipeline)
+{
+  VkShaderModule shader_module = VK_NULL_HANDLE;
+  if (!create_vulkan_shader (device,
+    compiled_shader_path,
+    shader_module))
+  {
+    return false;
+  }
+  bool const is_created = create_vulkan_pipeline_compute (device,
+    shader_module, "main",
+    pipeline_layout,
+    out_pipeline,
+    &specialization);
+  release_vulkan_shader (device,
+    shader_module); // don't need shader object now we have the pipeline
+  return is_created;
+}
+static bool create_bench_kernel (VkDevice device,
+  char const* compiled_shader_path, vulkan_specialization const& specialization,
+  u32 num_bindings, VkDescriptorType const* binding_types, u32 push_constants_size,
+  bench_kernel& out_kernel)
+{
+  DBG_ASSERT (num_bindings <= MAX_BENCH_BINDINGS);
+
+
+  // bindings 0..n-1 of set 0, in shader order
+  std::array <VkDescriptorSetLayoutBinding, MAX_BENCH_BINDINGS> bindings = {};
+  std::vector <VkDescriptorPoolSize> pool_sizes;
+  for (u32 i = 0u; i < num_bindings; ++i)
+  {
+    bindings [i] =
+    {
+      .binding = i,
+      .descriptorType = binding_types [i],
+      .descriptorCount = 1u,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .pImmutableSamplers = VK_NULL_HANDLE
+    };
+    pool_sizes.push_back ({ .type = binding_types [i], .descriptorCount = 1u });
+  }
+  std::span <const VkDescriptorSetLayoutBinding> const descriptor_set_layout_bindings (bindings.data (), num_bindings);
+  if (!create_vulkan_descriptor_set_layouts (device,
+    1u, &descriptor_set_layout_bindings,
+    &out_kernel.descriptor_set_layout))
+  {
+    return false;
+  }
+
+  VkPushConstantRange const push_constant_range =
+  {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0u,
+    .size = push_constants_size
+  };
+  if (!create_vulkan_pipeline_layout (device,
+    1u, &out_kernel.descriptor_set_layout,
+    push_constants_size > 0u ? 1u : 0u, &push_constant_range,
+    out_kernel.pipeline_layout))
+  {
+    return false;
+  }
+
+  if (!create_bench_pipeline (device,
+    compiled_shader_path, specialization, out_kernel.pipeline_layout,
+    out_kernel.pipeline))
+  {
+    return false;
+  }
+
+  if (!create_vulkan_descriptor_pool (device,
+    1u,
+    (u32)pool_sizes.size (), pool_sizes.data (),
+    out_kernel.descriptor_pool))
+  {
+    return false;
+  }
+  vulkan_descriptor_set_info const descriptor_set_info =
+  {
+    .desc_pool = &out_kernel.descriptor_pool,
+    .layout = &out_kernel.descriptor_set_layout,
+    .set_index = 0u,
+    .out_set = &out_kernel.desc_set_0
+  };
+  return create_vulkan_descriptor_sets (device,
+    1u, &descriptor_set_info);
+}
+static void release_bench_kernel (VkDevice device, bench_kernel& kernel)
+{
+  if (CHECK_VULKAN_HANDLE (kernel.desc_set_0.desc_set)) release_vulkan_descriptor_sets (device, 1u, &kernel.desc_set_0);
+  if (CHECK_VULKAN_HANDLE (kernel.descriptor_pool)) release_vulkan_descriptor_pool (device, kernel.descriptor_pool);
+  if (CHECK_VULKAN_HANDLE (kernel.pipeline)) release_vulkan_pipeline (device, kernel.pipeline);
+  if (CHECK_VULKAN_HANDLE (kernel.pipeline_layout)) release_vulkan_pipeline_layout (device, kernel.pipeline_layout);
+  if (CHECK_VULKAN_HANDLE (kernel.descriptor_set_layout)) release_vulkan_descriptor_set_layouts (device, 1u, &kernel.descriptor_set_layout);
+}
+
+// point binding i of the kernel's set at buffers [i]
+static void bind_bench_buffers (VkDevice device, bench_kernel const& kernel,
+  u32 num_buffers, vulkan_buffer const* const* buffers, VkDescriptorType const* binding_types)
+{
+  std::array <VkDescriptorBufferInfo, MAX_BENCH_BINDINGS> buffer_infos = {};
+  std::array <VkWriteDescriptorSet, MAX_BENCH_BINDINGS> write_descriptors = {};
+  for (u32 i = 0u; i < num_buffers; ++i)
+  {
+    buffer_infos [i] =
+    {
+      .buffer = buffers [i]->buffer,
+      .offset = 0u,
+      .range = VK_WHOLE_SIZE
+    };
+    write_descriptors [i] =
+    {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      //.pNext = VK_NULL_HANDLE,
+      .dstSet = kernel.desc_set_0.desc_set,
+      .dstBinding = i,
+      .dstArrayElement = 0u,
+      .descriptorCount = 1u,
+      .descriptorType = binding_types [i],
+      .pImageInfo = VK_NULL_HANDLE,
+      .pBufferInfo = &buffer_infos [i],
+      .pTexelBufferView = VK_NULL_HANDLE
+    };
+  }
+  vkUpdateDescriptorSets (device, // device
+    num_buffers,                  // descriptorWriteCount
+    write_descriptors.data (),    // pDescriptorWrites
+    0u,                           // descriptorCopyCount
+    VK_NULL_HANDLE);              // pDescriptorCopies
+}
+
+// fill device local buffers with a 4 byte pattern (e.g. the bits of a float), nothing is staged
+// the one off commands go to the compute queue, the one the timer runs on, and are waited for
+static bool fill_bench_buffers (u32 num_buffers, vulkan_buffer const* const* buffers, u32 const* patterns)
+{
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  if (!begin_single_time_commands (command_buffer) ||
+    !begin_command_buffer (command_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+  {
+    return false;
+  }
+  for (u32 i = 0u; i < num_buffers; ++i)
+  {
+    vkCmdFillBuffer (command_buffer, buffers [i]->buffer, 0u, VK_WHOLE_SIZE, patterns [i]);
+  }
+  return end_command_buffer (command_buffer) &&
+    end_single_time_commands ();
+}
+
+// the ones that were created, a size may have failed part way
+static void release_bench_buffers (VkDevice device, size_t num_buffers, vulkan_buffer* buffers)
+{
+  for (size_t i = 0u; i < num_buffers; ++i)
+  {
+    if (CHECK_VULKAN_HANDLE (buffers [i].buffer)) release_vulkan_buffer (device, buffers [i]);
+  }
+}
+
+static u32 as_bits (f32 value)
+{
+  u32 bits = {};
+  std::memcpy (&bits, &value, sizeof (bits));
+  return bits;
+}
+
+
+// skip sizes a single buffer can't be bound at, or that would crowd the device out of memory
+struct bench_limits
+{
+  VkDeviceSize max_binding_size = {};
+  VkDeviceSize max_total_size = {};
+  u32 max_image_dim = {};
+  u32 max_groups_x = {};
+};
+static bool fits_bench_limits (bench_limits const& limits, VkDeviceSize binding_size, VkDeviceSize total_size)
+{
+  return binding_size <= limits.max_binding_size && total_size <= limits.max_total_size;
+}
+
+
+static bool bench_fma (VkPhysicalDevice physical_device, VkDevice device,
+  bench_config const& config, bench_limits const& limits, vulkan_gpu_timer const& timer,
+  std::vector <bench_result>& out_results)
+{
+  vulkan_workgroup_size thread_group_size = { .x = THREAD_GROUP_SIZE_FMA };
+  find_vulkan_workgroup_size (AUTOTUNE_KERNEL_NAME_FMA, thread_group_size); // keeps the default if this device hasn't been tuned
+
+  VkDescriptorType const binding_types [] =
+  {
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // input a
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // input b
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // output
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER  // info
+  };
+  vulkan_specialization specialization;
+  bench_kernel kernel;
+  if (!set_vulkan_specialization_constant (specialization, 0u, thread_group_size.x) ||
+    !create_bench_kernel (device,
+    COMPILED_COMPUTE_SHADER_PATH_FMA, specialization,
+    (u32)std::size (binding_types), binding_types, sizeof (compute_push_constants_fma),
+    kernel))
+  {
+    release_bench_kernel (device, kernel);
+    return false;
+  }
+
+  bool is_ok = true;
+  for (u32 log2 = config.fma_min_log2; log2 <= config.fma_max_log2 && is_ok; ++log2)
+  {
+    u32 const num_elements = 1u << log2;
+    VkDeviceSize const buffer_size = (VkDeviceSize)num_elements * sizeof (f32);
+    if (!fits_bench_limits (limits, buffer_size, buffer_size * 3u))
+    {
+      dprintf ("bench: fma %u skipped, too big for this device\n", num_elements);
+      continue;
+    }
+
+    std::array <vulkan_buffer, 3u> buffers_data;
+    vulkan_buffer buffer_info;
+    for (vulkan_buffer& buffer : buffers_data)
+    {
+      is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+        buffer_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffer);
+    }
+    is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+      sizeof (u32),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      buffer_info);
+    is_ok = is_ok && map_and_unmap_memory (device,
+      buffer_info.allocation, [num_elements](void* mapped_memory)
+      {
+        *(u32*)mapped_memory = num_elements;
+      });
+
+    vulkan_buffer const* const buffers_inputs [] = { &buffers_data [0], &buffers_data [1] };
+    u32 const patterns [] = { as_bits (1.5f), as_bits (2.5f) };
+    is_ok = is_ok && fill_bench_buffers (2u, buffers_inputs, patterns);
+
+    if (is_ok)
+    {
+      vulkan_buffer const* const buffers [] = { &buffers_data [0], &buffers_data [1], &buffers_data [2], &buffer_info };
+      bind_bench_buffers (device, kernel, (u32)std::size (buffers), buffers, binding_types);
+
+      u32 groups_x = {}, groups_y = {};
+      fold_vulkan_dispatch (((num_elements - 1u) / thread_group_size.x) + 1u, limits.max_groups_x, groups_x, groups_y);
+
+      bench_result result = { .kernel = "fma", .size = std::to_string (num_elements),
+        .elements = num_elements, .bytes = buffer_size * 3u }; // 2 reads + 1 write per element
+      is_ok = run_bench (timer, config, [&](VkCommandBuffer command_buffer)
+        {
+          vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel.pipeline);
+          vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel.pipeline_layout,
+            kernel.desc_set_0.set_index, 1u, &kernel.desc_set_0.desc_set, 0u, VK_NULL_HANDLE);
+          compute_push_constants_fma const data = { .multiplier = 5.f };
+          vkCmdPushConstants (command_buffer, kernel.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0u, sizeof (compute_push_constants_fma), &data);
+          vkCmdDispatch (command_buffer, groups_x, groups_y, 1u);
+        }, result);
+      if (is_ok)
+      {
+        out_results.push_back (result);
+      }
+    }
+
+    release_bench_buffers (device, buffers_data.size (), buffers_data.data ());
+    release_bench_buffers (device, 1u, &buffer_info);
+  }
+
+  release_bench_kernel (device, kernel);
+  return is_ok;
+}
+
+// no gpu involved, the same sweep as 'bench_fma' timed on the host
+static bool bench_fma_cpu (bench_config const& config,
+  std::vector <bench_result>& out_results)
+{
+  for (u32 log2 = config.fma_min_log2; log2 <= std::min (config.fma_max_log2, MAX_CPU_BENCH_LOG2); ++log2)
+  {
+    u32 const num_elements = 1u << log2;
+    std::vector <f32> a (num_elements, 1.5f), b (num_elements, 2.5f), out (num_elements);
+
+    std::vector <f32> cpu_ms;
+    for (u32 run = 0u; run < config.warmup + config.repeats; ++run)
+    {
+      auto const start_time = std::chrono::steady_clock::now ();
+      run_cpu_fma (a.data (), b.data (), 5.f, out.data (), num_elements);
+      auto const complete_time = std::chrono::steady_clock::now ();
+      if (run >= config.warmup)
+      {
+        cpu_ms.push_back (std::chrono::duration <f32, std::milli> (complete_time - start_time).count ());
+      }
+    }
+
+    std::sort (cpu_ms.begin (), cpu_ms.end ());
+    f32 cpu_ms_total = 0.f;
+    for (f32 const ms : cpu_ms)
+    {
+      cpu_ms_total += ms;
+    }
+    out_results.push_back (
+      {
+        .kernel = "fma_cpu", .size = std::to_string (num_elements),
+        .elements = num_elements, .bytes = (u64)num_elements * sizeof (f32) * 3u,
+        .gpu_ms_min = cpu_ms.front (), .gpu_ms_median = cpu_ms [cpu_ms.size () / 2u], .gpu_ms_mean = cpu_ms_total / (f32)cpu_ms.size (),
+        .wall_ms_median = cpu_ms [cpu_ms.size () / 2u]
+      });
+  }
+  return true;
+}
+
+static bool bench_texture (VkPhysicalDevice physical_device, VkDevice device,
+  bench_config const& config, bench_limits const& limits, vulkan_gpu_timer const& timer,
+  std::vector <bench_result>& out_results)
+{
+  VkFormat const image_format = VK_FORMAT_R8G8B8A8_UNORM;
+  VkFormatProperties format_properties = {};
+  vkGetPhysicalDeviceFormatProperties (physical_device, image_format, &format_properties);
+  if ((format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) == 0u)
+  {
+    dprintf ("bench: texture skipped, device does not support VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT\n");
+    return true;
+  }
+
+  vulkan_workgroup_size thread_group_size = { .x = THREAD_GROUP_DIM_GREYSCALE, .y = THREAD_GROUP_DIM_GREYSCALE };
+  find_vulkan_workgroup_size (AUTOTUNE_KERNEL_NAME_GREYSCALE, thread_group_size); // keeps the default if this device hasn't been tuned
+
+  VkDescriptorType const binding_types [] =
+  {
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // input
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE  // output
+  };
+  vulkan_specialization specialization;
+  bench_kernel kernel;
+  if (!set_vulkan_specialization_constant (specialization, 0u, thread_group_size.x) ||
+    !set_vulkan_specialization_constant (specialization, 1u, thread_group_size.y) ||
+    !create_bench_kernel (device,
+    COMPILED_COMPUTE_SHADER_PATH_GREYSCALE, specialization,
+    (u32)std::size (binding_types), binding_types, 0u,
+    kernel))
+  {
+    release_bench_kernel (device, kernel);
+    return false;
+  }
+
+  bool is_ok = true;
+  for (u32 log2 = config.image_min_log2; log2 <= config.image_max_log2 && is_ok; ++log2)
+  {
+    u32 const dim = 1u << log2;
+    u64 const num_pixels = (u64)dim * dim;
+    if (dim > limits.max_image_dim || !fits_bench_limits (limits, 0u, num_pixels * 4u * 2u))
+    {
+      dprintf ("bench: texture %ux%u skipped, too big for this device\n", dim, dim);
+      continue;
+    }
+
+    // contents are left undefined, the filter costs the same whatever the pixels are
+    std::array <vulkan_texture, 2u> textures;
+    for (vulkan_texture& texture : textures)
+    {
+      is_ok = is_ok && create_vulkan_texture_empty (physical_device, device,
+        { dim, dim },
+        image_format, VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_USAGE_STORAGE_BIT,
+        texture);
+    }
+
+    if (is_ok)
+    {
+      std::array <VkDescriptorImageInfo, 2u> image_infos = {};
+      std::array <VkWriteDescriptorSet, 2u> write_descriptors = {};
+      for (u32 i = 0u; i < 2u; ++i)
+      {
+        image_infos [i] =
+        {
+          .sampler = VK_NULL_HANDLE,
+          .imageView = textures [i].view,
+          .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+        write_descriptors [i] =
+        {
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          //.pNext = VK_NULL_HANDLE,
+          .dstSet = kernel.desc_set_0.desc_set,
+          .dstBinding = i,
+          .dstArrayElement = 0u,
+          .descriptorCount = 1u,
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+          .pImageInfo = &image_infos [i],
+          .pBufferInfo = VK_NULL_HANDLE,
+          .pTexelBufferView = VK_NULL_HANDLE
+        };
+      }
+      vkUpdateDescriptorSets (device, 2u, write_descriptors.data (), 0u, VK_NULL_HANDLE);
+
+      bench_result result = { .kernel = "texture", .size = std::to_string (dim) + "x" + std::to_string (dim),
+        .elements = num_pixels, .bytes = num_pixels * 4u * 2u }; // rgba8 read + write per pixel
+      is_ok = run_bench (timer, config, [&](VkCommandBuffer command_buffer)
+        {
+          vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel.pipeline);
+          vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel.pipeline_layout,
+            kernel.desc_set_0.set_index, 1u, &kernel.desc_set_0.desc_set, 0u, VK_NULL_HANDLE);
+          vkCmdDispatch (command_buffer,
+            ((dim - 1u) / thread_group_size.x) + 1u,
+            ((dim - 1u) / thread_group_size.y) + 1u,
+            1u);
+        }, result);
+      if (is_ok)
+      {
+        out_results.push_back (result);
+      }
+    }
+
+    for (vulkan_texture& texture : textures)
+    {
+      if (CHECK_VULKAN_HANDLE (texture.view)) release_vulkan_texture (device, texture); // may have failed part way
+    }
+  }
+
+  release_bench_kernel (device, kernel);
+  return is_ok;
+}
+
+static bool bench_particle (VkPhysicalDevice physical_device, VkDevice device,
+  bench_config const& config, bench_limits const& limits, vulkan_gpu_timer const& timer,
+  std::vector <bench_result>& out_results)
+{
+  vulkan_workgroup_size thread_group_size = { .x = THREAD_GROUP_SIZE_PARTICLE };
+  find_vulkan_workgroup_size (AUTOTUNE_KERNEL_NAME_PARTICLE, thread_group_size); // keeps the default if this device hasn't been tuned
+
+  VkDescriptorType const binding_types_integrate [] =
+  {
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // pos x
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // pos y
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // vel x
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // vel y
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // info
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER  // step
+  };
+  VkDescriptorType const binding_types_grid [] =
+  {
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // pos x
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // pos y
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // vel x
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // vel y
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // info
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // cell count
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // cell start
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // particle cell
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // sorted particles
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER  // block sum
+  };
+  vulkan_specialization specialization;
+  bench_kernel kernel_integrate;
+  if (!set_vulkan_specialization_constant (specialization, 0u, thread_group_size.x) ||
+    !create_bench_kernel (device,
+    COMPILED_COMPUTE_SHADER_PATH_INTEGRATE, specialization,
+    (u32)std::size (binding_types_integrate), binding_types_integrate, 0u,
+    kernel_integrate))
+  {
+    release_bench_kernel (device, kernel_integrate);
+    return false;
+  }
+
+  bool is_ok = true;
+  for (u32 log2 = config.particle_min_log2; log2 <= config.particle_max_log2 && is_ok; ++log2)
+  {
+    // the same bounds and grid 'derive_particle_config' works out in the sample
+    u32 const num_particles = 1u << log2;
+    f32 const bounds_scale = std::max (std::sqrt ((f32)num_particles / (f32)BASE_NUM_PARTICLES), 1.f);
+    f32 const bounds_width = BASE_BOUNDS_WIDTH * bounds_scale, bounds_height = BASE_BOUNDS_HEIGHT * bounds_scale;
+    f32 const cell_dim = PARTICLE_RADIUS * 2.f;
+    u32 const num_cells_x = (u32)std::ceil (bounds_width / cell_dim), num_cells_y = (u32)std::ceil (bounds_height / cell_dim);
+    u32 const num_cells = num_cells_x * num_cells_y;
+    u32 const num_cell_blocks = ((num_cells - 1u) / THREAD_GROUP_SIZE_GRID_SCAN) + 1u;
+    u32 const num_particle_groups = ((num_particles - 1u) / thread_group_size.x) + 1u;
+
+    VkDeviceSize const buffer_size = (VkDeviceSize)num_particles * sizeof (f32);
+    VkDeviceSize const grid_size = (VkDeviceSize)num_cells * sizeof (u32) * 2u + (VkDeviceSize)num_cell_blocks * sizeof (u32) +
+      buffer_size * 6u; // cell counts & starts, block sums, a (cell, rank) and a sorted pos + vel per particle
+    if (!fits_bench_limits (limits, buffer_size * 4u, buffer_size * 4u + grid_size))
+    {
+      dprintf ("bench: particle %u skipped, too big for this device\n", num_particles);
+      continue;
+    }
+
+    // grid dimensions and radius are baked in to the grid shaders, so they are built for each size
+    vulkan_specialization specialization_particles, specialization_cells;
+    for (vulkan_specialization* grid_specialization : { &specialization_particles, &specialization_cells })
+    {
+      is_ok = is_ok &&
+        set_vulkan_specialization_constant (*grid_specialization, 1u, num_cells_x) &&
+        set_vulkan_specialization_constant (*grid_specialization, 2u, num_cells_y) &&
+        set_vulkan_specialization_constant (*grid_specialization, 3u, cell_dim) &&
+        set_vulkan_specialization_constant (*grid_specialization, 4u, PARTICLE_RADIUS);
+    }
+    is_ok = is_ok &&
+      set_vulkan_specialization_constant (specialization_particles, 0u, thread_group_size.x) &&
+      set_vulkan_specialization_constant (specialization_cells, 0u, THREAD_GROUP_SIZE_GRID_SCAN);
+
+    // the count pipeline comes with the layout and set, the rest share them
+    bench_kernel kernel_grid;
+    std::array <VkPipeline, 5u> pipelines_grid = {}; // scan, scan blocks, scan add, scatter, collide
+    is_ok = is_ok && create_bench_kernel (device,
+      COMPILED_COMPUTE_SHADER_PATH_GRID_COUNT, specialization_particles,
+      (u32)std::size (binding_types_grid), binding_types_grid, 0u,
+      kernel_grid);
+    is_ok = is_ok &&
+      create_bench_pipeline (device, COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN, specialization_cells, kernel_grid.pipeline_layout, pipelines_grid [0]) &&
+      create_bench_pipeline (device, COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_BLOCKS, specialization_cells, kernel_grid.pipeline_layout, pipelines_grid [1]) &&
+      create_bench_pipeline (device, COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_ADD, specialization_cells, kernel_grid.pipeline_layout, pipelines_grid [2]) &&
+      create_bench_pipeline (device, COMPILED_COMPUTE_SHADER_PATH_GRID_SCATTER, specialization_particles, kernel_grid.pipeline_layout, pipelines_grid [3]) &&
+      create_bench_pipeline (device, COMPILED_COMPUTE_SHADER_PATH_COLLISION, specialization_particles, kernel_grid.pipeline_layout, pipelines_grid [4]);
+
+    std::array <vulkan_buffer, 4u> buffers_data; // pos x, pos y, vel x, vel y
+    std::array <vulkan_buffer, 5u> buffers_grid; // cell count, cell start, block sum, particle cell, sorted particles
+    vulkan_buffer buffer_info, buffer_step;
+    for (vulkan_buffer& buffer : buffers_data)
+    {
+      is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+        buffer_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffer);
+    }
+    VkDeviceSize const grid_sizes [] =
+    {
+      (VkDeviceSize)num_cells * sizeof (u32), (VkDeviceSize)num_cells * sizeof (u32), (VkDeviceSize)num_cell_blocks * sizeof (u32),
+      buffer_size * 2u, buffer_size * 4u
+    };
+    for (size_t i = 0u; i < buffers_grid.size (); ++i)
+    {
+      is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+        grid_sizes [i],
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // the cell counts are cleared every run
+        VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffers_grid [i]);
+    }
+    is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+      sizeof (compute_UBO_info_buffer_particle),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      buffer_info);
+    is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+      sizeof (compute_UBO_step_buffer_particle),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      buffer_step);
+    is_ok = is_ok && map_and_unmap_memory (device,
+      buffer_info.allocation, [&](void* mapped_memory)
+      {
+        compute_UBO_info_buffer_particle const info =
+        {
+          .num_particles = num_particles,
+          .bounds = { 0.f, 0.f, bounds_width, bounds_height },
+          .num_cells = { num_cells_x, num_cells_y },
+          .cell_dim = cell_dim,
+          .particle_radius = PARTICLE_RADIUS
+        };
+        *(compute_UBO_info_buffer_particle*)mapped_memory = info;
+      });
+    is_ok = is_ok && map_and_unmap_memory (device,
+      buffer_step.allocation, [](void* mapped_memory)
+      {
+        ((compute_UBO_step_buffer_particle*)mapped_memory)->deltatime = 0.5f;
+      });
+
+    // spread over the bounds like the sample, a fixed seed so runs compare
+    auto const upload_state = [&](vulkan_buffer const& buffer, f32 min, f32 max)
+    {
+      return upload_vulkan_buffer (buffer.buffer, 0u, buffer_size, [&](void* mapped_memory)
+        {
+          std::mt19937 re (log2);
+          std::uniform_real_distribution <f32> dist (min, max);
+          for (f32& value : std::span <f32> ((f32*)mapped_memory, num_particles)) value = dist (re);
+        });
+    };
+    is_ok = is_ok && begin_vulkan_upload_batch (physical_device, device) &&
+      upload_state (buffers_data [0], 0.f, bounds_width) &&
+      upload_state (buffers_data [1], 0.f, bounds_height) &&
+      upload_state (buffers_data [2], -MAX_PARTICLE_SPEED, MAX_PARTICLE_SPEED) &&
+      upload_state (buffers_data [3], -MAX_PARTICLE_SPEED, MAX_PARTICLE_SPEED) &&
+      submit_vulkan_upload_batch (true);
+
+    if (is_ok)
+    {
+      vulkan_buffer const* const buffers_integrate [] =
+      {
+        &buffers_data [0], &buffers_data [1], &buffers_data [2], &buffers_data [3], &buffer_info, &buffer_step
+      };
+      bind_bench_buffers (device, kernel_integrate, (u32)std::size (buffers_integrate), buffers_integrate, binding_types_integrate);
+      vulkan_buffer const* const buffers_grid_set [] =
+      {
+        &buffers_data [0], &buffers_data [1], &buffers_data [2], &buffers_data [3], &buffer_info,
+        &buffers_grid [0], &buffers_grid [1], &buffers_grid [3], &buffers_grid [4], &buffers_grid [2]
+      };
+      bind_bench_buffers (device, kernel_grid, (u32)std::size (buffers_grid_set), buffers_grid_set, binding_types_grid);
+
+      struct grid_pass
+      {
+        VkPipeline pipeline;
+        u32 num_groups;
+      };
+      grid_pass const grid_passes [] =
+      {
+        { kernel_grid.pipeline, num_particle_groups }, // count
+        { pipelines_grid [0], num_cell_blocks },       // scan
+        { pipelines_grid [1], 1u },                    // scan blocks, one work group walks over all the block totals
+        { pipelines_grid [2], num_cell_blocks },       // scan add
+        { pipelines_grid [3], num_particle_groups },   // scatter
+        { pipelines_grid [4], num_particle_groups }    // collide
+      };
+
+      // integrate reads and writes pos + vel, count reads pos, scatter reads pos + vel and writes the sorted copy,
+      // collide reads the sorted copy and writes vel, the grid itself is a few u32 per cell and per particle
+      bench_result result = { .kernel = "particle", .size = std::to_string (num_particles),
+        .elements = num_particles, .bytes = buffer_size * (8u + 2u + 8u + 6u) + grid_size };
+      is_ok = run_bench (timer, config, [&](VkCommandBuffer command_buffer)
+        {
+          // the last run's collide is done with the cell counts before they are cleared, the count waits for the clear
+          VkMemoryBarrier barrier =
+          {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            //.pNext = VK_NULL_HANDLE,
+            .srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
+          };
+          vkCmdPipelineBarrier (command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0u, 1u, &barrier, 0u, VK_NULL_HANDLE, 0u, VK_NULL_HANDLE);
+          vkCmdFillBuffer (command_buffer, buffers_grid [0].buffer, 0u, VK_WHOLE_SIZE, 0u);
+
+          u32 groups_x = {}, groups_y = {};
+          fold_vulkan_dispatch (num_particle_groups, limits.max_groups_x, groups_x, groups_y);
+          vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel_integrate.pipeline);
+          vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel_integrate.pipeline_layout,
+            kernel_integrate.desc_set_0.set_index, 1u, &kernel_integrate.desc_set_0.desc_set, 0u, VK_NULL_HANDLE);
+          vkCmdDispatch (command_buffer, groups_x, groups_y, 1u);
+
+          // every grid pass reads what the one before it wrote (count also waits for the clear)
+          barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+          barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+          vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel_grid.pipeline_layout,
+            kernel_grid.desc_set_0.set_index, 1u, &kernel_grid.desc_set_0.desc_set, 0u, VK_NULL_HANDLE);
+          for (grid_pass const& pass : grid_passes)
+          {
+            vkCmdPipelineBarrier (command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0u, 1u, &barrier, 0u, VK_NULL_HANDLE, 0u, VK_NULL_HANDLE);
+            fold_vulkan_dispatch (pass.num_groups, limits.max_groups_x, groups_x, groups_y);
+            vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+            vkCmdDispatch (command_buffer, groups_x, groups_y, 1u);
+          }
+        }, result);
+      if (is_ok)
+      {
+        out_results.push_back (result);
+      }
+    }
+
+    release_bench_buffers (device, buffers_data.size (), buffers_data.data ());
+    release_bench_buffers (device, buffers_grid.size (), buffers_grid.data ());
+    release_bench_buffers (device, 1u, &buffer_info);
+    release_bench_buffers (device, 1u, &buffer_step);
+    for (VkPipeline& pipeline : pipelines_grid)
+    {
+      if (CHECK_VULKAN_HANDLE (pipeline)) release_vulkan_pipeline (device, pipeline);
+    }
+    release_bench_kernel (device, kernel_grid);
+  }
+
+  release_bench_kernel (device, kernel_integrate);
+  return is_ok;
+}
+
+// the same keys for the gpu and cpu sorts, a fixed seed so runs compare
+static void fill_sort_keys (std::span <u32> keys)
+{
+  std::mt19937 re (1u);
+  for (u32& key : keys) key = re ();
+}
+
+static bool bench_sort (VkPhysicalDevice physical_device, VkDevice device,
+  bench_config const& config, bench_limits const& limits, vulkan_gpu_timer const& timer, bool has_values,
+  std::vector <bench_result>& out_results)
+{
+  char const* const kernel_name = has_values ? "sort_pairs" : "sort";
+  if (!is_vulkan_sort_supported ())
+  {
+    dprintf ("bench: %s skipped, device does not support the subgroup operations it needs\n", kernel_name);
+    return true;
+  }
+  // the unsorted keys, the keys and their temporary, and for pairs the values, their temporary and the destinations
+  u32 const num_buffers = has_values ? 6u : 3u;
+
+  bool is_ok = true;
+  for (u32 log2 = config.sort_min_log2; log2 <= config.sort_max_log2 && is_ok; ++log2)
+  {
+    u32 const num_elements = 1u << log2;
+    VkDeviceSize const buffer_size = (VkDeviceSize)num_elements * sizeof (u32);
+    if (!fits_bench_limits (limits, buffer_size, buffer_size * num_buffers))
+    {
+      dprintf ("bench: %s %u skipped, too big for this device\n", kernel_name, num_elements);
+      continue;
+    }
+
+    std::array <vulkan_buffer, 3u> buffers_data; // unsorted keys, keys, values
+    for (u32 i = 0u; i < (has_values ? 3u : 2u); ++i)
+    {
+      is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+        buffer_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffers_data [i]);
+    }
+    vulkan_buffer const& buffer_unsorted = buffers_data [0];
+    vulkan_buffer const& buffer_keys = buffers_data [1];
+    vulkan_buffer const& buffer_values = buffers_data [2];
+    is_ok = is_ok && begin_vulkan_upload_batch (physical_device, device) &&
+      upload_vulkan_buffer (buffer_unsorted.buffer, 0u, buffer_size, [num_elements](void* mapped_memory)
+        {
+          fill_sort_keys (std::span <u32> ((u32*)mapped_memory, num_elements));
+        }) &&
+      submit_vulkan_upload_batch (true);
+    if (is_ok && has_values)
+    {
+      vulkan_buffer const* const buffers_values [] = { &buffer_values };
+      u32 const patterns [] = { 0u }; // permuted as they are, what they hold doesn't matter
+      is_ok = fill_bench_buffers (1u, buffers_values, patterns);
+    }
+
+    if (is_ok)
+    {
+      // per pass: the count reads the keys, the scatter reads them and writes keys (or destinations),
+      // pairs then permute the keys and the values (each a read of the destinations, a read and a write)
+      u64 const bytes_per_pass = buffer_size * (has_values ? 9u : 3u);
+      bench_result result = { .kernel = kernel_name, .size = std::to_string (num_elements),
+        .elements = num_elements, .bytes = (buffer_size * 2u) + (bytes_per_pass * 8u) }; // 8 passes of 4 bits
+      bool is_recorded = true;
+      is_ok = reserve_vulkan_primitives (0u, num_elements, has_values) &&
+        run_bench (timer, config, [&](VkCommandBuffer command_buffer)
+        {
+          // the last run's sort is done with the keys before the copy overwrites them, the sort waits for the copy
+          VkMemoryBarrier barrier =
+          {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            //.pNext = VK_NULL_HANDLE,
+            .srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
+          };
+          vkCmdPipelineBarrier (command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0u, 1u, &barrier, 0u, VK_NULL_HANDLE, 0u, VK_NULL_HANDLE);
+          VkBufferCopy const copy = { .size = buffer_size };
+          vkCmdCopyBuffer (command_buffer, buffer_unsorted.buffer, buffer_keys.buffer, 1u, &copy);
+          barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+          barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+          vkCmdPipelineBarrier (command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0u, 1u, &barrier, 0u, VK_NULL_HANDLE, 0u, VK_NULL_HANDLE);
+
+          is_recorded = has_values ?
+            gpu_sort_by_key <u32> (buffer_keys, buffer_values, num_elements, command_buffer) :
+            gpu_sort <u32> (buffer_keys, num_elements, command_buffer);
+        }, result) && is_recorded;
+      if (is_ok)
+      {
+        out_results.push_back (result);
+      }
+    }
+
+    release_bench_buffers (device, buffers_data.size (), buffers_data.data ());
+  }
+
+  // the sort's temporaries are sized for the largest run, give the memory back to the other kernels
+  release_vulkan_primitives_buffers ();
+  return is_ok;
+}
+
+// no gpu involved, std::sort of the same keys timed on the host
+static bool bench_sort_cpu (bench_config const& config,
+  std::vector <bench_result>& out_results)
+{
+  for (u32 log2 = config.sort_min_log2; log2 <= std::min (config.sort_max_log2, MAX_CPU_BENCH_LOG2); ++log2)
+  {
+    u32 const num_elements = 1u << log2;
+    std::vector <u32> unsorted (num_elements), keys (num_elements);
+    fill_sort_keys (unsorted);
+
+    std::vector <f32> cpu_ms;
+    for (u32 run = 0u; run < config.warmup + config.repeats; ++run)
+    {
+      keys = unsorted;
+      auto const start_time = std::chrono::steady_clock::now ();
+      std::sort (keys.begin (), keys.end ());
+      auto const complete_time = std::chrono::steady_clock::now ();
+      if (run >= config.warmup)
+      {
+        cpu_ms.push_back (std::chrono::duration <f32, std::milli> (complete_time - start_time).count ());
+      }
+    }
+
+    std::sort (cpu_ms.begin (), cpu_ms.end ());
+    f32 cpu_ms_total = 0.f;
+    for (f32 const ms : cpu_ms)
+    {
+      cpu_ms_total += ms;
+    }
+    out_results.push_back (
+      {
+        .kernel = "sort_cpu", .size = std::to_string (num_elements),
+        .elements = num_elements, .bytes = (u64)num_elements * sizeof (u32) * 2u, // a comparison sort has no fixed traffic, one read + one write
+        .gpu_ms_min = cpu_ms.front (), .gpu_ms_median = cpu_ms [cpu_ms.size () / 2u], .gpu_ms_mean = cpu_ms_total / (f32)cpu_ms.size (),
+        .wall_ms_median = cpu_ms [cpu_ms.size () / 2u]
+      });
+  }
+  return true;
+}
+
+static bool bench_gemm (VkPhysicalDevice physical_device, VkDevice device,
+  bench_config const& config, bench_limits const& limits, vulkan_gpu_timer const& timer,
+  std::vector <bench_result>& out_results)
+{
+  bool is_ok = true;
+  for (u32 log2 = config.gemm_min_log2; log2 <= config.gemm_max_log2 && is_ok; ++log2)
+  {
+    u32 const dim = 1u << log2;
+    VkDeviceSize const buffer_size = (VkDeviceSize)dim * dim * sizeof (f32);
+    if (!fits_bench_limits (limits, buffer_size, buffer_size * 3u))
+    {
+      dprintf ("bench: gemm %u skipped, too big for this device\n", dim);
+      continue;
+    }
+
+    std::array <vulkan_buffer, 3u> buffers_data; // a, b, c
+    for (vulkan_buffer& buffer : buffers_data)
+    {
+      is_ok = is_ok && create_vulkan_buffer (physical_device, device,
+        buffer_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffer);
+    }
+    // the time doesn't depend on the values
+    vulkan_buffer const* const buffers_inputs [] = { &buffers_data [0], &buffers_data [1] };
+    u32 const patterns [] = { as_bits (1.f), as_bits (0.5f) };
+    is_ok = is_ok && fill_bench_buffers (2u, buffers_inputs, patterns);
+
+    if (is_ok)
+    {
+      bench_result result = { .kernel = "gemm", .size = std::to_string (dim) + "^3",
+        .elements = (u64)dim * dim, .bytes = buffer_size * 3u, // each matrix once, the least a tiled gemm can move
+        .flops = 2u * (u64)dim * dim * dim };
+      bool is_recorded = true;
+      is_ok = run_bench (timer, config, [&](VkCommandBuffer command_buffer)
+        {
+          is_recorded = gemm_vulkan_buffer (buffers_data [0], buffers_data [1], buffers_data [2],
+            dim, dim, dim, config.gemm_tiles, command_buffer);
+        }, result) && is_recorded;
+      if (is_ok)
+      {
+        out_results.push_back (result);
+      }
+    }
+
+    release_bench_buffers (device, buffers_data.size (), buffers_data.data ());
+  }
+  return is_ok;
+}
+
+// no gpu involved, the same sweep as 'bench_gemm' timed on the host
+static bool bench_gemm_cpu (bench_config const& config,
+  std::vector <bench_result>& out_results)
+{
+  for (u32 log2 = config.gemm_min_log2; log2 <= std::min (config.gemm_max_log2, MAX_CPU_GEMM_LOG2); ++log2)
+  {
+    u32 const dim = 1u << log2;
+    u64 const num_elements = (u64)dim * dim;
+    std::vector <f32> a (num_elements, 1.f), b (num_elements, 0.5f), c (num_elements);
+
+    std::vector <f32> cpu_ms;
+    for (u32 run = 0u; run < config.warmup + config.repeats; ++run)
+    {
+      auto const start_time = std::chrono::steady_clock::now ();
+      run_cpu_gemm (a.data (), b.data (), c.data (), dim, dim, dim);
+      auto const complete_time = std::chrono::steady_clock::now ();
+      if (run >= config.warmup)
+      {
+        cpu_ms.push_back (std::chrono::duration <f32, std::milli> (complete_time - start_time).count ());
+      }
+    }
+
+    std::sort (cpu_ms.begin (), cpu_ms.end ());
+    f32 cpu_ms_total = 0.f;
+    for (f32 const ms : cpu_ms)
+    {
+      cpu_ms_total += ms;
+    }
+    out_results.push_back (
+      {
+        .kernel = "gemm_cpu", .size = std::to_string (dim) + "^3",
+        .elements = num_elements, .bytes = num_elements * sizeof (f32) * 3u, .flops = 2u * num_elements * dim,
+        .gpu_ms_min = cpu_ms.front (), .gpu_ms_median = cpu_ms [cpu_ms.size () / 2u], .gpu_ms_mean = cpu_ms_total / (f32)cpu_ms.size (),
+        .wall_ms_median = cpu_ms [cpu_ms.size () / 2u]
+      });
+  }
+  return true;
+}
+
+
+static bool write_bench_results (bench_config const& config, VkPhysicalDeviceProperties const& properties,
+  std::vector <bench_result> const& results)
+{
+  FILE* fp = std::fopen (config.output_path.c_str (), "w");
+  if (fp == nullptr)
+  {
+    return DBG_ASSERT_MSG (false, "bench: unable to write '%s'\n", config.output_path.c_str ());
+  }
+
+  // derived from the median gpu time, the wall time adds the submit/wait overhead on top
+  auto const gb_per_s = [](bench_result const& r) { return r.gpu_ms_median > 0.f ? (f32)r.bytes / (r.gpu_ms_median * 1e6f) : 0.f; };
+  auto const elements_per_s = [](bench_result const& r) { return r.gpu_ms_median > 0.f ? (f32)r.elements / (r.gpu_ms_median / 1e3f) : 0.f; };
+  auto const gflop_per_s = [](bench_result const& r) { return r.gpu_ms_median > 0.f ? (f32)r.flops / (r.gpu_ms_median * 1e6f) : 0.f; };
+
+  std::string const& path = config.output_path;
+  bool const is_csv = path.size () >= 4u && path.compare (path.size () - 4u, 4u, ".csv") == 0;
+  if (is_csv)
+  {
+    std::fprintf (fp, "device,driver_version,kernel,size,elements,bytes,gpu_ms_min,gpu_ms_median,gpu_ms_mean,wall_ms_median,gb_per_s,elements_per_s,gflop_per_s\n");
+    for (bench_result const& r : results)
+    {
+      std::fprintf (fp, "\"%s\",%u,%s,%s,%llu,%llu,%.6f,%.6f,%.6f,%.6f,%.3f,%.6e,%.3f\n",
+        properties.deviceName, properties.driverVersion, r.kernel, r.size.c_str (),
+        (unsigned long long)r.elements, (unsigned long long)r.bytes,
+        r.gpu_ms_min, r.gpu_ms_median, r.gpu_ms_mean, r.wall_ms_median, gb_per_s (r), elements_per_s (r), gflop_per_s (r));
+    }
+  }
+  else
+  {
+    std::fprintf (fp, "{\n  \"device\": \"%s\",\n  \"driver_version\": %u,\n  \"api_version\": \"%u.%u.%u\",\n",
+      properties.deviceName, properties.driverVersion,
+      VK_API_VERSION_MAJOR (properties.apiVersion), VK_API_VERSION_MINOR (properties.apiVersion), VK_API_VERSION_PATCH (properties.apiVersion));
+    std::fprintf (fp, "  \"warmup\": %u,\n  \"repeats\": %u,\n  \"results\": [", config.warmup, config.repeats);
+    for (size_t i = 0u; i < results.size (); ++i)
+    {
+      bench_result const& r = results [i];
+      std::fprintf (fp, "%s\n    {\"kernel\": \"%s\", \"size\": \"%s\", \"elements\": %llu, \"bytes\": %llu, "
+        "\"gpu_ms_min\": %.6f, \"gpu_ms_median\": %.6f, \"gpu_ms_mean\": %.6f, \"wall_ms_median\": %.6f, "
+        "\"gb_per_s\": %.3f, \"elements_per_s\": %.6e, \"gflop_per_s\": %.3f}",
+        i == 0u ? "" : ",", r.kernel, r.size.c_str (),
+        (unsigned long long)r.elements, (unsigned long long)r.bytes,
+        r.gpu_ms_min, r.gpu_ms_median, r.gpu_ms_mean, r.wall_ms_median, gb_per_s (r), elements_per_s (r), gflop_per_s (r));
+    }
+    std::fprintf (fp, "\n  ]\n}\n");
+  }
+  std::fclose (fp);
+
+  dprintf ("BENCH: %s\n", properties.deviceName);
+  dprintf ("%-10s %12s %12s %12s %12s %10s %12s %10s\n", "kernel", "size", "gpu ms", "gpu ms min", "wall ms", "GB/s", "elements/s", "GFLOP/s");
+  for (bench_result const& r : results)
+  {
+    dprintf ("%-10s %12s %12.4f %12.4f %12.4f %10.2f %12.4e %10.2f\n",
+      r.kernel, r.size.c_str (), r.gpu_ms_median, r.gpu_ms_min, r.wall_ms_median, gb_per_s (r), elements_per_s (r), gflop_per_s (r));
+  }
+  dprintf ("%zu results written to '%s'\n", results.size (), config.output_path.c_str ());
+
+  return true;
+}
+
+
+int main (int argc, char** argv)
+  // compute only app, no window or surface (headless), so the build system leaves 'SubSystem' as 'SUBSYSTEM:CONSOLE'
+{
+  bench_config config;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string const token = argv [i];
+    size_t const equals = token.find ('=');
+    if (equals == std::string::npos)
+    {
+      DBG_ASSERT_MSG (false, "expected key=value, got '%s'\n", token.c_str ());
+      return -1;
+    }
+    if (!set_bench_config_value (token.substr (0u, equals), token.substr (equals + 1u), config))
+    {
+      return -1;
+    }
+  }
+
+
+  // CONTEXT
+
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+
+  VkQueue queue_compute = VK_NULL_HANDLE;
+
+  {
+    if (!create_vulkan_instance ())
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+    if (!create_vulkan_device (VK_QUEUE_COMPUTE_BIT,
+      physical_device, device))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+    if (!get_vulkan_queue_compute (queue_compute))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
+  // create the libraries on top of the device
+  // the autotuner before the element-wise library, it before the primitives & gemm
+  {
+    if (!create_vulkan_pipeline_cache (physical_device, device,
+        VULKAN_PIPELINE_CACHE_PATH, has_vulkan_pipeline_creation_feedback ()) ||
+      !create_vulkan_autotuner (physical_device, VULKAN_AUTOTUNE_PATH) ||
+      !create_vulkan_elementwise (physical_device, device) ||
+      !create_vulkan_primitives (physical_device, device) ||
+      !create_vulkan_gemm (physical_device, device))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+
+  // leave half of the biggest device local heap for everything else
+  bench_limits limits =
+  {
+    .max_binding_size = properties.limits.maxStorageBufferRange,
+    .max_image_dim = properties.limits.maxImageDimension2D,
+    .max_groups_x = properties.limits.maxComputeWorkGroupCount [0]
+  };
+  {
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    vkGetPhysicalDeviceMemoryProperties (physical_device, &memory_properties);
+    for (u32 i = 0u; i < memory_properties.memoryHeapCount; ++i)
+    {
+      if ((memory_properties.memoryHeaps [i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0u)
+      {
+        limits.max_total_size = std::max (limits.max_total_size, memory_properties.memoryHeaps [i].size / 2u);
+      }
+    }
+  }
+
+
+  // BENCHMARKS
+
+  vulkan_gpu_timer timer;
+  std::vector <bench_result> results;
+  bool is_ok = create_vulkan_gpu_timer (physical_device, device, queue_compute, timer);
+  if (is_ok && is_kernel_enabled (config, "fma"))
+  {
+    is_ok = bench_fma (physical_device, device, config, limits, timer, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "fma_cpu"))
+  {
+    is_ok = create_cpu_compute () && bench_fma_cpu (config, results);
+    release_cpu_compute ();
+  }
+  if (is_ok && is_kernel_enabled (config, "texture"))
+  {
+    is_ok = bench_texture (physical_device, device, config, limits, timer, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "particle"))
+  {
+    is_ok = bench_particle (physical_device, device, config, limits, timer, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "sort"))
+  {
+    is_ok = bench_sort (physical_device, device, config, limits, timer, false, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "sort_pairs"))
+  {
+    is_ok = bench_sort (physical_device, device, config, limits, timer, true, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "sort_cpu"))
+  {
+    is_ok = bench_sort_cpu (config, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "gemm"))
+  {
+    is_ok = bench_gemm (physical_device, device, config, limits, timer, results);
+  }
+  if (is_ok && is_kernel_enabled (config, "gemm_cpu"))
+  {
+    is_ok = create_cpu_compute () && bench_gemm_cpu (config, results);
+    release_cpu_compute ();
+  }
+  // whatever finished is still worth keeping
+  is_ok = write_bench_results (config, properties, results) && is_ok;
+
+
+  // RELEASE
+  {
+    vkDeviceWaitIdle (device);
+    release_vulkan_gpu_timer (timer);
+
+    // LIBRARIES
+    {
+      print_vulkan_pipeline_cache_stats ();
+      release_vulkan_pipeline_cache (device); // saves the cache for the next run
+      print_vulkan_autotuner ();
+      release_vulkan_autotuner (); // saves anything tuned this run
+      release_vulkan_primitives (device);
+      release_vulkan_gemm (device);
+      release_vulkan_elementwise (device);
+    }
+
+    // CONTEXT
+    {
+      release_vulkan_uploads ();
+      release_vulkan_memory (device);
+      release_vulkan_device ();
+      release_vulkan_instance ();
+      queue_compute = VK_NULL_HANDLE;
+      device = VK_NULL_HANDLE;
+      physical_device = VK_NULL_HANDLE;
+    }
+  }
+
+  return is_ok ? 0 : -1;
+}
@@ -35,19 +35,30 @@
 #include "../vulkan_context.h"
 #include "../vulkan_pipeline.h"
 #include "../vulkan_resources.h"
-
-#include <cmath>                  // for std::ceilf
+#include "../vulkan_memory.h"
+#include "../vulkan_autotune.h"
+#include "../vulkan_elementwise.h"
+#include "../vulkan_primitives.h"
+#include "../vulkan_gemm.h"
+#include "../cpu_compute.h"
+
+#include <algorithm>              // for std::min, std::max
+#include <array>                  // for std::array
+#include <chrono>                 // for std::chrono::steady_clock
+#include <cmath>                  // for std::isfinite, std::fabs
+#include <cstdlib>                // for std::atoi
+#include <cstring>                // for std::strcmp, std::memcpy
 #include <random>                 // for std::random_device, std::uniform_real_distribution
+#include <span>                   // for std::span
+#include <vector>                 // for std::vector
 
-#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
 #include <vulkan/vulkan.h>        // for everything vulkan
-#define WIN32_LEAN_AND_MEAN       // exclude rarely-used content from the Windows headers
-#define NOMINMAX                  // prevent Windows macros defining their own min and max macros
-#include <Windows.h>              // for WinMain
 
 
 constexpr char const* COMPILED_COMPUTE_SHADER_PATH = "data/shaders/glsl/vulkan_compute_buffer/vulkan_compute_buffer.comp.spv";
 constexpr u32 NUM_ELEMENTS = 1u << 16;
+constexpr u32 THREAD_GROUP_SIZE = 256u; // baked in to the shader's local_size_x (specialization constant 0), unless this device has been tuned
+constexpr char const* AUTOTUNE_KERNEL_NAME = "vulkan_compute_buffer.fma";
 constexpr u32 ELEMENT_SIZE = sizeof (f32);
 constexpr f32 MULTIPLIER = 5.f;
 
@@ -63,18 +74,524 @@ struct compute_push_constants
 };
 
 
-int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
-  _In_opt_ HINSTANCE/* hPrevInstance*/,
-  _In_ LPSTR/* lpCmdLine*/,
-  _In_ int/* nShowCmd*/)
-  // I know this is not a graphics app, but the build system sets 'SubSystem' to 'SUBSYSTEM:WINDOWS' by default, so we need this :(
+// STREAMING (out of core)
+// 'stream_a=a.bin stream_b=b.bin stream_out=out.bin' runs the kernel over files of raw f32s instead of the built in data
+// the files are memory mapped and pushed through the gpu a tile at a time, so they can be bigger than device memory
+// (and 'maxStorageBufferRange'), e.g. inputs made with 'head -c 4G /dev/urandom > a.bin'
+// 'stream_tile_log2=n' sets the tile size, 2^n elements
+//
+// NUM_STREAM_SLOTS sets of tile buffers, so the stages of consecutive tiles overlap:
+//   host:           copies tile n+1 in to its staging buffer, and tile n-2 out of its one
+//   transfer queue: uploads tile n+1 (staging -> device), downloads tile n-1 (device -> staging)
+//   compute queue:  fma on tile n
+// one timeline per stage chains them (value n+1 = tile n is through that stage), the host only waits when it
+// comes back round to a slot, for that slot's last tile to be downloaded
+constexpr u32 NUM_STREAM_SLOTS = 3u;
+constexpr u32 DEFAULT_STREAM_TILE_LOG2 = 22u; // 4M elements, 16MB per buffer, large enough to hide the per submit cost
+
+struct stream_config
+{
+  char const* path_a = nullptr;
+  char const* path_b = nullptr;
+  char const* path_out = nullptr;
+  u32 tile_log2 = DEFAULT_STREAM_TILE_LOG2;
+};
+
+struct stream_slot
 {
+  vulkan_buffer staging_in;  // tile of a, then tile of b
+  vulkan_buffer staging_out;
+  vulkan_buffer device_a, device_b, device_out;
+  vulkan_descriptor_set desc_set_0;
+
+  // recorded once, every tile that uses this slot resubmits them
+  VkCommandBuffer command_buffer_upload = VK_NULL_HANDLE;   // transfer queue
+  VkCommandBuffer command_buffer_compute = VK_NULL_HANDLE;  // compute queue
+  VkCommandBuffer command_buffer_download = VK_NULL_HANDLE; // transfer queue
+};
+
+// hands 'buffer' from one queue family to another
+// recorded twice: as the release on the 'src_family' queue, then as the acquire on the 'dst_family' queue
+static VkBufferMemoryBarrier ownership_barrier (VkBuffer buffer,
+  VkAccessFlags src_access, VkAccessFlags dst_access,
+  u32 src_family, u32 dst_family)
+{
+  return VkBufferMemoryBarrier
+  {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    //.pNext = VK_NULL_HANDLE,
+    .srcAccessMask = src_access, // ignored by the acquire
+    .dstAccessMask = dst_access, // ignored by the release
+    .srcQueueFamilyIndex = src_family,
+    .dstQueueFamilyIndex = dst_family,
+    .buffer = buffer,
+    .offset = 0u,
+    .size = VK_WHOLE_SIZE
+  };
+}
+
+static bool stream_fma (VkPhysicalDevice physical_device, VkDevice device,
+  VkQueue queue_compute, VkQueue queue_transfer,
+  VkDescriptorSetLayout descriptor_set_layout, VkPipelineLayout pipeline_layout, VkPipeline pipeline,
+  u32 thread_group_size, stream_config const& config)
+{
+  DBG_ASSERT (config.path_a != nullptr && config.path_b != nullptr && config.path_out != nullptr);
+
+
+  // a transfer only family means the tile buffers change hands between the queues
+  // asked before the files are mapped, so failing here has nothing to unmap
+  u32 family_compute = {}, family_transfer = {};
+  if (!get_vulkan_queue_family_index (queue_compute, family_compute) ||
+    !get_vulkan_queue_family_index (queue_transfer, family_transfer))
+  {
+    return false;
+  }
+  bool const needs_ownership_transfer = family_compute != family_transfer;
+
+
+  // INPUT/OUTPUT FILES
+
+  mapped_file file_a, file_b, file_out;
+  if (!map_file_read (config.path_a, file_a) ||
+    !map_file_read (config.path_b, file_b))
+  {
+    unmap_file (file_a);
+    return false;
+  }
+  if (file_a.size != file_b.size || file_a.size == 0u || file_a.size % ELEMENT_SIZE != 0u)
+  {
+    unmap_file (file_b);
+    unmap_file (file_a);
+    return DBG_ASSERT_MSG (false, "stream: inputs must be the same (non zero) number of f32s\n");
+  }
+  if (!map_file_write (config.path_out, file_a.size, file_out))
+  {
+    unmap_file (file_b);
+    unmap_file (file_a);
+    return DBG_ASSERT_MSG (false, "stream: unable to create the output file '%s'\n", config.path_out);
+  }
+  u64 const num_elements = file_a.size / ELEMENT_SIZE;
+
+  // a tile must fit in one binding
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+  u32 tile_elements = 1u << config.tile_log2;
+  while ((u64)tile_elements * ELEMENT_SIZE > properties.limits.maxStorageBufferRange)
+  {
+    tile_elements /= 2u;
+  }
+  VkDeviceSize const tile_size = (VkDeviceSize)tile_elements * ELEMENT_SIZE;
+  u64 const num_tiles = ((num_elements - 1u) / tile_elements) + 1u;
+
+  // past maxComputeWorkGroupCount [0] groups the dispatch is folded in to y, the shader flattens it back
+  u32 const num_groups = ((tile_elements - 1u) / thread_group_size) + 1u;
+  u32 groups_x = {}, groups_y = {};
+  fold_vulkan_dispatch (num_groups, properties.limits.maxComputeWorkGroupCount [0], groups_x, groups_y);
+
+  // the host reads the downloads back, so cached memory if the device has it (uncached reads are very slow)
+  VkMemoryPropertyFlags readback_memory_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  {
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    vkGetPhysicalDeviceMemoryProperties (physical_device, &memory_properties);
+    for (u32 i = 0u; i < memory_properties.memoryTypeCount; ++i)
+    {
+      VkMemoryPropertyFlags const cached_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+      if ((memory_properties.memoryTypes [i].propertyFlags & cached_flags) == cached_flags)
+      {
+        readback_memory_flags = cached_flags;
+      }
+    }
+  }
+
+  dprintf ("stream: %llu elements in %llu tiles of %u, %s\n", (unsigned long long)num_elements, (unsigned long long)num_tiles,
+    tile_elements, needs_ownership_transfer ? "dedicated transfer queue" : "transfer on a compute family queue");
+
+
+  // RESOURCES
+
+  std::array <stream_slot, NUM_STREAM_SLOTS> slots;
+  vulkan_buffer buffer_info;
+  VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+  VkCommandPool command_pool_compute = VK_NULL_HANDLE, command_pool_transfer = VK_NULL_HANDLE;
+  std::array <vulkan_timeline, 3u> timelines; // upload, compute, download
+  vulkan_timeline& timeline_upload = timelines [0];
+  vulkan_timeline& timeline_compute = timelines [1];
+  vulkan_timeline& timeline_download = timelines [2];
+
+  auto const release_resources = [&]()
+  {
+    vkDeviceWaitIdle (device);
+    for (stream_slot& slot : slots)
+    {
+      if (CHECK_VULKAN_HANDLE (slot.command_buffer_download)) release_vulkan_command_buffers (1u, command_pool_transfer, &slot.command_buffer_download);
+      if (CHECK_VULKAN_HANDLE (slot.command_buffer_compute)) release_vulkan_command_buffers (1u, command_pool_compute, &slot.command_buffer_compute);
+      if (CHECK_VULKAN_HANDLE (slot.command_buffer_upload)) release_vulkan_command_buffers (1u, command_pool_transfer, &slot.command_buffer_upload);
+      if (CHECK_VULKAN_HANDLE (slot.desc_set_0.desc_set)) release_vulkan_descriptor_sets (device, 1u, &slot.desc_set_0);
+      for (vulkan_buffer* buffer : { &slot.staging_in, &slot.staging_out, &slot.device_a, &slot.device_b, &slot.device_out })
+      {
+        if (CHECK_VULKAN_HANDLE (buffer->buffer)) release_vulkan_buffer (device, *buffer);
+      }
+    }
+    if (CHECK_VULKAN_HANDLE (buffer_info.buffer)) release_vulkan_buffer (device, buffer_info);
+    if (CHECK_VULKAN_HANDLE (descriptor_pool)) release_vulkan_descriptor_pool (device, descriptor_pool);
+    if (CHECK_VULKAN_HANDLE (command_pool_transfer)) release_vulkan_command_pool (command_pool_transfer);
+    if (CHECK_VULKAN_HANDLE (command_pool_compute)) release_vulkan_command_pool (command_pool_compute);
+    for (vulkan_timeline& timeline : timelines)
+    {
+      if (CHECK_VULKAN_HANDLE (timeline.semaphore)) release_vulkan_timelines (1u, &timeline);
+    }
+    unmap_file (file_out);
+    unmap_file (file_b);
+    unmap_file (file_a);
+  };
+
+  bool is_created = create_vulkan_command_pool_for_queue (queue_compute, command_pool_compute) &&
+    create_vulkan_command_pool_for_queue (queue_transfer, command_pool_transfer) &&
+    create_vulkan_timelines ((u32)timelines.size (), 0u, timelines.data ());
+
+  // every tile is dispatched whole (the end of the last one is zero padded), so one info buffer does for all
+  is_created = is_created && create_vulkan_buffer (physical_device, device,
+    sizeof (compute_UBO_info_buffer),
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+    VK_SHARING_MODE_EXCLUSIVE,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    buffer_info);
+  is_created = is_created && map_and_unmap_memory (device,
+    buffer_info.allocation, [tile_elements](void* mapped_memory)
+    {
+      ((compute_UBO_info_buffer*)mapped_memory)->num_elements = tile_elements;
+    });
+
+  std::array <VkDescriptorPoolSize, 2u> const pool_sizes =
+  {{
+    {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 3u * NUM_STREAM_SLOTS
+    },
+    {
+      .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+      .descriptorCount = NUM_STREAM_SLOTS
+    }
+  }};
+  is_created = is_created && create_vulkan_descriptor_pool (device,
+    NUM_STREAM_SLOTS,
+    (u32)pool_sizes.size (), pool_sizes.data (),
+    descriptor_pool);
+
+  for (stream_slot& slot : slots)
+  {
+    is_created = is_created &&
+      create_vulkan_buffer (physical_device, device,
+        tile_size * 2u, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        slot.staging_in) &&
+      create_vulkan_buffer (physical_device, device,
+        tile_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        readback_memory_flags,
+        slot.staging_out) &&
+      create_vulkan_buffer (physical_device, device,
+        tile_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        slot.device_a) &&
+      create_vulkan_buffer (physical_device, device,
+        tile_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        slot.device_b) &&
+      create_vulkan_buffer (physical_device, device,
+        tile_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        slot.device_out) &&
+      create_vulkan_command_buffers (1u, command_pool_transfer, &slot.command_buffer_upload) &&
+      create_vulkan_command_buffers (1u, command_pool_compute, &slot.command_buffer_compute) &&
+      create_vulkan_command_buffers (1u, command_pool_transfer, &slot.command_buffer_download);
+
+    vulkan_descriptor_set_info const descriptor_set_info =
+    {
+      .desc_pool = &descriptor_pool,
+      .layout = &descriptor_set_layout,
+      .set_index = 0u,
+      .out_set = &slot.desc_set_0
+    };
+    is_created = is_created && create_vulkan_descriptor_sets (device,
+      1u, &descriptor_set_info);
+  }
+  if (!is_created)
+  {
+    release_resources ();
+    return DBG_ASSERT_MSG (false, "stream: failed to create the tile resources\n");
+  }
+
+  // bind each slot's tile buffers, same layout as 'desc_set_0_compute'
+  for (stream_slot& slot : slots)
+  {
+    VkDescriptorBufferInfo const buffer_infos [] =
+    {
+      { .buffer = slot.device_a.buffer, .offset = 0u, .range = VK_WHOLE_SIZE },
+      { .buffer = slot.device_b.buffer, .offset = 0u, .range = VK_WHOLE_SIZE },
+      { .buffer = slot.device_out.buffer, .offset = 0u, .range = VK_WHOLE_SIZE },
+      { .buffer = buffer_info.buffer, .offset = 0u, .range = VK_WHOLE_SIZE }
+    };
+    std::array <VkWriteDescriptorSet, std::size (buffer_infos)> write_descriptors = {};
+    for (u32 binding = 0u; binding < (u32)write_descriptors.size (); ++binding)
+    {
+      write_descriptors [binding] =
+      {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        //.pNext = VK_NULL_HANDLE,
+        .dstSet = slot.desc_set_0.desc_set,
+        .dstBinding = binding, // input a, input b, output, info
+        .dstArrayElement = 0u,
+        .descriptorCount = 1u,
+        .descriptorType = binding == 3u ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = VK_NULL_HANDLE,
+        .pBufferInfo = &buffer_infos [binding],
+        .pTexelBufferView = VK_NULL_HANDLE
+      };
+    }
+    vkUpdateDescriptorSets (device, (u32)write_descriptors.size (), write_descriptors.data (), 0u, VK_NULL_HANDLE);
+  }
+
+
+  // RECORD COMMAND BUFFERS
+
+  for (stream_slot& slot : slots)
+  {
+    // UPLOAD: staging -> device, then hand the inputs to compute
+    // nothing is handed back, the next upload overwrites them anyway
+    is_created = is_created && begin_command_buffer (slot.command_buffer_upload, 0u);
+    if (is_created)
+    {
+      VkBufferCopy const copy_a = { .srcOffset = 0u, .dstOffset = 0u, .size = tile_size };
+      VkBufferCopy const copy_b = { .srcOffset = tile_size, .dstOffset = 0u, .size = tile_size };
+      vkCmdCopyBuffer (slot.command_buffer_upload, slot.staging_in.buffer, slot.device_a.buffer, 1u, &copy_a);
+      vkCmdCopyBuffer (slot.command_buffer_upload, slot.staging_in.buffer, slot.device_b.buffer, 1u, &copy_b);
+      if (needs_ownership_transfer)
+      {
+        VkBufferMemoryBarrier const release_barriers [] =
+        {
+          ownership_barrier (slot.device_a.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, 0u, family_transfer, family_compute),
+          ownership_barrier (slot.device_b.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, 0u, family_transfer, family_compute)
+        };
+        vkCmdPipelineBarrier (slot.command_buffer_upload, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+          0u, 0u, VK_NULL_HANDLE, 2u, release_barriers, 0u, VK_NULL_HANDLE);
+      }
+      is_created = end_command_buffer (slot.command_buffer_upload);
+    }
+
+    // COMPUTE: fma on the whole tile, then hand the output to transfer
+    is_created = is_created && begin_command_buffer (slot.command_buffer_compute, 0u);
+    if (is_created)
+    {
+      if (needs_ownership_transfer)
+      {
+        VkBufferMemoryBarrier const acquire_barriers [] =
+        {
+          ownership_barrier (slot.device_a.buffer, 0u, VK_ACCESS_SHADER_READ_BIT, family_transfer, family_compute),
+          ownership_barrier (slot.device_b.buffer, 0u, VK_ACCESS_SHADER_READ_BIT, family_transfer, family_compute)
+        };
+        vkCmdPipelineBarrier (slot.command_buffer_compute, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          0u, 0u, VK_NULL_HANDLE, 2u, acquire_barriers, 0u, VK_NULL_HANDLE);
+      }
+
+      vkCmdBindPipeline (slot.command_buffer_compute, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+      vkCmdBindDescriptorSets (slot.command_buffer_compute, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout,
+        slot.desc_set_0.set_index, 1u, &slot.desc_set_0.desc_set, 0u, VK_NULL_HANDLE);
+      compute_push_constants const data =
+      {
+        .multiplier = MULTIPLIER
+      };
+      vkCmdPushConstants (slot.command_buffer_compute, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0u, sizeof (compute_push_constants), &data);
+      vkCmdDispatch (slot.command_buffer_compute, groups_x, groups_y, 1u);
+
+      if (needs_ownership_transfer)
+      {
+        VkBufferMemoryBarrier const release_barrier =
+          ownership_barrier (slot.device_out.buffer, VK_ACCESS_SHADER_WRITE_BIT, 0u, family_compute, family_transfer);
+        vkCmdPipelineBarrier (slot.command_buffer_compute, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+          0u, 0u, VK_NULL_HANDLE, 1u, &release_barrier, 0u, VK_NULL_HANDLE);
+      }
+      is_created = end_command_buffer (slot.command_buffer_compute);
+    }
+
+    // DOWNLOAD: device -> staging, then make it visible to the host
+    is_created = is_created && begin_command_buffer (slot.command_buffer_download, 0u);
+    if (is_created)
+    {
+      if (needs_ownership_transfer)
+      {
+        VkBufferMemoryBarrier const acquire_barrier =
+          ownership_barrier (slot.device_out.buffer, 0u, VK_ACCESS_TRANSFER_READ_BIT, family_compute, family_transfer);
+        vkCmdPipelineBarrier (slot.command_buffer_download, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          0u, 0u, VK_NULL_HANDLE, 1u, &acquire_barrier, 0u, VK_NULL_HANDLE);
+      }
+
+      VkBufferCopy const copy_out = { .srcOffset = 0u, .dstOffset = 0u, .size = tile_size };
+      vkCmdCopyBuffer (slot.command_buffer_download, slot.device_out.buffer, slot.staging_out.buffer, 1u, &copy_out);
+
+      VkBufferMemoryBarrier const host_barrier =
+        ownership_barrier (slot.staging_out.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED); // not a transfer, just a barrier
+      vkCmdPipelineBarrier (slot.command_buffer_download, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0u, 0u, VK_NULL_HANDLE, 1u, &host_barrier, 0u, VK_NULL_HANDLE);
+      is_created = end_command_buffer (slot.command_buffer_download);
+    }
+  }
+  if (!is_created)
+  {
+    release_resources ();
+    return DBG_ASSERT_MSG (false, "stream: failed to record the tile command buffers\n");
+  }
+
+
+  // STREAM
+
+  u64 num_checked = {}, num_mismatches = {};
+  auto const tile_count = [&](u64 tile) { return (u32)std::min <u64> (tile_elements, num_elements - tile * tile_elements); };
+
+  // host side of the upload, the inputs in to the slot's staging buffer
+  auto const write_tile = [&](u64 tile) -> bool
+  {
+    stream_slot const& slot = slots [tile % NUM_STREAM_SLOTS];
+    u32 const count = tile_count (tile);
+    u8* const staging = (u8*)slot.staging_in.allocation.mapped;
+    u64 const file_offset = tile * tile_size;
+
+    std::memcpy (staging, file_a.data + file_offset, count * ELEMENT_SIZE);
+    std::memcpy (staging + tile_size, file_b.data + file_offset, count * ELEMENT_SIZE);
+    if (count < tile_elements) // last tile, pad it out
+    {
+      std::memset (staging + count * ELEMENT_SIZE, 0, (tile_elements - count) * ELEMENT_SIZE);
+      std::memset (staging + tile_size + count * ELEMENT_SIZE, 0, (tile_elements - count) * ELEMENT_SIZE);
+    }
+    return flush_vulkan_memory (device, slot.staging_in.allocation);
+  };
+  // host side of the download, once the tile is through every stage, the output out of the slot's staging buffer
+  auto const read_tile = [&](u64 tile) -> bool
+  {
+    if (!wait_vulkan_timeline (timeline_download, tile + 1u))
+    {
+      return false;
+    }
+
+    stream_slot const& slot = slots [tile % NUM_STREAM_SLOTS];
+    u32 const count = tile_count (tile);
+    if (!invalidate_vulkan_memory (device, slot.staging_out.allocation))
+    {
+      return false;
+    }
+    std::memcpy (file_out.data + tile * tile_size, slot.staging_out.allocation.mapped, count * ELEMENT_SIZE);
+
+    // spot check the first and last element of each tile against the cpu
+    for (u64 i : { tile * tile_elements, tile * tile_elements + count - 1u })
+    {
+      f32 a, b, out;
+      std::memcpy (&a, file_a.data + i * ELEMENT_SIZE, ELEMENT_SIZE);
+      std::memcpy (&b, file_b.data + i * ELEMENT_SIZE, ELEMENT_SIZE);
+      std::memcpy (&out, file_out.data + i * ELEMENT_SIZE, ELEMENT_SIZE);
+      f32 const expected = (a * MULTIPLIER) + b;
+      if (std::isfinite (expected)) // random bits make some nans/infs
+      {
+        ++num_checked;
+        num_mismatches += std::fabs (out - expected) <= std::fabs (expected) * 1e-5f + 1e-6f ? 0u : 1u;
+      }
+    }
+    return true;
+  };
+
+  auto const submit = [](VkQueue queue, VkCommandBuffer command_buffer,
+    vulkan_timeline const* wait_timeline, VkPipelineStageFlags wait_stage, vulkan_timeline const& signal_timeline, u64 value)
+  {
+    vulkan_semaphore_wait const wait = { wait_timeline ? wait_timeline->semaphore : VK_NULL_HANDLE, value, wait_stage };
+    vulkan_semaphore_signal const signal = { signal_timeline.semaphore, value };
+    return submit_vulkan_command_buffers (queue,
+      1u, &command_buffer,
+      wait_timeline ? 1u : 0u, &wait,
+      1u, &signal);
+  };
+
+  auto const start_time = std::chrono::steady_clock::now ();
+  bool is_ok = true;
+  for (u64 tile = 0u; tile < num_tiles && is_ok; ++tile)
+  {
+    stream_slot const& slot = slots [tile % NUM_STREAM_SLOTS];
+
+    // back round to this slot, its last tile must be out before the staging buffers are reused
+    if (tile >= NUM_STREAM_SLOTS)
+    {
+      is_ok = read_tile (tile - NUM_STREAM_SLOTS);
+    }
+
+    // upload this tile, then compute it once it's there
+    // the previous tile's download goes on the transfer queue after this upload, so the upload isn't stuck behind it
+    is_ok = is_ok &&
+      write_tile (tile) &&
+      submit (queue_transfer, slot.command_buffer_upload, nullptr, 0u, timeline_upload, tile + 1u) &&
+      submit (queue_compute, slot.command_buffer_compute, &timeline_upload, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timeline_compute, tile + 1u);
+    if (is_ok && tile > 0u)
+    {
+      is_ok = submit (queue_transfer, slots [(tile - 1u) % NUM_STREAM_SLOTS].command_buffer_download,
+        &timeline_compute, VK_PIPELINE_STAGE_TRANSFER_BIT, timeline_download, tile);
+    }
+  }
+  // drain, the last download and the tiles still in flight
+  is_ok = is_ok && submit (queue_transfer, slots [(num_tiles - 1u) % NUM_STREAM_SLOTS].command_buffer_download,
+    &timeline_compute, VK_PIPELINE_STAGE_TRANSFER_BIT, timeline_download, num_tiles);
+  for (u64 tile = num_tiles > NUM_STREAM_SLOTS ? num_tiles - NUM_STREAM_SLOTS : 0u; tile < num_tiles && is_ok; ++tile)
+  {
+    is_ok = read_tile (tile);
+  }
+  f32 const seconds = std::chrono::duration <f32> (std::chrono::steady_clock::now () - start_time).count ();
+
+  // 2 reads + 1 write per element, through the host, the bus and the gpu
+  dprintf ("stream: %.2f GB in %.3f s, %.2f GB/s\n", (file_a.size * 3u) / 1e9f, seconds, (file_a.size * 3u) / (seconds * 1e9f));
+  dprintf ("stream: %llu of %llu spot checks wrong\n", (unsigned long long)num_mismatches, (unsigned long long)num_checked);
+
+  release_resources ();
+  return DBG_ASSERT_MSG (is_ok, "stream: failed part way, '%s' is incomplete\n", config.path_out) && num_mismatches == 0u;
+}
+
+
+int main (int argc, char** argv)
+  // compute only app, no window or surface (headless), so the build system leaves 'SubSystem' as 'SUBSYSTEM:CONSOLE'
+  // this lets it run on machines without a display, e.g. linux compute nodes
+{
+  // 'autotune=1' on the command line times the kernel with each candidate work group size before running it
+  // the winner is saved for this device, and used by every later run
+  // 'backend=cpu' runs the fma on the host instead, 'backend=auto' picks by size (see 'choose_compute_backend')
+  // either way the gpu's output is checked against the cpu's
+  // 'check_primitives=1' checks the reduce/scan/histogram kernels against the cpu before summarising the output with them
+  // 'check_gemm=1' checks the tiled matrix multiply against the cpu
+  bool is_autotune = false;
+  bool is_check_primitives = false;
+  bool is_check_gemm = false;
+  compute_backend requested_backend = compute_backend::gpu;
+  stream_config stream;
+  for (int i = 1; i < argc; ++i)
+  {
+    is_autotune = is_autotune || std::strcmp (argv [i], "autotune=1") == 0;
+    is_check_primitives = is_check_primitives || std::strcmp (argv [i], "check_primitives=1") == 0;
+    is_check_gemm = is_check_gemm || std::strcmp (argv [i], "check_gemm=1") == 0;
+    if (std::strcmp (argv [i], "backend=cpu") == 0) requested_backend = compute_backend::cpu;
+    else if (std::strcmp (argv [i], "backend=auto") == 0) requested_backend = compute_backend::automatic;
+
+    // see STREAMING
+    char const* const arg = argv [i];
+    if (std::strncmp (arg, "stream_a=", 9u) == 0) stream.path_a = arg + 9;
+    else if (std::strncmp (arg, "stream_b=", 9u) == 0) stream.path_b = arg + 9;
+    else if (std::strncmp (arg, "stream_out=", 11u) == 0) stream.path_out = arg + 11;
+    else if (std::strncmp (arg, "stream_tile_log2=", 17u) == 0) stream.tile_log2 = std::min (std::max ((u32)std::atoi (arg + 17), 10u), 30u);
+  }
+  bool const is_stream = stream.path_a != nullptr && stream.path_b != nullptr && stream.path_out != nullptr;
+
+
   // CONTEXT
 
   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
   VkDevice device = VK_NULL_HANDLE;
 
   VkQueue queue_compute = VK_NULL_HANDLE;
+  VkQueue queue_transfer = VK_NULL_HANDLE; // streaming only
 
   // create vulkan instance, device etc
   // one per app
@@ -84,13 +601,28 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       DBG_ASSERT (false);
       return -1;
     }
-    if (!create_vulkan_device (VK_QUEUE_COMPUTE_BIT,
+    if (!create_vulkan_device (is_stream ? VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT : VK_QUEUE_COMPUTE_BIT,
       physical_device, device))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
+  // create the libraries on top of the device
+  // the autotuner before the element-wise library, it before the primitives & gemm
+  {
+    if (!create_vulkan_pipeline_cache (physical_device, device,
+        VULKAN_PIPELINE_CACHE_PATH, has_vulkan_pipeline_creation_feedback ()) ||
+      !create_vulkan_autotuner (physical_device, VULKAN_AUTOTUNE_PATH) ||
+      !create_vulkan_profiler (physical_device, device, has_vulkan_pipeline_statistics ()) ||
+      !create_vulkan_elementwise (physical_device, device) ||
+      !create_vulkan_primitives (physical_device, device) ||
+      !create_vulkan_gemm (physical_device, device))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
   // get vulkan queues
   // once per app
   {
@@ -99,11 +631,27 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       DBG_ASSERT (false);
       return -1;
     }
+    if (is_stream && !get_vulkan_queue_transfer (queue_transfer))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
+  // cpu backend, also the reference the gpu output is checked against
+  {
+    if (!create_cpu_compute ())
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
   }
 
 
   // COMPUTE PIPELINE
 
+  vulkan_workgroup_size thread_group_size = { .x = THREAD_GROUP_SIZE };
+  find_vulkan_workgroup_size (AUTOTUNE_KERNEL_NAME, thread_group_size); // keeps the default if this device hasn't been tuned
+
   constexpr u32 NUM_SETS_COMPUTE = 1u;
 
   constexpr u32 NUM_RESOURCES_COMPUTE_SET_0 = 4u;
@@ -203,10 +751,13 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
 
-    if (!create_vulkan_pipeline_compute (device,
+    vulkan_specialization specialization;
+    if (!set_vulkan_specialization_constant (specialization, 0u, thread_group_size.x) ||
+      !create_vulkan_pipeline_compute (device,
       shader_module_compute, "main",
       pipeline_layout_compute,
-      pipeline_compute))
+      pipeline_compute,
+      &specialization))
     {
       DBG_ASSERT (false);
       return -1;
@@ -415,6 +966,9 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     }
   }
 
+  // how many driver allocations the resources above ended up using
+  print_vulkan_memory_stats ();
+
 
   // SET INPUT/INFO BUFFERS
   {
@@ -423,7 +977,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     std::uniform_real_distribution <f32> distribution (0.f, 100.f);
 
     if (!map_and_unmap_memory (device,
-      buffer_input_0.memory, [&rd, &distribution](void* mapped_memory)
+      buffer_input_0.allocation, [&rd, &distribution](void* mapped_memory)
       {
         f32* data = (f32*)mapped_memory;
         for (u32 i = 0u; i < NUM_ELEMENTS; ++i)
@@ -436,7 +990,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
     if (!map_and_unmap_memory(device,
-        buffer_input_1.memory, [&rd, &distribution](void* mapped_memory)
+        buffer_input_1.allocation, [&rd, &distribution](void* mapped_memory)
         {
             f32* data = (f32*)mapped_memory;
             for (u32 i = 0u; i < NUM_ELEMENTS; ++i)
@@ -451,7 +1005,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     // no need to set/initialise 'buffer_output' as its content will be completely overwritten by the compute shader
 
     if (!map_and_unmap_memory(device,
-        buffer_info.memory, [&rd, &distribution](void* mapped_memory)
+        buffer_info.allocation, [&rd, &distribution](void* mapped_memory)
         {
             u32* data = (u32*)mapped_memory;
             (*data) = NUM_ELEMENTS;
@@ -462,13 +1016,118 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     }
   }
 
- 
+
+  // AUTOTUNE
+  // fma only reads the inputs, so it can be run as often as we like on the real data
+  if (is_autotune)
+  {
+    vulkan_workgroup_size const candidates [] =
+    {
+      { .x = 32u }, { .x = 64u }, { .x = 128u }, { .x = 256u }, { .x = 512u }, { .x = 1024u }
+    };
+
+    auto const create_pipeline = [&](vulkan_workgroup_size const& size, VkPipeline& out_pipeline)
+    {
+      VkShaderModule shader_module = VK_NULL_HANDLE;
+      if (!create_vulkan_shader (device,
+        COMPILED_COMPUTE_SHADER_PATH,
+        shader_module))
+      {
+        return false;
+      }
+
+      vulkan_specialization specialization;
+      bool const is_created = set_vulkan_specialization_constant (specialization, 0u, size.x) &&
+        create_vulkan_pipeline_compute (device,
+        shader_module, "main",
+        pipeline_layout_compute,
+        out_pipeline,
+        &specialization);
+
+      release_vulkan_shader (device,
+        shader_module);
+      return is_created;
+    };
+    auto const record_dispatch = [&](VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_workgroup_size const& size)
+    {
+      vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+      vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_compute,
+        desc_set_0_compute.set_index, 1u, &desc_set_0_compute.desc_set, 0u, VK_NULL_HANDLE);
+
+      compute_push_constants const data =
+      {
+        .multiplier = MULTIPLIER
+      };
+      vkCmdPushConstants (command_buffer, pipeline_layout_compute, VK_SHADER_STAGE_COMPUTE_BIT,
+        0u, sizeof (compute_push_constants), &data);
+
+      vkCmdDispatch (command_buffer, ((NUM_ELEMENTS - 1u) / size.x) + 1u, 1u, 1u);
+    };
+
+    VkPipeline pipeline_tuned = VK_NULL_HANDLE;
+    if (!autotune_vulkan_workgroup_size (device, queue_compute,
+      AUTOTUNE_KERNEL_NAME,
+      (u32)std::size (candidates), candidates, 8u,
+      create_pipeline, record_dispatch,
+      thread_group_size, pipeline_tuned))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+
+    // carry on with the winner
+    release_vulkan_pipeline (device, pipeline_compute);
+    pipeline_compute = pipeline_tuned;
+  }
+
+
+  // STREAMING
+  // the files replace the built in inputs, so skip straight to the release
+  if (is_stream)
+  {
+    if (!stream_fma (physical_device, device,
+      queue_compute, queue_transfer,
+      descriptor_set_layouts_compute [0], pipeline_layout_compute, pipeline_compute,
+      thread_group_size.x, stream))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
+
+  // CPU
+  // small enough jobs are quicker on the host than a gpu round trip
+  bool const is_gpu_job = !is_stream &&
+    choose_compute_backend (requested_backend, NUM_ELEMENTS) == compute_backend::gpu;
+  std::vector <f32> reference (NUM_ELEMENTS);
+  if (!is_stream)
+  {
+    std::span <f32 const> const input_0 = get_mapped_span <f32 const> (buffer_input_0);
+    std::span <f32 const> const input_1 = get_mapped_span <f32 const> (buffer_input_1);
+    run_cpu_fma (input_0.data (), input_1.data (), MULTIPLIER, reference.data (), NUM_ELEMENTS);
+
+    if (!is_gpu_job)
+    {
+      // the result goes where the gpu would have put it, so the output below is the same either way
+      std::span <f32> const output = get_mapped_span <f32> (buffer_output);
+      std::memcpy (output.data (), reference.data (), NUM_ELEMENTS * ELEMENT_SIZE);
+      if (!flush_vulkan_memory (device, buffer_output.allocation)) // or the invalidate before the read back drops it
+      {
+        DBG_ASSERT (false);
+        return -1;
+      }
+    }
+    dprintf ("fma on the %s (%s)\n", is_gpu_job ? "gpu" : "cpu", get_cpu_simd_level_name (get_cpu_simd_level ()));
+  }
+
+  if (is_gpu_job)
   {
     if (!begin_command_buffer (command_buffer_compute, 0u))
     {
       DBG_ASSERT (false);
       return -1;
     }
+    begin_vulkan_profile_slot (command_buffer_compute, 0u, VK_PIPELINE_BIND_POINT_COMPUTE);
     {
       // any compute related command after this point is attached to this pipeline (on this command buffer)
         vkCmdBindPipeline(command_buffer_compute,  // Command Buffer
@@ -498,13 +1157,13 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           &data);                                // pValues
 
       // trigger compute shader
-      u32 const thread_group_dim = 256u; // this is set in the shader
-
       //                           Integer division ceiling
-      u32 const group_count_x = ((NUM_ELEMENTS - 1u) / thread_group_dim) + 1;
+      u32 const group_count_x = ((NUM_ELEMENTS - 1u) / thread_group_size.x) + 1;
 
+      begin_vulkan_profile_scope (command_buffer_compute, "fma");
       vkCmdDispatch(command_buffer_compute, // commandBuffer
           group_count_x, 1u, 1u);           // Group count X, Y, and Z
+      end_vulkan_profile_scope (command_buffer_compute);
     }
     if (!end_command_buffer (command_buffer_compute))
     {
@@ -514,6 +1173,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   }
 
   // TODO: SUBMIT
+  if (is_gpu_job)
   {
       if (vkResetFences(device, // device
           1u,                   // fenceCount
@@ -555,72 +1215,132 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
         DBG_ASSERT(false);
         return -1;
     }
+    resolve_vulkan_profile_slot (0u); // we waited anyway, so the timings are ready
   }
 
 
   // OUTPUT RESULTS
+  if (!is_stream)
   {
     dprintf ("output[i] = (input a[i] * multiplier) + input b [i]\n");
     dprintf ("multiplier = %.2f\n", MULTIPLIER);
 
 
-    if (!map_and_unmap_memory (device,
-      buffer_input_0.memory, [](void* mapped_memory)
-      {
-        f32* data = (f32*)mapped_memory;
-
-        dprintf ("input a: ");
-        for (u32 i = 0u; i < NUM_ELEMENTS - 1u; ++i)
-        {
-          dprintf ("%.2f, ", data [i]);
-        }
-        dprintf ("%.2f\n", data [NUM_ELEMENTS - 1u]);
-
-        write_file ("input_a.txt", data, NUM_ELEMENTS, "%.2f");
-      }))
+    // buffers are persistently mapped, make the device writes visible before reading them back
+    if (!invalidate_vulkan_memory (device, buffer_output.allocation))
     {
       DBG_ASSERT (false);
       return -1;
     }
 
-    if (!map_and_unmap_memory (device,
-      buffer_input_1.memory, [](void* mapped_memory)
+    struct result
+    {
+      char const* label;
+      char const* path;
+      vulkan_buffer const* buffer;
+    };
+    std::span <f32 const> const output = get_mapped_span <f32 const> (buffer_output).first (NUM_ELEMENTS);
+    dprintf ("%llu of %u outputs differ from the cpu reference\n",
+      (unsigned long long)count_cpu_mismatches (reference.data (), output.data (), NUM_ELEMENTS), NUM_ELEMENTS);
+
+    std::array <result, 3u> const results =
+    {
+      result { "input a", "input_a.txt", &buffer_input_0 },
+      result { "input b", "input_b.txt", &buffer_input_1 },
+      result { "output ", "output.txt", &buffer_output }
+    };
+    for (result const& r : results)
+    {
+      std::span <f32 const> const data = get_mapped_span <f32 const> (*r.buffer).first (NUM_ELEMENTS);
+
+      dprintf ("%s: ", r.label);
+      for (u32 i = 0u; i < NUM_ELEMENTS - 1u; ++i)
       {
-        f32* data = (f32*)mapped_memory;
+        dprintf ("%.2f, ", data [i]);
+      }
+      dprintf ("%.2f\n", data [NUM_ELEMENTS - 1u]);
 
-        dprintf ("input b: ");
-        for (u32 i = 0u; i < NUM_ELEMENTS - 1u; ++i)
-        {
-          dprintf ("%.2f, ", data [i]);
-        }
-        dprintf ("%.2f\n", data [NUM_ELEMENTS - 1u]);
+      write_file (r.path, data.data (), NUM_ELEMENTS, "%.2f");
+    }
+  }
 
-        write_file ("input_b.txt", data, NUM_ELEMENTS, "%.2f");
-      }))
+
+  // ELEMENT-WISE LIBRARY
+  // everything above, from the layouts to the fence wait, in one call (see vulkan_elementwise.h)
+  if (!is_stream)
+  {
+    vulkan_buffer buffer_output_zip;
+    if (!create_vulkan_buffer (physical_device, device,
+      NUM_ELEMENTS * ELEMENT_SIZE,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      buffer_output_zip))
     {
       DBG_ASSERT (false);
       return -1;
     }
 
-    if (!map_and_unmap_memory (device,
-      buffer_output.memory, [](void* mapped_memory)
-      {
-        f32* data = (f32*)mapped_memory;
+    if (!gpu_zip <gpu_op::fma> (buffer_input_0, buffer_input_1, buffer_output_zip, NUM_ELEMENTS, MULTIPLIER) ||
+      !invalidate_vulkan_memory (device, buffer_output_zip.allocation))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+    dprintf ("gpu_zip: %llu of %u outputs differ from the cpu reference\n",
+      (unsigned long long)count_cpu_mismatches (reference.data (), get_mapped_span <f32 const> (buffer_output_zip).data (), NUM_ELEMENTS),
+      NUM_ELEMENTS);
 
-        dprintf ("output : ");
-        for (u32 i = 0u; i < NUM_ELEMENTS - 1u; ++i)
-        {
-          dprintf ("%.2f, ", data [i]);
-        }
-        dprintf ("%.2f\n", data [NUM_ELEMENTS - 1u]);
+    release_vulkan_buffer (device, buffer_output_zip);
+  }
 
-        write_file ("output.txt", data, NUM_ELEMENTS, "%.2f");
-      }))
+
+  // PRIMITIVES
+  // sum, range and histogram of the output without reading it back (see vulkan_primitives.h), checked against the cpu
+  // the range needs reduce, which some devices don't have ('create_vulkan_primitives' says so), skipped there
+  if (!is_stream)
+  {
+    if (is_check_primitives && !check_vulkan_primitives ())
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
+  if (!is_stream && is_vulkan_reduce_scan_supported ())
+  {
+    constexpr u32 NUM_BINS = 10u;
+    f32 sum = {}, min = {}, max = {};
+    std::vector <u32> counts;
+    if (!gpu_reduce <gpu_reduce_op::sum> (buffer_output, NUM_ELEMENTS, sum) ||
+      !gpu_reduce <gpu_reduce_op::min> (buffer_output, NUM_ELEMENTS, min) ||
+      !gpu_reduce <gpu_reduce_op::max> (buffer_output, NUM_ELEMENTS, max) ||
+      !gpu_histogram (buffer_output, NUM_ELEMENTS, min, std::nextafter (max, INFINITY), NUM_BINS, counts))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+
+    double reference_sum = {};
+    for (f32 value : reference)
+    {
+      reference_sum += value;
+    }
+    dprintf ("output: sum %.1f (cpu %.1f), range [%.2f, %.2f], histogram:", sum, reference_sum, min, max);
+    for (u32 count : counts)
+    {
+      dprintf (" %u", count);
+    }
+    dprintf ("\n");
+  }
+
+
+  // GEMM
+  // not part of the fma job, a check of the matrix multiply kernel (see vulkan_gemm.h) on its own matrices
+  if (is_check_gemm && !check_vulkan_gemm ())
+  {
+    DBG_ASSERT (false);
+    return -1;
+  }
 
 
   // RELEASE
@@ -647,10 +1367,27 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
         NUM_SETS_COMPUTE, descriptor_set_layouts_compute.data ());
     }
 
+    release_cpu_compute ();
+
+    // LIBRARIES
+    {
+      print_vulkan_pipeline_cache_stats ();
+      release_vulkan_pipeline_cache (device); // saves the cache for the next run
+      print_vulkan_autotuner ();
+      release_vulkan_autotuner (); // saves anything tuned this run
+      print_vulkan_profile_stats ();
+      release_vulkan_profiler (device);
+      release_vulkan_primitives (device);
+      release_vulkan_gemm (device);
+      release_vulkan_elementwise (device);
+    }
+
     // CONTEXT
     {
+      release_vulkan_memory (device);
       release_vulkan_device ();
       release_vulkan_instance ();
+      queue_transfer = VK_NULL_HANDLE;
       queue_compute = VK_NULL_HANDLE;
       device = VK_NULL_HANDLE;
       physical_device = VK_NULL_HANDLE;
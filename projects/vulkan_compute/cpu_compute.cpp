@@ -0,0 +1,438 @@
+#include "cpu_compute.h"
+
+#include "utility.h"          // DBG_ASSERT
+
+#include <algorithm>          // for std::min, std::max, std::fill
+#include <cmath>              // for std::fabs, std::isnan, std::isfinite
+#include <condition_variable> // for std::condition_variable
+#include <functional>         // for std::function
+#include <mutex>              // for std::mutex
+#include <thread>             // for std::thread
+#include <vector>             // for std::vector
+
+#if defined (__x86_64__) || defined (_M_X64)
+#define CPU_COMPUTE_X86
+#include <immintrin.h>         // for avx2/avx-512 intrinsics
+#ifdef _MSC_VER
+#include <intrin.h>            // for __cpuidex, _xgetbv
+#define CPU_TARGET(isa)   // msvc compiles any intrinsic without flags
+#else // _MSC_VER
+#include <cpuid.h>             // for __cpuid_count
+#define CPU_TARGET(isa) __attribute__ ((target (isa))) // compile just this function for 'isa', the rest stays baseline
+#endif // _MSC_VER
+#endif // __x86_64__ || _M_X64
+
+
+// work is split in to chunks of at least this many elements, smaller jobs stay on the caller's thread
+// waking a worker costs a few microseconds, this is ~10x that of streaming through memory
+constexpr u64 MIN_ELEMENTS_PER_CHUNK = 1u << 15;
+constexpr u64 CHUNK_ALIGNMENT = 16u; // elements, a cache line of f32s so no two threads write the same line
+
+
+static bool s_is_simd_level_detected = false;
+static cpu_simd_level s_simd_level = cpu_simd_level::scalar;
+
+// worker pool, one job at a time: 'run_parallel' hands out chunk indices until they are all taken
+static std::mutex s_mutex;
+static std::condition_variable s_cv_work; // a job has been posted, or the pool is shutting down
+static std::condition_variable s_cv_done; // the last chunk of the job has finished
+static std::function <void (u32 chunk)> const* s_job = nullptr;
+static u32 s_num_chunks = {};
+static u32 s_next_chunk = {};
+static u32 s_num_chunks_done = {};
+static bool s_is_quitting = false;
+
+// joins at exit if 'release_cpu_compute' wasn't called (an early return from main),
+// destroying joinable threads would terminate, declared after the mutex and condition variables so it goes first
+struct worker_pool
+{
+  std::vector <std::thread> threads;
+
+  ~worker_pool ()
+  {
+    release_cpu_compute ();
+  }
+};
+static worker_pool s_workers;
+
+
+#pragma region cpu_compute_support
+static cpu_simd_level detect_simd_level ()
+{
+#ifdef CPU_COMPUTE_X86
+  auto const cpuid = [](u32 leaf, u32 subleaf, u32 (&out_regs) [4u])
+  {
+#ifdef _MSC_VER
+    __cpuidex ((int*)out_regs, (int)leaf, (int)subleaf);
+#else // _MSC_VER
+    __cpuid_count (leaf, subleaf, out_regs [0], out_regs [1], out_regs [2], out_regs [3]);
+#endif // _MSC_VER
+  };
+  // which register state the os saves on a context switch, the cpu supporting an isa isn't enough
+  auto const xgetbv = []() -> u64
+  {
+#ifdef _MSC_VER
+    return _xgetbv (0u);
+#else // _MSC_VER
+    u32 eax = {}, edx = {};
+    __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0u));
+    return ((u64)edx << 32u) | eax;
+#endif // _MSC_VER
+  };
+
+  u32 regs [4u] = {}; // eax, ebx, ecx, edx
+  cpuid (0u, 0u, regs);
+  u32 const max_leaf = regs [0];
+  if (max_leaf < 7u)
+  {
+    return cpu_simd_level::scalar;
+  }
+
+  cpuid (1u, 0u, regs);
+  bool const has_osxsave = (regs [2] & (1u << 27u)) != 0u;
+  bool const has_fma = (regs [2] & (1u << 12u)) != 0u;
+  if (!has_osxsave)
+  {
+    return cpu_simd_level::scalar;
+  }
+  u64 const xcr0 = xgetbv ();
+  bool const is_ymm_saved = (xcr0 & 0x06u) == 0x06u; // sse + avx state
+  bool const is_zmm_saved = (xcr0 & 0xe6u) == 0xe6u; // + opmask + upper zmm state
+
+  cpuid (7u, 0u, regs);
+  bool const has_avx2 = (regs [1] & (1u << 5u)) != 0u;
+  bool const has_avx512f = (regs [1] & (1u << 16u)) != 0u;
+
+  if (has_avx512f && is_zmm_saved)
+  {
+    return cpu_simd_level::avx512;
+  }
+  if (has_avx2 && has_fma && is_ymm_saved)
+  {
+    return cpu_simd_level::avx2;
+  }
+#endif // CPU_COMPUTE_X86
+  return cpu_simd_level::scalar;
+}
+
+static void worker_main ()
+{
+  std::unique_lock <std::mutex> lock (s_mutex);
+  for (;;)
+  {
+    s_cv_work.wait (lock, []() { return s_is_quitting || s_next_chunk < s_num_chunks; });
+    if (s_is_quitting)
+    {
+      return;
+    }
+
+    u32 const chunk = s_next_chunk++;
+    std::function <void (u32)> const& job = *s_job;
+    lock.unlock ();
+    job (chunk);
+    lock.lock ();
+
+    if (++s_num_chunks_done == s_num_chunks)
+    {
+      s_cv_done.notify_all ();
+    }
+  }
+}
+
+// run 'job' on chunks 0..num_chunks-1, the caller takes chunks too, returns once every chunk is done
+static void run_parallel (u32 num_chunks, std::function <void (u32 chunk)> const& job)
+{
+  if (num_chunks <= 1u || s_workers.threads.empty ())
+  {
+    for (u32 chunk = 0u; chunk < num_chunks; ++chunk)
+    {
+      job (chunk);
+    }
+    return;
+  }
+
+  std::unique_lock <std::mutex> lock (s_mutex);
+  s_job = &job;
+  s_num_chunks = num_chunks;
+  s_next_chunk = 0u;
+  s_num_chunks_done = 0u;
+  s_cv_work.notify_all ();
+
+  while (s_next_chunk < s_num_chunks)
+  {
+    u32 const chunk = s_next_chunk++;
+    lock.unlock ();
+    job (chunk);
+    lock.lock ();
+    ++s_num_chunks_done;
+  }
+  s_cv_done.wait (lock, []() { return s_num_chunks_done == s_num_chunks; });
+
+  s_job = nullptr;
+  s_num_chunks = 0u;
+  s_next_chunk = 0u;
+}
+
+// split [0, num_elements) in to aligned chunks, about one per thread
+static void for_each_chunk (u64 num_elements, std::function <void (u64 begin, u64 end)> const& func)
+{
+  u64 const num_threads = s_workers.threads.size () + 1u;
+  u64 chunk_size = std::max (MIN_ELEMENTS_PER_CHUNK, ((num_elements - 1u) / num_threads) + 1u);
+  chunk_size = ((chunk_size + CHUNK_ALIGNMENT - 1u) / CHUNK_ALIGNMENT) * CHUNK_ALIGNMENT;
+  u32 const num_chunks = (u32)(((num_elements - 1u) / chunk_size) + 1u);
+
+  run_parallel (num_chunks, [&](u32 chunk)
+    {
+      u64 const begin = chunk * chunk_size;
+      func (begin, std::min (begin + chunk_size, num_elements));
+    });
+}
+
+
+// FMA
+
+static void fma_scalar (f32 const* a, f32 const* b, f32 multiplier,
+  f32* out, u64 begin, u64 end)
+{
+  for (u64 i = begin; i < end; ++i)
+  {
+    out [i] = (a [i] * multiplier) + b [i];
+  }
+}
+#ifdef CPU_COMPUTE_X86
+CPU_TARGET ("avx2,fma")
+static void fma_avx2 (f32 const* a, f32 const* b, f32 multiplier,
+  f32* out, u64 begin, u64 end)
+{
+  __m256 const k = _mm256_set1_ps (multiplier);
+  u64 i = begin;
+  // 2 vectors per iteration, enough loads in flight to saturate memory
+  for (; i + 16u <= end; i += 16u)
+  {
+    __m256 const r0 = _mm256_fmadd_ps (_mm256_loadu_ps (a + i), k, _mm256_loadu_ps (b + i));
+    __m256 const r1 = _mm256_fmadd_ps (_mm256_loadu_ps (a + i + 8u), k, _mm256_loadu_ps (b + i + 8u));
+    _mm256_storeu_ps (out + i, r0);
+    _mm256_storeu_ps (out + i + 8u, r1);
+  }
+  for (; i + 8u <= end; i += 8u)
+  {
+    _mm256_storeu_ps (out + i, _mm256_fmadd_ps (_mm256_loadu_ps (a + i), k, _mm256_loadu_ps (b + i)));
+  }
+  fma_scalar (a, b, multiplier, out, i, end);
+}
+CPU_TARGET ("avx512f")
+static void fma_avx512 (f32 const* a, f32 const* b, f32 multiplier,
+  f32* out, u64 begin, u64 end)
+{
+  __m512 const k = _mm512_set1_ps (multiplier);
+  u64 i = begin;
+  for (; i + 16u <= end; i += 16u)
+  {
+    _mm512_storeu_ps (out + i, _mm512_fmadd_ps (_mm512_loadu_ps (a + i), k, _mm512_loadu_ps (b + i)));
+  }
+  // the tail in one masked op, no scalar loop
+  __mmask16 const mask = (__mmask16)((1u << (end - i)) - 1u);
+  __m512 const r = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (mask, a + i), k, _mm512_maskz_loadu_ps (mask, b + i));
+  _mm512_mask_storeu_ps (out + i, mask, r);
+}
+#endif // CPU_COMPUTE_X86
+
+
+// GEMM
+
+// cache blocking: a GEMM_BLOCK_K x GEMM_BLOCK_N panel of b (128 KB) stays in L2 while a chunk's rows of c,
+// GEMM_BLOCK_N wide (1 KB each), stay in L1 and accumulate over it
+constexpr u32 GEMM_BLOCK_N = 256u;
+constexpr u32 GEMM_BLOCK_K = 128u;
+constexpr u32 GEMM_ROWS_PER_CHUNK = 16u; // the work each thread takes at a time
+
+// c_row [j] += a * b_row [j], j in [begin, end)
+static void gemm_row_scalar (f32 a, f32 const* b_row,
+  f32* c_row, u32 begin, u32 end)
+{
+  for (u32 j = begin; j < end; ++j)
+  {
+    c_row [j] += a * b_row [j];
+  }
+}
+#ifdef CPU_COMPUTE_X86
+CPU_TARGET ("avx2,fma")
+static void gemm_row_avx2 (f32 a, f32 const* b_row,
+  f32* c_row, u32 begin, u32 end)
+{
+  __m256 const k = _mm256_set1_ps (a);
+  u32 j = begin;
+  for (; j + 8u <= end; j += 8u)
+  {
+    _mm256_storeu_ps (c_row + j, _mm256_fmadd_ps (k, _mm256_loadu_ps (b_row + j), _mm256_loadu_ps (c_row + j)));
+  }
+  gemm_row_scalar (a, b_row, c_row, j, end);
+}
+CPU_TARGET ("avx512f")
+static void gemm_row_avx512 (f32 a, f32 const* b_row,
+  f32* c_row, u32 begin, u32 end)
+{
+  __m512 const k = _mm512_set1_ps (a);
+  u32 j = begin;
+  for (; j + 16u <= end; j += 16u)
+  {
+    _mm512_storeu_ps (c_row + j, _mm512_fmadd_ps (k, _mm512_loadu_ps (b_row + j), _mm512_loadu_ps (c_row + j)));
+  }
+  __mmask16 const mask = (__mmask16)((1u << (end - j)) - 1u);
+  __m512 const r = _mm512_fmadd_ps (k, _mm512_maskz_loadu_ps (mask, b_row + j), _mm512_maskz_loadu_ps (mask, c_row + j));
+  _mm512_mask_storeu_ps (c_row + j, mask, r);
+}
+#endif // CPU_COMPUTE_X86
+#pragma endregion
+
+
+bool create_cpu_compute (u32 num_threads)
+{
+  DBG_ASSERT (s_workers.threads.empty ());
+
+
+  get_cpu_simd_level (); // detect up front, not in the middle of the first job
+
+  if (num_threads == 0u)
+  {
+    num_threads = std::max (std::thread::hardware_concurrency (), 1u);
+  }
+
+  // the caller's thread is one of them
+  s_is_quitting = false;
+  s_workers.threads.reserve (num_threads - 1u);
+  for (u32 i = 1u; i < num_threads; ++i)
+  {
+    s_workers.threads.emplace_back (worker_main);
+  }
+
+  dprintf ("cpu compute: %u threads, %s\n", num_threads, get_cpu_simd_level_name (s_simd_level));
+  return true;
+}
+
+cpu_simd_level get_cpu_simd_level ()
+{
+  if (!s_is_simd_level_detected)
+  {
+    s_simd_level = detect_simd_level ();
+    s_is_simd_level_detected = true;
+  }
+  return s_simd_level;
+}
+char const* get_cpu_simd_level_name (cpu_simd_level level)
+{
+  switch (level)
+  {
+  case cpu_simd_level::avx512: return "avx-512";
+  case cpu_simd_level::avx2: return "avx2";
+  default: return "scalar";
+  }
+}
+
+compute_backend choose_compute_backend (compute_backend requested, u64 num_elements)
+{
+  if (requested != compute_backend::automatic)
+  {
+    return requested;
+  }
+  return num_elements < CPU_BACKEND_MAX_ELEMENTS ? compute_backend::cpu : compute_backend::gpu;
+}
+
+void run_cpu_fma (f32 const* a, f32 const* b, f32 multiplier,
+  f32* out, u64 num_elements)
+{
+  DBG_ASSERT (a != nullptr && b != nullptr && out != nullptr);
+  if (num_elements == 0u)
+  {
+    return;
+  }
+
+  auto kernel = fma_scalar;
+#ifdef CPU_COMPUTE_X86
+  switch (get_cpu_simd_level ())
+  {
+  case cpu_simd_level::avx512: kernel = fma_avx512; break;
+  case cpu_simd_level::avx2: kernel = fma_avx2; break;
+  default: break;
+  }
+#endif // CPU_COMPUTE_X86
+
+  for_each_chunk (num_elements, [&](u64 begin, u64 end)
+    {
+      kernel (a, b, multiplier, out, begin, end);
+    });
+}
+
+void run_cpu_gemm (f32 const* a, f32 const* b, f32* c,
+  u32 m, u32 n, u32 k)
+{
+  DBG_ASSERT (c != nullptr && ((a != nullptr && b != nullptr) || k == 0u));
+  if (m == 0u || n == 0u)
+  {
+    return;
+  }
+
+  auto row_kernel = gemm_row_scalar;
+#ifdef CPU_COMPUTE_X86
+  switch (get_cpu_simd_level ())
+  {
+  case cpu_simd_level::avx512: row_kernel = gemm_row_avx512; break;
+  case cpu_simd_level::avx2: row_kernel = gemm_row_avx2; break;
+  default: break;
+  }
+#endif // CPU_COMPUTE_X86
+
+  // each chunk of rows of c is only written by its own thread
+  u32 const num_chunks = ((m - 1u) / GEMM_ROWS_PER_CHUNK) + 1u;
+  run_parallel (num_chunks, [&](u32 chunk)
+    {
+      u32 const row_begin = chunk * GEMM_ROWS_PER_CHUNK;
+      u32 const row_end = std::min (row_begin + GEMM_ROWS_PER_CHUNK, m);
+      std::fill (c + ((u64)row_begin * n), c + ((u64)row_end * n), 0.f);
+      for (u32 j0 = 0u; j0 < n; j0 += GEMM_BLOCK_N)
+      {
+        u32 const j1 = std::min (j0 + GEMM_BLOCK_N, n);
+        for (u32 p0 = 0u; p0 < k; p0 += GEMM_BLOCK_K)
+        {
+          u32 const p1 = std::min (p0 + GEMM_BLOCK_K, k);
+          for (u32 i = row_begin; i < row_end; ++i)
+          {
+            f32* const c_row = c + ((u64)i * n);
+            for (u32 p = p0; p < p1; ++p)
+            {
+              row_kernel (a [((u64)i * k) + p], b + ((u64)p * n), c_row, j0, j1);
+            }
+          }
+        }
+      }
+    });
+}
+
+u64 count_cpu_mismatches (f32 const* expected, f32 const* actual, u64 num_elements,
+  f32 relative_tolerance)
+{
+  u64 num_mismatches = {};
+  for (u64 i = 0u; i < num_elements; ++i)
+  {
+    f32 const e = expected [i], a = actual [i];
+    bool const is_match = std::isfinite (e) ?
+      std::fabs (a - e) <= std::max (std::fabs (e) * relative_tolerance, 1e-6f) :
+      (std::isnan (e) ? std::isnan (a) : a == e);
+    num_mismatches += is_match ? 0u : 1u;
+  }
+  return num_mismatches;
+}
+
+void release_cpu_compute ()
+{
+  {
+    std::lock_guard <std::mutex> lock (s_mutex);
+    s_is_quitting = true;
+  }
+  s_cv_work.notify_all ();
+  for (std::thread& worker : s_workers.threads)
+  {
+    worker.join ();
+  }
+  s_workers.threads.clear ();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+
+// cpu backend:
+// the element-wise kernels run on the host, vectorised (avx-512, avx2 + fma, or plain scalar, picked at runtime
+// from what the cpu supports) and split across a pool of worker threads
+//
+// two uses:
+// - a reference to check the gpu's output against
+// - a faster path for small jobs, where the gpu round trip (record, submit, fence wait, read back) costs more
+//   than the work itself, see 'choose_compute_backend'
+//
+// the kernels match their shaders, e.g. 'run_cpu_fma' is vulkan_compute_buffer.comp, 'run_cpu_gemm' vulkan_gemm.comp
+// results can differ from the gpu's in the last bit (fused vs unfused multiply add), compare with a tolerance
+
+
+/// <summary>
+/// where a job runs, 'automatic' picks by size (see 'choose_compute_backend')
+/// </summary>
+enum class compute_backend : u8
+{
+  automatic,
+  cpu,
+  gpu
+};
+
+/// <summary>
+/// the widest vector instructions the cpu (and the os) supports, best first
+/// </summary>
+enum class cpu_simd_level : u8
+{
+  scalar,
+  avx2,   // + fma
+  avx512  // avx512f
+};
+
+// below this many elements 'automatic' runs on the cpu
+// an element-wise job this size is a few tens of microseconds on the cpu, about what a submit + fence wait costs
+// measure the crossover on a machine with 'vulkan_compute_bench kernels=fma,fma_cpu'
+constexpr u64 CPU_BACKEND_MAX_ELEMENTS = 1u << 18;
+
+
+/// <summary>
+/// start the worker threads, 'num_threads' = 0 uses one per hardware thread (the caller's thread works too)
+/// without this the kernels still run, on the caller's thread only
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_cpu_compute (u32 num_threads = 0u);
+
+/// <summary>
+/// the simd level the kernels use, detected once
+/// </summary>
+cpu_simd_level get_cpu_simd_level ();
+char const* get_cpu_simd_level_name (cpu_simd_level level);
+
+/// <summary>
+/// resolve 'automatic' to the cpu or gpu for a job of 'num_elements'
+/// </summary>
+compute_backend choose_compute_backend (compute_backend requested, u64 num_elements);
+
+/// <summary>
+/// out [i] = (a [i] * multiplier) + b [i], as vulkan_compute_buffer.comp
+/// 'out' may alias 'a' or 'b', blocks until done
+/// not re-entrant, call from one thread at a time
+/// </summary>
+void run_cpu_fma (f32 const* a, f32 const* b, f32 multiplier,
+  f32* out, u64 num_elements);
+
+/// <summary>
+/// c = a * b, row major, a is m x k, b is k x n, c is m x n, as vulkan_gemm.comp
+/// cache blocked and split across the workers by rows of c, 'c' must not alias 'a' or 'b', blocks until done
+/// not re-entrant, call from one thread at a time
+/// </summary>
+void run_cpu_gemm (f32 const* a, f32 const* b, f32* c,
+  u32 m, u32 n, u32 k);
+
+/// <summary>
+/// count the elements of 'actual' further than 'relative_tolerance' from 'expected'
+/// non finite 'expected' values must match exactly
+/// </summary>
+u64 count_cpu_mismatches (f32 const* expected, f32 const* actual, u64 num_elements,
+  f32 relative_tolerance = 1e-5f);
+
+/// <summary>
+/// join the worker threads, also done at exit if it wasn't called, calling it again does nothing
+/// </summary>
+void release_cpu_compute ();
@@ -1,6 +1,6 @@
 #include "maths.h"
 
-#include <cmath>   // for std::sqrtf
+#include <cmath>   // for std::sqrt
 #include <limits>  // for std::numeric_limits <T>::epsilon
 
 
@@ -36,7 +36,7 @@ f32 vec2_magnitude_squared (vec2 const& a)
 }
 f32 vec2_magnitude (vec2 const& a)
 {
-  return std::sqrtf (vec2_magnitude_squared (a));
+  return std::sqrt (vec2_magnitude_squared (a));
 }
 
 f32 vec2_distance_squared (vec2 const& a, vec2 const& b)
@@ -4,9 +4,11 @@
 #include <glm/gtc/matrix_transform.hpp> // for glm::ortho...
 
 
+using u8 = glm::u8;
 using u16 = glm::u16;
 using i32 = glm::i32;
 using u32 = glm::u32;
+using u64 = glm::u64;
 using f32 = glm::f32;
 using vec2 = glm::vec2;
 using uvec2 = glm::uvec2;
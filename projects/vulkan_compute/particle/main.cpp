@@ -84,28 +84,30 @@
 //      |   mesh_sprite:
 //      |     1 x vertex buffer (xy = position, uv = tex coords)
 //      |     1 x index buffer (16bit uint)
-//      | 6) create vulkan command buffer
+//      | 6) create vulkan command buffers (1 per frame in flight)
 //      | 7) create vulkan sync objects
-//      |   1 x semaphore
-//      |   1 x fence
+//      |   2 x semaphore per frame in flight (swapchain image available, render finished)
+//      |   1 x timeline semaphore (timeline_frame, signalled with the frame number by each draw)
 
 // GRAPHICS RENDER
 //      | GAME LOOP
 //      | 01) process os messages
 //      |   check glfw if window should close
 //      |   poll glfw input events
+//      |   wait for 'timeline_frame' to reach this frame number - NUM_FRAMES_IN_FLIGHT (the last frame to use these resources)
 //      |   UPDATE
 //      |   RENDER
 //      |   02) acquire next swapchain image
 //      |     sets 'swapchain_image_available_semaphore' semaphore which is triggered when an available presentable image (back buffer) is ready to use
 //      |   03) reset command buffer
 //      |   04) begin command buffer
+//      |     acquire this frame's render copy of the positions from compute (only when the queue families differ)
 //      |   05) begin render pass
 //      |   06) bind pipeline
 //      | -----------------
 //      |     07) bind vertex buffer
 //      |     08) bind index buffer
-//      |     09) bind desc_set_0_graphics_input
+//      |     09) bind desc_set_0_graphics_input (of this frame's render copy)
 //      |     10) bind desc_set_1_graphics_input
 //      |     11) draw indexed
 //      |       draw 'input' image on left
@@ -116,12 +118,14 @@
 //      |       draw 'output' image on right
 //      | -----------------
 //      |   17) end render pass
+//      |     release this frame's render copy back to compute (only when the queue families differ)
 //      |   18) end command buffer
-//      |   19) reset fence
-//      |   20) submit
-//      |     wait on 'swapchain_image_available_semaphore' semaphore
-//      |   21) wait for submit to complete (via fence)
-//      |   22) present
+//      |   19) submit
+//      |     wait on 'swapchain_image_available_semaphore' semaphore + 'timeline_step' (this frame's step)
+//      |     signal 'render_finished_semaphore' semaphore + 'timeline_frame' (this frame number)
+//      |   20) present
+//      |     wait on 'render_finished_semaphore' semaphore
+//      |   21) move on to the next frame in flight
 
 // RELEASE
 //      | 1) release graphics pipeline
@@ -134,11 +138,20 @@
 #include "../vulkan_context.h"
 #include "../vulkan_pipeline.h"
 #include "../vulkan_resources.h"
+#include "../vulkan_memory.h"
+#include "../vulkan_upload.h"
+#include "../vulkan_autotune.h"
+#include "../vulkan_trace.h"
 
+#include <algorithm>              // for std::min, std::max
 #include <array>                  // for std::array
-#include <cmath>                  // for std::ceilf
+#include <cmath>                  // for std::ceilf, std::sqrt
+#include <cstdlib>                // for std::strtoul, std::strtof
 #include <span>                   // for std::span
 #include <random>                 // for rng.
+#include <sstream>                // for std::istringstream
+#include <string>                 // for std::string
+#include <vector>                 // for std::vector
 
 #define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
 #include <vulkan/vulkan.h>        // for everything vulkan
@@ -149,71 +162,239 @@
 static constexpr unsigned int ApproxCeilIntCast(float in) { return static_cast<unsigned int>(in - 0.00001f) + 1; }
 static constexpr unsigned int IntCeilDiv(unsigned int numerator, unsigned int denominator) { return ((numerator - 1u) / denominator) + 1u; }
 
+// hands 'buffer' from one queue family to another
+// recorded twice: as the release on the 'src_family' queue, then as the acquire on the 'dst_family' queue
+static VkBufferMemoryBarrier ownership_barrier(VkBuffer buffer,
+    VkAccessFlags src_access, VkAccessFlags dst_access,
+    u32 src_family, u32 dst_family)
+{
+    return VkBufferMemoryBarrier
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      //.pNext = VK_NULL_HANDLE,
+      .srcAccessMask = src_access, // ignored by the acquire
+      .dstAccessMask = dst_access, // ignored by the release
+      .srcQueueFamilyIndex = src_family,
+      .dstQueueFamilyIndex = dst_family,
+      .buffer = buffer,
+      .offset = 0u,
+      .size = VK_WHOLE_SIZE
+    };
+}
+
 constexpr char const* WINDOW_TITLE = "vulkan_compute_collision";
 constexpr char const* COMPILED_COMPUTE_SHADER_PATH_PARTICLE = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_particle.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_COUNT = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_count.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scan.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_BLOCKS = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scan_blocks.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_ADD = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scan_add.comp.spv";
+constexpr char const* COMPILED_COMPUTE_SHADER_PATH_GRID_SCATTER = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_grid_scatter.comp.spv";
 constexpr char const* COMPILED_COMPUTE_SHADER_PATH_COLLISION = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_collision.comp.spv";
-constexpr char const* COMPILED_COMPUTE_SHADER_PATH_COMMUNICATION = "data/shaders/glsl/vulkan_compute_collision/vulkan_compute_communication.comp.spv";
 constexpr char const* COMPILED_GRAPHICS_SHADER_PATH_VERT = "data/shaders/glsl/vulkan_compute_collision/sprite.vert.spv";
 constexpr char const* COMPILED_GRAPHICS_SHADER_PATH_FRAG = "data/shaders/glsl/vulkan_compute_collision/sprite.frag.spv";
 
 constexpr char const* TEXTURE_PATH = "data/textures/Particle.png";
 constexpr unsigned int PARTICLE_TEXTURE_SIZE = 8u;
 
-constexpr unsigned int NUM_PARTICLES = 1u << 8u;
-
-constexpr unsigned int NUM_THREAD_GROUPS_COMPUTE_PARTICLES = 1u;
-constexpr unsigned int WARP_WIDTH = 32u;
 constexpr unsigned int DATA_SIZE = sizeof(u32);
-constexpr unsigned int THREAD_GROUP_SIZE_COMPUTE_PARTICLE = IntCeilDiv((NUM_PARTICLES), (NUM_THREAD_GROUPS_COMPUTE_PARTICLES));
-constexpr unsigned int NUM_PARTICLES_PER_CORE = IntCeilDiv((THREAD_GROUP_SIZE_COMPUTE_PARTICLE), (WARP_WIDTH));
+constexpr unsigned int DEFAULT_PARTICLE_GROUP_SIZE = 256u; // unless the config sets one, or this device has been tuned
+constexpr char const* AUTOTUNE_KERNEL_NAME = "vulkan_compute_particle.collision";
 
-constexpr int BOUNDS_X = -29, BOUNDS_Y = -16;
-constexpr unsigned int BOUNDS_WIDTH = 58u, BOUNDS_HEIGHT = 32u;
-constexpr float MAX_PARTICLE_SPEED = 1.f / (1u << 6u);
 constexpr float PARTICLE_SCALE = static_cast<float>(1u << 2u) / (1u << 0u);
 constexpr float DRAW_SCALING = 5.4f;
 constexpr float PARTICLE_SIZE = PARTICLE_TEXTURE_SIZE * PARTICLE_SCALE / DRAW_SCALING;
 
-constexpr unsigned int NUM_TEMP_BUCKETS_X = 5u, NUM_TEMP_BUCKETS_Y = 3u;
-constexpr unsigned int TEMP_BUCKET_SIZE = (NUM_PARTICLES_PER_CORE + 1) * WARP_WIDTH * NUM_THREAD_GROUPS_COMPUTE_PARTICLES;
+constexpr unsigned int BASE_NUM_PARTICLES = 1u << 8u; // number of particles the base bounds were tuned for
+constexpr float BASE_BOUNDS_WIDTH = 58.f, BASE_BOUNDS_HEIGHT = 32.f;
+
+// simulation parameters, so one binary can sweep problem sizes without a recompile
+// the defaults below are overridden by 'key=value' pairs, first from a config file ('config=path' on the command line,
+// one pair per line, '#' starts a comment) then from the rest of the command line
+// e.g. vulkan_compute_particle.exe num_particles=1048576 num_frames=1000
+struct particle_config
+{
+    // set by the user
+    u32 num_particles = BASE_NUM_PARTICLES; // scales to millions (1u << 20u .. 1u << 24u)
+    f32 bounds_width = 0.f;                 // 0 = the base bounds, grown to keep the density (and so the particles per grid cell) constant
+    f32 bounds_height = 0.f;
+    f32 particle_radius = PARTICLE_SIZE;
+    f32 max_particle_speed = 1.f / (1u << 6u);
+    f32 deltatime = 0.5f;
+    u32 num_frames = 0u;                    // 0 = run until the window is closed, otherwise quit after this many frames
+    u32 autotune = 0u;                      // 1 = time the collide shader with each candidate 'particle_group_size', save the winner for this device and quit
+    u32 particle_group_size = 0u;           // work group size of every per particle shader (integrate, grid count/scatter, collide), 0 = autotuned or 256
+    u32 scan_block_size = 256u;             // work group size of the grid scan shaders, cells per block
+    std::string trace_path;                 // not empty = record a cpu/gpu timeline of the run, open it in https://ui.perfetto.dev
+
+    // derived by 'derive_particle_config', everything below is sized from these
+    // uniform grid for the collision broad phase, built every step by counting sort (count -> prefix sum -> scatter)
+    // cells are one collision distance (2 x radius) wide, so a particle can only touch particles in its own and the 8 neighbouring cells
+    // no per cell capacity, grid memory is 2 x u32 per cell (+ 1 per block of cells) + 24 bytes per particle
+    f32 bounds_x = 0.f, bounds_y = 0.f; // origin, the bounds are centred on the screen
+    f32 cell_dim = 0.f;
+    u32 num_cells_x = 0u, num_cells_y = 0u, num_cells = 0u;
+    u32 num_cell_blocks = 0u;              // blocks of 'scan_block_size' cells
+    u32 num_thread_groups_particles = 0u;  // groups of 'particle_group_size' particles
+};
+
+// apply one 'key=value' pair, false if the key is unknown or the value doesn't parse
+static bool set_particle_config_value(std::string const& key, std::string const& value,
+    particle_config& config)
+{
+    char* end = nullptr;
+    auto const as_u32 = [&](u32& out) { out = (u32)std::strtoul(value.c_str(), &end, 0); };
+    auto const as_f32 = [&](f32& out) { out = std::strtof(value.c_str(), &end); };
+
+    if (key == "trace")
+    {
+        config.trace_path = value;
+        return DBG_ASSERT_MSG(!value.empty(), "particle config key 'trace' needs a path\n");
+    }
+
+    if (key == "num_particles") as_u32(config.num_particles);
+    else if (key == "bounds_width") as_f32(config.bounds_width);
+    else if (key == "bounds_height") as_f32(config.bounds_height);
+    else if (key == "particle_radius") as_f32(config.particle_radius);
+    else if (key == "max_particle_speed") as_f32(config.max_particle_speed);
+    else if (key == "deltatime") as_f32(config.deltatime);
+    else if (key == "num_frames") as_u32(config.num_frames);
+    else if (key == "autotune") as_u32(config.autotune);
+    else if (key == "particle_group_size") as_u32(config.particle_group_size);
+    else if (key == "scan_block_size") as_u32(config.scan_block_size);
+    else
+    {
+        return DBG_ASSERT_MSG(false, "unknown particle config key '%s'\n", key.c_str());
+    }
+
+    if (end == value.c_str() || *end != '\0')
+    {
+        return DBG_ASSERT_MSG(false, "bad value '%s' for particle config key '%s'\n", value.c_str(), key.c_str());
+    }
+    return true;
+}
+
+// apply every whitespace separated 'key=value' pair in 'text', '#' comments out the rest of the line
+// 'config=path' loads a config file (same format) in place
+static bool parse_particle_config(char const* text,
+    particle_config& config)
+{
+    std::istringstream lines(text ? text : "");
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        line = line.substr(0u, line.find('#'));
+
+        std::istringstream tokens(line);
+        std::string token;
+        while (tokens >> token)
+        {
+            size_t const equals = token.find('=');
+            if (equals == std::string::npos)
+            {
+                return DBG_ASSERT_MSG(false, "expected key=value, got '%s'\n", token.c_str());
+            }
+            std::string const key = token.substr(0u, equals), value = token.substr(equals + 1u);
+
+            if (key == "config")
+            {
+                std::vector <char> file;
+                if (!read_file(value.c_str(), file))
+                {
+                    return DBG_ASSERT_MSG(false, "unable to open particle config '%s'\n", value.c_str());
+                }
+                file.push_back('\0');
+                if (!parse_particle_config(file.data(), config))
+                {
+                    return false;
+                }
+            }
+            else if (!set_particle_config_value(key, value, config))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
 
-constexpr float BUCKET_DIM = PARTICLE_SIZE * 1.f;
-constexpr unsigned int NUM_BUCKETS_X = ApproxCeilIntCast(BOUNDS_WIDTH / BUCKET_DIM), NUM_BUCKETS_Y = ApproxCeilIntCast(BOUNDS_HEIGHT / BUCKET_DIM);
-constexpr unsigned int MAX_PARTICLES_PER_BUCKET = 8u;
-constexpr unsigned int BUCKET_SIZE = MAX_PARTICLES_PER_BUCKET + 1u;
+// work out the bounds, grid and dispatch sizes from the user parameters
+// work group sizes are clamped to what the device supports, the shaders pick them up as specialization constants
+static bool derive_particle_config(VkPhysicalDevice physical_device,
+    particle_config& config)
+{
+    DBG_ASSERT(CHECK_VULKAN_HANDLE(physical_device));
 
-constexpr unsigned int NUM_BUCKETS_PER_TEMP_BUCKET_X = IntCeilDiv(NUM_BUCKETS_X, NUM_TEMP_BUCKETS_X);
-constexpr unsigned int NUM_BUCKETS_PER_TEMP_BUCKET_Y = IntCeilDiv(NUM_BUCKETS_Y, NUM_TEMP_BUCKETS_Y);
-constexpr float TEMP_BUCKET_DIM_X = BUCKET_DIM * NUM_BUCKETS_PER_TEMP_BUCKET_X, TEMP_BUCKET_DIM_Y = BUCKET_DIM * NUM_BUCKETS_PER_TEMP_BUCKET_Y;
+    if (config.num_particles == 0u || config.particle_radius <= 0.f || config.bounds_width < 0.f || config.bounds_height < 0.f ||
+        config.scan_block_size == 0u)
+    {
+        return DBG_ASSERT_MSG(false, "particle config needs particles, a radius, a scan block size and non negative bounds\n");
+    }
 
-constexpr unsigned int FINAL_BUCKET_COUNT_X = NUM_BUCKETS_PER_TEMP_BUCKET_X * NUM_TEMP_BUCKETS_X;
-constexpr unsigned int FINAL_BUCKET_COUNT_Y = NUM_BUCKETS_PER_TEMP_BUCKET_Y * NUM_TEMP_BUCKETS_Y;
+    // not set by the user, so whatever won the last tuning run on this device
+    if (config.particle_group_size == 0u)
+    {
+        vulkan_workgroup_size tuned_size = { .x = DEFAULT_PARTICLE_GROUP_SIZE };
+        find_vulkan_workgroup_size(AUTOTUNE_KERNEL_NAME, tuned_size);
+        config.particle_group_size = tuned_size.x;
+    }
 
-constexpr unsigned int TEMP_BUCKET_BUFFER_SIZE = TEMP_BUCKET_SIZE * NUM_TEMP_BUCKETS_X * NUM_TEMP_BUCKETS_Y * DATA_SIZE;
-constexpr unsigned int BUCKET_BUFFER_SIZE = BUCKET_SIZE * FINAL_BUCKET_COUNT_X * FINAL_BUCKET_COUNT_Y * DATA_SIZE;
+    VkPhysicalDeviceProperties properties = {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    u32 const max_group_size = std::min(properties.limits.maxComputeWorkGroupSize[0], properties.limits.maxComputeWorkGroupInvocations);
+    config.particle_group_size = std::min(config.particle_group_size, max_group_size);
+    config.scan_block_size = std::min(config.scan_block_size, max_group_size);
 
-constexpr unsigned int COLLISION_THREADS_X = IntCeilDiv(FINAL_BUCKET_COUNT_X, 8u), COLLISION_THREADS_Y = IntCeilDiv(FINAL_BUCKET_COUNT_Y, 16u);
+    if (config.bounds_width == 0.f || config.bounds_height == 0.f)
+    {
+        f32 const bounds_scale = std::max(std::sqrt((f32)config.num_particles / (f32)BASE_NUM_PARTICLES), 1.f);
+        config.bounds_width = config.bounds_width == 0.f ? BASE_BOUNDS_WIDTH * bounds_scale : config.bounds_width;
+        config.bounds_height = config.bounds_height == 0.f ? BASE_BOUNDS_HEIGHT * bounds_scale : config.bounds_height;
+    }
+    config.bounds_x = -config.bounds_width / 2.f;
+    config.bounds_y = -config.bounds_height / 2.f;
+
+    config.cell_dim = config.particle_radius * 2.f;
+    config.num_cells_x = ApproxCeilIntCast(config.bounds_width / config.cell_dim);
+    config.num_cells_y = ApproxCeilIntCast(config.bounds_height / config.cell_dim);
+    config.num_cells = config.num_cells_x * config.num_cells_y;
+    config.num_cell_blocks = IntCeilDiv(config.num_cells, config.scan_block_size);
+    config.num_thread_groups_particles = IntCeilDiv(config.num_particles, config.particle_group_size);
+
+    dprintf("particles: %u in %.1f x %.1f, grid: %u x %u cells, groups: %u particles, %u cells\n",
+        config.num_particles, config.bounds_width, config.bounds_height, config.num_cells_x, config.num_cells_y,
+        config.particle_group_size, config.scan_block_size);
+    return true;
+}
 
 struct compute_UBO_info_buffer
 {
     u32 num_particles;
-    f32 bounds[4u];
-    u32 bucketNums[4u];
-    f32 bucketDims[3u];
-    f32 Particle_radius;
-    u32 bucketSlots[2u];
+    f32 bounds[4u]; // origin x, origin y, width, height
+    u32 num_cells[2u];
+    f32 cell_dim;
+    f32 particle_radius;
 };
 
-struct compute_push_constants
+struct compute_UBO_step_buffer
 {
     f32 deltatime;
 };
 
 int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   _In_opt_ HINSTANCE/* hPrevInstance*/,
-  _In_ LPSTR/* lpCmdLine*/,
+  _In_ LPSTR lpCmdLine,
   _In_ int/* nShowCmd*/)
 {
+  // CONFIG
+
+  particle_config config;
+  if (!parse_particle_config(lpCmdLine, config))
+  {
+    DBG_ASSERT (false);
+    return -1;
+  }
+
+
   // CONTEXT
 
   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
@@ -222,6 +403,8 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   VkRenderPass render_pass = VK_NULL_HANDLE;
 
   VkQueue queue_compute = VK_NULL_HANDLE, queue_graphics = VK_NULL_HANDLE;
+  u32 family_compute = {}, family_graphics = {};
+  bool needs_ownership_transfer = false; // exclusive buffers shared by both queues must be handed over when their families differ
 
   // create window, vulkan instance & device etc
   {
@@ -252,9 +435,21 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
   }
+  // create the libraries on top of the device
+  {
+    if (!create_vulkan_pipeline_cache (physical_device, device,
+        VULKAN_PIPELINE_CACHE_PATH, has_vulkan_pipeline_creation_feedback ()) ||
+      !create_vulkan_autotuner (physical_device, VULKAN_AUTOTUNE_PATH) ||
+      !create_vulkan_profiler (physical_device, device, has_vulkan_pipeline_statistics ()))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
   // get vulkan queues
+  // the simulation runs on the async compute queue, so it can overlap rendering
   {
-    if (!get_vulkan_queue_compute (queue_compute))
+    if (!get_vulkan_queue_async_compute (queue_compute))
     {
       DBG_ASSERT (false);
       return -1;
@@ -264,6 +459,22 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       DBG_ASSERT (false);
       return -1;
     }
+    if (!get_vulkan_queue_family_index (queue_compute, family_compute) ||
+      !get_vulkan_queue_family_index (queue_graphics, family_graphics))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+    needs_ownership_transfer = family_compute != family_graphics;
+  }
+  // size everything from the config, now we know the device limits
+  {
+    if (!derive_particle_config (physical_device,
+      config))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
   }
 
 
@@ -277,7 +488,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   constexpr u32 BINDING_ID_SET_0_X_VELOCITY = 2u;
   constexpr u32 BINDING_ID_SET_0_Y_VELOCITY = 3u;
   constexpr u32 BINDING_ID_SET_0_INFO       = 4u;
-  constexpr u32 BINDING_ID_SET_0_TEMP_BUCKETS = 5u;
+  constexpr u32 BINDING_ID_SET_0_STEP       = 5u;
 
   std::array <VkDescriptorSetLayout, NUM_SETS_COMPUTE> descriptor_set_layouts_compute = { VK_NULL_HANDLE };
   VkPipelineLayout pipeline_layout_compute = VK_NULL_HANDLE;
@@ -286,12 +497,20 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   VkDescriptorPool descriptor_pool_compute = VK_NULL_HANDLE;
   vulkan_descriptor_set desc_set_0_compute; // for compute, X,Y - Pos,Vel
 
-  vulkan_buffer buffer_pos_x, buffer_pos_y, buffer_vel_x, buffer_vel_y, buffer_info, buffer_bucket_temp;
+  vulkan_buffer buffer_pos_x, buffer_pos_y, buffer_vel_x, buffer_vel_y, buffer_info;
+  vulkan_buffer buffer_step; // per frame parameters, 1 slice per frame in flight, written through its persistent mapping
+
+  // ping-pong copies of the positions for graphics to draw, the step for frame n writes copy n (one per frame in flight)
+  // so the next step can integrate/build the grid/collide while this one is drawn, only its final copy waits for the draw
+  constexpr u32 NUM_PARTICLE_STATES = NUM_FRAMES_IN_FLIGHT;
+  std::array <vulkan_buffer, NUM_PARTICLE_STATES> buffers_render_pos_x, buffers_render_pos_y;
+  VkDeviceSize step_slice_size = {}; // 'compute_UBO_step_buffer' padded to 'minUniformBufferOffsetAlignment'
 
   VkCommandPool command_pool_compute = VK_NULL_HANDLE;
-  VkCommandBuffer command_buffer_compute = VK_NULL_HANDLE;
+  // whole simulation step: integrate -> grid count/scan/scatter -> collide, recorded once per frame in flight (they differ by step slice)
+  std::array <VkCommandBuffer, NUM_FRAMES_IN_FLIGHT> command_buffers_compute = { VK_NULL_HANDLE };
 
-  VkFence fence_compute = VK_NULL_HANDLE;
+  vulkan_timeline timeline_step; // signalled with the frame number when that frame's step is done, graphics waits on it
 
 
   // create compute pipeline
@@ -301,28 +520,28 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     {
       VkDescriptorSetLayoutBinding {
         .binding = BINDING_ID_SET_0_X_POSITION,          // at binding point 0 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (X_pos[NUM_PARTICLES])
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (X_pos[num_particles])
         .descriptorCount = 1u,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .pImmutableSamplers = VK_NULL_HANDLE
       },
       VkDescriptorSetLayoutBinding {
         .binding = BINDING_ID_SET_0_Y_POSITION,         // at binding point 1 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_pos[NUM_PARTICLES])
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_pos[num_particles])
         .descriptorCount = 1u,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .pImmutableSamplers = VK_NULL_HANDLE
       },
       VkDescriptorSetLayoutBinding {
         .binding = BINDING_ID_SET_0_X_VELOCITY,         // at binding point 2 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (X_vel[NUM_PARTICLES])
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (X_vel[num_particles])
         .descriptorCount = 1u,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .pImmutableSamplers = VK_NULL_HANDLE
       },
       VkDescriptorSetLayoutBinding {
         .binding = BINDING_ID_SET_0_Y_VELOCITY,         // at binding point 3 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_vel[NUM_PARTICLES])
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_vel[num_particles])
         .descriptorCount = 1u,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .pImmutableSamplers = VK_NULL_HANDLE
@@ -335,8 +554,8 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
         .pImmutableSamplers = VK_NULL_HANDLE
       },
       VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_TEMP_BUCKETS,       // at binding point 5 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // yet another storage buffer
+        .binding = BINDING_ID_SET_0_STEP,               // at binding point 5 we have
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, // a uniform buffer (deltatime), offset to this frame's slice when bound
         .descriptorCount = 1u,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .pImmutableSamplers = VK_NULL_HANDLE
@@ -357,19 +576,10 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
 
-    // describe push constants structure
-    VkPushConstantRange const push_constant_ranges[] =
-    {
-      {
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .offset = 0u,
-        .size = sizeof(compute_push_constants)
-      }
-    };
-
+    // no push constants, deltatime lives in 'buffer_step' so the command buffer can be recorded once
     if (!create_vulkan_pipeline_layout (device,
       descriptor_set_layouts_compute.size (), descriptor_set_layouts_compute.data (),
-      1u, push_constant_ranges,
+      0u, VK_NULL_HANDLE,
       pipeline_layout_compute))
     {
       DBG_ASSERT (false);
@@ -386,10 +596,19 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
 
+    // work group size is picked at pipeline creation, see 'particle_config'
+    vulkan_specialization specialization_compute = {};
+    if (!set_vulkan_specialization_constant (specialization_compute, 0u, config.particle_group_size))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+
     if (!create_vulkan_pipeline_compute (device,
       shader_module_compute, "main",
       pipeline_layout_compute,
-      pipeline_compute))
+      pipeline_compute,
+      &specialization_compute))
     {
       DBG_ASSERT (false);
       return -1;
@@ -404,16 +623,20 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     //
     // we could have multiple descriptor pools, or one huge one
     // we are going to have one per pipeline in order to keep it simple
-    std::array <VkDescriptorPoolSize, 2u> const pool_sizes =
+    std::array <VkDescriptorPoolSize, 3u> const pool_sizes =
     {{ // yes this is deliberate!
       {
         // we have 1 x descriptor set that consists of 4 x 'storage buffer' descriptors
         .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .descriptorCount = 5u
+        .descriptorCount = 4u
       },
       {
         .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
         .descriptorCount = 1u
+      },
+      {
+        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .descriptorCount = 1u
       }
       // if you also needed n uniform buffer descriptors you would need to create a new VkDescriptorPoolSize here
     }};
@@ -445,44 +668,45 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     }
   }
   // create compute resources
+  // the particle state is device local, every step reads and writes all of it (host visible memory would be read over the bus)
   {
       {
 
           if (!create_vulkan_buffer(physical_device, device,
-              NUM_PARTICLES * DATA_SIZE,
-              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+              (VkDeviceSize)config.num_particles * DATA_SIZE,
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // copied to the render copy every step
               VK_SHARING_MODE_EXCLUSIVE,
-              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
               buffer_pos_x))
           {
               DBG_ASSERT(false);
               return -1;
           }
           if (!create_vulkan_buffer(physical_device, device,
-              NUM_PARTICLES * DATA_SIZE,
-              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+              (VkDeviceSize)config.num_particles * DATA_SIZE,
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // copied to the render copy every step
               VK_SHARING_MODE_EXCLUSIVE,
-              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
               buffer_pos_y))
           {
               DBG_ASSERT(false);
               return -1;
           }
           if (!create_vulkan_buffer(physical_device, device,
-              NUM_PARTICLES * DATA_SIZE,
-              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+              (VkDeviceSize)config.num_particles * DATA_SIZE,
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
               VK_SHARING_MODE_EXCLUSIVE,
-              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
               buffer_vel_x))
           {
               DBG_ASSERT(false);
               return -1;
           }
           if (!create_vulkan_buffer(physical_device, device,
-              NUM_PARTICLES * DATA_SIZE,
-              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+              (VkDeviceSize)config.num_particles * DATA_SIZE,
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
               VK_SHARING_MODE_EXCLUSIVE,
-              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
               buffer_vel_y))
           {
               DBG_ASSERT(false);
@@ -498,16 +722,48 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
               DBG_ASSERT(false);
               return -1;
           }
+
+          // 1 slice per frame in flight, so the cpu never writes a slice the gpu may still be reading
+          VkPhysicalDeviceProperties device_properties = {};
+          vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+          VkDeviceSize const alignment = device_properties.limits.minUniformBufferOffsetAlignment;
+          step_slice_size = ((sizeof(compute_UBO_step_buffer) + alignment - 1u) / alignment) * alignment;
+
           if (!create_vulkan_buffer(physical_device, device,
-              TEMP_BUCKET_BUFFER_SIZE,
-              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+              step_slice_size * NUM_FRAMES_IN_FLIGHT,
+              VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
               VK_SHARING_MODE_EXCLUSIVE,
               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-              buffer_bucket_temp))
+              buffer_step))
           {
               DBG_ASSERT(false);
               return -1;
           }
+
+          // only ever touched by the gpu, written by a copy at the end of each step and read by the vertex shader
+          for (u32 state = 0u; state < NUM_PARTICLE_STATES; ++state)
+          {
+              if (!create_vulkan_buffer(physical_device, device,
+                  (VkDeviceSize)config.num_particles * DATA_SIZE,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_SHARING_MODE_EXCLUSIVE,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  buffers_render_pos_x[state]))
+              {
+                  DBG_ASSERT(false);
+                  return -1;
+              }
+              if (!create_vulkan_buffer(physical_device, device,
+                  (VkDeviceSize)config.num_particles * DATA_SIZE,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_SHARING_MODE_EXCLUSIVE,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  buffers_render_pos_y[state]))
+              {
+                  DBG_ASSERT(false);
+                  return -1;
+              }
+          }
       }
 
     // needs to have the exact same size as texture_compute_input
@@ -547,9 +803,9 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           .range = VK_WHOLE_SIZE
         },
         {
-          .buffer = buffer_bucket_temp.buffer,
+          .buffer = buffer_step.buffer,
           .offset = 0u,
-          .range = VK_WHOLE_SIZE
+          .range = sizeof(compute_UBO_step_buffer) // one slice, the dynamic offset picks which
         }
       };
 
@@ -625,10 +881,10 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
           //.pNext = VK_NULL_HANDLE,
           .dstSet = desc_set_0_compute.desc_set,
-          .dstBinding = BINDING_ID_SET_0_TEMP_BUCKETS,
+          .dstBinding = BINDING_ID_SET_0_STEP,
           .dstArrayElement = 0u,
           .descriptorCount = 1u,
-          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+          .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
           .pImageInfo = VK_NULL_HANDLE,
           .pBufferInfo = &buffer_infos[5],
           .pTexelBufferView = VK_NULL_HANDLE
@@ -643,21 +899,21 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   }
   // create compute command buffers
   {
-    if (!create_vulkan_command_pool (VK_QUEUE_COMPUTE_BIT, command_pool_compute))
+    if (!create_vulkan_command_pool_for_queue (queue_compute, command_pool_compute))
     {
       DBG_ASSERT (false);
       return -1;
     }
-    if (!create_vulkan_command_buffers (1u, command_pool_compute, &command_buffer_compute))
+    if (!create_vulkan_command_buffers (NUM_FRAMES_IN_FLIGHT, command_pool_compute, command_buffers_compute.data ()))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
   // create compute sync objects
-  // at least one per submit (can be reused if in loop)
+  // no fence, the graphics submit waits on the timeline and the cpu only ever waits on 'timeline_frame'
   {
-    if (!create_vulkan_fences (1u, 0u, &fence_compute))
+    if (!create_vulkan_timelines (1u, 0u, &timeline_step))
     {
       DBG_ASSERT (false);
       return -1;
@@ -666,87 +922,96 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
 
   // SET INPUT/INFO BUFFERS
+  // the initial state is generated in to a staging buffer and copied on the compute queue, which then owns the buffers
+  // (the upload batcher runs on the general compute queue, which may be a different family to 'queue_compute')
   {
       std::random_device rd;
       std::ranlux24_base re(rd()); // std::default_engine (std::mersenne_twister_engine) uses 5K bytes on the stack!!!
-      std::uniform_real_distribution <f32> X_Pos_Dist(0.f, BOUNDS_WIDTH);
-      std::uniform_real_distribution <f32> Y_Pos_Dist(0.f, BOUNDS_HEIGHT);
-      std::uniform_real_distribution <f32> Vel_Dist(-MAX_PARTICLE_SPEED, MAX_PARTICLE_SPEED);
+      std::uniform_real_distribution <f32> X_Pos_Dist(0.f, config.bounds_width);
+      std::uniform_real_distribution <f32> Y_Pos_Dist(0.f, config.bounds_height);
+      std::uniform_real_distribution <f32> Vel_Dist(-config.max_particle_speed, config.max_particle_speed);
 
+      u32 const num_particles = config.num_particles;
+      VkDeviceSize const STATE_SIZE = (VkDeviceSize)num_particles * DATA_SIZE; // one of pos x, pos y, vel x, vel y
+      vulkan_buffer buffer_staging;
+      if (!create_vulkan_buffer(physical_device, device,
+          STATE_SIZE * 4u,
+          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+          VK_SHARING_MODE_EXCLUSIVE,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+          buffer_staging))
+      {
+          DBG_ASSERT(false);
+          return -1;
+      }
       if (!map_and_unmap_memory(device,
-          buffer_pos_x.memory, [&re, &X_Pos_Dist](void* mapped_memory)
+          buffer_staging.allocation, [&](void* mapped_memory)
           {
               f32* data = (f32*)mapped_memory;
-              for (u32 i = 0u; i < NUM_PARTICLES; ++i)
+              for (u32 i = 0u; i < num_particles; ++i)
               {
                   data[i] = X_Pos_Dist(re);
+                  data[num_particles + i] = Y_Pos_Dist(re);
+                  data[(size_t)num_particles * 2u + i] = Vel_Dist(re);
+                  data[(size_t)num_particles * 3u + i] = Vel_Dist(re);
               }
           }))
       {
           DBG_ASSERT(false);
           return -1;
       }
-      if (!map_and_unmap_memory(device,
-          buffer_pos_y.memory, [&re, &Y_Pos_Dist](void* mapped_memory)
-          {
-              f32* data = (f32*)mapped_memory;
-              for (u32 i = 0u; i < NUM_PARTICLES; ++i)
-              {
-                  data[i] = Y_Pos_Dist(re);
-              }
-          }))
+
+      // one off, borrow the first compute command buffer before it is recorded for real
+      VkCommandBuffer const command_buffer_compute = command_buffers_compute[0];
+      if (!begin_command_buffer(command_buffer_compute, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
       {
           DBG_ASSERT(false);
           return -1;
       }
-      if (!map_and_unmap_memory(device,
-          buffer_vel_x.memory, [&re, &Vel_Dist](void* mapped_memory)
+      VkBuffer const state_buffers[] = { buffer_pos_x.buffer, buffer_pos_y.buffer, buffer_vel_x.buffer, buffer_vel_y.buffer };
+      for (u32 state = 0u; state < 4u; ++state)
+      {
+          VkBufferCopy const region =
           {
-              f32* data = (f32*)mapped_memory;
-              for (u32 i = 0u; i < NUM_PARTICLES; ++i)
-              {
-                  data[i] =  Vel_Dist(re);
-              }
-          }))
+            .srcOffset = STATE_SIZE * state,
+            .dstOffset = 0u,
+            .size = STATE_SIZE
+          };
+          vkCmdCopyBuffer(command_buffer_compute, buffer_staging.buffer, state_buffers[state], 1u, &region);
+      }
+      if (!end_command_buffer(command_buffer_compute))
       {
           DBG_ASSERT(false);
           return -1;
       }
-      if (!map_and_unmap_memory(device,
-          buffer_vel_y.memory, [&re, &Vel_Dist](void* mapped_memory)
-          {
-              f32* data = (f32*)mapped_memory;
-              for (u32 i = 0u; i < NUM_PARTICLES; ++i)
-              {
-                  data[i] =  Vel_Dist(re);
-              }
-          }))
+
+      // wait here, the staging buffer is released straight after
+      // the first step is a later submit on the same queue, and starts with a transfer -> compute barrier
+      if (!submit_vulkan_command_buffers(queue_compute,
+          1u, &command_buffer_compute,
+          0u, VK_NULL_HANDLE,
+          0u, VK_NULL_HANDLE) ||
+          !CHECK_VULKAN_RESULT(vkQueueWaitIdle(queue_compute)))
       {
           DBG_ASSERT(false);
           return -1;
       }
+      release_vulkan_buffer(device, buffer_staging);
       // no need to set/initialise 'buffer_output' as its content will be completely overwritten by the compute shader
 
       if (!map_and_unmap_memory(device,
-          buffer_info.memory, [](void* mapped_memory)
+          buffer_info.allocation, [&config](void* mapped_memory)
           {
-              u32* u32_data = (u32*)mapped_memory;
-              f32* f32_data = (f32*)mapped_memory;
-              u32_data[0u] = NUM_PARTICLES;
-              f32_data[1u] = static_cast<float>(BOUNDS_X);
-              f32_data[2u] = static_cast<float>(BOUNDS_Y);
-              f32_data[3u] = static_cast<float>(BOUNDS_WIDTH);
-              f32_data[4u] = static_cast<float>(BOUNDS_HEIGHT);
-              u32_data[5u] = NUM_TEMP_BUCKETS_X;
-              u32_data[6u] = NUM_TEMP_BUCKETS_Y;
-              u32_data[7u] = FINAL_BUCKET_COUNT_X;
-              u32_data[8u] = FINAL_BUCKET_COUNT_Y;
-              f32_data[9u] = TEMP_BUCKET_DIM_X;
-              f32_data[10u] = TEMP_BUCKET_DIM_Y;
-              f32_data[11u] = BUCKET_DIM;
-              f32_data[12u] = PARTICLE_SIZE * 1.f;
-              u32_data[13u] = NUM_PARTICLES_PER_CORE;
-              u32_data[14u] = MAX_PARTICLES_PER_BUCKET;
+              compute_UBO_info_buffer* info = (compute_UBO_info_buffer*)mapped_memory;
+              info->num_particles = config.num_particles;
+              info->bounds[0u] = config.bounds_x;
+              info->bounds[1u] = config.bounds_y;
+              info->bounds[2u] = config.bounds_width;
+              info->bounds[3u] = config.bounds_height;
+              info->num_cells[0u] = config.num_cells_x;
+              info->num_cells[1u] = config.num_cells_y;
+              info->cell_dim = config.cell_dim;
+              info->particle_radius = config.particle_radius;
           }))
       {
           DBG_ASSERT(false);
@@ -754,99 +1019,127 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       }      
   }
 
-  // COLLISION PIPELINE
-
-  constexpr u32 NUM_SETS_COLLISION= 1u;
-
-  constexpr u32 NUM_RESOURCES_COLLISION_SET_0 = 7u;
-  constexpr u32 BINDING_ID_SET_0_COLLISION_X_POSITION = 0u;
-  constexpr u32 BINDING_ID_SET_0_COLLISION_Y_POSITION = 1u; 
-  constexpr u32 BINDING_ID_SET_0_COLLISION_X_VELOCITY = 2u; 
-  constexpr u32 BINDING_ID_SET_0_COLLISION_Y_VELOCITY = 3u;
-  constexpr u32 BINDING_ID_SET_0_COLLISION_INFO = 4u;
-  constexpr u32 BINDING_ID_SET_0_COLLISION_TEMP_BUCKETS = 5u;
-  constexpr u32 BINDING_ID_SET_0_COLLISION_BUCKETS = 6u;
-
-  std::array <VkDescriptorSetLayout, NUM_SETS_COLLISION> descriptor_set_layouts_collision = { VK_NULL_HANDLE };
-  VkPipelineLayout pipeline_layout_collision = VK_NULL_HANDLE;
+  // GRID PIPELINES
+  // count -> scan (blocks of cells, block totals, add totals back) -> scatter builds the uniform grid, collide then reads it
+  // all four shaders declare the same set 0, so they share one layout, one descriptor set and one bind
+
+  constexpr u32 NUM_SETS_GRID = 1u;
+
+  constexpr u32 NUM_RESOURCES_GRID_SET_0 = 10u;
+  constexpr u32 BINDING_ID_SET_0_GRID_X_POSITION = 0u;
+  constexpr u32 BINDING_ID_SET_0_GRID_Y_POSITION = 1u;
+  constexpr u32 BINDING_ID_SET_0_GRID_X_VELOCITY = 2u;
+  constexpr u32 BINDING_ID_SET_0_GRID_Y_VELOCITY = 3u;
+  constexpr u32 BINDING_ID_SET_0_GRID_INFO = 4u;
+  constexpr u32 BINDING_ID_SET_0_GRID_CELL_COUNT = 5u;
+  constexpr u32 BINDING_ID_SET_0_GRID_CELL_START = 6u;
+  constexpr u32 BINDING_ID_SET_0_GRID_PARTICLE_CELL = 7u;
+  constexpr u32 BINDING_ID_SET_0_GRID_SORTED_PARTICLES = 8u;
+  constexpr u32 BINDING_ID_SET_0_GRID_BLOCK_SUM = 9u;
+
+  std::array <VkDescriptorSetLayout, NUM_SETS_GRID> descriptor_set_layouts_grid = { VK_NULL_HANDLE };
+  VkPipelineLayout pipeline_layout_grid = VK_NULL_HANDLE;
+  VkPipeline pipeline_grid_count = VK_NULL_HANDLE, pipeline_grid_scan = VK_NULL_HANDLE, pipeline_grid_scatter = VK_NULL_HANDLE;
+  VkPipeline pipeline_grid_scan_blocks = VK_NULL_HANDLE, pipeline_grid_scan_add = VK_NULL_HANDLE;
   VkPipeline pipeline_collision = VK_NULL_HANDLE;
+  vulkan_specialization specialization_particles, specialization_cells; // per particle and per block of cells shaders
 
-  VkDescriptorPool descriptor_pool_collision = VK_NULL_HANDLE;
-  vulkan_descriptor_set desc_set_0_collision; // for compute, X,Y - Pos,Vel
-
-  vulkan_buffer buffer_bucket;
+  VkDescriptorPool descriptor_pool_grid = VK_NULL_HANDLE;
+  vulkan_descriptor_set desc_set_0_grid; // for compute, X,Y - Pos,Vel + the grid
 
-  VkCommandPool command_pool_collision = VK_NULL_HANDLE;
-  VkCommandBuffer command_buffer_collision = VK_NULL_HANDLE;
+  vulkan_buffer buffer_cell_count;       // u32 [num_cells], cleared every step
+  vulkan_buffer buffer_cell_start;       // u32 [num_cells], exclusive prefix sum of 'buffer_cell_count'
+  vulkan_buffer buffer_block_sum;        // u32 [num_cell_blocks], total of each block of cells, then the start of each block
+  vulkan_buffer buffer_particle_cell;    // uvec2 [num_particles], cell + rank within the cell
+  vulkan_buffer buffer_sorted_particles; // vec4 [num_particles], pos + vel ordered by cell
 
-  VkFence fence_collision = VK_NULL_HANDLE;
 
-
-  // create collision pipeline
+  // create grid pipelines
   {
       // describe the descriptors in set 0
-      std::array <VkDescriptorSetLayoutBinding, NUM_RESOURCES_COLLISION_SET_0> const descriptor_set_layout_binding_info_0 =
+      std::array <VkDescriptorSetLayoutBinding, NUM_RESOURCES_GRID_SET_0> const descriptor_set_layout_binding_info_0 =
       {
         VkDescriptorSetLayoutBinding {
-          .binding = BINDING_ID_SET_0_COLLISION_X_POSITION,          // at binding point 0 we have
-          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (X_pos[NUM_PARTICLES])
+          .binding = BINDING_ID_SET_0_GRID_X_POSITION,         // at binding point 0 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (X_pos[num_particles])
           .descriptorCount = 1u,
           .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
           .pImmutableSamplers = VK_NULL_HANDLE
         },
         VkDescriptorSetLayoutBinding {
-          .binding = BINDING_ID_SET_0_COLLISION_Y_POSITION,         // at binding point 1 we have
-          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_pos[NUM_PARTICLES])
+          .binding = BINDING_ID_SET_0_GRID_Y_POSITION,         // at binding point 1 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_pos[num_particles])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        },
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_X_VELOCITY,         // at binding point 2 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (X_vel[num_particles])
           .descriptorCount = 1u,
           .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
           .pImmutableSamplers = VK_NULL_HANDLE
         },
-      VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_COLLISION_X_VELOCITY,         // at binding point 2 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (X_vel[NUM_PARTICLES])
-        .descriptorCount = 1u,
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pImmutableSamplers = VK_NULL_HANDLE
-      },
-      VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_COLLISION_Y_VELOCITY,         // at binding point 3 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_vel[NUM_PARTICLES])
-        .descriptorCount = 1u,
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pImmutableSamplers = VK_NULL_HANDLE
-      },
         VkDescriptorSetLayoutBinding {
-          .binding = BINDING_ID_SET_0_COLLISION_INFO,               // at binding point 4 we have
+          .binding = BINDING_ID_SET_0_GRID_Y_VELOCITY,         // at binding point 3 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_vel[num_particles])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        },
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_INFO,               // at binding point 4 we have
           .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // a uniform buffer
           .descriptorCount = 1u,
           .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
           .pImmutableSamplers = VK_NULL_HANDLE
         },
-      VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_COLLISION_TEMP_BUCKETS,       // at binding point 5 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // yet another storage buffer
-        .descriptorCount = 1u,
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pImmutableSamplers = VK_NULL_HANDLE
-      },
-      VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_COLLISION_BUCKETS,       // at binding point 6 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // yet another storage buffer
-        .descriptorCount = 1u,
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pImmutableSamplers = VK_NULL_HANDLE
-      }
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_CELL_COUNT,         // at binding point 5 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (cell_count[num_cells])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        },
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_CELL_START,         // at binding point 6 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (cell_start[num_cells])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        },
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_PARTICLE_CELL,      // at binding point 7 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (particle_cell[num_particles])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        },
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_SORTED_PARTICLES,   // at binding point 8 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (sorted[num_particles])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        },
+        VkDescriptorSetLayoutBinding {
+          .binding = BINDING_ID_SET_0_GRID_BLOCK_SUM,          // at binding point 9 we have
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (block_sum[num_cell_blocks])
+          .descriptorCount = 1u,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+          .pImmutableSamplers = VK_NULL_HANDLE
+        }
       };
       // group up all descriptor layout descriptions
-      std::array <std::span <const VkDescriptorSetLayoutBinding>, NUM_SETS_COLLISION> const descriptor_set_layout_bindings =
+      std::array <std::span <const VkDescriptorSetLayoutBinding>, NUM_SETS_GRID> const descriptor_set_layout_bindings =
       {
         descriptor_set_layout_binding_info_0 // set 0
                                              // set 1...
       };
       if (!create_vulkan_descriptor_set_layouts(device,
-          NUM_SETS_COLLISION,
+          NUM_SETS_GRID,
           descriptor_set_layout_bindings.data(),
-          descriptor_set_layouts_collision.data()))
+          descriptor_set_layouts_grid.data()))
       {
           DBG_ASSERT(false);
           return -1;
@@ -854,37 +1147,76 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
 
       if (!create_vulkan_pipeline_layout(device,
-          descriptor_set_layouts_collision.size(), descriptor_set_layouts_collision.data(),
+          descriptor_set_layouts_grid.size(), descriptor_set_layouts_grid.data(),
           0u, nullptr,
-          pipeline_layout_collision))
+          pipeline_layout_grid))
       {
           DBG_ASSERT(false);
           return -1;
       }
 
 
-      VkShaderModule shader_module_collision = VK_NULL_HANDLE;
-      if (!create_vulkan_shader(device,
-          COMPILED_COMPUTE_SHADER_PATH_COLLISION,
-          shader_module_collision))
+      // grid dimensions and radius never change after start up, so bake them in to the shaders
+      // constant 0 is the work group size, per particle or per block of cells
+      for (vulkan_specialization* specialization : { &specialization_particles, &specialization_cells })
       {
-          DBG_ASSERT(false);
-          return -1;
+          if (!set_vulkan_specialization_constant(*specialization, 1u, config.num_cells_x) ||
+              !set_vulkan_specialization_constant(*specialization, 2u, config.num_cells_y) ||
+              !set_vulkan_specialization_constant(*specialization, 3u, config.cell_dim) ||
+              !set_vulkan_specialization_constant(*specialization, 4u, config.particle_radius))
+          {
+              DBG_ASSERT(false);
+              return -1;
+          }
       }
-      // error: type mismatch storage image != storage buffer
-      if (!create_vulkan_pipeline_compute(device,
-          shader_module_collision, "main",
-          pipeline_layout_collision,
-          pipeline_collision))
+      if (!set_vulkan_specialization_constant(specialization_particles, 0u, config.particle_group_size) ||
+          !set_vulkan_specialization_constant(specialization_cells, 0u, config.scan_block_size))
       {
           DBG_ASSERT(false);
           return -1;
       }
 
-      release_vulkan_shader(device,
-          shader_module_collision); // don't need shader object now we have the pipeline
+      struct grid_shader
+      {
+          char const* path;
+          vulkan_specialization const* specialization;
+          VkPipeline* out_pipeline;
+      };
+      grid_shader const grid_shaders [] =
+      {
+        { COMPILED_COMPUTE_SHADER_PATH_GRID_COUNT, &specialization_particles, &pipeline_grid_count },
+        { COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN, &specialization_cells, &pipeline_grid_scan },
+        { COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_BLOCKS, &specialization_cells, &pipeline_grid_scan_blocks },
+        { COMPILED_COMPUTE_SHADER_PATH_GRID_SCAN_ADD, &specialization_cells, &pipeline_grid_scan_add },
+        { COMPILED_COMPUTE_SHADER_PATH_GRID_SCATTER, &specialization_particles, &pipeline_grid_scatter },
+        { COMPILED_COMPUTE_SHADER_PATH_COLLISION, &specialization_particles, &pipeline_collision }
+      };
+      for (grid_shader const& shader : grid_shaders)
+      {
+          VkShaderModule shader_module_grid = VK_NULL_HANDLE;
+          if (!create_vulkan_shader(device,
+              shader.path,
+              shader_module_grid))
+          {
+              DBG_ASSERT(false);
+              return -1;
+          }
+
+          if (!create_vulkan_pipeline_compute(device,
+              shader_module_grid, "main",
+              pipeline_layout_grid,
+              *shader.out_pipeline,
+              shader.specialization))
+          {
+              DBG_ASSERT(false);
+              return -1;
+          }
+
+          release_vulkan_shader(device,
+              shader_module_grid); // don't need shader object now we have the pipeline
+      }
   }
-  // create collision descriptor sets
+  // create grid descriptor sets
   {
       // create pool of descriptors from which our descriptor sets will draw from
       //
@@ -893,36 +1225,35 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       std::array <VkDescriptorPoolSize, 2u> const pool_sizes =
       { { // yes this is deliberate!
         {
-              // we have 1 x descriptor set that consists of 4 x 'storage buffer' descriptors
-              .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-              .descriptorCount = 6u
-            },
-            {
-              .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-              .descriptorCount = 1u
-            }
-          // if you also needed n uniform buffer descriptors you would need to create a new VkDescriptorPoolSize here
-        } };
+          // we have 1 x descriptor set that consists of 9 x 'storage buffer' descriptors
+          .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+          .descriptorCount = 9u
+        },
+        {
+          .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+          .descriptorCount = 1u
+        }
+      } };
       if (!create_vulkan_descriptor_pool(device,
           1u, // how many descriptor sets will we make from the sets in the pool?
           pool_sizes.size(), pool_sizes.data(),
-          descriptor_pool_collision))
+          descriptor_pool_grid))
       {
           DBG_ASSERT(false);
           return -1;
       }
 
-      std::array <vulkan_descriptor_set_info, NUM_SETS_COLLISION> const descriptor_set_infos =
+      std::array <vulkan_descriptor_set_info, NUM_SETS_GRID> const descriptor_set_infos =
       { {
-              // set 0
-              {
-                .desc_pool = &descriptor_pool_collision,         // the pool from which to allocate the individual descriptors from
-                .layout = &descriptor_set_layouts_collision[0], // layout of the descriptor set
-                .set_index = 0u,                               // index of the descriptor set
-                .out_set = &desc_set_0_collision                 // pointer to where to instantiate the descriptor set to
-              }
-          // set 1...
-        } };
+        // set 0
+        {
+          .desc_pool = &descriptor_pool_grid,         // the pool from which to allocate the individual descriptors from
+          .layout = &descriptor_set_layouts_grid[0], // layout of the descriptor set
+          .set_index = 0u,                           // index of the descriptor set
+          .out_set = &desc_set_0_grid                // pointer to where to instantiate the descriptor set to
+        }
+        // set 1...
+      } };
       if (!create_vulkan_descriptor_sets(device,
           descriptor_set_infos.size(), descriptor_set_infos.data()))
       {
@@ -930,28 +1261,65 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           return -1;
       }
   }
-  // create compute resources
+  // create grid resources
+  // sized by the particle and cell counts only, a cell holds however many particles land in it
+  // only ever touched by the gpu
   {
+      if (!create_vulkan_buffer(physical_device, device,
+          (VkDeviceSize)config.num_cells * DATA_SIZE,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // cleared with 'vkCmdFillBuffer'
+          VK_SHARING_MODE_EXCLUSIVE,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          buffer_cell_count))
       {
-
-          if (!create_vulkan_buffer(physical_device, device,
-              BUCKET_BUFFER_SIZE,
-              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-              VK_SHARING_MODE_EXCLUSIVE,
-              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-              buffer_bucket))
-          {
-              DBG_ASSERT(false);
-              return -1;
-          }
+          DBG_ASSERT(false);
+          return -1;
+      }
+      if (!create_vulkan_buffer(physical_device, device,
+          (VkDeviceSize)config.num_cells * DATA_SIZE,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_SHARING_MODE_EXCLUSIVE,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          buffer_cell_start))
+      {
+          DBG_ASSERT(false);
+          return -1;
+      }
+      if (!create_vulkan_buffer(physical_device, device,
+          (VkDeviceSize)config.num_cell_blocks * DATA_SIZE,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_SHARING_MODE_EXCLUSIVE,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          buffer_block_sum))
+      {
+          DBG_ASSERT(false);
+          return -1;
+      }
+      if (!create_vulkan_buffer(physical_device, device,
+          (VkDeviceSize)config.num_particles * DATA_SIZE * 2u,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_SHARING_MODE_EXCLUSIVE,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          buffer_particle_cell))
+      {
+          DBG_ASSERT(false);
+          return -1;
+      }
+      if (!create_vulkan_buffer(physical_device, device,
+          (VkDeviceSize)config.num_particles * DATA_SIZE * 4u,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_SHARING_MODE_EXCLUSIVE,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          buffer_sorted_particles))
+      {
+          DBG_ASSERT(false);
+          return -1;
       }
-
-
   }
-  // bind collision resources to collision descriptor set
+  // bind grid resources to grid descriptor set
   {
-      // desc_set_0_compute = for compute = texture_compute_input + texture_compute_output
-      VkDescriptorBufferInfo const buffer_infos[NUM_RESOURCES_COLLISION_SET_0] =
+      // in binding order, binding n = buffer_infos[n]
+      VkDescriptorBufferInfo const buffer_infos[NUM_RESOURCES_GRID_SET_0] =
       {
         {
           .buffer = buffer_pos_x.buffer,
@@ -979,449 +1347,58 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           .range = VK_WHOLE_SIZE
         },
         {
-          .buffer = buffer_bucket_temp.buffer,
+          .buffer = buffer_cell_count.buffer,
           .offset = 0u,
           .range = VK_WHOLE_SIZE
         },
         {
-          .buffer = buffer_bucket.buffer,
+          .buffer = buffer_cell_start.buffer,
           .offset = 0u,
           .range = VK_WHOLE_SIZE
-        }
-      };
-
-      VkWriteDescriptorSet const write_descriptors[NUM_RESOURCES_COLLISION_SET_0] =
-      {
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_X_POSITION,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[0],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_Y_POSITION,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[1],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },{
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_X_VELOCITY,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[2],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_Y_VELOCITY,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[3],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_INFO,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-          .pImageInfo = VK_NULL_HANDLE,
-          .pBufferInfo = &buffer_infos[4],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_TEMP_BUCKETS,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[5],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_collision.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COLLISION_BUCKETS,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[6],
-            .pTexelBufferView = VK_NULL_HANDLE
-          }
-      };
-
-      vkUpdateDescriptorSets(device, // device
-          NUM_RESOURCES_COLLISION_SET_0,  // descriptorWriteCount
-          write_descriptors,            // pDescriptorWrites
-          0u,                           // descriptorCopyCount
-          VK_NULL_HANDLE);              // pDescriptorCopies
-  }
-  // create collision command buffers
-  {
-      if (!create_vulkan_command_pool(VK_QUEUE_COMPUTE_BIT, command_pool_collision))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-      if (!create_vulkan_command_buffers(1u, command_pool_collision, &command_buffer_collision))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-  }
-  // create compute sync objects
-  // at least one per submit (can be reused if in loop)
-  {
-      if (!create_vulkan_fences(1u, 0u, &fence_collision))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-  }
-
-
-  // SET INPUT/INFO BUFFERS
-  {
-
-
-      if (!map_and_unmap_memory(device,
-          buffer_bucket_temp.memory, [](void* mapped_memory)
-          {
-              constexpr unsigned int BUFFER_SIZE = NUM_TEMP_BUCKETS_X * NUM_TEMP_BUCKETS_Y * NUM_THREAD_GROUPS_COMPUTE_PARTICLES * WARP_WIDTH * NUM_PARTICLES_PER_CORE;
-              u32* data = (u32*)mapped_memory;
-              for (int i(0); i < BUFFER_SIZE; ++i)
-              {
-                  data[i] = 0u;
-              }
-          }))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-  }
-
-  // COMMUNICATION PIPELINE
-
-  constexpr u32 NUM_SETS_COMMUNICATION = 1u;
-
-  constexpr u32 NUM_RESOURCES_COMMUNICATION_SET_0 = 5u;
-  constexpr u32 BINDING_ID_SET_0_COMMUNICATION_X_POSITION = 0u;
-  constexpr u32 BINDING_ID_SET_0_COMMUNICATION_Y_POSITION = 1u;
-  constexpr u32 BINDING_ID_SET_0_COMMUNICATION_INFO = 2u;
-  constexpr u32 BINDING_ID_SET_0_COMMUNICATION_TEMP_BUCKETS = 3u;
-  constexpr u32 BINDING_ID_SET_0_COMMUNICATION_BUCKETS = 4u;
-
-  std::array <VkDescriptorSetLayout, NUM_SETS_COMMUNICATION> descriptor_set_layouts_communication = { VK_NULL_HANDLE };
-  VkPipelineLayout pipeline_layout_communication = VK_NULL_HANDLE;
-  VkPipeline pipeline_communication = VK_NULL_HANDLE;
-
-  VkDescriptorPool descriptor_pool_communication = VK_NULL_HANDLE;
-  vulkan_descriptor_set desc_set_0_communication; // for compute, X,Y - Pos,Vel
-
-  VkCommandPool command_pool_communication = VK_NULL_HANDLE;
-  VkCommandBuffer command_buffer_communication = VK_NULL_HANDLE;
-
-  VkFence fence_communication = VK_NULL_HANDLE;
-
-
-  // create communication pipeline
-  {
-      // describe the descriptors in set 0
-      std::array <VkDescriptorSetLayoutBinding, NUM_RESOURCES_COMMUNICATION_SET_0> const descriptor_set_layout_binding_info_0 =
-      {
-        VkDescriptorSetLayoutBinding {
-          .binding = BINDING_ID_SET_0_COMMUNICATION_X_POSITION,          // at binding point 0 we have
-          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // a storage buffer (X_pos[NUM_PARTICLES])
-          .descriptorCount = 1u,
-          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-          .pImmutableSamplers = VK_NULL_HANDLE
         },
-        VkDescriptorSetLayoutBinding {
-          .binding = BINDING_ID_SET_0_COMMUNICATION_Y_POSITION,         // at binding point 1 we have
-          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // another storage buffer (Y_pos[NUM_PARTICLES])
-          .descriptorCount = 1u,
-          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-          .pImmutableSamplers = VK_NULL_HANDLE
-        },
-        VkDescriptorSetLayoutBinding {
-          .binding = BINDING_ID_SET_0_COMMUNICATION_INFO,               // at binding point 4 we have
-          .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // a uniform buffer
-          .descriptorCount = 1u,
-          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-          .pImmutableSamplers = VK_NULL_HANDLE
-        },
-      VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_COMMUNICATION_TEMP_BUCKETS,       // at binding point 5 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // yet another storage buffer
-        .descriptorCount = 1u,
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pImmutableSamplers = VK_NULL_HANDLE
-      },
-      VkDescriptorSetLayoutBinding {
-        .binding = BINDING_ID_SET_0_COMMUNICATION_BUCKETS,       // at binding point 6 we have
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // yet another storage buffer
-        .descriptorCount = 1u,
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pImmutableSamplers = VK_NULL_HANDLE
-      }
-      };
-      // group up all descriptor layout descriptions
-      std::array <std::span <const VkDescriptorSetLayoutBinding>, NUM_SETS_COMMUNICATION> const descriptor_set_layout_bindings =
-      {
-        descriptor_set_layout_binding_info_0 // set 0
-                                             // set 1...
-      };
-      if (!create_vulkan_descriptor_set_layouts(device,
-          NUM_SETS_COMMUNICATION,
-          descriptor_set_layout_bindings.data(),
-          descriptor_set_layouts_communication.data()))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-
-
-      if (!create_vulkan_pipeline_layout(device,
-          descriptor_set_layouts_communication.size(), descriptor_set_layouts_communication.data(),
-          0u, nullptr,
-          pipeline_layout_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-
-
-      VkShaderModule shader_module_communication = VK_NULL_HANDLE;
-      if (!create_vulkan_shader(device,
-          COMPILED_COMPUTE_SHADER_PATH_COMMUNICATION,
-          shader_module_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-      // error: type mismatch storage image != storage buffer
-      if (!create_vulkan_pipeline_compute(device,
-          shader_module_communication, "main",
-          pipeline_layout_communication,
-          pipeline_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-
-      release_vulkan_shader(device,
-          shader_module_communication); // don't need shader object now we have the pipeline
-  }
-  // create communication descriptor sets
-  {
-      // create pool of descriptors from which our descriptor sets will draw from
-      //
-      // we could have multiple descriptor pools, or one huge one
-      // we are going to have one per pipeline in order to keep it simple
-      std::array <VkDescriptorPoolSize, 2u> const pool_sizes =
-      { { // yes this is deliberate!
         {
-              // we have 1 x descriptor set that consists of 4 x 'storage buffer' descriptors
-              .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-              .descriptorCount = 6u
-            },
-            {
-              .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-              .descriptorCount = 1u
-            }
-          // if you also needed n uniform buffer descriptors you would need to create a new VkDescriptorPoolSize here
-        } };
-      if (!create_vulkan_descriptor_pool(device,
-          1u, // how many descriptor sets will we make from the sets in the pool?
-          pool_sizes.size(), pool_sizes.data(),
-          descriptor_pool_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-
-      std::array <vulkan_descriptor_set_info, NUM_SETS_COMMUNICATION> const descriptor_set_infos =
-      { {
-              // set 0
-              {
-                .desc_pool = &descriptor_pool_communication,         // the pool from which to allocate the individual descriptors from
-                .layout = &descriptor_set_layouts_communication[0], // layout of the descriptor set
-                .set_index = 0u,                               // index of the descriptor set
-                .out_set = &desc_set_0_communication                 // pointer to where to instantiate the descriptor set to
-              }
-          // set 1...
-        } };
-      if (!create_vulkan_descriptor_sets(device,
-          descriptor_set_infos.size(), descriptor_set_infos.data()))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-  }
-
-  // bind communication resources to communication descriptor set
-  {
-      // desc_set_0_compute = for compute = texture_compute_input + texture_compute_output
-      VkDescriptorBufferInfo const buffer_infos[NUM_RESOURCES_COMMUNICATION_SET_0] =
-      {
-        {
-          .buffer = buffer_pos_x.buffer,
-          .offset = 0u,
-          .range = VK_WHOLE_SIZE
-        },
-        {
-          .buffer = buffer_pos_y.buffer,
-          .offset = 0u,
-          .range = VK_WHOLE_SIZE
-        },
-        {
-          .buffer = buffer_info.buffer,
+          .buffer = buffer_particle_cell.buffer,
           .offset = 0u,
           .range = VK_WHOLE_SIZE
         },
         {
-          .buffer = buffer_bucket_temp.buffer,
+          .buffer = buffer_sorted_particles.buffer,
           .offset = 0u,
           .range = VK_WHOLE_SIZE
         },
         {
-          .buffer = buffer_bucket.buffer,
+          .buffer = buffer_block_sum.buffer,
           .offset = 0u,
           .range = VK_WHOLE_SIZE
         }
       };
 
-      VkWriteDescriptorSet const write_descriptors[NUM_RESOURCES_COMMUNICATION_SET_0] =
+      std::array <VkWriteDescriptorSet, NUM_RESOURCES_GRID_SET_0> write_descriptors = {};
+      for (u32 binding = 0u; binding < NUM_RESOURCES_GRID_SET_0; ++binding)
       {
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_communication.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COMMUNICATION_X_POSITION,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[0],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
+          write_descriptors[binding] =
           {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_communication.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COMMUNICATION_Y_POSITION,
+            .dstSet = desc_set_0_grid.desc_set,
+            .dstBinding = binding,
             .dstArrayElement = 0u,
             .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorType = binding == BINDING_ID_SET_0_GRID_INFO ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[1],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_communication.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COMMUNICATION_INFO,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-          .pImageInfo = VK_NULL_HANDLE,
-          .pBufferInfo = &buffer_infos[2],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_communication.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COMMUNICATION_TEMP_BUCKETS,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[3],
-            .pTexelBufferView = VK_NULL_HANDLE
-          },
-          // desc_set_0_compute
-          {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            //.pNext = VK_NULL_HANDLE,
-            .dstSet = desc_set_0_communication.desc_set,
-            .dstBinding = BINDING_ID_SET_0_COMMUNICATION_BUCKETS,
-            .dstArrayElement = 0u,
-            .descriptorCount = 1u,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = VK_NULL_HANDLE,
-            .pBufferInfo = &buffer_infos[4],
-            .pTexelBufferView = VK_NULL_HANDLE
-          }
-      };
-
-      vkUpdateDescriptorSets(device, // device
-          NUM_RESOURCES_COMMUNICATION_SET_0,  // descriptorWriteCount
-          write_descriptors,            // pDescriptorWrites
-          0u,                           // descriptorCopyCount
-          VK_NULL_HANDLE);              // pDescriptorCopies
-  }
-  // create COMMUNICATION command buffers
-  {
-      if (!create_vulkan_command_pool(VK_QUEUE_COMPUTE_BIT, command_pool_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-      if (!create_vulkan_command_buffers(1u, command_pool_communication, &command_buffer_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
-      }
-  }
-  // create compute sync objects
-  // at least one per submit (can be reused if in loop)
-  {
-      if (!create_vulkan_fences(1u, 0u, &fence_communication))
-      {
-          DBG_ASSERT(false);
-          return -1;
+            .pBufferInfo = &buffer_infos[binding],
+            .pTexelBufferView = VK_NULL_HANDLE
+          };
       }
+
+      vkUpdateDescriptorSets(device,   // device
+          NUM_RESOURCES_GRID_SET_0,    // descriptorWriteCount
+          write_descriptors.data(),    // pDescriptorWrites
+          0u,                          // descriptorCopyCount
+          VK_NULL_HANDLE);             // pDescriptorCopies
   }
-  
+  // the grid passes are recorded in to 'command_buffers_compute', no command buffer/sync objects of their own
+
 
   // GRAPHICS PIPELINE
 
@@ -1457,8 +1434,8 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   VkPipeline pipeline_graphics = VK_NULL_HANDLE;
 
   VkDescriptorPool descriptor_pool_graphics = VK_NULL_HANDLE;
-  vulkan_descriptor_set desc_set_0_graphics_input,  // for rendering input image , buffer_graphics_camera + buffer_graphics_model_input
-                        desc_set_1_graphics_input;  // for rendering input image , texture_compute_input
+  std::array <vulkan_descriptor_set, NUM_PARTICLE_STATES> desc_sets_0_graphics_input; // buffer_graphics_camera + buffer_graphics_model_input + render copy of the positions, 1 per particle state
+  vulkan_descriptor_set desc_set_1_graphics_input;  // for rendering input image , texture_compute_input
 
   vulkan_buffer buffer_graphics_camera,
       buffer_graphics_model_input;  // for when rendering the input texture
@@ -1466,12 +1443,16 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   vulkan_texture texture_particle;
 
   VkCommandPool command_pool_graphics = VK_NULL_HANDLE;
-  VkCommandBuffer command_buffer_graphics = VK_NULL_HANDLE;
+  std::array <VkCommandBuffer, NUM_FRAMES_IN_FLIGHT> command_buffers_graphics = { VK_NULL_HANDLE }; // one per frame in flight
 
   vulkan_mesh mesh_sprite;
 
-  VkSemaphore swapchain_image_available_semaphore = VK_NULL_HANDLE;
-  VkFence fence_submit_graphics = VK_NULL_HANDLE;
+  // one set per frame in flight, so frame n+1 can be recorded while frame n renders
+  std::array <VkSemaphore, NUM_FRAMES_IN_FLIGHT> swapchain_image_available_semaphores = { VK_NULL_HANDLE };
+  std::array <VkSemaphore, NUM_FRAMES_IN_FLIGHT> render_finished_semaphores = { VK_NULL_HANDLE }; // present waits on these
+  // signalled with the frame number when that frame's draw is done
+  // the next step waits on it (it overwrites the positions being drawn), the cpu waits on it before reusing a frame's resources
+  vulkan_timeline timeline_frame;
 
 
   // create graphics pipeline
@@ -1753,14 +1734,14 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     std::array <VkDescriptorPoolSize, 3u> const pool_sizes =
     {{ // yes this is deliberate!
       {
-        // we have 2 x descriptors set that consist of 3 x uniform buffers
+        // we have NUM_PARTICLE_STATES x descriptors set that consist of 3 x uniform buffers
         .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = 4u
+        .descriptorCount = 3u * NUM_PARTICLE_STATES
       },
       {
-          // we have 2 x descriptors set that consist of 2 x storage buffers
+          // we have NUM_PARTICLE_STATES x descriptors set that consist of 2 x storage buffers
           .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-          .descriptorCount = 4u
+          .descriptorCount = 2u * NUM_PARTICLE_STATES
       },
       {
         // we have 2 x descriptor set that consist of 1 x image descriptor
@@ -1769,7 +1750,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       }
     }};
     if (!create_vulkan_descriptor_pool (device,
-      4u, // how many descriptor sets will we make from the sets in the pool?
+      NUM_PARTICLE_STATES + 1u, // how many descriptor sets will we make from the sets in the pool?
       pool_sizes.size (), pool_sizes.data (),
       descriptor_pool_graphics))
     {
@@ -1777,24 +1758,26 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
 
-    std::array <vulkan_descriptor_set_info, NUM_SETS_GRAPHICS> const descriptor_set_infos =
-    {{
-      // set 0 - input
+    std::array <vulkan_descriptor_set_info, NUM_PARTICLE_STATES + 1u> descriptor_set_infos = {};
+    // set 0 - input, one per particle state
+    for (u32 state = 0u; state < NUM_PARTICLE_STATES; ++state)
+    {
+      descriptor_set_infos [state] =
       {
         .desc_pool = &descriptor_pool_graphics,         // the pool from which to allocate the individual descriptors from
         .layout = &descriptor_set_layouts_graphics [0], // layout of the descriptor set
         .set_index = 0u,                                // index of the descriptor set
-        .out_set = &desc_set_0_graphics_input           // pointer to where to instantiate the descriptor set to
-      },
-      // set 1 - input
-      {
-        .desc_pool = &descriptor_pool_graphics,
-        .layout = &descriptor_set_layouts_graphics [1],
-        .set_index = 1u,
-        .out_set = &desc_set_1_graphics_input
-      }
-
-    }};
+        .out_set = &desc_sets_0_graphics_input [state]  // pointer to where to instantiate the descriptor set to
+      };
+    }
+    // set 1 - input
+    descriptor_set_infos [NUM_PARTICLE_STATES] =
+    {
+      .desc_pool = &descriptor_pool_graphics,
+      .layout = &descriptor_set_layouts_graphics [1],
+      .set_index = 1u,
+      .out_set = &desc_set_1_graphics_input
+    };
     if (!create_vulkan_descriptor_sets (device,
       descriptor_set_infos.size (), descriptor_set_infos.data ()))
     {
@@ -1803,6 +1786,12 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     }
   }
   // create graphics resources
+  // the texture and mesh uploads are batched in to one submit, see 'submit_vulkan_upload_batch' below
+  if (!begin_vulkan_upload_batch (physical_device, device))
+  {
+    DBG_ASSERT (false);
+    return -1;
+  }
   {
 
       VkFormat const image_format = VK_FORMAT_R8G8B8A8_UNORM;
@@ -1867,48 +1856,48 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     // as the data will never change (because we are not actually double buffering and the camera/sprites will never move)
     // we can set the data in these buffers upfront
 
-    if (!map_and_unmap_memory (device,
-      buffer_graphics_camera.memory,
-      [extent](void* mem)
-      {
-        camera_buffer* buf = (camera_buffer*)mem;
-
-        // put camera origin in centre of screen
+    // host visible buffers stay mapped for their lifetime, so write straight in to them
+    std::span <camera_buffer> const camera = get_mapped_span <camera_buffer> (buffer_graphics_camera);
+    DBG_ASSERT (!camera.empty ());
+    {
+      // put camera origin in centre of screen
+      // zoom out if the bounds (which grow with the particle count) don't fit on screen
 
-        f32 const screen_width_half = (f32)extent.width / 2.f;
-        f32 const screen_height_half = (f32)extent.height / 2.f;
+      f32 const zoom = std::max({ 1.f, config.bounds_width / (f32)extent.width, config.bounds_height / (f32)extent.height });
+      f32 const screen_width_half = (f32)extent.width * zoom / 2.f;
+      f32 const screen_height_half = (f32)extent.height * zoom / 2.f;
 
-        f32 const left = -screen_width_half, right = screen_width_half;
-        f32 const bottom = -screen_height_half, top = screen_height_half;
-        f32 const z_near = 0.f, z_far = 1.f;
+      f32 const left = -screen_width_half, right = screen_width_half;
+      f32 const bottom = -screen_height_half, top = screen_height_half;
+      f32 const z_near = 0.f, z_far = 1.f;
 
-        buf->vp_matrix = glm::ortho (left, right, bottom, top, z_near, z_far);
-        buf->vp_matrix [1][1] *= -1.f;
-      }))
+      camera [0].vp_matrix = glm::ortho (left, right, bottom, top, z_near, z_far);
+      camera [0].vp_matrix [1][1] *= -1.f;
+    }
+    if (!flush_vulkan_memory (device, buffer_graphics_camera.allocation))
     {
       DBG_ASSERT (false);
       return -1;
     }
 
     vec2 const texture_dim = (vec2)texture_particle.dim * 0.65f;
-    if (!map_and_unmap_memory (device,
-      buffer_graphics_model_input.memory,
-      [&texture_dim](void* mem)
-      {
-        model_buffer* buf = (model_buffer*)mem;
-
-        buf->model_matrix = fast_transform_2D (-(texture_dim.x * PARTICLE_SCALE) / 2.f, 0.f,
-          0.f,
-          0.f, 0.f,
-          texture_dim.x * PARTICLE_SCALE, texture_dim.y * PARTICLE_SCALE);
-      }))
+    std::span <model_buffer> const model_input = get_mapped_span <model_buffer> (buffer_graphics_model_input);
+    DBG_ASSERT (!model_input.empty ());
+    model_input [0].model_matrix = fast_transform_2D (-(texture_dim.x * PARTICLE_SCALE) / 2.f, 0.f,
+      0.f,
+      0.f, 0.f,
+      texture_dim.x * PARTICLE_SCALE, texture_dim.y * PARTICLE_SCALE);
+    if (!flush_vulkan_memory (device, buffer_graphics_model_input.allocation))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
   // bind graphics + compute resources to graphics descriptor sets
+  // once per particle state, they only differ by which render copy of the positions they read
+  for (u32 state = 0u; state < NUM_PARTICLE_STATES; ++state)
   {
+    vulkan_descriptor_set const& desc_set_0_graphics_input = desc_sets_0_graphics_input [state];
       
     // desc_set_0_graphics_input  = for rendering input image  = buffer_graphics_camera + buffer_graphics_model_input
     // desc_set_1_graphics_input  = for rendering input image  = texture_compute_input
@@ -1937,12 +1926,12 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
             .range = VK_WHOLE_SIZE
         },
         {
-            .buffer = buffer_pos_x.buffer,
+            .buffer = buffers_render_pos_x[state].buffer,
             .offset = 0u,
             .range = VK_WHOLE_SIZE
         },
         {
-            .buffer = buffer_pos_y.buffer,
+            .buffer = buffers_render_pos_y[state].buffer,
             .offset = 0u,
             .range = VK_WHOLE_SIZE
         }
@@ -2080,261 +2069,443 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
   }
+  // upload the texture and mesh, a single round trip
+  if (!submit_vulkan_upload_batch (true))
+  {
+    DBG_ASSERT (false);
+    return -1;
+  }
   // create graphics command buffers
   {
     // we can have several command buffers per pipeline
-    // but we are going to keep it simple
-    // 1 command buffer for graphics that we reuse every frame
+    // 1 command buffer per frame in flight, each reused every NUM_FRAMES_IN_FLIGHT frames
 
     if (!create_vulkan_command_pool (VK_QUEUE_GRAPHICS_BIT, command_pool_graphics))
     {
       DBG_ASSERT (false);
       return -1;
     }
-    if (!create_vulkan_command_buffers (1u, command_pool_graphics, &command_buffer_graphics))
+    if (!create_vulkan_command_buffers (NUM_FRAMES_IN_FLIGHT, command_pool_graphics, command_buffers_graphics.data ()))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
   // create graphics sync objects
-  // at least one per submit (can be reused if in loop)
+  // one set per frame in flight
   {
-    if (!create_vulkan_semaphores (1u, &swapchain_image_available_semaphore))
+    if (!create_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, swapchain_image_available_semaphores.data ()))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+    if (!create_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, render_finished_semaphores.data ()))
     {
       DBG_ASSERT (false);
       return -1;
     }
-    if (!create_vulkan_fences (1u, 0u, &fence_submit_graphics))
+    // starts at 0, so waits on the frames 'before' the first one return straight away
+    if (!create_vulkan_timelines (1u, 0u, &timeline_frame))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
 
+  // record compute command buffers
+  // integrate, build the grid and collide in one command buffer, each stage reads what the previous one wrote
+  // then copy the positions out to the frame's render copy, for graphics to draw
+  // nothing in here changes between frames (deltatime comes from 'buffer_step'), so record once and resubmit every frame
+  // 1 per frame in flight, as each binds its own slice of 'buffer_step' and copies to its own render copy
+  // not ONE_TIME_SUBMIT, and no SIMULTANEOUS_USE as a submit always completes before its frame comes round again (timeline_frame)
+  u32 max_groups_x = {}; // dispatches bigger than this are folded in to y, see 'fold_vulkan_dispatch' (at least 65535, so 16M particles in groups of 256 don't fit)
+  {
+    VkPhysicalDeviceProperties device_properties = {};
+    vkGetPhysicalDeviceProperties (physical_device, &device_properties);
+    max_groups_x = device_properties.limits.maxComputeWorkGroupCount [0];
+  }
+  for (u32 frame = 0u; frame < NUM_FRAMES_IN_FLIGHT; ++frame)
+  {
+    VkCommandBuffer const command_buffer_compute = command_buffers_compute [frame];
+    u32 const step_offset = (u32)(frame * step_slice_size);
+    VkBuffer const render_buffers [] = { buffers_render_pos_x [frame].buffer, buffers_render_pos_y [frame].buffer };
 
-  // GRAPHICS RENDER
+    if (!begin_command_buffer(command_buffer_compute, 0u))
+    {
+        DBG_ASSERT(false);
+        return -1;
+    }
 
-  // GAME LOOP
-  while (process_os_messages ())
-  {
-    // UPDATE
-    // COMPUTE DISPATCH
-      {
-          // RECORD COMMAND BUFFER
-          {
-              if (!CHECK_VULKAN_RESULT(vkResetCommandBuffer(command_buffer_compute, 0u)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-              if (!begin_command_buffer(command_buffer_compute, 0u))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-              {
-                  // any compute related command after this point is attached to this pipeline (on this command buffer)
-                  vkCmdBindPipeline(command_buffer_compute, // Command Buffer
-                      VK_PIPELINE_BIND_POINT_COMPUTE,       // Pipeline Bind Point
-                      pipeline_compute);                    // Pipeline
-
-                  // bind descriptor set - texture_compute_input & texture_compute_output
-                  vkCmdBindDescriptorSets(command_buffer_compute, //  commandBuffer
-                      VK_PIPELINE_BIND_POINT_COMPUTE,             //  pipelineBindPoint
-                      pipeline_layout_compute,                    //  layout
-                      desc_set_0_compute.set_index,               //  firstSet
-                      1u,                                         //  descriptorSetCount
-                      &desc_set_0_compute.desc_set,               //  pDescriptorSets
-                      0u,                                         //  dynamicOffsetCount
-                      VK_NULL_HANDLE);                            //  pDynamicOffsets
-
-                  compute_push_constants const data =
-                  {
-                    .deltatime = 0.5f
-                  };
-
-                  vkCmdPushConstants(command_buffer_compute, // commandBuffer
-                      pipeline_layout_compute,               // layout
-                      VK_SHADER_STAGE_COMPUTE_BIT,           // stageFlags
-                      0u,                                    // offset
-                      sizeof(compute_push_constants),        // size
-                      &data);                                // pValues
-
-                  u32 ThreadGroup_x = NUM_THREAD_GROUPS_COMPUTE_PARTICLES;
-
-                  vkCmdDispatch(command_buffer_compute,
-                      ThreadGroup_x, 1u, 1u);
-              }
-              if (!end_command_buffer(command_buffer_compute))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-          }
+    // compute profile slots are the frame in flight, graphics are after them
+    // recorded once, so resolved every frame after the wait instead
+    begin_vulkan_profile_slot(command_buffer_compute, frame, VK_PIPELINE_BIND_POINT_COMPUTE);
 
-          // RECORD COMMAND BUFFER
-          {
-              if (!CHECK_VULKAN_RESULT(vkResetCommandBuffer(command_buffer_collision, 0u)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-              if (!begin_command_buffer(command_buffer_collision, 0u))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-              {
-                  // any compute related command after this point is attached to this pipeline (on this command buffer)
-                  vkCmdBindPipeline(command_buffer_collision, // Command Buffer
-                      VK_PIPELINE_BIND_POINT_COMPUTE,       // Pipeline Bind Point
-                      pipeline_collision);                    // Pipeline
+    // storage buffer writes of one dispatch must be visible to the next
+    VkMemoryBarrier const compute_to_compute_barrier =
+    {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      //.pNext = VK_NULL_HANDLE,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, // transfer for the cell count clear
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
 
-                  // bind descriptor set - texture_compute_input & texture_compute_output
-                  vkCmdBindDescriptorSets(command_buffer_collision, //  commandBuffer
-                      VK_PIPELINE_BIND_POINT_COMPUTE,             //  pipelineBindPoint
-                      pipeline_layout_collision,                    //  layout
-                      desc_set_0_collision.set_index,               //  firstSet
-                      1u,                                         //  descriptorSetCount
-                      &desc_set_0_collision.desc_set,               //  pDescriptorSets
-                      0u,                                         //  dynamicOffsetCount
-                      VK_NULL_HANDLE);                            //  pDynamicOffsets
+    // the previous step (previous submit on this queue) wrote the positions & velocities, and copied the positions out
+    // and collide must be done reading the cell counts before they are cleared
+    VkMemoryBarrier const previous_step_barrier =
+    {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      //.pNext = VK_NULL_HANDLE,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(command_buffer_compute, // commandBuffer
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, // dstStageMask
+        0u,                                      // dependencyFlags
+        1u,                                      // memoryBarrierCount
+        &previous_step_barrier,                  // pMemoryBarriers
+        0u,                                      // bufferMemoryBarrierCount
+        VK_NULL_HANDLE,                          // pBufferMemoryBarriers
+        0u,                                      // imageMemoryBarrierCount
+        VK_NULL_HANDLE);                         // pImageMemoryBarriers
+
+    // the grid count pass accumulates in to these
+    vkCmdFillBuffer(command_buffer_compute, buffer_cell_count.buffer, 0u, VK_WHOLE_SIZE, 0u);
+
+    // INTEGRATE
+    {
+        // any compute related command after this point is attached to this pipeline (on this command buffer)
+        vkCmdBindPipeline(command_buffer_compute, // Command Buffer
+            VK_PIPELINE_BIND_POINT_COMPUTE,       // Pipeline Bind Point
+            pipeline_compute);                    // Pipeline
+
+        // bind descriptor set - texture_compute_input & texture_compute_output
+        vkCmdBindDescriptorSets(command_buffer_compute, //  commandBuffer
+            VK_PIPELINE_BIND_POINT_COMPUTE,             //  pipelineBindPoint
+            pipeline_layout_compute,                    //  layout
+            desc_set_0_compute.set_index,               //  firstSet
+            1u,                                         //  descriptorSetCount
+            &desc_set_0_compute.desc_set,               //  pDescriptorSets
+            1u,                                         //  dynamicOffsetCount
+            &step_offset);                              //  pDynamicOffsets, this frame's slice of 'buffer_step'
+
+        u32 ThreadGroup_x = {}, ThreadGroup_y = {};
+        fold_vulkan_dispatch(config.num_thread_groups_particles, max_groups_x, ThreadGroup_x, ThreadGroup_y);
+
+        begin_vulkan_profile_scope(command_buffer_compute, "integrate");
+        vkCmdDispatch(command_buffer_compute,
+            ThreadGroup_x, ThreadGroup_y, 1u);
+        end_vulkan_profile_scope(command_buffer_compute);
+    }
 
+    // GRID (count -> scan -> scan blocks -> scan add -> scatter) + COLLIDE
+    // all share 'pipeline_layout_grid', so the descriptor set stays bound across the pipeline changes
+    vkCmdBindDescriptorSets(command_buffer_compute, //  commandBuffer
+        VK_PIPELINE_BIND_POINT_COMPUTE,             //  pipelineBindPoint
+        pipeline_layout_grid,                       //  layout
+        desc_set_0_grid.set_index,                  //  firstSet
+        1u,                                         //  descriptorSetCount
+        &desc_set_0_grid.desc_set,                  //  pDescriptorSets
+        0u,                                         //  dynamicOffsetCount
+        VK_NULL_HANDLE);                            //  pDynamicOffsets
+
+    struct grid_pass
+    {
+        char const* name; // profile scope
+        VkPipeline pipeline;
+        u32 num_groups;
+    };
+    grid_pass const grid_passes [] =
+    {
+        { "grid_count", pipeline_grid_count, config.num_thread_groups_particles },
+        { "grid_scan", pipeline_grid_scan, config.num_cell_blocks },
+        { "grid_scan_blocks", pipeline_grid_scan_blocks, 1u }, // one work group walks over all the block totals
+        { "grid_scan_add", pipeline_grid_scan_add, config.num_cell_blocks },
+        { "grid_scatter", pipeline_grid_scatter, config.num_thread_groups_particles },
+        { "collide", pipeline_collision, config.num_thread_groups_particles }
+    };
+    for (grid_pass const& pass : grid_passes)
+    {
+        // each pass reads what the one before it wrote (count reads integrate's positions, and accumulates in to the cleared counts)
+        vkCmdPipelineBarrier(command_buffer_compute, // commandBuffer
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,    // dstStageMask
+            0u,                                      // dependencyFlags
+            1u,                                      // memoryBarrierCount
+            &compute_to_compute_barrier,             // pMemoryBarriers
+            0u,                                      // bufferMemoryBarrierCount
+            VK_NULL_HANDLE,                          // pBufferMemoryBarriers
+            0u,                                      // imageMemoryBarrierCount
+            VK_NULL_HANDLE);                         // pImageMemoryBarriers
+
+        vkCmdBindPipeline(command_buffer_compute, // Command Buffer
+            VK_PIPELINE_BIND_POINT_COMPUTE,       // Pipeline Bind Point
+            pass.pipeline);                       // Pipeline
+
+        u32 groups_x = {}, groups_y = {};
+        fold_vulkan_dispatch(pass.num_groups, max_groups_x, groups_x, groups_y);
+
+        begin_vulkan_profile_scope(command_buffer_compute, pass.name);
+        vkCmdDispatch(command_buffer_compute,
+            groups_x, groups_y, 1u);
+        end_vulkan_profile_scope(command_buffer_compute);
+    }
 
+    // HAND OFF TO GRAPHICS
+    // the submit waits (at the transfer stage) for the draw that last read this render copy
+    {
+        // collide's writes must be visible to the copy
+        VkMemoryBarrier const compute_to_transfer_barrier =
+        {
+          .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+          //.pNext = VK_NULL_HANDLE,
+          .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+        };
+        // acquire the render copy back from graphics (released after it was drawn)
+        VkBufferMemoryBarrier const acquire_barriers [] =
+        {
+          ownership_barrier(render_buffers[0], 0u, VK_ACCESS_TRANSFER_WRITE_BIT, family_graphics, family_compute),
+          ownership_barrier(render_buffers[1], 0u, VK_ACCESS_TRANSFER_WRITE_BIT, family_graphics, family_compute)
+        };
+        vkCmdPipelineBarrier(command_buffer_compute, // commandBuffer
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_TRANSFER_BIT,          // dstStageMask
+            0u,                                      // dependencyFlags
+            1u,                                      // memoryBarrierCount
+            &compute_to_transfer_barrier,            // pMemoryBarriers
+            needs_ownership_transfer ? 2u : 0u,      // bufferMemoryBarrierCount
+            acquire_barriers,                        // pBufferMemoryBarriers
+            0u,                                      // imageMemoryBarrierCount
+            VK_NULL_HANDLE);                         // pImageMemoryBarriers
+
+        VkBufferCopy const region =
+        {
+          .srcOffset = 0u,
+          .dstOffset = 0u,
+          .size = config.num_particles * DATA_SIZE
+        };
+        vkCmdCopyBuffer(command_buffer_compute, buffer_pos_x.buffer, render_buffers[0], 1u, &region);
+        vkCmdCopyBuffer(command_buffer_compute, buffer_pos_y.buffer, render_buffers[1], 1u, &region);
 
-                  vkCmdDispatch(command_buffer_collision,
-                      COLLISION_THREADS_X, COLLISION_THREADS_Y, 1u);
-              }
-              if (!end_command_buffer(command_buffer_collision))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-          }
+        // release the render copy to graphics, which acquires it before drawing
+        // with a shared family the timeline semaphore alone makes the copy visible
+        if (needs_ownership_transfer)
+        {
+            VkBufferMemoryBarrier const release_barriers [] =
+            {
+              ownership_barrier(render_buffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, 0u, family_compute, family_graphics),
+              ownership_barrier(render_buffers[1], VK_ACCESS_TRANSFER_WRITE_BIT, 0u, family_compute, family_graphics)
+            };
+            vkCmdPipelineBarrier(command_buffer_compute, // commandBuffer
+                VK_PIPELINE_STAGE_TRANSFER_BIT,          // srcStageMask
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,    // dstStageMask
+                0u,                                      // dependencyFlags
+                0u,                                      // memoryBarrierCount
+                VK_NULL_HANDLE,                          // pMemoryBarriers
+                2u,                                      // bufferMemoryBarrierCount
+                release_barriers,                        // pBufferMemoryBarriers
+                0u,                                      // imageMemoryBarrierCount
+                VK_NULL_HANDLE);                         // pImageMemoryBarriers
+        }
+    }
 
+    if (!end_command_buffer(command_buffer_compute))
+    {
+        DBG_ASSERT(false);
+        return -1;
+    }
+  }
 
-          // RECORD COMMAND BUFFER
-          {
-              if (!CHECK_VULKAN_RESULT(vkResetCommandBuffer(command_buffer_communication, 0u)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-              if (!begin_command_buffer(command_buffer_communication, 0u))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-              {
-                  // any compute related command after this point is attached to this pipeline (on this command buffer)
-                  vkCmdBindPipeline(command_buffer_communication, // Command Buffer
-                      VK_PIPELINE_BIND_POINT_COMPUTE,       // Pipeline Bind Point
-                      pipeline_communication);                    // Pipeline
+  // hand the render copies to the compute queue, as if they had already been drawn
+  // every compute command buffer starts by acquiring its render copy from graphics, so the first ones need a release to match
+  if (needs_ownership_transfer)
+  {
+    VkCommandBuffer const command_buffer_graphics = command_buffers_graphics [0];
+    if (!begin_command_buffer (command_buffer_graphics, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+
+    std::array <VkBufferMemoryBarrier, NUM_PARTICLE_STATES * 2u> release_barriers = {};
+    for (u32 state = 0u; state < NUM_PARTICLE_STATES; ++state)
+    {
+      release_barriers [state * 2u + 0u] = ownership_barrier (buffers_render_pos_x [state].buffer, 0u, 0u, family_graphics, family_compute);
+      release_barriers [state * 2u + 1u] = ownership_barrier (buffers_render_pos_y [state].buffer, 0u, 0u, family_graphics, family_compute);
+    }
+    vkCmdPipelineBarrier (command_buffer_graphics, // commandBuffer
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,           // srcStageMask
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,        // dstStageMask
+      0u,                                          // dependencyFlags
+      0u,                                          // memoryBarrierCount
+      VK_NULL_HANDLE,                              // pMemoryBarriers
+      (u32)release_barriers.size (),               // bufferMemoryBarrierCount
+      release_barriers.data (),                    // pBufferMemoryBarriers
+      0u,                                          // imageMemoryBarrierCount
+      VK_NULL_HANDLE);                             // pImageMemoryBarriers
+
+    if (!end_command_buffer (command_buffer_graphics))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
 
-                  // bind descriptor set - texture_compute_input & texture_compute_output
-                  vkCmdBindDescriptorSets(command_buffer_communication, //  commandBuffer
-                      VK_PIPELINE_BIND_POINT_COMPUTE,             //  pipelineBindPoint
-                      pipeline_layout_communication,                    //  layout
-                      desc_set_0_communication.set_index,               //  firstSet
-                      1u,                                         //  descriptorSetCount
-                      &desc_set_0_communication.desc_set,               //  pDescriptorSets
-                      0u,                                         //  dynamicOffsetCount
-                      VK_NULL_HANDLE);                            //  pDynamicOffsets
+    // one off, wait here so the releases complete before the first step acquires
+    if (!submit_vulkan_command_buffers (queue_graphics,
+      1u, &command_buffer_graphics,
+      0u, VK_NULL_HANDLE,
+      0u, VK_NULL_HANDLE) ||
+      !CHECK_VULKAN_RESULT (vkQueueWaitIdle (queue_graphics)))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
 
+  // AUTOTUNE
+  // collide dominates the step, so tune 'particle_group_size' on it and apply the winner to every per particle shader on the next run
+  // (the pipelines and dispatch sizes here were already built with the old size)
+  // collide reads the grid, so run one real step first to build it, after that collide can be rerun as often as we like
+  if (config.autotune != 0u)
+  {
+      compute_UBO_step_buffer* const step = (compute_UBO_step_buffer*)get_mapped_span <u8> (buffer_step).data();
+      step->deltatime = config.deltatime;
+      if (!flush_vulkan_memory(device, buffer_step.allocation, 0u, step_slice_size) ||
+          !submit_vulkan_command_buffers(queue_compute,
+              1u, &command_buffers_compute[0],
+              0u, VK_NULL_HANDLE,
+              0u, VK_NULL_HANDLE) ||
+          !CHECK_VULKAN_RESULT(vkQueueWaitIdle(queue_compute)))
+      {
+          DBG_ASSERT(false);
+          return -1;
+      }
 
+      vulkan_workgroup_size const candidates [] =
+      {
+        { .x = 32u }, { .x = 64u }, { .x = 128u }, { .x = 256u }, { .x = 512u }, { .x = 1024u }
+      };
 
-                  vkCmdDispatch(command_buffer_communication,
-                      NUM_TEMP_BUCKETS_X, NUM_TEMP_BUCKETS_Y, 1u);
-              }
-              if (!end_command_buffer(command_buffer_communication))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
+      auto const create_pipeline = [&](vulkan_workgroup_size const& size, VkPipeline& out_pipeline)
+      {
+          VkShaderModule shader_module = VK_NULL_HANDLE;
+          if (!create_vulkan_shader(device,
+              COMPILED_COMPUTE_SHADER_PATH_COLLISION,
+              shader_module))
+          {
+              return false;
           }
 
-          // SUBMIT
-          {
-              if (!CHECK_VULKAN_RESULT(vkResetFences(device, 1u, &fence_compute)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
+          vulkan_specialization specialization = specialization_particles; // same grid constants, only the size changes
+          bool const is_created = set_vulkan_specialization_constant(specialization, 0u, size.x) &&
+              create_vulkan_pipeline_compute(device,
+                  shader_module, "main",
+                  pipeline_layout_grid,
+                  out_pipeline,
+                  &specialization);
+
+          release_vulkan_shader(device,
+              shader_module);
+          return is_created;
+      };
+      auto const record_dispatch = [&](VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_workgroup_size const& size)
+      {
+          vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+          vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_grid,
+              desc_set_0_grid.set_index, 1u, &desc_set_0_grid.desc_set, 0u, VK_NULL_HANDLE);
 
+          u32 groups_x = {}, groups_y = {};
+          fold_vulkan_dispatch(IntCeilDiv(config.num_particles, size.x), max_groups_x, groups_x, groups_y);
 
-              // submit compute commands
-              VkSubmitInfo const submit_info =
-              {
-                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                //.pNext = VK_NULL_HANDLE,
-                .waitSemaphoreCount = 0u,
-                .pWaitSemaphores = VK_NULL_HANDLE,
-                .pWaitDstStageMask = VK_NULL_HANDLE,
-                .commandBufferCount = 1u,
-                .pCommandBuffers = &command_buffer_compute,
-                .signalSemaphoreCount = 0u,
-                .pSignalSemaphores = VK_NULL_HANDLE
-              };
-
-              if (!CHECK_VULKAN_RESULT(vkQueueSubmit(queue_compute, 1u, &submit_info,
-                  fence_compute))) // fence to signal when complete
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
+          vkCmdDispatch(command_buffer,
+              groups_x, groups_y, 1u);
+      };
+
+      vulkan_workgroup_size tuned_size = {};
+      VkPipeline pipeline_tuned = VK_NULL_HANDLE;
+      if (!autotune_vulkan_workgroup_size(device, queue_compute,
+          AUTOTUNE_KERNEL_NAME,
+          (u32)std::size(candidates), candidates, 8u,
+          create_pipeline, record_dispatch,
+          tuned_size, pipeline_tuned))
+      {
+          DBG_ASSERT(false);
+          return -1;
+      }
+      release_vulkan_pipeline(device, pipeline_tuned);
 
+      dprintf("autotune: particle_group_size %u saved, run again without 'autotune=1' to use it\n", tuned_size.x);
+  }
 
-              // wait for fence to be triggered via vkQueueSubmit (slow!)
-              if (!CHECK_VULKAN_RESULT(vkWaitForFences(device,
-                  1u,
-                  &fence_compute,
-                  VK_TRUE,
-                  UINT64_MAX)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-          }
+  // how many driver allocations the resources above ended up using
+  print_vulkan_memory_stats ();
 
+  // after the set up and tuning, so the trace is just the frames
+  if (!config.trace_path.empty ())
+  {
+    if (!begin_vulkan_trace (physical_device, device,
+      config.trace_path.c_str ()))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
 
-          // SUBMIT
-          {
-              if (!CHECK_VULKAN_RESULT(vkResetFences(device, 1u, &fence_communication)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
 
+  // GRAPHICS RENDER
 
-              // submit compute commands
-              VkSubmitInfo const submit_info =
-              {
-                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                //.pNext = VK_NULL_HANDLE,
-                .waitSemaphoreCount = 0u,
-                .pWaitSemaphores = VK_NULL_HANDLE,
-                .pWaitDstStageMask = VK_NULL_HANDLE,
-                .commandBufferCount = 1u,
-                .pCommandBuffers = &command_buffer_communication,
-                .signalSemaphoreCount = 0u,
-                .pSignalSemaphores = VK_NULL_HANDLE
-              };
-
-              if (!CHECK_VULKAN_RESULT(vkQueueSubmit(queue_compute, 1u, &submit_info,
-                  fence_communication))) // fence to signal when complete
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
+  // GAME LOOP
+  u32 frame_index = 0u; // which set of per frame resources this frame uses
+  while (process_os_messages ())
+  {
+    // fixed length runs, for sweeps, and tuning runs, which are done before the first frame
+    if (config.autotune != 0u || (config.num_frames != 0u && timeline_frame.last_value >= config.num_frames))
+    {
+      break;
+    }
+
+    TRACE_SCOPE ("frame");
+    VkCommandBuffer const command_buffer_compute = command_buffers_compute [frame_index];
+    VkCommandBuffer const command_buffer_graphics = command_buffers_graphics [frame_index];
+    VkSemaphore const swapchain_image_available_semaphore = swapchain_image_available_semaphores [frame_index];
+    VkSemaphore const render_finished_semaphore = render_finished_semaphores [frame_index];
+
+    // frame number (1, 2, 3...), both this frame's step and draw signal it on their timeline
+    u64 const step_value = advance_vulkan_timeline (timeline_step);
+    u64 const frame_value = advance_vulkan_timeline (timeline_frame);
+    DBG_ASSERT (step_value == frame_value);
+
+    // WAIT FOR FRAME
+    // the last frame to use these resources was NUM_FRAMES_IN_FLIGHT frames ago, it has probably finished already
+    // the only cpu wait of the frame, covers that frame's compute step too (its draw waited on it)
+    if (frame_value > NUM_FRAMES_IN_FLIGHT)
+    {
+      if (!wait_vulkan_timeline (timeline_frame, frame_value - NUM_FRAMES_IN_FLIGHT))
+      {
+        DBG_ASSERT (false);
+        return -1;
+      }
 
+      // so that frame's step is done, read its timings before the command buffer is resubmitted
+      // (the draw's are read when its command buffer is re-recorded, by 'begin_vulkan_profile_slot')
+      resolve_vulkan_profile_slot (frame_index);
+    }
 
-              // wait for fence to be triggered via vkQueueSubmit (slow!)
-              if (!CHECK_VULKAN_RESULT(vkWaitForFences(device,
-                  1u,
-                  &fence_communication,
-                  VK_TRUE,
-                  UINT64_MAX)))
+    // UPDATE
+    // COMPUTE DISPATCH
+      {
+          // UPDATE STEP PARAMETERS
+          // the only per frame cpu work for the step, the command buffer itself is reused as is
+          // only this frame's slice, the other frame in flight may still be reading its own
+          {
+              TRACE_SCOPE("update step parameters");
+              VkDeviceSize const step_offset = frame_index * step_slice_size;
+              std::span <u8> const step_slices = get_mapped_span <u8> (buffer_step);
+              DBG_ASSERT(!step_slices.empty());
+              compute_UBO_step_buffer* const step = (compute_UBO_step_buffer*)(step_slices.data() + step_offset);
+              step->deltatime = config.deltatime;
+              if (!flush_vulkan_memory(device, buffer_step.allocation, step_offset, step_slice_size))
               {
                   DBG_ASSERT(false);
                   return -1;
@@ -2342,49 +2513,24 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           }
 
           // SUBMIT
+          // no fence/wait, 'timeline_step' hands the results to the graphics submit
+          // only the final copy waits, for the draw that last read this frame's render copy (NUM_PARTICLE_STATES frames ago)
+          // integrate/grid/collide run while the previous frame is drawn
+          // (on the first frames 'timeline_frame' is already at 0, so there is nothing to wait for)
           {
-              if (!CHECK_VULKAN_RESULT(vkResetFences(device, 1u, &fence_collision)))
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-
-
-              // submit compute commands
-              VkSubmitInfo const submit_info =
-              {
-                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                //.pNext = VK_NULL_HANDLE,
-                .waitSemaphoreCount = 0u,
-                .pWaitSemaphores = VK_NULL_HANDLE,
-                .pWaitDstStageMask = VK_NULL_HANDLE,
-                .commandBufferCount = 1u,
-                .pCommandBuffers = &command_buffer_collision,
-                .signalSemaphoreCount = 0u,
-                .pSignalSemaphores = VK_NULL_HANDLE
-              };
-
-              if (!CHECK_VULKAN_RESULT(vkQueueSubmit(queue_compute, 1u, &submit_info,
-                  fence_collision))) // fence to signal when complete
-              {
-                  DBG_ASSERT(false);
-                  return -1;
-              }
-
-
-              // wait for fence to be triggered via vkQueueSubmit (slow!)
-              if (!CHECK_VULKAN_RESULT(vkWaitForFences(device,
-                  1u,
-                  &fence_collision,
-                  VK_TRUE,
-                  UINT64_MAX)))
+              u64 const last_draw_value = frame_value > NUM_PARTICLE_STATES ? frame_value - NUM_PARTICLE_STATES : 0u;
+              vulkan_semaphore_wait const wait = { timeline_frame.semaphore, last_draw_value, VK_PIPELINE_STAGE_TRANSFER_BIT };
+              vulkan_semaphore_signal const signal = { timeline_step.semaphore, step_value };
+              if (!submit_vulkan_command_buffers(queue_compute,
+                  1u, &command_buffer_compute,
+                  1u, &wait,
+                  1u, &signal))
               {
                   DBG_ASSERT(false);
                   return -1;
               }
+              mark_vulkan_profile_slot_submitted(frame_index); // recorded once, so each submit has to re-arm it
           }
-
-
       }
 
 
@@ -2399,7 +2545,8 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
       // RECORD COMMAND BUFFER(S)
       {
-        // we are reusing the graphics command buffer, so need to ensure it starts of empty
+        TRACE_SCOPE ("record graphics");
+        // we are reusing this frame's graphics command buffer, so need to ensure it starts of empty
         if (!CHECK_VULKAN_RESULT (vkResetCommandBuffer (command_buffer_graphics, 0u)))
         {
           DBG_ASSERT (false);
@@ -2411,7 +2558,29 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           DBG_ASSERT (false);
           return -1;
         }
+        begin_vulkan_profile_slot (command_buffer_graphics, NUM_FRAMES_IN_FLIGHT + frame_index, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
 
+        // acquire this frame's render copy from compute (released at the end of the step)
+        // barriers can't go inside the render pass, so before it
+        if (needs_ownership_transfer)
+        {
+          VkBufferMemoryBarrier const acquire_barriers [] =
+          {
+            ownership_barrier (buffers_render_pos_x [frame_index].buffer, 0u, VK_ACCESS_SHADER_READ_BIT, family_compute, family_graphics),
+            ownership_barrier (buffers_render_pos_y [frame_index].buffer, 0u, VK_ACCESS_SHADER_READ_BIT, family_compute, family_graphics)
+          };
+          vkCmdPipelineBarrier (command_buffer_graphics, // commandBuffer
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,         // srcStageMask, where the submit waits on 'timeline_step'
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,         // dstStageMask
+            0u,                                          // dependencyFlags
+            0u,                                          // memoryBarrierCount
+            VK_NULL_HANDLE,                              // pMemoryBarriers
+            2u,                                          // bufferMemoryBarrierCount
+            acquire_barriers,                            // pBufferMemoryBarriers
+            0u,                                          // imageMemoryBarrierCount
+            VK_NULL_HANDLE);                             // pImageMemoryBarriers
+        }
 
         begin_render_pass (command_buffer_graphics, { 0.39f, 0.8f, 0.92f }); // cornflower blue
 
@@ -2438,9 +2607,9 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           vkCmdBindDescriptorSets(command_buffer_graphics,
               VK_PIPELINE_BIND_POINT_GRAPHICS,
               pipeline_layout_graphics,
-              desc_set_0_graphics_input.set_index,
+              desc_sets_0_graphics_input[frame_index].set_index,
               1u,
-              &desc_set_0_graphics_input.desc_set,
+              &desc_sets_0_graphics_input[frame_index].desc_set, // this frame's render copy
               0u,
               VK_NULL_HANDLE);
           // TODO: bind graphics input descriptor set 1 - texture_compute_input
@@ -2457,16 +2626,38 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           // TODO: call vkCmdDrawIndexed
           // indexCount = number of indices in our mesh
           // look in 'mesh_sprite'
+          begin_vulkan_profile_scope(command_buffer_graphics, "draw_particles");
           vkCmdDrawIndexed(command_buffer_graphics, // CommandBuffer
               mesh_sprite.num_indices,              // indexCount
-              NUM_PARTICLES,                        // instanceCount
+              config.num_particles,                 // instanceCount
               0u,                                   // firstIndex
               0u,                                   // vertexOffset
               0u);                                  // firstINstance
+          end_vulkan_profile_scope(command_buffer_graphics);
         }
 
         end_render_pass (command_buffer_graphics);
 
+        // release this frame's render copy back to compute, the step NUM_PARTICLE_STATES frames on acquires it
+        if (needs_ownership_transfer)
+        {
+          VkBufferMemoryBarrier const release_barriers [] =
+          {
+            ownership_barrier (buffers_render_pos_x [frame_index].buffer, 0u, 0u, family_graphics, family_compute),
+            ownership_barrier (buffers_render_pos_y [frame_index].buffer, 0u, 0u, family_graphics, family_compute)
+          };
+          vkCmdPipelineBarrier (command_buffer_graphics, // commandBuffer
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,         // srcStageMask
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,        // dstStageMask
+            0u,                                          // dependencyFlags
+            0u,                                          // memoryBarrierCount
+            VK_NULL_HANDLE,                              // pMemoryBarriers
+            2u,                                          // bufferMemoryBarrierCount
+            release_barriers,                            // pBufferMemoryBarriers
+            0u,                                          // imageMemoryBarrierCount
+            VK_NULL_HANDLE);                             // pImageMemoryBarriers
+        }
+
 
         if (!end_command_buffer (command_buffer_graphics))
         {
@@ -2477,73 +2668,69 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
       // SUBMIT
       {
-        if (!CHECK_VULKAN_RESULT (vkResetFences (device, 1u, &fence_submit_graphics)))
-        {
-          DBG_ASSERT (false);
-          return -1;
-        }
-
-
         // submit graphics commands
-        VkPipelineStageFlags const wait_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // look me up!
-        // TODO: fill in 'submit_info'
         // remember we must WAIT for 'swapchain_image_available_semaphore' semaphore to be triggered before we submit
-        VkSubmitInfo const submit_info =
+        // and for the simulation step, the vertex shader reads the particle positions
+        vulkan_semaphore_wait const waits [] =
         {
-          .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-          //.pNext = VK_NULL_HANDLE,
-          .waitSemaphoreCount = 1u,
-          .pWaitSemaphores = &swapchain_image_available_semaphore, // wait for these semaphores to be signalled before submitting command buffers
-          .pWaitDstStageMask = &wait_stage_mask,
-          .commandBufferCount = 1u,
-          .pCommandBuffers = &command_buffer_graphics,
-          .signalSemaphoreCount = 0u,
-          .pSignalSemaphores = VK_NULL_HANDLE                     // semaphores to trigger when command buffer has finished executing
+          { swapchain_image_available_semaphore, 0u, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }, // binary, look me up!
+          { timeline_step.semaphore, step_value, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT }
         };
-
-        if (!CHECK_VULKAN_RESULT (vkQueueSubmit (queue_graphics, 1u, &submit_info,
-          fence_submit_graphics))) // fence to signal when complete
+        // semaphores to trigger when command buffer has finished executing
+        vulkan_semaphore_signal const signals [] =
         {
-          DBG_ASSERT (false);
-          return -1;
-        }
-
+          { render_finished_semaphore, 0u }, // binary, present waits on it
+          { timeline_frame.semaphore, frame_value }
+        };
 
-        // wait for fence to be triggered via vkQueueSubmit
-        // would not do this here if 'properly' double buffering...
-        // research it
-        if (!CHECK_VULKAN_RESULT (vkWaitForFences (device,
-          1u,
-          &fence_submit_graphics,
-          VK_TRUE,
-          UINT64_MAX)))
+        if (!submit_vulkan_command_buffers (queue_graphics,
+          1u, &command_buffer_graphics,
+          2u, waits,
+          2u, signals))
         {
           DBG_ASSERT (false);
           return -1;
         }
 
-
+        // no wait here, 'timeline_frame' is waited on when this frame's resources come round again
       }
 
-      if (!present ())
+      if (!present (render_finished_semaphore))
       {
         DBG_ASSERT (false);
         return -1;
       }
     }
+
+    frame_index = (frame_index + 1u) % NUM_FRAMES_IN_FLIGHT;
   }
 
 
   // RELEASE
   {
+    // frames may still be in flight
+    vkDeviceWaitIdle (device);
+
+    // the last frames in flight were never waited on, so their gpu scopes are still in the query pools
+    if (is_vulkan_trace_recording ())
+    {
+      for (u32 frame = 0u; frame < NUM_FRAMES_IN_FLIGHT; ++frame)
+      {
+        resolve_vulkan_profile_slot (frame);
+        resolve_vulkan_profile_slot (NUM_FRAMES_IN_FLIGHT + frame);
+      }
+    }
+    end_vulkan_trace ();
+
     // GRAPHICS PIPELINE
     {
-      release_vulkan_fences (1u, &fence_submit_graphics);
-      release_vulkan_semaphores (1u, &swapchain_image_available_semaphore);
+      release_vulkan_timelines (1u, &timeline_frame);
+      release_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, render_finished_semaphores.data ());
+      release_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, swapchain_image_available_semaphores.data ());
 
       release_vulkan_mesh (device, mesh_sprite);
 
-      release_vulkan_command_buffers (1u, command_pool_graphics, &command_buffer_graphics);
+      release_vulkan_command_buffers (NUM_FRAMES_IN_FLIGHT, command_pool_graphics, command_buffers_graphics.data ());
       release_vulkan_command_pool (command_pool_graphics);
 
 
@@ -2555,7 +2742,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       release_vulkan_descriptor_sets (device,
         1u, &desc_set_1_graphics_input);
       release_vulkan_descriptor_sets (device,
-        1u, &desc_set_0_graphics_input);
+        NUM_PARTICLE_STATES, desc_sets_0_graphics_input.data ());
       release_vulkan_descriptor_pool (device, descriptor_pool_graphics);
 
       release_vulkan_pipeline (device, pipeline_graphics);
@@ -2566,9 +2753,9 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
     // COMPUTE PIPELINE
     {
-      release_vulkan_fences (1u, &fence_compute);
+      release_vulkan_timelines (1u, &timeline_step);
 
-      release_vulkan_command_buffers (1u, command_pool_compute, &command_buffer_compute);
+      release_vulkan_command_buffers (NUM_FRAMES_IN_FLIGHT, command_pool_compute, command_buffers_compute.data ());
       release_vulkan_command_pool (command_pool_compute);
 
 
@@ -2577,7 +2764,12 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       release_vulkan_buffer(device, buffer_vel_x);
       release_vulkan_buffer(device, buffer_vel_y);
       release_vulkan_buffer(device, buffer_info);
-      release_vulkan_buffer(device, buffer_bucket_temp);
+      release_vulkan_buffer(device, buffer_step);
+      for (u32 state = 0u; state < NUM_PARTICLE_STATES; ++state)
+      {
+          release_vulkan_buffer(device, buffers_render_pos_x[state]);
+          release_vulkan_buffer(device, buffers_render_pos_y[state]);
+      }
 
       release_vulkan_descriptor_sets (device,
         1u, &desc_set_0_compute);
@@ -2588,27 +2780,43 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       release_vulkan_descriptor_set_layouts (device,
         NUM_SETS_COMPUTE, descriptor_set_layouts_compute.data ());
     }
-    // COMPUTE PIPELINE
+    // GRID PIPELINES
     {
-        release_vulkan_fences(1u, &fence_collision);
-
-        release_vulkan_command_buffers(1u, command_pool_collision, &command_buffer_collision);
-        release_vulkan_command_pool(command_pool_collision);
-
-        release_vulkan_buffer(device, buffer_bucket);
+        release_vulkan_buffer(device, buffer_sorted_particles);
+        release_vulkan_buffer(device, buffer_particle_cell);
+        release_vulkan_buffer(device, buffer_block_sum);
+        release_vulkan_buffer(device, buffer_cell_start);
+        release_vulkan_buffer(device, buffer_cell_count);
 
         release_vulkan_descriptor_sets(device,
-            1u, &desc_set_0_collision);
-        release_vulkan_descriptor_pool(device, descriptor_pool_collision);
+            1u, &desc_set_0_grid);
+        release_vulkan_descriptor_pool(device, descriptor_pool_grid);
 
         release_vulkan_pipeline(device, pipeline_collision);
-        release_vulkan_pipeline_layout(device, pipeline_layout_collision);
+        release_vulkan_pipeline(device, pipeline_grid_scatter);
+        release_vulkan_pipeline(device, pipeline_grid_scan_add);
+        release_vulkan_pipeline(device, pipeline_grid_scan_blocks);
+        release_vulkan_pipeline(device, pipeline_grid_scan);
+        release_vulkan_pipeline(device, pipeline_grid_count);
+        release_vulkan_pipeline_layout(device, pipeline_layout_grid);
         release_vulkan_descriptor_set_layouts(device,
-            NUM_SETS_COLLISION, descriptor_set_layouts_collision.data());
+            NUM_SETS_GRID, descriptor_set_layouts_grid.data());
+    }
+
+    // LIBRARIES
+    {
+      print_vulkan_pipeline_cache_stats ();
+      release_vulkan_pipeline_cache (device); // saves the cache for the next run
+      print_vulkan_autotuner ();
+      release_vulkan_autotuner (); // saves anything tuned this run
+      print_vulkan_profile_stats ();
+      release_vulkan_profiler (device);
     }
 
     // CONTEXT
     {
+      release_vulkan_uploads ();
+      release_vulkan_memory (device);
       release_vulkan_swapchain ();
       release_vulkan_device ();
       release_vulkan_surface ();
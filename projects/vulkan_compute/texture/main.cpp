@@ -84,16 +84,17 @@
 //      |   mesh_sprite:
 //      |     1 x vertex buffer (xy = position, uv = tex coords)
 //      |     1 x index buffer (16bit uint)
-//      | 6) create vulkan command buffer
-//      | 7) create vulkan sync objects
-//      |   1 x semaphore
-//      |   1 x fence
+//      | 6) create vulkan command buffers (1 per frame in flight)
+//      | 7) create vulkan sync objects (per frame in flight)
+//      |   2 x semaphore (swapchain image available, render finished)
+//      |   1 x fence (created signalled)
 
 // GRAPHICS RENDER
 //      | GAME LOOP
 //      | 01) process os messages
 //      |   check glfw if window should close
 //      |   poll glfw input events
+//      |   wait for this frame in flight's fence (signalled NUM_FRAMES_IN_FLIGHT frames ago)
 //      |   UPDATE
 //      |   RENDER
 //      |   02) acquire next swapchain image
@@ -120,8 +121,10 @@
 //      |   19) reset fence
 // TODO |   20) submit
 //      |     wait on 'swapchain_image_available_semaphore' semaphore
-//      |   21) wait for submit to complete (via fence)
-//      |   22) present
+//      |     signal 'render_finished_semaphore' semaphore + fence
+//      |   21) present
+//      |     wait on 'render_finished_semaphore' semaphore
+//      |   22) move on to the next frame in flight
 
 // RELEASE
 //      | 1) release graphics pipeline
@@ -134,9 +137,13 @@
 #include "../vulkan_context.h"
 #include "../vulkan_pipeline.h"
 #include "../vulkan_resources.h"
+#include "../vulkan_memory.h"
+#include "../vulkan_upload.h"
+#include "../vulkan_autotune.h"
 
 #include <array>                  // for std::array
 #include <cmath>                  // for std::ceilf
+#include <cstring>                // for std::strstr
 #include <span>                   // for std::span
 
 #define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
@@ -151,13 +158,19 @@ constexpr char const* COMPILED_COMPUTE_SHADER_PATH = "data/shaders/glsl/vulkan_c
 constexpr char const* COMPILED_GRAPHICS_SHADER_PATH_VERT = "data/shaders/glsl/vulkan_compute_texture/sprite.vert.spv";
 constexpr char const* COMPILED_GRAPHICS_SHADER_PATH_FRAG = "data/shaders/glsl/vulkan_compute_texture/sprite.frag.spv";
 constexpr char const* TEXTURE_PATH = "data/textures/test.png";
+constexpr u32 THREAD_GROUP_DIM = 16u; // baked in to the shader's local_size_x/y (specialization constants 0 & 1), unless this device has been tuned
+constexpr char const* AUTOTUNE_KERNEL_NAME = "vulkan_compute_texture.greyscale";
 
 
 int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   _In_opt_ HINSTANCE/* hPrevInstance*/,
-  _In_ LPSTR/* lpCmdLine*/,
+  _In_ LPSTR lpCmdLine,
   _In_ int/* nShowCmd*/)
 {
+  // 'autotune=1' on the command line times the kernel with each candidate work group shape before running it
+  // the winner is saved for this device, and used by every later run
+  bool const is_autotune = lpCmdLine != nullptr && std::strstr (lpCmdLine, "autotune=1") != nullptr;
+
   // CONTEXT
 
   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
@@ -196,6 +209,17 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
   }
+  // create the libraries on top of the device
+  {
+    if (!create_vulkan_pipeline_cache (physical_device, device,
+        VULKAN_PIPELINE_CACHE_PATH, has_vulkan_pipeline_creation_feedback ()) ||
+      !create_vulkan_autotuner (physical_device, VULKAN_AUTOTUNE_PATH) ||
+      !create_vulkan_profiler (physical_device, device, has_vulkan_pipeline_statistics ()))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+  }
   // get vulkan queues
   {
     if (!get_vulkan_queue_compute (queue_compute))
@@ -213,6 +237,9 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
   // COMPUTE PIPELINE
 
+  vulkan_workgroup_size thread_group_size = { .x = THREAD_GROUP_DIM, .y = THREAD_GROUP_DIM };
+  find_vulkan_workgroup_size (AUTOTUNE_KERNEL_NAME, thread_group_size); // keeps the default if this device hasn't been tuned
+
   constexpr u32 NUM_SETS_COMPUTE = 1u;
 
   constexpr u32 NUM_RESOURCES_COMPUTE_SET_0 = 2u;
@@ -288,10 +315,14 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       return -1;
     }
 
-    if (!create_vulkan_pipeline_compute (device,
+    vulkan_specialization specialization;
+    if (!set_vulkan_specialization_constant (specialization, 0u, thread_group_size.x) ||
+      !set_vulkan_specialization_constant (specialization, 1u, thread_group_size.y) ||
+      !create_vulkan_pipeline_compute (device,
       shader_module_compute, "main",
       pipeline_layout_compute,
-      pipeline_compute))
+      pipeline_compute,
+      &specialization))
     {
       DBG_ASSERT (false);
       return -1;
@@ -345,6 +376,12 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     }
   }
   // create compute resources
+  // the texture upload and layout transitions are batched in to one submit
+  if (!begin_vulkan_upload_batch (physical_device, device))
+  {
+    DBG_ASSERT (false);
+    return -1;
+  }
   {
     VkFormat const image_format = VK_FORMAT_R8G8B8A8_UNORM;
 
@@ -385,6 +422,11 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     //   sampled = image can be sampled from later
     //   storage = so we can use it in the compute shader
   }
+  if (!submit_vulkan_upload_batch (true))
+  {
+    DBG_ASSERT (false);
+    return -1;
+  }
   // bind compute resources to compute descriptor set
   {
     // desc_set_0_compute = for compute = texture_compute_input + texture_compute_output
@@ -462,6 +504,66 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   }
 
 
+  // AUTOTUNE
+  // the filter only reads the input image and overwrites the output, so it can be run as often as we like on the real images
+  if (is_autotune)
+  {
+    vulkan_workgroup_size const candidates [] =
+    {
+      { .x = 8u, .y = 8u }, { .x = 16u, .y = 8u }, { .x = 8u, .y = 16u }, { .x = 16u, .y = 16u },
+      { .x = 32u, .y = 8u }, { .x = 64u, .y = 4u }, { .x = 32u, .y = 32u }
+    };
+
+    auto const create_pipeline = [&](vulkan_workgroup_size const& size, VkPipeline& out_pipeline)
+    {
+      VkShaderModule shader_module = VK_NULL_HANDLE;
+      if (!create_vulkan_shader (device,
+        COMPILED_COMPUTE_SHADER_PATH,
+        shader_module))
+      {
+        return false;
+      }
+
+      vulkan_specialization specialization;
+      bool const is_created = set_vulkan_specialization_constant (specialization, 0u, size.x) &&
+        set_vulkan_specialization_constant (specialization, 1u, size.y) &&
+        create_vulkan_pipeline_compute (device,
+        shader_module, "main",
+        pipeline_layout_compute,
+        out_pipeline,
+        &specialization);
+
+      release_vulkan_shader (device,
+        shader_module);
+      return is_created;
+    };
+    auto const record_dispatch = [&](VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_workgroup_size const& size)
+    {
+      vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+      vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_compute,
+        desc_set_0_compute.set_index, 1u, &desc_set_0_compute.desc_set, 0u, VK_NULL_HANDLE);
+
+      vkCmdDispatch (command_buffer,
+        ((texture_compute_input.dim.x - 1u) / size.x) + 1u, ((texture_compute_input.dim.y - 1u) / size.y) + 1u, 1u);
+    };
+
+    VkPipeline pipeline_tuned = VK_NULL_HANDLE;
+    if (!autotune_vulkan_workgroup_size (device, queue_compute,
+      AUTOTUNE_KERNEL_NAME,
+      (u32)std::size (candidates), candidates, 8u,
+      create_pipeline, record_dispatch,
+      thread_group_size, pipeline_tuned))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+
+    // carry on with the winner
+    release_vulkan_pipeline (device, pipeline_compute);
+    pipeline_compute = pipeline_tuned;
+  }
+
+
   // COMPUTE DISPATCH
   {
     // RECORD COMMAND BUFFER
@@ -471,6 +573,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
         DBG_ASSERT (false);
         return -1;
       }
+      begin_vulkan_profile_slot (command_buffer_compute, 0u, VK_PIPELINE_BIND_POINT_COMPUTE);
       {
         // any compute related command after this point is attached to this pipeline (on this command buffer)
           vkCmdBindPipeline(command_buffer_compute, // Command Buffer
@@ -488,12 +591,15 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
               VK_NULL_HANDLE);                            //  pDynamicOffsets
 
 
-        // see 'bin/data/shaders/glsl/vulkan_compute_texture/vulkan_compute_texture.comp' for thread group size!
+        // the thread group size is 'thread_group_size' (THREAD_GROUP_DIM x THREAD_GROUP_DIM or tuned), set when the pipeline was created
         // HINT: the thread groups are 2D and so will the 'grid' of thread groups we want to create
-          u32 ThreadGroup_x = 60u, ThreadGroup_y = 60u;
+        // rounded up, the shader skips the pixels past the edge of the image
+          u32 ThreadGroup_x = ((texture_compute_input.dim.x - 1u) / thread_group_size.x) + 1u, ThreadGroup_y = ((texture_compute_input.dim.y - 1u) / thread_group_size.y) + 1u;
 
+          begin_vulkan_profile_scope (command_buffer_compute, "greyscale");
           vkCmdDispatch(command_buffer_compute,
               ThreadGroup_x, ThreadGroup_y, 1u);
+          end_vulkan_profile_scope (command_buffer_compute);
       }
       if (!end_command_buffer (command_buffer_compute))
       {
@@ -543,6 +649,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
         DBG_ASSERT (false);
         return -1;
       }
+      resolve_vulkan_profile_slot (0u); // we waited anyway, so the timings are ready
     }
 
     // TRANSITION IMAGE LAYOUTS
@@ -608,12 +715,14 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
     buffer_graphics_model_output; // for when rendering the output texture
 
   VkCommandPool command_pool_graphics = VK_NULL_HANDLE;
-  VkCommandBuffer command_buffer_graphics = VK_NULL_HANDLE;
+  std::array <VkCommandBuffer, NUM_FRAMES_IN_FLIGHT> command_buffers_graphics = { VK_NULL_HANDLE }; // one per frame in flight
 
   vulkan_mesh mesh_sprite;
 
-  VkSemaphore swapchain_image_available_semaphore = VK_NULL_HANDLE;
-  VkFence fence_submit_graphics = VK_NULL_HANDLE;
+  // one set per frame in flight, so frame n+1 can be recorded while frame n renders
+  std::array <VkSemaphore, NUM_FRAMES_IN_FLIGHT> swapchain_image_available_semaphores = { VK_NULL_HANDLE };
+  std::array <VkSemaphore, NUM_FRAMES_IN_FLIGHT> render_finished_semaphores = { VK_NULL_HANDLE }; // present waits on these
+  std::array <VkFence, NUM_FRAMES_IN_FLIGHT> fences_submit_graphics = { VK_NULL_HANDLE };
 
 
   // create graphics pipeline
@@ -969,60 +1078,50 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
       }
 
 
-    // as the data will never change (because we are not actually double buffering and the camera/sprites will never move)
-    // we can set the data in these buffers upfront
-
-    if (!map_and_unmap_memory (device,
-      buffer_graphics_camera.memory,
-      [extent](void* mem)
-      {
-        camera_buffer* buf = (camera_buffer*)mem;
+    // as the data will never change (the camera/sprites never move)
+    // we can set the data in these buffers upfront, and share them between frames in flight
 
-        // put camera origin in centre of screen
+    // host visible buffers stay mapped for their lifetime, so write straight in to them
+    std::span <camera_buffer> const camera = get_mapped_span <camera_buffer> (buffer_graphics_camera);
+    DBG_ASSERT (!camera.empty ());
+    {
+      // put camera origin in centre of screen
 
-        f32 const screen_width_half = (f32)extent.width / 2.f;
-        f32 const screen_height_half = (f32)extent.height / 2.f;
+      f32 const screen_width_half = (f32)extent.width / 2.f;
+      f32 const screen_height_half = (f32)extent.height / 2.f;
 
-        f32 const left = -screen_width_half, right = screen_width_half;
-        f32 const bottom = -screen_height_half, top = screen_height_half;
-        f32 const z_near = 0.f, z_far = 1.f;
+      f32 const left = -screen_width_half, right = screen_width_half;
+      f32 const bottom = -screen_height_half, top = screen_height_half;
+      f32 const z_near = 0.f, z_far = 1.f;
 
-        buf->vp_matrix = glm::ortho (left, right, bottom, top, z_near, z_far);
-        buf->vp_matrix [1][1] *= -1.f;
-      }))
+      camera [0].vp_matrix = glm::ortho (left, right, bottom, top, z_near, z_far);
+      camera [0].vp_matrix [1][1] *= -1.f;
+    }
+    if (!flush_vulkan_memory (device, buffer_graphics_camera.allocation))
     {
       DBG_ASSERT (false);
       return -1;
     }
 
     vec2 const texture_dim = (vec2)texture_compute_input.dim * 0.65f;
-    if (!map_and_unmap_memory (device,
-      buffer_graphics_model_input.memory,
-      [&texture_dim](void* mem)
-      {
-        model_buffer* buf = (model_buffer*)mem;
-
-        buf->model_matrix = fast_transform_2D (-texture_dim.x / 2.f, 0.f,
-          0.f,
-          0.f, 0.f,
-          texture_dim.x, texture_dim.y);
-      }))
+    std::span <model_buffer> const model_input = get_mapped_span <model_buffer> (buffer_graphics_model_input);
+    DBG_ASSERT (!model_input.empty ());
+    model_input [0].model_matrix = fast_transform_2D (-texture_dim.x / 2.f, 0.f,
+      0.f,
+      0.f, 0.f,
+      texture_dim.x, texture_dim.y);
+    if (!flush_vulkan_memory (device, buffer_graphics_model_input.allocation))
     {
       DBG_ASSERT (false);
       return -1;
     }
-
-    if (!map_and_unmap_memory (device,
-      buffer_graphics_model_output.memory,
-      [&texture_dim](void* mem)
-      {
-        model_buffer* buf = (model_buffer*)mem;
-
-        buf->model_matrix = fast_transform_2D (texture_dim.x / 2.f, 0.f,
-          0.f,
-          0.f, 0.f,
-          texture_dim.x, texture_dim.y);
-      }))
+    std::span <model_buffer> const model_output = get_mapped_span <model_buffer> (buffer_graphics_model_output);
+    DBG_ASSERT (!model_output.empty ());
+    model_output [0].model_matrix = fast_transform_2D (texture_dim.x / 2.f, 0.f,
+      0.f,
+      0.f, 0.f,
+      texture_dim.x, texture_dim.y);
+    if (!flush_vulkan_memory (device, buffer_graphics_model_output.allocation))
     {
       DBG_ASSERT (false);
       return -1;
@@ -1191,41 +1290,69 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
   // create graphics command buffers
   {
     // we can have several command buffers per pipeline
-    // but we are going to keep it simple
-    // 1 command buffer for graphics that we reuse every frame
+    // 1 command buffer per frame in flight, each reused every NUM_FRAMES_IN_FLIGHT frames
 
     if (!create_vulkan_command_pool (VK_QUEUE_GRAPHICS_BIT, command_pool_graphics))
     {
       DBG_ASSERT (false);
       return -1;
     }
-    if (!create_vulkan_command_buffers (1u, command_pool_graphics, &command_buffer_graphics))
+    if (!create_vulkan_command_buffers (NUM_FRAMES_IN_FLIGHT, command_pool_graphics, command_buffers_graphics.data ()))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
   // create graphics sync objects
-  // at least one per submit (can be reused if in loop)
+  // one set per frame in flight
   {
-    if (!create_vulkan_semaphores (1u, &swapchain_image_available_semaphore))
+    if (!create_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, swapchain_image_available_semaphores.data ()))
+    {
+      DBG_ASSERT (false);
+      return -1;
+    }
+    if (!create_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, render_finished_semaphores.data ()))
     {
       DBG_ASSERT (false);
       return -1;
     }
-    if (!create_vulkan_fences (1u, 0u, &fence_submit_graphics))
+    // created signalled, so the first wait on each frame's fence returns straight away
+    if (!create_vulkan_fences (NUM_FRAMES_IN_FLIGHT, VK_FENCE_CREATE_SIGNALED_BIT, fences_submit_graphics.data ()))
     {
       DBG_ASSERT (false);
       return -1;
     }
   }
 
+  // how many driver allocations the resources above ended up using
+  print_vulkan_memory_stats ();
+
 
   // GRAPHICS RENDER
 
   // GAME LOOP
+  u32 frame_index = 0u; // which set of per frame resources this frame uses
   while (process_os_messages ())
   {
+    VkCommandBuffer const command_buffer_graphics = command_buffers_graphics [frame_index];
+    VkSemaphore const swapchain_image_available_semaphore = swapchain_image_available_semaphores [frame_index];
+    VkSemaphore const render_finished_semaphore = render_finished_semaphores [frame_index];
+    VkFence const fence_submit_graphics = fences_submit_graphics [frame_index];
+
+    // WAIT FOR FRAME
+    // the last frame to use these resources was NUM_FRAMES_IN_FLIGHT frames ago, it has probably finished already
+    {
+      if (!CHECK_VULKAN_RESULT (vkWaitForFences (device,
+        1u,
+        &fence_submit_graphics,
+        VK_TRUE,
+        UINT64_MAX)))
+      {
+        DBG_ASSERT (false);
+        return -1;
+      }
+    }
+
     // UPDATE
     {
     }
@@ -1241,7 +1368,7 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
 
       // RECORD COMMAND BUFFER(S)
       {
-        // we are reusing the graphics command buffer, so need to ensure it starts of empty
+        // we are reusing this frame's graphics command buffer, so need to ensure it starts of empty
         if (!CHECK_VULKAN_RESULT (vkResetCommandBuffer (command_buffer_graphics, 0u)))
         {
           DBG_ASSERT (false);
@@ -1253,6 +1380,8 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           DBG_ASSERT (false);
           return -1;
         }
+        // profile slot 0 is the compute dispatch, then one per frame in flight
+        begin_vulkan_profile_slot (command_buffer_graphics, 1u + frame_index, VK_PIPELINE_BIND_POINT_GRAPHICS);
 
 
         begin_render_pass (command_buffer_graphics, { 0.39f, 0.8f, 0.92f }); // cornflower blue
@@ -1299,12 +1428,14 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           // TODO: call vkCmdDrawIndexed
           // indexCount = number of indices in our mesh
           // look in 'mesh_sprite'
+          begin_vulkan_profile_scope (command_buffer_graphics, "draw_input");
           vkCmdDrawIndexed(command_buffer_graphics,
               mesh_sprite.num_indices,
               1u,
               0u,
               0u,
               0u);
+          end_vulkan_profile_scope (command_buffer_graphics);
         }
 
         // render output image
@@ -1334,12 +1465,14 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
                 VK_NULL_HANDLE);
           // TODO: call vkCmdDrawIndexed
           // we are drawing the same mesh again (just with different DSIs now :)
+            begin_vulkan_profile_scope (command_buffer_graphics, "draw_output");
             vkCmdDrawIndexed(command_buffer_graphics,
                 mesh_sprite.num_indices,
                 1u,
                 0u,
                 0u,
                 0u);
+            end_vulkan_profile_scope (command_buffer_graphics);
         }
 
         end_render_pass (command_buffer_graphics);
@@ -1374,8 +1507,8 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           .pWaitDstStageMask = &wait_stage_mask,
           .commandBufferCount = 1u,
           .pCommandBuffers = &command_buffer_graphics,
-          .signalSemaphoreCount = 0u,
-          .pSignalSemaphores = VK_NULL_HANDLE                     // semaphores to trigger when command buffer has finished executing
+          .signalSemaphoreCount = 1u,
+          .pSignalSemaphores = &render_finished_semaphore         // semaphores to trigger when command buffer has finished executing
         };
 
         if (!CHECK_VULKAN_RESULT (vkQueueSubmit (queue_graphics, 1u, &submit_info,
@@ -1385,40 +1518,34 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
           return -1;
         }
 
-
-        // wait for fence to be triggered via vkQueueSubmit
-        // would not do this here if 'properly' double buffering...
-        // research it
-        if (!CHECK_VULKAN_RESULT (vkWaitForFences (device,
-          1u,
-          &fence_submit_graphics,
-          VK_TRUE,
-          UINT64_MAX)))
-        {
-          DBG_ASSERT (false);
-          return -1;
-        }
+        // no wait here, the fence is waited on when this frame's resources come round again
       }
 
-      if (!present ())
+      if (!present (render_finished_semaphore))
       {
         DBG_ASSERT (false);
         return -1;
       }
     }
+
+    frame_index = (frame_index + 1u) % NUM_FRAMES_IN_FLIGHT;
   }
 
 
   // RELEASE
   {
+    // frames may still be in flight
+    vkDeviceWaitIdle (device);
+
     // GRAPHICS PIPELINE
     {
-      release_vulkan_fences (1u, &fence_submit_graphics);
-      release_vulkan_semaphores (1u, &swapchain_image_available_semaphore);
+      release_vulkan_fences (NUM_FRAMES_IN_FLIGHT, fences_submit_graphics.data ());
+      release_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, render_finished_semaphores.data ());
+      release_vulkan_semaphores (NUM_FRAMES_IN_FLIGHT, swapchain_image_available_semaphores.data ());
 
       release_vulkan_mesh (device, mesh_sprite);
 
-      release_vulkan_command_buffers (1u, command_pool_graphics, &command_buffer_graphics);
+      release_vulkan_command_buffers (NUM_FRAMES_IN_FLIGHT, command_pool_graphics, command_buffers_graphics.data ());
       release_vulkan_command_pool (command_pool_graphics);
 
       release_vulkan_buffer (device, buffer_graphics_model_output);
@@ -1461,8 +1588,20 @@ int WINAPI WinMain (_In_ HINSTANCE/* hInstance*/,
         NUM_SETS_COMPUTE, descriptor_set_layouts_compute.data ());
     }
 
+    // LIBRARIES
+    {
+      print_vulkan_pipeline_cache_stats ();
+      release_vulkan_pipeline_cache (device); // saves the cache for the next run
+      print_vulkan_autotuner ();
+      release_vulkan_autotuner (); // saves anything tuned this run
+      print_vulkan_profile_stats ();
+      release_vulkan_profiler (device);
+    }
+
     // CONTEXT
     {
+      release_vulkan_uploads ();
+      release_vulkan_memory (device);
       release_vulkan_swapchain ();
       release_vulkan_device ();
       release_vulkan_surface ();
@@ -3,15 +3,19 @@
 #include <cassert> // for assert
 #include <cmath>   // for std::cos, std::sin
 #include <cstdarg> // for va_list, va_start
+#include <cstdio>  // for std::vsnprintf, std::fputs
 #include <fstream> // for std::ifstream
 
-#ifndef NDEBUG
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN // exclude rarely-used content from the Windows headers
 #define NOMINMAX            // prevent windows macros defining their own min and max macros
-#include <Windows.h>        // for DebugBreak, OutputDebugString
+#include <Windows.h>        // for DebugBreak, OutputDebugString, CreateFileMapping
+#else // _WIN32
+#include <fcntl.h>          // for open
+#include <sys/mman.h>       // for mmap, munmap
+#include <sys/stat.h>       // for fstat
+#include <unistd.h>         // for close, ftruncate
 #endif // _WIN32
-#endif // NDEBUG
 
 
 //#define DPRINTF_FILE
@@ -27,7 +31,7 @@ void dprintf (char const* const fmt, ...)
   // format string
   va_list params;
   va_start (params, fmt);
-  vsprintf_s (buf, fmt, params);
+  std::vsnprintf (buf, sizeof (buf), fmt, params);
   va_end (params);
 
   // output to file
@@ -40,6 +44,9 @@ void dprintf (char const* const fmt, ...)
   // output to VS output window
 #ifdef _WIN32
   OutputDebugString (buf);
+#else // _WIN32
+  // no debugger output window, e.g. headless linux, so use stderr instead
+  std::fputs (buf, stderr);
 #endif // _WIN32
 #endif // NDEBUG
 }
@@ -98,3 +105,125 @@ bool read_file (char const* path,
 
   return true;
 }
+
+#ifdef _WIN32
+static bool map_file (char const* path, u64 size, bool is_writable,
+  mapped_file& out_file)
+{
+  DBG_ASSERT (out_file.data == nullptr);
+
+
+  HANDLE const file = CreateFileA (path,
+    is_writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+    FILE_SHARE_READ,
+    NULL,
+    is_writable ? CREATE_ALWAYS : OPEN_EXISTING,
+    FILE_FLAG_SEQUENTIAL_SCAN,
+    NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return DBG_ASSERT_MSG (false, "failed to open file: %s\n", path);
+  }
+  if (!is_writable)
+  {
+    LARGE_INTEGER file_size = {};
+    GetFileSizeEx (file, &file_size);
+    size = (u64)file_size.QuadPart;
+  }
+  out_file.file_handle = file;
+  out_file.size = size;
+  if (size == 0u)
+  {
+    return true; // nothing to map
+  }
+
+  HANDLE const mapping = CreateFileMappingA (file, NULL, is_writable ? PAGE_READWRITE : PAGE_READONLY,
+    (DWORD)(size >> 32u), (DWORD)(size & 0xffffffffu), NULL); // also sets the size of a new file
+  if (mapping == NULL)
+  {
+    unmap_file (out_file);
+    return DBG_ASSERT_MSG (false, "failed to map file: %s\n", path);
+  }
+  out_file.mapping_handle = mapping;
+
+  out_file.data = (u8*)MapViewOfFile (mapping, is_writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0u, 0u, 0u);
+  if (out_file.data == nullptr)
+  {
+    unmap_file (out_file);
+    return DBG_ASSERT_MSG (false, "failed to map file: %s\n", path);
+  }
+
+  return true;
+}
+void unmap_file (mapped_file& file)
+{
+  if (file.data != nullptr) UnmapViewOfFile (file.data);
+  if (file.mapping_handle != nullptr) CloseHandle (file.mapping_handle);
+  if (file.file_handle != nullptr) CloseHandle (file.file_handle);
+  file = {};
+}
+#else // _WIN32
+static bool map_file (char const* path, u64 size, bool is_writable,
+  mapped_file& out_file)
+{
+  DBG_ASSERT (out_file.data == nullptr);
+
+
+  int const fd = is_writable ? open (path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open (path, O_RDONLY);
+  if (fd < 0)
+  {
+    return DBG_ASSERT_MSG (false, "failed to open file: %s\n", path);
+  }
+  out_file.fd = fd;
+
+  if (is_writable)
+  {
+    if (ftruncate (fd, (off_t)size) != 0)
+    {
+      unmap_file (out_file);
+      return DBG_ASSERT_MSG (false, "failed to size file: %s\n", path);
+    }
+  }
+  else
+  {
+    struct stat file_stat = {};
+    fstat (fd, &file_stat);
+    size = (u64)file_stat.st_size;
+  }
+  out_file.size = size;
+  if (size == 0u)
+  {
+    return true; // nothing to map
+  }
+
+  void* const data = mmap (nullptr, size, is_writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    unmap_file (out_file);
+    return DBG_ASSERT_MSG (false, "failed to map file: %s\n", path);
+  }
+  out_file.data = (u8*)data;
+
+  // read front to back, so the os can read ahead (and drop pages behind)
+  madvise (data, size, MADV_SEQUENTIAL);
+
+  return true;
+}
+void unmap_file (mapped_file& file)
+{
+  if (file.data != nullptr) munmap (file.data, file.size);
+  if (file.fd >= 0) close (file.fd);
+  file = {};
+}
+#endif // _WIN32
+
+bool map_file_read (char const* path,
+  mapped_file& out_file)
+{
+  return map_file (path, 0u, false, out_file);
+}
+bool map_file_write (char const* path, u64 size,
+  mapped_file& out_file)
+{
+  return map_file (path, size, true, out_file);
+}
@@ -2,10 +2,12 @@
 
 #include "maths.h"                // for standard types
 
-#include <cstdio>                 // for std::fopen, std::fprintf, std::fclose, vsprintf_s
+#include <cstdio>                 // for std::fopen, std::fprintf, std::fclose
 #include <vector>                 // for std::vector
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
 #include <vulkan/vulkan.h>        // for everything vulkan
 
 
@@ -31,7 +33,7 @@ bool dbg_assert_impl_variadic (bool val,
 
 
 #define DBG_ASSERT(val) dbg_assert_impl ((val), #val, __LINE__, __FILE__)
-#define DBG_ASSERT_MSG(val, errmsg, ...) dbg_assert_impl_variadic ((val), #val, __LINE__, __FILE__, errmsg, __VA_ARGS__)
+#define DBG_ASSERT_MSG(val, errmsg, ...) dbg_assert_impl_variadic ((val), #val, __LINE__, __FILE__, errmsg, ##__VA_ARGS__) // ## drops the comma when there are no args (gcc/clang)
 
 #define CHECK_VULKAN_RESULT(val) (val == VK_SUCCESS)
 #define CHECK_VULKAN_HANDLE(val) (val != VK_NULL_HANDLE)
@@ -62,3 +64,36 @@ void write_file (char const* path,
 
   std::fclose (fp);
 }
+
+/// <summary>
+/// a file mapped in to the address space rather than read in to memory
+/// pages are read/written by the os on demand, so it can be far bigger than ram
+/// </summary>
+struct mapped_file
+{
+  u8* data = nullptr;
+  u64 size = {};
+#ifdef _WIN32
+  void* file_handle = nullptr;    // HANDLE
+  void* mapping_handle = nullptr; // HANDLE
+#else // _WIN32
+  int fd = -1;
+#endif // _WIN32
+};
+
+/// <summary>
+/// map an existing file, read only
+/// </summary>
+/// <returns>false if unable to open or map the file</returns>
+bool map_file_read (char const* path,
+  mapped_file& out_file);
+/// <summary>
+/// create (or truncate) a file of 'size' bytes and map it, read/write
+/// </summary>
+/// <returns>false if unable to create or map the file</returns>
+bool map_file_write (char const* path, u64 size,
+  mapped_file& out_file);
+/// <summary>
+/// unmap the file, written pages are flushed to disk by the os
+/// </summary>
+void unmap_file (mapped_file& file);
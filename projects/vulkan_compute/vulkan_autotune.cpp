@@ -0,0 +1,421 @@
+#include "vulkan_autotune.h"
+
+#include "vulkan_context.h"  // create_vulkan_command_pool_for_queue, ...
+#include "vulkan_pipeline.h" // begin_command_buffer, ...
+#include "utility.h"         // DBG_ASSERT, DBG_ASSERT_VULKAN
+
+#include <algorithm> // for std::min
+#include <array>     // for std::array
+#include <cstdio>    // for std::snprintf
+#include <fstream>   // for std::ifstream, std::ofstream
+#include <sstream>   // for std::istringstream
+#include <string>    // for std::string
+#include <vector>    // for std::vector
+
+
+struct tuning_entry
+{
+  std::string device_uuid; // hex
+  std::string kernel_name;
+  vulkan_workgroup_size size;
+  f32 time_ms = {};
+};
+
+
+static VkPhysicalDevice s_physical_device = VK_NULL_HANDLE;
+static std::string s_tuning_path;
+static std::string s_device_uuid;             // of 's_physical_device', hex
+static std::vector <tuning_entry> s_entries;  // every device in the file, not just this one
+static bool s_is_dirty = false;               // something was tuned this run, so the file needs saving
+
+
+#pragma region vulkan_autotune_support
+static std::string get_device_uuid (VkPhysicalDevice physical_device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+
+
+  // core in vulkan 1.1, identifies the device across processes/apis (unlike the index in 'vkEnumeratePhysicalDevices')
+  VkPhysicalDeviceIDProperties id_properties =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+    //.pNext = VK_NULL_HANDLE,
+  };
+  VkPhysicalDeviceProperties2 properties =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+    .pNext = &id_properties,
+  };
+  vkGetPhysicalDeviceProperties2 (physical_device, &properties);
+
+  std::string uuid;
+  for (u32 i = 0u; i < VK_UUID_SIZE; ++i)
+  {
+    char hex [3] = {};
+    std::snprintf (hex, sizeof (hex), "%02x", id_properties.deviceUUID [i]);
+    uuid += hex;
+  }
+  return uuid;
+}
+static tuning_entry* find_entry (char const* kernel_name)
+{
+  for (tuning_entry& entry : s_entries)
+  {
+    if (entry.device_uuid == s_device_uuid && entry.kernel_name == kernel_name)
+    {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+static void read_tuning_file (char const* path)
+{
+  // not 'read_file', a missing file (first run) is not an error
+  std::ifstream file (path);
+  if (!file.is_open ())
+  {
+    dprintf ("autotune: no tuning file found at '%s', default work group sizes will be used\n", path);
+    return;
+  }
+
+  std::string line;
+  while (std::getline (file, line))
+  {
+    std::istringstream tokens (line);
+    tuning_entry entry;
+    if (!(tokens >> entry.device_uuid >> entry.kernel_name >> entry.size.x >> entry.size.y >> entry.time_ms) ||
+      entry.size.x == 0u || entry.size.y == 0u)
+    {
+      dprintf ("autotune: ignoring bad line '%s'\n", line.c_str ());
+      continue;
+    }
+    s_entries.push_back (entry);
+  }
+}
+static void write_tuning_file (char const* path)
+{
+  std::ofstream file (path, std::ios::trunc);
+  if (!file.is_open ())
+  {
+    dprintf ("autotune: unable to write '%s'\n", path);
+    return;
+  }
+
+  for (tuning_entry const& entry : s_entries)
+  {
+    file << entry.device_uuid << ' ' << entry.kernel_name << ' ' << entry.size.x << ' ' << entry.size.y << ' ' << entry.time_ms << '\n';
+  }
+}
+static bool is_workgroup_size_supported (VkPhysicalDeviceLimits const& limits,
+  vulkan_workgroup_size const& size)
+{
+  return size.x > 0u && size.y > 0u &&
+    size.x <= limits.maxComputeWorkGroupSize [0] &&
+    size.y <= limits.maxComputeWorkGroupSize [1] &&
+    size.x * size.y <= limits.maxComputeWorkGroupInvocations;
+}
+#pragma endregion
+
+
+bool create_vulkan_autotuner (VkPhysicalDevice physical_device,
+  char const* tuning_path)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (tuning_path != nullptr);
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (s_physical_device));
+
+
+  s_physical_device = physical_device;
+  s_tuning_path = tuning_path;
+  s_device_uuid = get_device_uuid (physical_device);
+  s_entries.clear ();
+  s_is_dirty = false;
+
+  read_tuning_file (tuning_path);
+
+  return true;
+}
+
+bool find_vulkan_workgroup_size (char const* kernel_name,
+  vulkan_workgroup_size& out_size)
+{
+  DBG_ASSERT (kernel_name != nullptr);
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_physical_device),
+    "must call 'create_vulkan_autotuner' before looking up tuned work group sizes!\n");
+
+
+  tuning_entry const* const entry = find_entry (kernel_name);
+  if (entry == nullptr)
+  {
+    return false;
+  }
+
+  out_size = entry->size;
+  return true;
+}
+
+bool autotune_vulkan_workgroup_size (VkDevice device, VkQueue queue,
+  char const* kernel_name,
+  u32 num_candidates, vulkan_workgroup_size const* candidates, u32 num_repeats,
+  std::function <bool (vulkan_workgroup_size const& size, VkPipeline& out_pipeline)> create_pipeline,
+  std::function <void (VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_workgroup_size const& size)> record_dispatch,
+  vulkan_workgroup_size& out_size, VkPipeline& out_pipeline)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (queue));
+  DBG_ASSERT (kernel_name != nullptr);
+  DBG_ASSERT (num_candidates > 0u && candidates != nullptr);
+  DBG_ASSERT (num_repeats > 0u);
+  DBG_ASSERT (create_pipeline && record_dispatch);
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_pipeline));
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_physical_device),
+    "must call 'create_vulkan_autotuner' before autotuning!\n");
+
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (s_physical_device, &properties);
+
+  // one command buffer, re-recorded per run, and one pair of timestamps
+  vulkan_gpu_timer timer;
+  if (!create_vulkan_gpu_timer (s_physical_device, device, queue, timer))
+  {
+    release_vulkan_gpu_timer (timer);
+    return DBG_ASSERT_MSG (false, "autotune: failed to create the timer\n");
+  }
+
+  // record, submit and wait for one run of 'pipeline', in ms
+  auto const time_dispatch = [&](VkPipeline pipeline, vulkan_workgroup_size const& size, f32& out_time_ms) -> bool
+  {
+    return record_vulkan_gpu_timer (timer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, [&](VkCommandBuffer command_buffer)
+      {
+        record_dispatch (command_buffer, pipeline, size);
+      }) &&
+      run_vulkan_gpu_timer (timer, out_time_ms);
+  };
+
+
+  dprintf ("autotune: %s, %u candidates\n", kernel_name, num_candidates);
+
+  f32 best_time_ms = {};
+  for (u32 i = 0u; i < num_candidates; ++i)
+  {
+    vulkan_workgroup_size const& size = candidates [i];
+    if (!is_workgroup_size_supported (properties.limits, size))
+    {
+      dprintf ("autotune:   %4u x %-4u skipped, over the device limits\n", size.x, size.y);
+      continue;
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (!create_pipeline (size, pipeline))
+    {
+      release_vulkan_gpu_timer (timer);
+      return DBG_ASSERT_MSG (false, "autotune: failed to create %s for %u x %u\n", kernel_name, size.x, size.y);
+    }
+
+    // first run warms up the caches/clocks (and pays for any lazy driver work), so it doesn't count
+    f32 time_ms = {}, min_time_ms = {};
+    bool is_ok = time_dispatch (pipeline, size, time_ms);
+    for (u32 repeat = 0u; is_ok && repeat < num_repeats; ++repeat)
+    {
+      is_ok = time_dispatch (pipeline, size, time_ms);
+      min_time_ms = repeat == 0u ? time_ms : std::min (min_time_ms, time_ms);
+    }
+    if (!is_ok)
+    {
+      release_vulkan_pipeline (device, pipeline);
+      release_vulkan_gpu_timer (timer);
+      return DBG_ASSERT_MSG (false, "autotune: failed to time %s for %u x %u\n", kernel_name, size.x, size.y);
+    }
+
+    dprintf ("autotune:   %4u x %-4u %.4f ms\n", size.x, size.y, min_time_ms);
+
+    if (!CHECK_VULKAN_HANDLE (out_pipeline) || min_time_ms < best_time_ms)
+    {
+      if (CHECK_VULKAN_HANDLE (out_pipeline))
+      {
+        release_vulkan_pipeline (device, out_pipeline);
+      }
+      out_pipeline = pipeline;
+      out_size = size;
+      best_time_ms = min_time_ms;
+    }
+    else
+    {
+      release_vulkan_pipeline (device, pipeline);
+    }
+  }
+
+  release_vulkan_gpu_timer (timer);
+
+  if (!CHECK_VULKAN_HANDLE (out_pipeline))
+  {
+    return DBG_ASSERT_MSG (false, "autotune: no candidate for %s fits this device\n", kernel_name);
+  }
+
+  dprintf ("autotune: %s picked %u x %u (%.4f ms)\n", kernel_name, out_size.x, out_size.y, best_time_ms);
+
+  tuning_entry* entry = find_entry (kernel_name);
+  if (entry == nullptr)
+  {
+    s_entries.push_back ({ .device_uuid = s_device_uuid, .kernel_name = kernel_name });
+    entry = &s_entries.back ();
+  }
+  entry->size = out_size;
+  entry->time_ms = best_time_ms;
+  s_is_dirty = true;
+
+  return true;
+}
+
+
+bool create_vulkan_gpu_timer (VkPhysicalDevice physical_device, VkDevice device, VkQueue queue,
+  vulkan_gpu_timer& out_timer)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (queue));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_timer.command_pool));
+
+
+  out_timer.device = device;
+  out_timer.queue = queue;
+
+  // timestamps tick at 'timestampPeriod' ns, and only the low 'timestampValidBits' bits are meaningful
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+  out_timer.timestamp_period_ns = properties.limits.timestampPeriod;
+  if (!get_vulkan_timestamp_mask (physical_device, queue, out_timer.timestamp_mask))
+  {
+    return DBG_ASSERT_MSG (false, "gpu timer: the queue does not support timestamps\n");
+  }
+
+  return create_vulkan_command_pool_for_queue (queue, out_timer.command_pool) &&
+    create_vulkan_command_buffers (1u, out_timer.command_pool, &out_timer.command_buffer) &&
+    create_vulkan_fences (1u, 0u, &out_timer.fence) &&
+    create_vulkan_query_pool (device, VK_QUERY_TYPE_TIMESTAMP, 2u, 0u, out_timer.query_pool);
+}
+
+bool record_vulkan_gpu_timer (vulkan_gpu_timer const& timer, VkCommandBufferUsageFlags flags,
+  std::function <void (VkCommandBuffer command_buffer)> const& record_work)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (timer.command_buffer) && CHECK_VULKAN_HANDLE (timer.query_pool));
+  DBG_ASSERT (record_work != nullptr);
+
+
+  VkCommandBuffer const command_buffer = timer.command_buffer;
+  if (!CHECK_VULKAN_RESULT (vkResetCommandBuffer (command_buffer, 0u)) ||
+    !begin_command_buffer (command_buffer, flags))
+  {
+    return false;
+  }
+  // each run may read what the last one wrote, the fence wait alone doesn't make those writes visible
+  VkMemoryBarrier const barrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    //.pNext = VK_NULL_HANDLE,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+  };
+  vkCmdPipelineBarrier (command_buffer,    // commandBuffer
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,  // srcStageMask
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,  // dstStageMask
+    0u,                                    // dependencyFlags
+    1u,                                    // memoryBarrierCount
+    &barrier,                              // pMemoryBarriers
+    0u,                                    // bufferMemoryBarrierCount
+    VK_NULL_HANDLE,                        // pBufferMemoryBarriers
+    0u,                                    // imageMemoryBarrierCount
+    VK_NULL_HANDLE);                       // pImageMemoryBarriers
+  vkCmdResetQueryPool (command_buffer, timer.query_pool, 0u, 2u);
+  vkCmdWriteTimestamp (command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timer.query_pool, 0u);
+  record_work (command_buffer);
+  vkCmdWriteTimestamp (command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timer.query_pool, 1u);
+  return end_command_buffer (command_buffer);
+}
+
+bool run_vulkan_gpu_timer (vulkan_gpu_timer const& timer,
+  f32& out_time_ms)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (timer.command_buffer) && CHECK_VULKAN_HANDLE (timer.fence));
+
+
+  VkSubmitInfo const submit_info =
+  {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    //.waitSemaphoreCount = {},
+    //.pWaitSemaphores = VK_NULL_HANDLE,
+    //.pWaitDstStageMask = VK_NULL_HANDLE,
+    .commandBufferCount = 1u,
+    .pCommandBuffers = &timer.command_buffer,
+    //.signalSemaphoreCount = {},
+    //.pSignalSemaphores = VK_NULL_HANDLE
+  };
+  if (!CHECK_VULKAN_RESULT (vkResetFences (timer.device, 1u, &timer.fence)) ||
+    !CHECK_VULKAN_RESULT (vkQueueSubmit (timer.queue, 1u, &submit_info, timer.fence)) ||
+    !CHECK_VULKAN_RESULT (vkWaitForFences (timer.device, 1u, &timer.fence, VK_TRUE, UINT64_MAX)))
+  {
+    return DBG_ASSERT_MSG (false, "gpu timer: submit failed\n");
+  }
+
+  std::array <u64, 2u> timestamps = {};
+  VkResult const result = vkGetQueryPoolResults (timer.device, // device
+    timer.query_pool,                                         // queryPool
+    0u,                                                       // firstQuery
+    2u,                                                       // queryCount
+    sizeof (timestamps),                                      // dataSize
+    timestamps.data (),                                       // pData
+    sizeof (u64),                                             // stride
+    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);       // flags
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "gpu timer: failed to read timestamps\n");
+  }
+
+  u64 const ticks = get_vulkan_timestamp_ticks (timestamps [0], timestamps [1], timer.timestamp_mask);
+  out_time_ms = (f32)ticks * timer.timestamp_period_ns / 1e6f;
+  return true;
+}
+
+void release_vulkan_gpu_timer (vulkan_gpu_timer& timer)
+{
+  if (CHECK_VULKAN_HANDLE (timer.query_pool)) vkDestroyQueryPool (timer.device, timer.query_pool, VK_NULL_HANDLE);
+  if (CHECK_VULKAN_HANDLE (timer.fence)) release_vulkan_fences (1u, &timer.fence);
+  if (CHECK_VULKAN_HANDLE (timer.command_buffer)) release_vulkan_command_buffers (1u, timer.command_pool, &timer.command_buffer);
+  if (CHECK_VULKAN_HANDLE (timer.command_pool)) release_vulkan_command_pool (timer.command_pool);
+  timer = {};
+}
+
+
+void print_vulkan_autotuner ()
+{
+#ifndef NDEBUG
+  dprintf ("AUTOTUNE:\n");
+  for (tuning_entry const& entry : s_entries)
+  {
+    if (entry.device_uuid == s_device_uuid)
+    {
+      dprintf ("%s: %u x %u (%.4f ms)\n", entry.kernel_name.c_str (), entry.size.x, entry.size.y, entry.time_ms);
+    }
+  }
+#endif // NDEBUG
+}
+
+
+void release_vulkan_autotuner ()
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_physical_device));
+
+
+  if (s_is_dirty)
+  {
+    write_tuning_file (s_tuning_path.c_str ());
+  }
+
+  s_physical_device = VK_NULL_HANDLE;
+  s_tuning_path.clear ();
+  s_device_uuid.clear ();
+  s_entries.clear ();
+  s_is_dirty = false;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+#include <functional> // for std::function
+
+
+// work group size autotuner:
+// the best work group size depends on the gpu (wave/warp width, registers, shared memory, cache), so rather than
+// hand pick one, build the kernel with each candidate size (specialization constants), time it with gpu timestamps
+// on real data and keep the fastest
+//
+// winners are kept per device (by device UUID) in a small text file, loaded by 'create_vulkan_autotuner' and saved
+// by 'release_vulkan_autotuner', so only the first (tuning) run pays for it, later runs look the size up with
+// 'find_vulkan_workgroup_size'
+// one line per kernel per device: '<device UUID> <kernel name> <size x> <size y> <time in ms>'
+
+
+/// <summary>
+/// a candidate work group shape, y is 1 for 1D kernels
+/// </summary>
+struct vulkan_workgroup_size
+{
+  u32 x = 1u;
+  u32 y = 1u;
+};
+
+/// <summary>
+/// times work on one queue with a pair of gpu timestamps around it, each run submitted and waited for on its own
+/// used by the autotuner and 'vulkan_compute_bench'
+/// </summary>
+struct vulkan_gpu_timer
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkQueue queue = VK_NULL_HANDLE;
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+  VkQueryPool query_pool = VK_NULL_HANDLE;
+  f32 timestamp_period_ns = {};
+  u64 timestamp_mask = {};
+};
+
+
+constexpr char const* VULKAN_AUTOTUNE_PATH = "autotune.txt"; // the apps' 'tuning_path', relative to the working directory
+/// <summary>
+/// load the tuning table, the entries for other devices are kept (and saved back) but never used
+/// a missing file (first run) is not an error
+/// call after 'create_vulkan_device', before creating the libraries that look up their work group size
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_autotuner (VkPhysicalDevice physical_device,
+  char const* tuning_path);
+
+/// <summary>
+/// look up the tuned work group size of 'kernel_name' on this device
+/// </summary>
+/// <returns>false, if the kernel has not been tuned on this device ('out_size' is left alone)</returns>
+bool find_vulkan_workgroup_size (char const* kernel_name,
+  vulkan_workgroup_size& out_size);
+
+/// <summary>
+/// time 'kernel_name' with every candidate work group size and keep the fastest
+/// candidates bigger than the device limits are skipped
+/// 'create_pipeline' builds the kernel for a candidate (normally specialization constants 0 & 1 = x & y)
+/// 'record_dispatch' binds the pipeline/descriptor sets and dispatches enough groups to cover the data
+/// each candidate is run once to warm up, then 'num_repeats' times on its own submit, the fastest run counts
+/// the data the kernel reads/writes is the caller's, so it must be safe to run the kernel over and over
+/// </summary>
+/// <param name="out_pipeline">the winning pipeline, owned by the caller (the others are released)</param>
+/// <returns>true, if successful</returns>
+bool autotune_vulkan_workgroup_size (VkDevice device, VkQueue queue,
+  char const* kernel_name,
+  u32 num_candidates, vulkan_workgroup_size const* candidates, u32 num_repeats,
+  std::function <bool (vulkan_workgroup_size const& size, VkPipeline& out_pipeline)> create_pipeline,
+  std::function <void (VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_workgroup_size const& size)> record_dispatch,
+  vulkan_workgroup_size& out_size, VkPipeline& out_pipeline);
+
+/// <summary>
+/// create the command buffer, fence and timestamps of a timer on 'queue'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_gpu_timer (VkPhysicalDevice physical_device, VkDevice device, VkQueue queue,
+  vulkan_gpu_timer& out_timer);
+
+/// <summary>
+/// record 'record_work' between the timestamps, replacing whatever was recorded before
+/// a barrier ahead of it makes the last run's shader writes visible, so runs can read what the previous one wrote
+/// without VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT in 'flags' it can be run over and over
+/// </summary>
+/// <returns>true, if successful</returns>
+bool record_vulkan_gpu_timer (vulkan_gpu_timer const& timer, VkCommandBufferUsageFlags flags,
+  std::function <void (VkCommandBuffer command_buffer)> const& record_work);
+
+/// <summary>
+/// submit what was recorded, wait for it and read back the gpu time between the timestamps
+/// </summary>
+/// <returns>true, if successful</returns>
+bool run_vulkan_gpu_timer (vulkan_gpu_timer const& timer,
+  f32& out_time_ms);
+
+void release_vulkan_gpu_timer (vulkan_gpu_timer& timer);
+
+/// <summary>
+/// print the tuned work group sizes of this device (debug only)
+/// </summary>
+void print_vulkan_autotuner ();
+
+/// <summary>
+/// save the tuning table if anything was tuned this run, then clear it
+/// call before 'release_vulkan_device'
+/// </summary>
+void release_vulkan_autotuner ();
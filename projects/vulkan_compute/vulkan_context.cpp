@@ -2,21 +2,30 @@
 
 #include "utility.h"          // for dprintf, DBG_ASSERT, DBG_ASSERT_...
 #include "vulkan_resources.h" // for create_image_view_2d_default
+#include "vulkan_trace.h"     // for TRACE_SCOPE, can_calibrate_vulkan_trace_clock
 
 #include <array>              // for std::array
+#include <cstring>            // for strcmp, strlen
+#include <algorithm>          // for std::max
+#include <map>                // for std::map
 #include <optional>           // for std::optional
 #include <set>                // for std::set
 #include <string>             // for std::string
 #include <vector>             // for std::vector
 
+#if defined (_WIN32) && !defined (VULKAN_HEADLESS)
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h> // for glfwGetWin32Window
+#endif // _WIN32 && !VULKAN_HEADLESS
 
 
+#ifndef NDEBUG
 #define ENABLE_VULKAN_DEBUG // enable code to get vulkan to tell us if we did anything wrong
+#endif // NDEBUG
 
 
 #pragma region vulkan_window
+#ifndef VULKAN_HEADLESS
 GLFWwindow* s_window_handle = NULL;
 
 
@@ -51,6 +60,7 @@ bool create_window (char const*const title)
 
   return true;
 }
+#endif // VULKAN_HEADLESS
 #pragma endregion
 
 
@@ -223,12 +233,59 @@ static void print_available_instance_extensions ()
   }
 #endif // NDEBUG
 }
+#ifdef ENABLE_VULKAN_DEBUG
+static bool is_instance_layer_available (char const* const layer_name)
+{
+  u32 layer_count = 0u;
+  VkResult result = vkEnumerateInstanceLayerProperties (&layer_count, VK_NULL_HANDLE);
+  if (!CHECK_VULKAN_RESULT (result)) return false;
+
+  std::vector <VkLayerProperties> available_layers (layer_count);
+  result = vkEnumerateInstanceLayerProperties (&layer_count, available_layers.data ());
+  if (!CHECK_VULKAN_RESULT (result)) return false;
+
+  for (VkLayerProperties const& layer_properties : available_layers)
+  {
+    if (strcmp (layer_properties.layerName, layer_name) == 0) return true;
+  }
+
+  return false;
+}
+static bool is_instance_extension_available (char const* const extension_name)
+{
+  u32 extension_count = 0u;
+  VkResult result = vkEnumerateInstanceExtensionProperties (VK_NULL_HANDLE, &extension_count, VK_NULL_HANDLE);
+  if (!CHECK_VULKAN_RESULT (result)) return false;
+
+  std::vector <VkExtensionProperties> available_extensions (extension_count);
+  result = vkEnumerateInstanceExtensionProperties (VK_NULL_HANDLE, &extension_count, available_extensions.data ());
+  if (!CHECK_VULKAN_RESULT (result)) return false;
+
+  for (VkExtensionProperties const& extension_properties : available_extensions)
+  {
+    if (strcmp (extension_properties.extensionName, extension_name) == 0) return true;
+  }
+
+  return false;
+}
+#endif // ENABLE_VULKAN_DEBUG
 static std::vector <char const*> get_required_instance_layers ()
 {
   std::vector <char const*> layers = INSTANCE_LAYERS;
 
 #ifdef ENABLE_VULKAN_DEBUG
-  layers.insert (layers.begin (), INSTANCE_LAYERS_DEBUG.begin (), INSTANCE_LAYERS_DEBUG.end ());
+  // debug layers are optional, e.g. they are usually not installed on headless compute nodes
+  for (char const* const layer : INSTANCE_LAYERS_DEBUG)
+  {
+    if (is_instance_layer_available (layer))
+    {
+      layers.insert (layers.begin (), layer);
+    }
+    else
+    {
+      dprintf ("instance layer '%s' is not available, skipping\n", layer);
+    }
+  }
 #endif // ENABLE_VULKAN_DEBUG
 
   return layers;
@@ -238,15 +295,32 @@ static std::vector <char const*> get_required_instance_extensions ()
   std::vector <char const*> extensions = INSTANCE_EXTENSIONS;
 
 #ifdef ENABLE_VULKAN_DEBUG
-  extensions.insert (extensions.begin (), INSTANCE_EXTENSIONS_DEBUG.begin (), INSTANCE_EXTENSIONS_DEBUG.end ());
+  // debug extensions are optional, same as the debug layers
+  for (char const* const extension : INSTANCE_EXTENSIONS_DEBUG)
+  {
+    if (is_instance_extension_available (extension))
+    {
+      extensions.insert (extensions.begin (), extension);
+    }
+    else
+    {
+      dprintf ("instance extension '%s' is not available, skipping\n", extension);
+    }
+  }
 #endif // ENABLE_VULKAN_DEBUG
 
-  u32 glfw_required_extensions_count = 0u;
-  char const** glfw_required_extensions = glfwGetRequiredInstanceExtensions (&glfw_required_extensions_count);
-  for (u32 i = 0u; i < glfw_required_extensions_count; ++i)
+#ifndef VULKAN_HEADLESS
+  // surface extensions are only required if we are going to present to a window
+  if (s_window_handle != NULL)
   {
-    extensions.push_back (glfw_required_extensions [i]);
+    u32 glfw_required_extensions_count = 0u;
+    char const** glfw_required_extensions = glfwGetRequiredInstanceExtensions (&glfw_required_extensions_count);
+    for (u32 i = 0u; i < glfw_required_extensions_count; ++i)
+    {
+      extensions.push_back (glfw_required_extensions [i]);
+    }
   }
+#endif // VULKAN_HEADLESS
 
   return extensions;
 }
@@ -274,23 +348,24 @@ static bool create_instance ()
     .apiVersion = VK_API_VERSION_1_2
   };
 
+  print_available_instance_layers ();
+  print_available_instance_extensions ();
+  std::vector <char const*> layers = get_required_instance_layers ();
+  std::vector <char const*> extensions = get_required_instance_extensions ();
+
 #ifdef ENABLE_VULKAN_DEBUG
   // This is info to add a temporary callback to use during vkCreateInstance
   // After the instance is created, we use the instance-based function to register the final callback
   VkDebugUtilsMessengerCreateInfoEXT dumci = {};
   populate_debug_messenger_create_info (dumci);
+  bool const debug_utils_enabled = is_instance_extension_available (VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 #endif // ENABLE_VULKAN_DEBUG
 
-  print_available_instance_layers ();
-  print_available_instance_extensions ();
-  std::vector <char const*> layers = get_required_instance_layers ();
-  std::vector <char const*> extensions = get_required_instance_extensions ();
-
   VkInstanceCreateInfo const ici =
   {
     .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 #ifdef ENABLE_VULKAN_DEBUG
-    .pNext = &dumci,
+    .pNext = debug_utils_enabled ? &dumci : VK_NULL_HANDLE,
 #endif // ENABLE_VULKAN_DEBUG
     //.flags = 0u,
     .pApplicationInfo = &application_info,          
@@ -320,57 +395,64 @@ static bool create_debug_messenger ()
   DBG_ASSERT (!CHECK_VULKAN_HANDLE (s_debug_messenger));
 
 
-  // create Debug Report Callback
+  // the debug extensions are optional (see 'get_required_instance_extensions')
+  // so skip any that were not enabled
 
-  // as the VK_EXT_debug_report instance extension is not a core feature,the addresses
-  // of the entry points has to be acquired through via the vkGetInstanceProcAddr function
-  PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT = VK_NULL_HANDLE;
-  *(void**)&vkCreateDebugReportCallbackEXT = vkGetInstanceProcAddr (s_instance, "vkCreateDebugReportCallbackEXT");
-  if (!vkCreateDebugReportCallbackEXT)
+  // create Debug Report Callback
+  if (is_instance_extension_available (VK_EXT_DEBUG_REPORT_EXTENSION_NAME))
   {
-    //VK_ERROR_EXTENSION_NOT_PRESENT
-    return DBG_ASSERT_MSG (false, "Extension 'VK_EXT_debug_report' is not loaded\n");
-  }
+    // as the VK_EXT_debug_report instance extension is not a core feature,the addresses
+    // of the entry points has to be acquired through via the vkGetInstanceProcAddr function
+    PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT = VK_NULL_HANDLE;
+    vkCreateDebugReportCallbackEXT = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr (s_instance, "vkCreateDebugReportCallbackEXT");
+    if (!vkCreateDebugReportCallbackEXT)
+    {
+      //VK_ERROR_EXTENSION_NOT_PRESENT
+      return DBG_ASSERT_MSG (false, "Extension 'VK_EXT_debug_report' is not loaded\n");
+    }
 
-  // we could separate this e.g. errors go to 'callback a' & warnings go to 'callback b'
-  VkDebugReportCallbackCreateInfoEXT const cbci =
-  {
-    .sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CREATE_INFO_EXT,
-    //.pNext = VK_NULL_HANDLE,
-    .flags = VK_DEBUG_REPORT_WARNING_BIT_EXT
-      | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT
-      | VK_DEBUG_REPORT_ERROR_BIT_EXT,
-    .pfnCallback = &debug_report_callback,
-    //.pUserData = VK_NULL_HANDLE
-  };
+    // we could separate this e.g. errors go to 'callback a' & warnings go to 'callback b'
+    VkDebugReportCallbackCreateInfoEXT const cbci =
+    {
+      .sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CREATE_INFO_EXT,
+      //.pNext = VK_NULL_HANDLE,
+      .flags = VK_DEBUG_REPORT_WARNING_BIT_EXT
+        | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT
+        | VK_DEBUG_REPORT_ERROR_BIT_EXT,
+      .pfnCallback = &debug_report_callback,
+      //.pUserData = VK_NULL_HANDLE
+    };
 
-  VkResult result = vkCreateDebugReportCallbackEXT (s_instance,
-    &cbci,
-    VK_NULL_HANDLE,
-    &s_debug_report_callback);
-  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (s_debug_report_callback))
-  {
-    return DBG_ASSERT_MSG (false, "VkDebugReportCallbackCreateInfoEXT failed\n");
+    VkResult const result = vkCreateDebugReportCallbackEXT (s_instance,
+      &cbci,
+      VK_NULL_HANDLE,
+      &s_debug_report_callback);
+    if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (s_debug_report_callback))
+    {
+      return DBG_ASSERT_MSG (false, "VkDebugReportCallbackCreateInfoEXT failed\n");
+    }
   }
 
 
   // create Debug Utils Messenger
-
-  // use same error callback function here that we used when creating 'VkInstanceCreateInfo'
-  VkDebugUtilsMessengerCreateInfoEXT dumci = {};
-  populate_debug_messenger_create_info (dumci);
-
-  auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr (s_instance, "vkCreateDebugUtilsMessengerEXT");
-  if (!func)
+  if (is_instance_extension_available (VK_EXT_DEBUG_UTILS_EXTENSION_NAME))
   {
-    //VK_ERROR_EXTENSION_NOT_PRESENT
-    return DBG_ASSERT_MSG (false, "Extension 'VK_EXT_debug_utils' is not loaded\n");
-  }
+    // use same error callback function here that we used when creating 'VkInstanceCreateInfo'
+    VkDebugUtilsMessengerCreateInfoEXT dumci = {};
+    populate_debug_messenger_create_info (dumci);
 
-  result = func (s_instance, &dumci, VK_NULL_HANDLE, &s_debug_messenger);
-  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (s_debug_messenger))
-  {
-    return DBG_ASSERT_MSG (false, "vkCreateDebugUtilsMessengerEXT failed\n");
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr (s_instance, "vkCreateDebugUtilsMessengerEXT");
+    if (!func)
+    {
+      //VK_ERROR_EXTENSION_NOT_PRESENT
+      return DBG_ASSERT_MSG (false, "Extension 'VK_EXT_debug_utils' is not loaded\n");
+    }
+
+    VkResult const result = func (s_instance, &dumci, VK_NULL_HANDLE, &s_debug_messenger);
+    if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (s_debug_messenger))
+    {
+      return DBG_ASSERT_MSG (false, "vkCreateDebugUtilsMessengerEXT failed\n");
+    }
   }
 #endif // ENABLE_VULKAN_DEBUG
 
@@ -389,6 +471,7 @@ bool create_vulkan_instance ()
 VkSurfaceKHR s_surface = VK_NULL_HANDLE;
 
 
+#ifndef VULKAN_HEADLESS
 bool create_vulkan_surface()
 {
     DBG_ASSERT(CHECK_VULKAN_HANDLE(s_instance));
@@ -405,6 +488,7 @@ bool create_vulkan_surface()
 
     return true;
 }
+#endif // VULKAN_HEADLESS
 
 #pragma endregion
 
@@ -414,25 +498,33 @@ struct queue_family_indices
 {
   std::optional <u32> graphics_family;
   std::optional <u32> present_family;
-  std::optional <u32> compute_family;
-  //std::optional <u32> transfer_family;
+  std::optional <u32> compute_family;       // first compute family, usually shared with graphics
+  std::optional <u32> async_compute_family; // compute only family if there is one, otherwise 'compute_family'
+  std::optional <u32> transfer_family;      // transfer only family if there is one, otherwise 'async_compute_family' (or 'graphics_family')
 
   bool is_complete (VkQueueFlags requested_queue_types) const
   {
     bool const found_graphics_queue = requested_queue_types & VK_QUEUE_GRAPHICS_BIT ? graphics_family.has_value () && present_family.has_value () : true;
-    bool const found_compute_queue = requested_queue_types & VK_QUEUE_COMPUTE_BIT ? compute_family.has_value () : true;
-    //bool const found_transfer_queue = requested_queue_types & VK_QUEUE_TRANSFER_BIT ? transfer_family.has_value () : true;
+    bool const found_compute_queue = requested_queue_types & VK_QUEUE_COMPUTE_BIT ? compute_family.has_value () && async_compute_family.has_value () : true;
+    bool const found_transfer_queue = requested_queue_types & VK_QUEUE_TRANSFER_BIT ? transfer_family.has_value () : true;
 
-    return found_graphics_queue && found_compute_queue;//&& found_transfer_queue;
+    return found_graphics_queue && found_compute_queue && found_transfer_queue;
   }
   void clear ()
   {
     graphics_family.reset ();
     present_family.reset ();
     compute_family.reset ();
-    //transfer_family.reset ();
+    async_compute_family.reset ();
+    transfer_family.reset ();
   }
 };
+// which queue of which family, the async compute & transfer queues may be extra queues in a shared family
+struct queue_location
+{
+  u32 family = {};
+  u32 index = {};
+};
 struct swapchain_support
 {
   VkSurfaceCapabilitiesKHR capabilities = {};
@@ -442,8 +534,13 @@ struct swapchain_support
 
 
 static queue_family_indices s_queue_indices;
+static queue_location s_queue_async_compute; // graphics/present & compute always use queue 0 of their family
+static queue_location s_queue_transfer;
 static VkPhysicalDevice s_physical_device = VK_NULL_HANDLE;
 static VkDevice s_device = VK_NULL_HANDLE;
+static bool s_has_pipeline_creation_feedback = false;
+static bool s_has_pipeline_statistics = false;
+static bool s_has_timeline_semaphores = false;
 
 
 static std::vector <char const*> const DEVICE_EXTENSIONS = {};
@@ -564,14 +661,11 @@ static void print_queue_family_capabilities (VkPhysicalDevice pd)
   }
 #endif // NDEBUG
 }
-static bool find_compatible_queue_families (VkPhysicalDevice pd, VkQueueFlags requested_queue_types,
-  queue_family_indices& out_indices)
+static std::vector <VkQueueFamilyProperties> get_queue_family_properties (VkPhysicalDevice pd)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (pd));
 
 
-  print_queue_family_capabilities (pd);
-
   // get num queue family capabilities
   u32 queue_family_count = 0u;
   vkGetPhysicalDeviceQueueFamilyProperties (pd, // physicalDevice
@@ -584,36 +678,76 @@ static bool find_compatible_queue_families (VkPhysicalDevice pd, VkQueueFlags re
     &queue_family_count,                        // pQueueFamilyPropertyCount
     queue_families.data ());                    // pQueueFamilyProperties
 
+  return queue_families;
+}
+static bool find_compatible_queue_families (VkPhysicalDevice pd, VkQueueFlags requested_queue_types,
+  queue_family_indices& out_indices)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (pd));
+
+
+  print_queue_family_capabilities (pd);
+
+  std::vector <VkQueueFamilyProperties> const queue_families = get_queue_family_properties (pd);
+
+  // look at every family, rather than stopping at the first complete set
+  // dedicated (compute only/transfer only) families tend to come after the general purpose one
   out_indices.clear ();
-  u32 i = 0u;
-  while (i < queue_families.size () && !out_indices.is_complete (requested_queue_types))
+  for (u32 i = 0u; i < queue_families.size (); ++i)
   {
     VkQueueFamilyProperties const& queue_family = queue_families [i];
 
     if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT // it's available
-      && requested_queue_types & VK_QUEUE_GRAPHICS_BIT) // and was requested
+      && requested_queue_types & VK_QUEUE_GRAPHICS_BIT  // and was requested
+      && !out_indices.present_family.has_value ())      // and we haven't already found one we can present with
     {
       out_indices.graphics_family = i;
 
       // check if phyical device supports 'present' for the surface on this queue
-      DBG_ASSERT (CHECK_VULKAN_HANDLE (s_surface));
-      VkBool32 present_support = VK_FALSE;
-      VkResult const result = vkGetPhysicalDeviceSurfaceSupportKHR (pd, i, s_surface, &present_support);
-      DBG_ASSERT (CHECK_VULKAN_RESULT (result));
-      if (present_support == VK_TRUE)
+      // without a surface (headless) there is nothing to present to
+      if (CHECK_VULKAN_HANDLE (s_surface))
       {
-        out_indices.present_family = i;
+        VkBool32 present_support = VK_FALSE;
+        VkResult const result = vkGetPhysicalDeviceSurfaceSupportKHR (pd, i, s_surface, &present_support);
+        DBG_ASSERT (CHECK_VULKAN_RESULT (result));
+        if (present_support == VK_TRUE)
+        {
+          out_indices.present_family = i;
+        }
       }
     }
     if (queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT
       && requested_queue_types & VK_QUEUE_COMPUTE_BIT)
     {
-      out_indices.compute_family = i;
+      if (!out_indices.compute_family.has_value ())
+      {
+        out_indices.compute_family = i;
+      }
+      // no graphics, so work submitted here can run alongside the graphics queue (async compute)
+      if ((queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0 && !out_indices.async_compute_family.has_value ())
+      {
+        out_indices.async_compute_family = i;
+      }
+    }
+    // transfer only, usually backed by dedicated copy (dma) engines
+    if (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT
+      && (queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0
+      && !out_indices.transfer_family.has_value ())
+    {
+      out_indices.transfer_family = i;
     }
+  }
 
-    // for transfer: check 'queue_family.queueFlags' & VK_QUEUE_TRANSFER_BIT'
-
-    ++i;
+  // no dedicated families, fall back to the general purpose ones
+  // graphics and compute families always support transfer, even if they don't report it
+  if (!out_indices.async_compute_family.has_value ())
+  {
+    out_indices.async_compute_family = out_indices.compute_family;
+  }
+  if (!out_indices.transfer_family.has_value ())
+  {
+    out_indices.transfer_family = out_indices.async_compute_family.has_value () ?
+      out_indices.async_compute_family : out_indices.graphics_family;
   }
 
   return out_indices.is_complete (requested_queue_types);
@@ -633,6 +767,36 @@ static std::vector <char const*> get_required_device_extensions ()
 
   return extensions;
 }
+static bool is_device_extension_available (VkPhysicalDevice pd, char const* const extension_name)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (pd));
+  DBG_ASSERT (extension_name != nullptr);
+
+
+  u32 extension_count;
+  VkResult result = vkEnumerateDeviceExtensionProperties (pd, VK_NULL_HANDLE, &extension_count, VK_NULL_HANDLE);
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT (false);
+  }
+
+  std::vector <VkExtensionProperties> available_extensions (extension_count);
+  result = vkEnumerateDeviceExtensionProperties (pd, VK_NULL_HANDLE, &extension_count, available_extensions.data ());
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT (false);
+  }
+
+  for (VkExtensionProperties const& extension : available_extensions)
+  {
+    if (strcmp (extension_name, extension.extensionName) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
 static bool check_device_extension_support (VkPhysicalDevice pd)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (pd));
@@ -700,6 +864,28 @@ static swapchain_support query_swapchain_support (VkPhysicalDevice pd)
 
   return details;
 }
+static bool supports_timeline_semaphores (VkPhysicalDevice pd)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (pd));
+
+
+  // core in vulkan 1.2, but still an optional feature
+  VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+    //.pNext = VK_NULL_HANDLE,
+    //.timelineSemaphore = VK_FALSE
+  };
+  VkPhysicalDeviceFeatures2 features =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &timeline_features,
+    //.features = {}
+  };
+  vkGetPhysicalDeviceFeatures2 (pd, &features);
+
+  return timeline_features.timelineSemaphore == VK_TRUE;
+}
 static bool is_physical_device_suitable (VkPhysicalDevice pd,
   VkQueueFlags requested_queue_types)
 {
@@ -771,6 +957,10 @@ static bool create_physical_device (VkQueueFlags requested_queue_types)
       break;
     }
   }
+  if (!CHECK_VULKAN_HANDLE (s_physical_device))
+  {
+    return DBG_ASSERT_MSG (false, "couldn't find a device that supports the requested queue types\n");
+  }
 
   return true;
 }
@@ -791,21 +981,50 @@ static bool create_logical_device (VkQueueFlags requested_queue_types)
   }
 
   // get the queue types family indices the device supports
-  std::set <u32> unique_queue_families;
+  // and how many queues we want from each, queue 0 of a family is shared by graphics/present & compute
+  std::vector <VkQueueFamilyProperties> const queue_families = get_queue_family_properties (s_physical_device);
+  std::map <u32, u32> num_queues_per_family;
   if (s_queue_indices.graphics_family.has_value () && s_queue_indices.present_family.has_value ())
   {
-    unique_queue_families.insert (s_queue_indices.graphics_family.value ());
-    unique_queue_families.insert (s_queue_indices.present_family.value ());
+    num_queues_per_family [s_queue_indices.graphics_family.value ()] = 1u;
+    num_queues_per_family [s_queue_indices.present_family.value ()] = 1u;
   }
   if (s_queue_indices.compute_family.has_value ())
   {
-    unique_queue_families.insert (s_queue_indices.compute_family.value ());
+    num_queues_per_family [s_queue_indices.compute_family.value ()] = 1u;
   }
-  // add queue indices for present and transfer here also (if you want them)
+  // async compute & transfer get a queue of their own while the family has one spare
+  // otherwise they share the family's last queue (and so run in order with it)
+  auto const claim_queue = [&] (u32 family) -> queue_location
+  {
+    u32& num_queues = num_queues_per_family [family];
+    if (num_queues < queue_families [family].queueCount)
+    {
+      ++num_queues;
+    }
+    return { family, num_queues - 1u };
+  };
+  if (s_queue_indices.async_compute_family.has_value ())
+  {
+    s_queue_async_compute = claim_queue (s_queue_indices.async_compute_family.value ());
+  }
+  if (s_queue_indices.transfer_family.has_value ())
+  {
+    s_queue_transfer = claim_queue (s_queue_indices.transfer_family.value ());
+  }
+  dprintf ("queues: graphics = %d, compute = %d, async compute = %d (queue %d), transfer = %d (queue %d)\n",
+    (i32)s_queue_indices.graphics_family.value_or (~0u), (i32)s_queue_indices.compute_family.value_or (~0u),
+    (i32)s_queue_async_compute.family, (i32)s_queue_async_compute.index,
+    (i32)s_queue_transfer.family, (i32)s_queue_transfer.index);
 
-  float const queue_priority = 1.f; // give all queues equal poriority
+  u32 max_queues_per_family = 0u;
+  for (auto const& [queue_family, num_queues] : num_queues_per_family)
+  {
+    max_queues_per_family = std::max (max_queues_per_family, num_queues);
+  }
+  std::vector <float> const queue_priorities (max_queues_per_family, 1.f); // give all queues equal poriority
   std::vector <VkDeviceQueueCreateInfo> queue_create_infos;
-  for (u32 const& queue_family : unique_queue_families)
+  for (auto const& [queue_family, num_queues] : num_queues_per_family)
   {
     VkDeviceQueueCreateInfo const qci =
     {
@@ -813,29 +1032,54 @@ static bool create_logical_device (VkQueueFlags requested_queue_types)
       //.pNext = VK_NULL_HANDLE,
       //.flags = 0u,
       .queueFamilyIndex = queue_family,
-      .queueCount = 1u,
-      .pQueuePriorities = &queue_priority
+      .queueCount = num_queues,
+      .pQueuePriorities = queue_priorities.data ()
     };
     queue_create_infos.push_back (qci);
   }
 
   std::vector <char const*> extensions = get_required_device_extensions ();
 
+  // optional: lets the pipeline cache report hits/misses, core in vulkan 1.3
+  s_has_pipeline_creation_feedback = is_device_extension_available (s_physical_device,
+    VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+  if (s_has_pipeline_creation_feedback)
+  {
+    extensions.push_back (VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+  }
+  // optional: lines the gpu scopes up with the cpu scopes in a trace, see 'begin_vulkan_trace'
+  if (is_device_extension_available (s_physical_device, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) &&
+    can_calibrate_vulkan_trace_clock (s_instance, s_physical_device))
+  {
+    extensions.push_back (VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+  }
+
   // only request the features if they are supported!
   VkPhysicalDeviceFeatures supported_device_features = {};
   vkGetPhysicalDeviceFeatures (s_physical_device, &supported_device_features);
+  // optional: shader invocation counts for the profiler
+  s_has_pipeline_statistics = supported_device_features.pipelineStatisticsQuery == VK_TRUE;
   VkPhysicalDeviceFeatures const device_features =
   {
     // add features you want to enable here
     // e.g. samplerAnisotropy and shaderClipDistance
     // just make sure they are supported first!
+    .pipelineStatisticsQuery = s_has_pipeline_statistics ? VK_TRUE : VK_FALSE
+  };
+  // optional: only the apps that chain submits with 'create_vulkan_timelines' need them
+  s_has_timeline_semaphores = supports_timeline_semaphores (s_physical_device);
+  VkPhysicalDeviceTimelineSemaphoreFeatures const timeline_features =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+    //.pNext = VK_NULL_HANDLE,
+    .timelineSemaphore = s_has_timeline_semaphores ? VK_TRUE : VK_FALSE
   };
 
   
   VkDeviceCreateInfo const dci =
   {
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-    //.pNext = VK_NULL_HANDLE,
+    .pNext = &timeline_features,
     //.flags = 0u,
     .queueCreateInfoCount = (u32)queue_create_infos.size (),
     .pQueueCreateInfos = queue_create_infos.data (),
@@ -862,9 +1106,9 @@ static bool create_logical_device (VkQueueFlags requested_queue_types)
 bool create_vulkan_device (VkQueueFlags requested_queue_types,
   VkPhysicalDevice& out_physical_device, VkDevice& out_device)
 {
-  if ((requested_queue_types & VK_QUEUE_GRAPHICS_BIT) > 0)
+  if ((requested_queue_types & VK_QUEUE_GRAPHICS_BIT) > 0 && !CHECK_VULKAN_HANDLE (s_surface))
   {
-    DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_surface),
+    return DBG_ASSERT_MSG (false,
       "you must call 'create_vulkan_surface' to request 'VK_QUEUE_GRAPHICS_BIT'\n");
   }
 
@@ -894,7 +1138,9 @@ static VkRenderPass s_render_pass = VK_NULL_HANDLE;
 static VkExtent2D choose_swap_extent ()
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (s_physical_device));
+#ifndef VULKAN_HEADLESS
   DBG_ASSERT (CHECK_VULKAN_HANDLE (s_window_handle));
+#endif // VULKAN_HEADLESS
 
 
   swapchain_support sc_support = query_swapchain_support (s_physical_device);
@@ -903,8 +1149,10 @@ static VkExtent2D choose_swap_extent ()
     return sc_support.capabilities.currentExtent;
   }
 
-  int width, height;
+  int width = 0, height = 0;
+#ifndef VULKAN_HEADLESS
   glfwGetFramebufferSize (s_window_handle, &width, &height);
+#endif // VULKAN_HEADLESS
   VkExtent2D const actual_extent =
   {
     .width = glm::clamp ((u32)width, sc_support.capabilities.minImageExtent.width, sc_support.capabilities.maxImageExtent.width),
@@ -1221,6 +1469,86 @@ bool get_vulkan_queue_graphics (VkQueue& out_queue)
 
   return true;
 }
+bool get_vulkan_queue_async_compute (VkQueue& out_queue)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (s_queue_indices.async_compute_family.has_value ());
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_queue));
+
+
+  vkGetDeviceQueue (s_device, s_queue_async_compute.family, s_queue_async_compute.index, &out_queue);
+  if (!CHECK_VULKAN_HANDLE (out_queue))
+  {
+    return DBG_ASSERT_MSG (false, "failed to get queue\n");
+  }
+
+  return true;
+}
+bool get_vulkan_queue_transfer (VkQueue& out_queue)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (s_queue_indices.transfer_family.has_value ());
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_queue));
+
+
+  vkGetDeviceQueue (s_device, s_queue_transfer.family, s_queue_transfer.index, &out_queue);
+  if (!CHECK_VULKAN_HANDLE (out_queue))
+  {
+    return DBG_ASSERT_MSG (false, "failed to get queue\n");
+  }
+
+  return true;
+}
+bool get_vulkan_queue_family_index (VkQueue queue, u32& out_family_index)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (queue));
+
+
+  // every queue we created, queue 0 of each family covers graphics/present & compute
+  std::vector <queue_location> locations = { s_queue_async_compute, s_queue_transfer };
+  for (std::optional <u32> const& family : { s_queue_indices.graphics_family, s_queue_indices.present_family, s_queue_indices.compute_family })
+  {
+    if (family.has_value ())
+    {
+      locations.push_back ({ family.value (), 0u });
+    }
+  }
+
+  for (queue_location const& location : locations)
+  {
+    VkQueue device_queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue (s_device, location.family, location.index, &device_queue);
+    if (device_queue == queue)
+    {
+      out_family_index = location.family;
+      return true;
+    }
+  }
+
+  return DBG_ASSERT_MSG (false, "queue was not created by 'create_vulkan_device'\n");
+}
+bool has_vulkan_pipeline_creation_feedback ()
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+
+
+  return s_has_pipeline_creation_feedback;
+}
+bool has_vulkan_pipeline_statistics ()
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+
+
+  return s_has_pipeline_statistics;
+}
+bool has_vulkan_timeline_semaphores ()
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+
+
+  return s_has_timeline_semaphores;
+}
 #pragma endregion
 
 
@@ -1289,41 +1617,212 @@ bool create_vulkan_fences (u32 num, VkFenceCreateFlags flags, VkFence* out_fence
 
   return true;
 }
-#pragma endregion
+bool create_vulkan_timelines (u32 num, u64 initial_value, vulkan_timeline* out_timelines)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (num > 0u);
+  DBG_ASSERT (out_timelines != nullptr);
+  if (!s_has_timeline_semaphores)
+  {
+    return DBG_ASSERT_MSG (false, "the device doesn't support timeline semaphores ('timelineSemaphore' feature)\n");
+  }
 
 
-#pragma region vulkan_command
-bool create_vulkan_command_pool (VkQueueFlags requested_queue_type, VkCommandPool& out_command_pool)
+  VkSemaphoreTypeCreateInfo const stci =
+  {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = initial_value
+  };
+  VkSemaphoreCreateInfo const sci =
+  {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &stci,
+    //.flags = 0u,
+  };
+  for (u32 i = 0u; i < num; ++i)
+  {
+    if (CHECK_VULKAN_HANDLE (out_timelines [i].semaphore))
+    {
+      return DBG_ASSERT (false);
+    }
+
+    VkResult const result = vkCreateSemaphore (s_device, // device
+      &sci,                                              // pCreateInfo
+      nullptr,                                           // pAllocator
+      &out_timelines [i].semaphore);                     // pSemaphore
+    if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (out_timelines [i].semaphore))
+    {
+      return DBG_ASSERT_MSG (false, "failed to create timeline semaphore\n");
+    }
+    out_timelines [i].last_value = initial_value;
+  }
+
+  return true;
+}
+
+u64 advance_vulkan_timeline (vulkan_timeline& timeline)
 {
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
-  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_command_pool));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (timeline.semaphore));
 
 
-  // a 'VkCommandPool' can be associated with several 'VkCommandBuffer's
-  // but must be in the same queue family
-  // see 'VkCommandPoolCreateInfo' below
+  return ++timeline.last_value;
+}
+bool submit_vulkan_command_buffers (VkQueue queue,
+  u32 num_command_buffers, VkCommandBuffer const* command_buffers,
+  u32 num_waits, vulkan_semaphore_wait const* waits,
+  u32 num_signals, vulkan_semaphore_signal const* signals,
+  VkFence fence)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (queue));
+  DBG_ASSERT (num_command_buffers == 0u || command_buffers != nullptr);
+  DBG_ASSERT (num_waits == 0u || waits != nullptr);
+  DBG_ASSERT (num_signals == 0u || signals != nullptr);
 
 
-  std::optional <u32> family;
-  if ((requested_queue_type & VK_QUEUE_GRAPHICS_BIT) > 0)
+  // split the descriptions in to the parallel arrays 'VkSubmitInfo' wants
+  // values for binary semaphores are ignored by the driver, so the arrays can be mixed
+  std::vector <VkSemaphore> wait_semaphores (num_waits);
+  std::vector <u64> wait_values (num_waits);
+  std::vector <VkPipelineStageFlags> wait_stages (num_waits);
+  for (u32 i = 0u; i < num_waits; ++i)
   {
-    family = s_queue_indices.graphics_family;
+    DBG_ASSERT (CHECK_VULKAN_HANDLE (waits [i].semaphore));
+    wait_semaphores [i] = waits [i].semaphore;
+    wait_values [i] = waits [i].value;
+    wait_stages [i] = waits [i].stage_mask;
   }
-  else if ((requested_queue_type & VK_QUEUE_COMPUTE_BIT) > 0)
+  std::vector <VkSemaphore> signal_semaphores (num_signals);
+  std::vector <u64> signal_values (num_signals);
+  for (u32 i = 0u; i < num_signals; ++i)
   {
-    family = s_queue_indices.compute_family;
+    DBG_ASSERT (CHECK_VULKAN_HANDLE (signals [i].semaphore));
+    signal_semaphores [i] = signals [i].semaphore;
+    signal_values [i] = signals [i].value;
   }
-  if (!family.has_value ())
+
+  VkTimelineSemaphoreSubmitInfo const tssi =
   {
-    return DBG_ASSERT_MSG (false, "there is no valid queue for the requested queue type\n");
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    .waitSemaphoreValueCount = num_waits,
+    .pWaitSemaphoreValues = wait_values.data (),
+    .signalSemaphoreValueCount = num_signals,
+    .pSignalSemaphoreValues = signal_values.data ()
+  };
+  VkSubmitInfo const submit_info =
+  {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext = &tssi,
+    .waitSemaphoreCount = num_waits,
+    .pWaitSemaphores = wait_semaphores.data (),
+    .pWaitDstStageMask = wait_stages.data (),
+    .commandBufferCount = num_command_buffers,
+    .pCommandBuffers = command_buffers,
+    .signalSemaphoreCount = num_signals,
+    .pSignalSemaphores = signal_semaphores.data ()
+  };
+  TRACE_SCOPE ("vkQueueSubmit");
+  VkResult const result = vkQueueSubmit (queue, // queue
+    1u,                                         // submitCount
+    &submit_info,                               // pSubmits
+    fence);                                     // fence
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to submit command buffers\n");
   }
 
+  return true;
+}
+bool wait_vulkan_timeline (vulkan_timeline const& timeline, u64 value, u64 timeout)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (timeline.semaphore));
+
+
+  VkSemaphoreWaitInfo const swi =
+  {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    //.flags = 0u,
+    .semaphoreCount = 1u,
+    .pSemaphores = &timeline.semaphore,
+    .pValues = &value
+  };
+  TRACE_SCOPE ("wait timeline");
+  VkResult const result = vkWaitSemaphores (s_device, // device
+    &swi,                                             // pWaitInfo
+    timeout);                                         // timeout
+  if (result == VK_TIMEOUT)
+  {
+    return false; // not an error, the caller asked to give up
+  }
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to wait on timeline semaphore\n");
+  }
+
+  return true;
+}
+bool get_vulkan_timeline_value (vulkan_timeline const& timeline, u64& out_value)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (timeline.semaphore));
+
+
+  VkResult const result = vkGetSemaphoreCounterValue (s_device, // device
+    timeline.semaphore,                                         // semaphore
+    &out_value);                                                // pValue
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to get timeline semaphore value\n");
+  }
+
+  return true;
+}
+bool signal_vulkan_timeline (vulkan_timeline const& timeline, u64 value)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (timeline.semaphore));
+
+
+  VkSemaphoreSignalInfo const ssi =
+  {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    .semaphore = timeline.semaphore,
+    .value = value
+  };
+  VkResult const result = vkSignalSemaphore (s_device, // device
+    &ssi);                                             // pSignalInfo
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to signal timeline semaphore\n");
+  }
+
+  return true;
+}
+#pragma endregion
+
+
+#pragma region vulkan_command
+static bool create_command_pool (u32 family, VkCommandPool& out_command_pool)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_command_pool));
+
+
+  // a 'VkCommandPool' can be associated with several 'VkCommandBuffer's
+  // but must be in the same queue family
+  // see 'VkCommandPoolCreateInfo' below
+
   VkCommandPoolCreateInfo const cpci =
   {
     .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
     //.pNext = VK_NULL_HANDLE,
     .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, // look me up!
-    .queueFamilyIndex = family.value ()
+    .queueFamilyIndex = family
   };
 
   VkResult const result = vkCreateCommandPool(s_device, // device
@@ -1338,6 +1837,38 @@ bool create_vulkan_command_pool (VkQueueFlags requested_queue_type, VkCommandPoo
 
   return true;
 }
+bool create_vulkan_command_pool (VkQueueFlags requested_queue_type, VkCommandPool& out_command_pool)
+{
+  std::optional <u32> family;
+  if ((requested_queue_type & VK_QUEUE_GRAPHICS_BIT) > 0)
+  {
+    family = s_queue_indices.graphics_family;
+  }
+  else if ((requested_queue_type & VK_QUEUE_COMPUTE_BIT) > 0)
+  {
+    family = s_queue_indices.compute_family;
+  }
+  else if ((requested_queue_type & VK_QUEUE_TRANSFER_BIT) > 0)
+  {
+    family = s_queue_indices.transfer_family;
+  }
+  if (!family.has_value ())
+  {
+    return DBG_ASSERT_MSG (false, "there is no valid queue for the requested queue type\n");
+  }
+
+  return create_command_pool (family.value (), out_command_pool);
+}
+bool create_vulkan_command_pool_for_queue (VkQueue queue, VkCommandPool& out_command_pool)
+{
+  u32 family = {};
+  if (!get_vulkan_queue_family_index (queue, family))
+  {
+    return false;
+  }
+
+  return create_command_pool (family, out_command_pool);
+}
 bool create_vulkan_command_buffers (u32 num, VkCommandPool command_pool, VkCommandBuffer* out_command_buffers)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
@@ -1375,6 +1906,7 @@ bool create_vulkan_command_buffers (u32 num, VkCommandPool command_pool, VkComma
 #pragma endregion
 
 
+#ifndef VULKAN_HEADLESS
 bool process_os_messages ()
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (s_window_handle));
@@ -1384,6 +1916,7 @@ bool process_os_messages ()
   glfwPollEvents ();
   return true;
 }
+#endif // VULKAN_HEADLESS
 bool acquire_next_swapchain_image(VkSemaphore swapchain_image_available_semaphore)
 {
     DBG_ASSERT(CHECK_VULKAN_HANDLE(s_device));
@@ -1391,6 +1924,7 @@ bool acquire_next_swapchain_image(VkSemaphore swapchain_image_available_semaphor
     DBG_ASSERT(CHECK_VULKAN_HANDLE(swapchain_image_available_semaphore));
 
 
+    TRACE_SCOPE("acquire swapchain image");
     VkResult const result = vkAcquireNextImageKHR(s_device, // device
         s_swapchain,                                           // swapchain
         UINT64_MAX,                                            // timeout
@@ -1474,17 +2008,19 @@ void end_render_pass (VkCommandBuffer command_buffer)
 
   vkCmdEndRenderPass (command_buffer);
 }
-bool present()
+bool present(VkSemaphore render_finished_semaphore)
 {
     DBG_ASSERT(CHECK_VULKAN_HANDLE(s_swapchain));
+    DBG_ASSERT(CHECK_VULKAN_HANDLE(render_finished_semaphore));
 
 
+    TRACE_SCOPE("present");
     VkPresentInfoKHR const present_info =
     {
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
       //.pNext = VK_NULL_HANDLE,
-      .waitSemaphoreCount = 0u,
-      .pWaitSemaphores = VK_NULL_HANDLE,
+      .waitSemaphoreCount = 1u,
+      .pWaitSemaphores = &render_finished_semaphore, // don't flip until rendering to the image has finished
       .swapchainCount = 1u,
       .pSwapchains = &s_swapchain,
       .pImageIndices = &s_swapchain_index,
@@ -1562,6 +2098,7 @@ bool end_single_time_commands ()
   DBG_ASSERT (CHECK_VULKAN_HANDLE (s_single_time_queue));
 
 
+  TRACE_SCOPE ("single time commands");
   // Create fence to ensure that the command buffer has finished executing
   VkFence fence = VK_NULL_HANDLE;
   if (!create_vulkan_fences (1u, 0u, &fence))
@@ -1646,6 +2183,20 @@ void release_vulkan_semaphores (u32 num, VkSemaphore* semaphores)
     semaphores [i] = VK_NULL_HANDLE;
   }
 }
+void release_vulkan_timelines (u32 num, vulkan_timeline* timelines)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+  DBG_ASSERT (num > 0u);
+  DBG_ASSERT (timelines != nullptr);
+
+
+  for (u32 i = 0u; i < num; ++i)
+  {
+    DBG_ASSERT (CHECK_VULKAN_HANDLE (timelines [i].semaphore));
+    vkDestroySemaphore (s_device, timelines [i].semaphore, VK_NULL_HANDLE);
+    timelines [i] = {};
+  }
+}
 
 void release_vulkan_command_buffers (u32 num, VkCommandPool command_pool, VkCommandBuffer* command_buffers)
 {
@@ -1708,7 +2259,10 @@ void release_vulkan_device ()
 
   vkDestroyDevice (s_device, VK_NULL_HANDLE);
   s_device = VK_NULL_HANDLE;
+  s_queue_async_compute = {};
+  s_queue_transfer = {};
 }
+#ifndef VULKAN_HEADLESS
 void release_vulkan_surface ()
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (s_instance));
@@ -1718,6 +2272,7 @@ void release_vulkan_surface ()
   vkDestroySurfaceKHR (s_instance, s_surface, VK_NULL_HANDLE);
   s_surface = VK_NULL_HANDLE;
 }
+#endif // VULKAN_HEADLESS
 #ifdef ENABLE_VULKAN_DEBUG
 static void destroy_debug_report_callback ()
 {
@@ -1752,12 +2307,13 @@ void release_vulkan_instance ()
 
 
 #ifdef ENABLE_VULKAN_DEBUG
-  destroy_debug_messenger ();
-  destroy_debug_report_callback ();
+  if (CHECK_VULKAN_HANDLE (s_debug_messenger)) destroy_debug_messenger ();
+  if (CHECK_VULKAN_HANDLE (s_debug_report_callback)) destroy_debug_report_callback ();
 #endif // ENABLE_VULKAN_DEBUG
   vkDestroyInstance (s_instance, VK_NULL_HANDLE);
   s_instance = VK_NULL_HANDLE;
 }
+#ifndef VULKAN_HEADLESS
 void release_window ()
 {
   DBG_ASSERT (s_window_handle != NULL);
@@ -1767,4 +2323,5 @@ void release_window ()
   glfwTerminate ();
   s_window_handle = NULL;
 }
+#endif // VULKAN_HEADLESS
 #pragma endregion
@@ -2,32 +2,74 @@
 
 #include "maths.h"                // for standard types
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
 #include <vulkan/vulkan.h>        // for everything vulkan
+#ifndef VULKAN_HEADLESS
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>           // for glfw...
+#endif // VULKAN_HEADLESS
 
 
 constexpr u32 NUM_SWAPCHAIN_IMAGES = 2u; // vulkan requires at least 2 swapchain images
+constexpr u32 NUM_FRAMES_IN_FLIGHT = 2u; // frames the cpu may record ahead of the gpu, each needs its own command buffer, sync objects & per frame data
 
 
+/// <summary>
+/// timeline semaphore: a u64 counter, only ever increased, signalled by submits (or the host)
+/// waiting for a value also waits for every value before it, so ONE timeline orders a whole chain of submits
+/// (across queues) and the host can wait on / poll it, instead of a binary semaphore + fence per submit
+/// </summary>
+struct vulkan_timeline
+{
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  u64 last_value = {}; // last value handed out by 'advance_vulkan_timeline'
+};
+/// <summary>
+/// a semaphore a submit waits on, before any of its commands reach 'stage_mask'
+/// 'value' is ignored for binary semaphores (e.g. swapchain image available)
+/// </summary>
+struct vulkan_semaphore_wait
+{
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  u64 value = {};
+  VkPipelineStageFlags stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+/// <summary>
+/// a semaphore a submit signals, once all of its commands have completed
+/// 'value' is ignored for binary semaphores (e.g. render finished)
+/// </summary>
+struct vulkan_semaphore_signal
+{
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  u64 value = {};
+};
+
+
+#ifndef VULKAN_HEADLESS
 /// <summary>
 /// create window (using glfw)
 /// </summary>
 /// <returns>true, if successful</returns>
 bool create_window (char const*const title);
+#endif // VULKAN_HEADLESS
 /// <summary>
 /// create vulkan instance and debug messenger
 /// </summary>
 /// <returns>true, if successful</returns>
 bool create_vulkan_instance ();
+#ifndef VULKAN_HEADLESS
 /// <summary>
 /// create vulkan surface (using glfw)
 /// </summary>
 /// <returns>true, if successful</returns>
 bool create_vulkan_surface ();
+#endif // VULKAN_HEADLESS
 /// <summary>
 /// create vulkan physical & logical device
+/// 'VK_QUEUE_GRAPHICS_BIT' requires a surface, compute only devices do not (headless)
+/// prefers dedicated compute only/transfer only queue families for the async compute/transfer queues
 /// </summary>
 /// <param name="requested_queue_types">types of queues you want the device to support</param>
 /// <returns>true, if successful</returns>
@@ -49,6 +91,38 @@ bool get_vulkan_queue_compute (VkQueue& out_queue);
 /// </summary>
 /// <returns>true, if successful</returns>
 bool get_vulkan_queue_graphics (VkQueue& out_queue);
+/// <summary>
+/// get queue to submit compute work that should overlap graphics/compute to
+/// from a compute only family if the device has one, otherwise an extra queue in (or the same queue as) the compute family
+/// NOTE: a different family than the graphics/compute queue means exclusive resources need queue family ownership transfers!
+/// </summary>
+/// <returns>true, if successful</returns>
+bool get_vulkan_queue_async_compute (VkQueue& out_queue);
+/// <summary>
+/// get queue to submit copies to
+/// from a transfer only family (dma engines) if the device has one, otherwise shared like the async compute queue
+/// NOTE: a different family than the graphics/compute queue means exclusive resources need queue family ownership transfers!
+/// </summary>
+/// <returns>true, if successful</returns>
+bool get_vulkan_queue_transfer (VkQueue& out_queue);
+/// <summary>
+/// get the family of any queue returned by 'get_vulkan_queue_...'
+/// for command pools and queue family ownership transfers
+/// </summary>
+/// <returns>true, if successful</returns>
+bool get_vulkan_queue_family_index (VkQueue queue, u32& out_family_index);
+/// <summary>
+/// 'VK_EXT_pipeline_creation_feedback' was enabled on the device, pass it on to 'create_vulkan_pipeline_cache'
+/// </summary>
+bool has_vulkan_pipeline_creation_feedback ();
+/// <summary>
+/// 'pipelineStatisticsQuery' was enabled on the device, pass it on to 'create_vulkan_profiler'
+/// </summary>
+bool has_vulkan_pipeline_statistics ();
+/// <summary>
+/// the 'timelineSemaphore' feature was enabled on the device, 'create_vulkan_timelines' fails without it
+/// </summary>
+bool has_vulkan_timeline_semaphores ();
 
 
 /// <summary>
@@ -61,6 +135,44 @@ bool create_vulkan_semaphores (u32 num, VkSemaphore* out_semaphores);
 /// </summary>
 /// <returns>true, if successful</returns>
 bool create_vulkan_fences (u32 num, VkFenceCreateFlags flags, VkFence* out_fences);
+/// <summary>
+/// create vulkan timeline semaphores, starting at 'initial_value'
+/// the device must support them, see 'has_vulkan_timeline_semaphores'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_timelines (u32 num, u64 initial_value, vulkan_timeline* out_timelines);
+
+/// <summary>
+/// reserve the next value of the timeline, for a submit (or the host) to signal
+/// </summary>
+u64 advance_vulkan_timeline (vulkan_timeline& timeline);
+/// <summary>
+/// submit command buffers to 'queue', waiting on/signalling any mix of timeline and binary semaphores
+/// waits on a timeline signalled by another queue are how work is chained across queues
+/// fence is optional, the timelines make it redundant in most cases
+/// </summary>
+/// <returns>true, if successful</returns>
+bool submit_vulkan_command_buffers (VkQueue queue,
+  u32 num_command_buffers, VkCommandBuffer const* command_buffers,
+  u32 num_waits, vulkan_semaphore_wait const* waits,
+  u32 num_signals, vulkan_semaphore_signal const* signals,
+  VkFence fence = VK_NULL_HANDLE);
+/// <summary>
+/// block the host until the timeline reaches 'value', or 'timeout' (in nanoseconds) expires
+/// </summary>
+/// <returns>true, if the value was reached (false on timeout or error)</returns>
+bool wait_vulkan_timeline (vulkan_timeline const& timeline, u64 value, u64 timeout = UINT64_MAX);
+/// <summary>
+/// read the current value of the timeline, without blocking
+/// i.e. every submit signalling a value <= 'out_value' has completed
+/// </summary>
+/// <returns>true, if successful</returns>
+bool get_vulkan_timeline_value (vulkan_timeline const& timeline, u64& out_value);
+/// <summary>
+/// signal the timeline from the host, releasing device work waiting on 'value'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool signal_vulkan_timeline (vulkan_timeline const& timeline, u64 value);
 
 
 /// <summary>
@@ -70,6 +182,11 @@ bool create_vulkan_fences (u32 num, VkFenceCreateFlags flags, VkFence* out_fence
 /// <returns>true, if successful</returns>
 bool create_vulkan_command_pool (VkQueueFlags requested_queue_type, VkCommandPool& out_command_pool);
 /// <summary>
+/// create a new command pool, for command buffers submitted to 'queue' (e.g. the async compute or transfer queue)
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_command_pool_for_queue (VkQueue queue, VkCommandPool& out_command_pool);
+/// <summary>
 /// create a new command buffer
 /// </summary>
 /// <param name="command_pool">command pool to create the new command buffer from</param>
@@ -81,7 +198,9 @@ bool begin_single_time_commands (VkCommandBuffer& out_command_buffer);
 bool end_single_time_commands ();
 
 
+#ifndef VULKAN_HEADLESS
 bool process_os_messages ();
+#endif // VULKAN_HEADLESS
 bool acquire_next_swapchain_image (VkSemaphore swapchain_image_available_semaphore);
 /// <summary>
 /// MUST be called after 'acquire_next_swapchain_image', so swapchain image index is correct!
@@ -90,17 +209,26 @@ bool acquire_next_swapchain_image (VkSemaphore swapchain_image_available_semapho
 /// </summary>
 void begin_render_pass (VkCommandBuffer command_buffer, vec3 const& clear_colour);
 void end_render_pass (VkCommandBuffer command_buffer);
-bool present ();
+/// <summary>
+/// present the acquired swapchain image, once 'render_finished_semaphore' has been signalled
+/// (i.e. by the submit that rendered to it), so the cpu does not need to wait on the frame
+/// </summary>
+bool present (VkSemaphore render_finished_semaphore);
 
 
 void release_vulkan_fences (u32 num, VkFence* fences);
 void release_vulkan_semaphores (u32 num, VkSemaphore* semaphores);
+void release_vulkan_timelines (u32 num, vulkan_timeline* timelines);
 
 void release_vulkan_command_buffers (u32 num, VkCommandPool command_pool, VkCommandBuffer* command_buffers);
 void release_vulkan_command_pool (VkCommandPool& command_pool);
 
 void release_vulkan_swapchain ();
 void release_vulkan_device ();
+#ifndef VULKAN_HEADLESS
 void release_vulkan_surface ();
+#endif // VULKAN_HEADLESS
 void release_vulkan_instance ();
+#ifndef VULKAN_HEADLESS
 void release_window ();
+#endif // VULKAN_HEADLESS
@@ -0,0 +1,437 @@
+#include "vulkan_elementwise.h"
+
+#include "vulkan_context.h"   // for create_vulkan_command_pool, ...
+#include "vulkan_pipeline.h"  // for create_vulkan_pipeline_compute, ...
+#include "vulkan_resources.h" // for vulkan_buffer, add_vulkan_buffer_release_callback
+#include "vulkan_autotune.h"  // for find_vulkan_workgroup_size
+#include "utility.h"          // DBG_ASSERT
+
+#include <array>              // for std::array
+#include <functional>         // for std::function
+#include <span>               // for std::span
+#include <vector>             // for std::vector
+
+
+constexpr char const* COMPILED_ELEMENTWISE_SHADER_PATH = "data/shaders/glsl/vulkan_compute/vulkan_elementwise.comp.spv";
+constexpr char const* AUTOTUNE_KERNEL_NAME = "vulkan_elementwise";
+constexpr u32 THREAD_GROUP_SIZE = 256u; // unless this device has been tuned
+
+constexpr u32 NUM_BINDINGS = 3u; // a, b, out
+constexpr u32 SETS_PER_POOL = 64u;
+constexpr u32 MAX_DESCRIPTOR_POOLS = 16u; // 1024 distinct a/b/out triples cached at once
+constexpr u32 NUM_TYPES = (u32)gpu_type::u32 + 1u;
+constexpr u32 NUM_OPS = (u32)gpu_op::fma + 1u;
+
+
+struct elementwise_push_constants
+{
+  u32 num_elements;
+  u32 k; // bits of the scalar
+};
+
+// a descriptor set pointing at one a/b/out triple
+struct elementwise_set
+{
+  VkBuffer a = VK_NULL_HANDLE, b = VK_NULL_HANDLE, out = VK_NULL_HANDLE;
+  u32 pool_index = {};
+  vulkan_descriptor_set desc_set;
+};
+
+
+static VkDevice s_device = VK_NULL_HANDLE;
+static u32 s_max_groups_x = {};
+static VkDeviceSize s_max_binding_size = {};
+static vulkan_workgroup_size s_thread_group_size = { .x = THREAD_GROUP_SIZE };
+
+static VkDescriptorSetLayout s_descriptor_set_layout = VK_NULL_HANDLE;
+static VkPipelineLayout s_pipeline_layout = VK_NULL_HANDLE;
+static std::array <VkPipeline, NUM_TYPES * NUM_OPS> s_pipelines = {}; // by type, then op, created on first use
+
+static std::array <VkDescriptorPool, MAX_DESCRIPTOR_POOLS> s_descriptor_pools = {}; // created as they fill up
+static std::array <u32, MAX_DESCRIPTOR_POOLS> s_num_pool_sets = {};
+static std::vector <elementwise_set> s_sets;
+
+// for launches without a command buffer, reused by every one
+static VkQueue s_queue = VK_NULL_HANDLE;
+static VkCommandPool s_command_pool = VK_NULL_HANDLE;
+static VkCommandBuffer s_command_buffer = VK_NULL_HANDLE;
+static VkFence s_fence = VK_NULL_HANDLE;
+
+
+#pragma region vulkan_elementwise_support
+static bool get_pipeline (gpu_op op, gpu_type type,
+  VkPipeline& out_pipeline)
+{
+  VkPipeline& pipeline = s_pipelines [((u32)type * NUM_OPS) + (u32)op];
+  if (CHECK_VULKAN_HANDLE (pipeline))
+  {
+    out_pipeline = pipeline;
+    return true;
+  }
+
+  vulkan_specialization specialization;
+  bool const is_created = set_vulkan_specialization_constant (specialization, 0u, s_thread_group_size.x) &&
+    set_vulkan_specialization_constant (specialization, 1u, (u32)type) &&
+    set_vulkan_specialization_constant (specialization, 2u, (u32)op) &&
+    create_vulkan_elementwise_pipeline (COMPILED_ELEMENTWISE_SHADER_PATH, specialization, pipeline);
+
+  out_pipeline = pipeline;
+  return is_created;
+}
+
+static bool get_descriptor_set (vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& out,
+  vulkan_descriptor_set& out_desc_set)
+{
+  for (elementwise_set const& set : s_sets)
+  {
+    if (set.a == a.buffer && set.b == b.buffer && set.out == out.buffer)
+    {
+      out_desc_set = set.desc_set;
+      return true;
+    }
+  }
+
+  // first pool with room, sets freed by 'forget_vulkan_elementwise_buffer' make room again
+  u32 pool_index = {};
+  while (pool_index < MAX_DESCRIPTOR_POOLS && s_num_pool_sets [pool_index] == SETS_PER_POOL)
+  {
+    ++pool_index;
+  }
+  if (pool_index == MAX_DESCRIPTOR_POOLS)
+  {
+    return DBG_ASSERT_MSG (false, "elementwise: too many buffer combinations, release some buffers\n");
+  }
+  if (!CHECK_VULKAN_HANDLE (s_descriptor_pools [pool_index]))
+  {
+    VkDescriptorPoolSize const pool_size =
+    {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = NUM_BINDINGS * SETS_PER_POOL
+    };
+    if (!create_vulkan_descriptor_pool (s_device,
+      SETS_PER_POOL,
+      1u, &pool_size,
+      s_descriptor_pools [pool_index]))
+    {
+      return false;
+    }
+  }
+
+  elementwise_set set = { .a = a.buffer, .b = b.buffer, .out = out.buffer, .pool_index = pool_index };
+  vulkan_descriptor_set_info const descriptor_set_info =
+  {
+    .desc_pool = &s_descriptor_pools [pool_index],
+    .layout = &s_descriptor_set_layout,
+    .set_index = 0u,
+    .out_set = &set.desc_set
+  };
+  if (!create_vulkan_descriptor_sets (s_device,
+    1u, &descriptor_set_info))
+  {
+    return false;
+  }
+  ++s_num_pool_sets [pool_index];
+
+  VkDescriptorBufferInfo const buffer_infos [NUM_BINDINGS] =
+  {
+    { .buffer = a.buffer, .offset = 0u, .range = VK_WHOLE_SIZE },
+    { .buffer = b.buffer, .offset = 0u, .range = VK_WHOLE_SIZE },
+    { .buffer = out.buffer, .offset = 0u, .range = VK_WHOLE_SIZE }
+  };
+  std::array <VkWriteDescriptorSet, NUM_BINDINGS> write_descriptors = {};
+  for (u32 binding = 0u; binding < NUM_BINDINGS; ++binding)
+  {
+    write_descriptors [binding] =
+    {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      //.pNext = VK_NULL_HANDLE,
+      .dstSet = set.desc_set.desc_set,
+      .dstBinding = binding,
+      .dstArrayElement = 0u,
+      .descriptorCount = 1u,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .pImageInfo = VK_NULL_HANDLE,
+      .pBufferInfo = &buffer_infos [binding],
+      .pTexelBufferView = VK_NULL_HANDLE
+    };
+  }
+  vkUpdateDescriptorSets (s_device, // device
+    NUM_BINDINGS,                   // descriptorWriteCount
+    write_descriptors.data (),      // pDescriptorWrites
+    0u,                             // descriptorCopyCount
+    VK_NULL_HANDLE);                // pDescriptorCopies
+
+  s_sets.push_back (set);
+  out_desc_set = set.desc_set;
+  return true;
+}
+
+static void record_dispatch (VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_descriptor_set const& desc_set,
+  elementwise_push_constants const& push_constants)
+{
+  vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, s_pipeline_layout,
+    desc_set.set_index, 1u, &desc_set.desc_set, 0u, VK_NULL_HANDLE);
+  vkCmdPushConstants (command_buffer, s_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+    0u, sizeof (elementwise_push_constants), &push_constants);
+
+  // past maxComputeWorkGroupCount [0] groups the dispatch is folded in to y, the shader flattens it back
+  u32 const num_groups = ((push_constants.num_elements - 1u) / s_thread_group_size.x) + 1u;
+  u32 groups_x = {}, groups_y = {};
+  fold_vulkan_dispatch (num_groups, s_max_groups_x, groups_x, groups_y);
+  vkCmdDispatch (command_buffer, groups_x, groups_y, 1u);
+
+  // the output is ready for whatever comes next: another kernel, a copy, or the host once the submit completes
+  VkMemoryBarrier const barrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    //.pNext = VK_NULL_HANDLE,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT
+  };
+  VkPipelineStageFlags const dst_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT;
+  vkCmdPipelineBarrier (command_buffer,   // commandBuffer
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+    dst_stages,                           // dstStageMask
+    0u,                                   // dependencyFlags
+    1u,                                   // memoryBarrierCount
+    &barrier,                             // pMemoryBarriers
+    0u,                                   // bufferMemoryBarrierCount
+    VK_NULL_HANDLE,                       // pBufferMemoryBarriers
+    0u,                                   // imageMemoryBarrierCount
+    VK_NULL_HANDLE);                      // pImageMemoryBarriers
+}
+
+static bool submit_and_wait (VkPipeline pipeline, vulkan_descriptor_set const& desc_set,
+  elementwise_push_constants const& push_constants)
+{
+  return submit_vulkan_elementwise_commands ([&](VkCommandBuffer command_buffer)
+    {
+      record_dispatch (command_buffer, pipeline, desc_set, push_constants);
+    });
+}
+#pragma endregion
+
+
+bool create_vulkan_elementwise (VkPhysicalDevice physical_device, VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (s_device));
+
+
+  s_device = device;
+  add_vulkan_buffer_release_callback (forget_vulkan_elementwise_buffer); // a new buffer could get a released buffer's handle
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+  s_max_groups_x = properties.limits.maxComputeWorkGroupCount [0];
+  s_max_binding_size = properties.limits.maxStorageBufferRange;
+
+  s_thread_group_size = { .x = THREAD_GROUP_SIZE };
+  find_vulkan_workgroup_size (AUTOTUNE_KERNEL_NAME, s_thread_group_size); // keeps the default if this device hasn't been tuned
+
+  // set 0: input a, input b, output
+  std::array <VkDescriptorSetLayoutBinding, NUM_BINDINGS> bindings = {};
+  for (u32 binding = 0u; binding < NUM_BINDINGS; ++binding)
+  {
+    bindings [binding] =
+    {
+      .binding = binding,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 1u,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .pImmutableSamplers = VK_NULL_HANDLE
+    };
+  }
+  std::span <const VkDescriptorSetLayoutBinding> const descriptor_set_layout_bindings (bindings);
+  if (!create_vulkan_descriptor_set_layouts (s_device,
+    1u, &descriptor_set_layout_bindings,
+    &s_descriptor_set_layout))
+  {
+    return false;
+  }
+
+  VkPushConstantRange const push_constant_range =
+  {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0u,
+    .size = MAX_ELEMENTWISE_PUSH_CONSTANTS_SIZE
+  };
+  return create_vulkan_pipeline_layout (s_device,
+    1u, &s_descriptor_set_layout,
+    1u, &push_constant_range,
+    s_pipeline_layout);
+}
+
+bool launch_vulkan_elementwise (gpu_op op, gpu_type type,
+  vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& out,
+  u64 num_elements, u32 k_bits,
+  VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_elementwise' first\n");
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (a.buffer) && CHECK_VULKAN_HANDLE (b.buffer) && CHECK_VULKAN_HANDLE (out.buffer));
+
+
+  if (num_elements == 0u)
+  {
+    return true;
+  }
+  // every element type is 4 bytes
+  VkDeviceSize const size = num_elements * sizeof (u32);
+  if (size > a.size || size > b.size || size > out.size || size > s_max_binding_size)
+  {
+    return DBG_ASSERT_MSG (false, "elementwise: %llu elements don't fit the buffers (or 'maxStorageBufferRange')\n",
+      (unsigned long long)num_elements);
+  }
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  vulkan_descriptor_set desc_set;
+  if (!get_pipeline (op, type, pipeline) ||
+    !get_descriptor_set (a, b, out, desc_set))
+  {
+    return false;
+  }
+
+  elementwise_push_constants const push_constants =
+  {
+    .num_elements = (u32)num_elements,
+    .k = k_bits
+  };
+  if (CHECK_VULKAN_HANDLE (command_buffer))
+  {
+    record_dispatch (command_buffer, pipeline, desc_set, push_constants);
+    return true;
+  }
+  return submit_and_wait (pipeline, desc_set, push_constants);
+}
+
+bool create_vulkan_elementwise_pipeline (char const* shader_path, vulkan_specialization const& specialization,
+  VkPipeline& out_pipeline)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_elementwise' first\n");
+
+
+  VkShaderModule shader_module = VK_NULL_HANDLE;
+  if (!create_vulkan_shader (s_device,
+    shader_path,
+    shader_module))
+  {
+    return false;
+  }
+
+  bool const is_created = create_vulkan_pipeline_compute (s_device,
+    shader_module, "main",
+    s_pipeline_layout,
+    out_pipeline,
+    &specialization);
+
+  release_vulkan_shader (s_device,
+    shader_module); // don't need shader object now we have the pipeline
+  return is_created;
+}
+
+VkPipelineLayout get_vulkan_elementwise_pipeline_layout ()
+{
+  return s_pipeline_layout;
+}
+
+bool get_vulkan_elementwise_descriptor_set (vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& out,
+  vulkan_descriptor_set& out_desc_set)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_elementwise' first\n");
+  return get_descriptor_set (a, b, out, out_desc_set);
+}
+
+bool submit_vulkan_elementwise_commands (std::function <void (VkCommandBuffer command_buffer)> const& record)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_elementwise' first\n");
+
+
+  if (!CHECK_VULKAN_HANDLE (s_command_pool))
+  {
+    if (!get_vulkan_queue_compute (s_queue) ||
+      !create_vulkan_command_pool_for_queue (s_queue, s_command_pool) ||
+      !create_vulkan_command_buffers (1u, s_command_pool, &s_command_buffer) ||
+      !create_vulkan_fences (1u, 0u, &s_fence))
+    {
+      return DBG_ASSERT_MSG (false, "elementwise: failed to create the command buffer\n");
+    }
+  }
+
+  if (!CHECK_VULKAN_RESULT (vkResetCommandBuffer (s_command_buffer, 0u)) ||
+    !begin_command_buffer (s_command_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+  {
+    return false;
+  }
+  record (s_command_buffer);
+  if (!end_command_buffer (s_command_buffer))
+  {
+    return false;
+  }
+
+  if (!CHECK_VULKAN_RESULT (vkResetFences (s_device, 1u, &s_fence)) ||
+    !submit_vulkan_command_buffers (s_queue,
+      1u, &s_command_buffer,
+      0u, nullptr,
+      0u, nullptr,
+      s_fence))
+  {
+    return false;
+  }
+
+  VkResult const result = vkWaitForFences (s_device, 1u, &s_fence, VK_TRUE, UINT64_MAX);
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "elementwise: wait failed\n");
+  }
+  return true;
+}
+
+void forget_vulkan_elementwise_buffer (VkBuffer buffer)
+{
+  for (size_t i = 0u; i < s_sets.size ();)
+  {
+    elementwise_set& set = s_sets [i];
+    if (set.a != buffer && set.b != buffer && set.out != buffer)
+    {
+      ++i;
+      continue;
+    }
+
+    release_vulkan_descriptor_sets (s_device,
+      1u, &set.desc_set);
+    --s_num_pool_sets [set.pool_index];
+    set = s_sets.back ();
+    s_sets.pop_back ();
+  }
+}
+
+void release_vulkan_elementwise (VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+
+
+  if (CHECK_VULKAN_HANDLE (s_fence)) release_vulkan_fences (1u, &s_fence);
+  if (CHECK_VULKAN_HANDLE (s_command_buffer)) release_vulkan_command_buffers (1u, s_command_pool, &s_command_buffer);
+  if (CHECK_VULKAN_HANDLE (s_command_pool)) release_vulkan_command_pool (s_command_pool);
+  s_queue = VK_NULL_HANDLE;
+
+  // destroying the pools frees their sets
+  s_sets.clear ();
+  for (VkDescriptorPool& pool : s_descriptor_pools)
+  {
+    if (CHECK_VULKAN_HANDLE (pool)) release_vulkan_descriptor_pool (device, pool);
+  }
+  s_num_pool_sets = {};
+
+  for (VkPipeline& pipeline : s_pipelines)
+  {
+    if (CHECK_VULKAN_HANDLE (pipeline)) release_vulkan_pipeline (device, pipeline);
+  }
+  if (CHECK_VULKAN_HANDLE (s_pipeline_layout)) release_vulkan_pipeline_layout (device, s_pipeline_layout);
+  if (CHECK_VULKAN_HANDLE (s_descriptor_set_layout)) release_vulkan_descriptor_set_layouts (device, 1u, &s_descriptor_set_layout);
+
+  remove_vulkan_buffer_release_callback (forget_vulkan_elementwise_buffer);
+  s_device = VK_NULL_HANDLE;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+#include <cstring>                // for std::memcpy
+#include <functional>             // for std::function
+#include <type_traits>            // for std::is_same_v
+
+struct vulkan_buffer;
+struct vulkan_descriptor_set;
+struct vulkan_specialization;
+
+
+// element-wise kernel library:
+// 'gpu_map' (out = f (a)) and 'gpu_zip' (out = f (a, b)) over whole storage buffers, in a line or two, e.g.
+//   gpu_zip <gpu_op::add> (buffer_a, buffer_b, buffer_out, num_elements);
+//   gpu_map <gpu_op::scale> (buffer_a, buffer_out, num_elements, 2.f);
+//
+// every op/type is one shader (vulkan_elementwise.comp) specialised when its pipeline is first used
+// the layouts are shared, pipelines are cached per op/type and descriptor sets per a/b/out buffers,
+// so a repeat launch only records and submits
+//
+// the plain calls submit and wait, 'command_buffer' versions record in to the caller's command buffer instead
+// (each dispatch is followed by a barrier, so jobs can be chained and the output read back once it completes)
+
+
+/// <summary>
+/// element types the kernels support, values MUST match TYPE_ in vulkan_elementwise.comp
+/// </summary>
+enum class gpu_type : u32
+{
+  f32,
+  i32,
+  u32
+};
+
+/// <summary>
+/// operations, values MUST match OP_ in vulkan_elementwise.comp
+/// 'k' is the scalar passed to the launch
+/// </summary>
+enum class gpu_op : u32
+{
+  // map
+  copy,     // a
+  negate,   // -a
+  abs,      // |a|
+  scale,    // a * k
+  offset,   // a + k
+  square,   // a * a
+  sqrt,     // f32 only
+  // zip
+  add,      // a + b
+  subtract, // a - b
+  multiply, // a * b
+  divide,   // a / b, integer division by 0 gives 0
+  min,
+  max,
+  fma       // (a * k) + b, as vulkan_compute_buffer.comp
+};
+
+constexpr bool is_gpu_op_zip (gpu_op op)
+{
+  return op >= gpu_op::add;
+}
+
+template <class T> constexpr gpu_type get_gpu_type ()
+{
+  static_assert (std::is_same_v <T, f32> || std::is_same_v <T, i32> || std::is_same_v <T, u32>,
+    "element-wise kernels support f32, i32 and u32");
+  return std::is_same_v <T, f32> ? gpu_type::f32 : (std::is_same_v <T, i32> ? gpu_type::i32 : gpu_type::u32);
+}
+
+
+/// <summary>
+/// create the shared descriptor set/pipeline layouts, pipelines are created on first use
+/// call after 'create_vulkan_autotuner', it looks up its work group size
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_elementwise (VkPhysicalDevice physical_device, VkDevice device);
+
+/// <summary>
+/// run out [i] = op (a [i], b [i], k) for i < num_elements, 'k_bits' is the scalar's bytes
+/// maps pass 'a' as 'b'
+/// records in to 'command_buffer', or if it is VK_NULL_HANDLE, submits to the compute queue and waits
+/// use 'gpu_map'/'gpu_zip' rather than this
+/// </summary>
+/// <returns>true, if successful</returns>
+bool launch_vulkan_elementwise (gpu_op op, gpu_type type,
+  vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& out,
+  u64 num_elements, u32 k_bits,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE);
+
+
+// shared with the primitives (vulkan_primitives.h) and gemm (vulkan_gemm.h), their kernels bind the same three storage buffers
+
+// the shared pipeline layout has room for this many bytes of push constants
+constexpr u32 MAX_ELEMENTWISE_PUSH_CONSTANTS_SIZE = 16u;
+
+/// <summary>
+/// create a compute pipeline for the shader at 'shader_path' with the shared pipeline layout
+/// the caller owns 'out_pipeline', release it before 'release_vulkan_elementwise'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_elementwise_pipeline (char const* shader_path, vulkan_specialization const& specialization,
+  VkPipeline& out_pipeline);
+
+VkPipelineLayout get_vulkan_elementwise_pipeline_layout ();
+
+/// <summary>
+/// the cached descriptor set for bindings 0, 1, 2 = a, b, out, created if this is a new triple
+/// </summary>
+/// <returns>true, if successful</returns>
+bool get_vulkan_elementwise_descriptor_set (vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& out,
+  vulkan_descriptor_set& out_desc_set);
+
+/// <summary>
+/// record with 'record', submit to the compute queue and wait
+/// </summary>
+/// <returns>true, if successful</returns>
+bool submit_vulkan_elementwise_commands (std::function <void (VkCommandBuffer command_buffer)> const& record);
+
+
+/// <summary>
+/// free any cached descriptor sets that point at 'buffer'
+/// registered with 'add_vulkan_buffer_release_callback' by 'create_vulkan_elementwise', so 'release_vulkan_buffer' calls it
+/// </summary>
+void forget_vulkan_elementwise_buffer (VkBuffer buffer);
+
+/// <summary>
+/// release the cached pipelines and descriptor sets, and the layouts
+/// call before 'release_vulkan_device', after the libraries sharing its layouts
+/// </summary>
+void release_vulkan_elementwise (VkDevice device);
+
+
+/// <summary>
+/// out [i] = OP (a [i], k)
+/// </summary>
+/// <returns>true, if successful</returns>
+template <gpu_op OP, class T = f32>
+bool gpu_map (vulkan_buffer const& a, vulkan_buffer const& out, u64 num_elements, T k = {},
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE)
+{
+  static_assert (!is_gpu_op_zip (OP), "gpu_map takes a map op ('copy' .. 'sqrt'), use gpu_zip");
+  static_assert (OP != gpu_op::sqrt || std::is_same_v <T, f32>, "sqrt is f32 only");
+
+  u32 k_bits = {};
+  std::memcpy (&k_bits, &k, sizeof (k_bits));
+  return launch_vulkan_elementwise (OP, get_gpu_type <T> (), a, a, out, num_elements, k_bits, command_buffer);
+}
+
+/// <summary>
+/// out [i] = OP (a [i], b [i], k)
+/// </summary>
+/// <returns>true, if successful</returns>
+template <gpu_op OP, class T = f32>
+bool gpu_zip (vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& out, u64 num_elements, T k = {},
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE)
+{
+  static_assert (is_gpu_op_zip (OP), "gpu_zip takes a zip op ('add' .. 'fma'), use gpu_map");
+
+  u32 k_bits = {};
+  std::memcpy (&k_bits, &k, sizeof (k_bits));
+  return launch_vulkan_elementwise (OP, get_gpu_type <T> (), a, b, out, num_elements, k_bits, command_buffer);
+}
@@ -0,0 +1,316 @@
+#include "vulkan_gemm.h"
+
+#include "vulkan_context.h"     // for CHECK_VULKAN_HANDLE
+#include "vulkan_elementwise.h" // for create_vulkan_elementwise_pipeline, get_vulkan_elementwise_descriptor_set
+#include "vulkan_memory.h"      // for flush_vulkan_memory, invalidate_vulkan_memory
+#include "vulkan_pipeline.h"    // for vulkan_specialization, vulkan_descriptor_set
+#include "vulkan_resources.h"   // for vulkan_buffer
+#include "cpu_compute.h"        // for run_cpu_gemm
+#include "utility.h"            // DBG_ASSERT
+
+#include <cmath>                // for std::fabs
+#include <initializer_list>     // for std::initializer_list
+#include <iterator>             // for std::size
+#include <random>               // for std::ranlux24_base, std::uniform_real_distribution
+#include <span>                 // for std::span
+#include <vector>               // for std::vector
+
+
+constexpr char const* COMPILED_GEMM_SHADER_PATH = "data/shaders/glsl/vulkan_compute/vulkan_gemm.comp.spv";
+
+
+struct gemm_push_constants
+{
+  u32 m;
+  u32 n;
+  u32 k;
+};
+static_assert (sizeof (gemm_push_constants) <= MAX_ELEMENTWISE_PUSH_CONSTANTS_SIZE);
+
+struct gemm_pipeline
+{
+  vulkan_gemm_tiles tiles;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+
+static VkPhysicalDevice s_physical_device = VK_NULL_HANDLE;
+static VkDevice s_device = VK_NULL_HANDLE;
+static VkPhysicalDeviceLimits s_limits = {};
+
+static std::vector <gemm_pipeline> s_pipelines; // by tile sizes
+
+
+#pragma region vulkan_gemm_support
+static u32 get_group_size (vulkan_gemm_tiles const& tiles)
+{
+  return (tiles.tile_m / tiles.thread_m) * (tiles.tile_n / tiles.thread_n);
+}
+
+static bool check_tiles (vulkan_gemm_tiles const& tiles)
+{
+  if (tiles.tile_m == 0u || tiles.tile_n == 0u || tiles.tile_k == 0u || tiles.thread_m == 0u || tiles.thread_n == 0u ||
+    tiles.tile_m % tiles.thread_m != 0u || tiles.tile_n % tiles.thread_n != 0u)
+  {
+    return DBG_ASSERT_MSG (false, "gemm: tiles %ux%ux%u don't divide in to %ux%u per invocation\n",
+      tiles.tile_m, tiles.tile_n, tiles.tile_k, tiles.thread_m, tiles.thread_n);
+  }
+
+  u32 const group_size = get_group_size (tiles);
+  u32 const shared_size = (tiles.tile_m + tiles.tile_n) * tiles.tile_k * sizeof (f32);
+  if (group_size > s_limits.maxComputeWorkGroupInvocations || group_size > s_limits.maxComputeWorkGroupSize [0] ||
+    shared_size > s_limits.maxComputeSharedMemorySize)
+  {
+    return DBG_ASSERT_MSG (false, "gemm: tiles %ux%ux%u need %u invocations and %u bytes of shared memory, too many for this device\n",
+      tiles.tile_m, tiles.tile_n, tiles.tile_k, group_size, shared_size);
+  }
+  return true;
+}
+
+static bool get_pipeline (vulkan_gemm_tiles const& tiles,
+  VkPipeline& out_pipeline)
+{
+  for (gemm_pipeline const& entry : s_pipelines)
+  {
+    if (entry.tiles.tile_m == tiles.tile_m && entry.tiles.tile_n == tiles.tile_n && entry.tiles.tile_k == tiles.tile_k &&
+      entry.tiles.thread_m == tiles.thread_m && entry.tiles.thread_n == tiles.thread_n)
+    {
+      out_pipeline = entry.pipeline;
+      return true;
+    }
+  }
+
+  vulkan_specialization specialization;
+  gemm_pipeline entry = { .tiles = tiles };
+  if (!set_vulkan_specialization_constant (specialization, 0u, get_group_size (tiles)) ||
+    !set_vulkan_specialization_constant (specialization, 1u, tiles.tile_m) ||
+    !set_vulkan_specialization_constant (specialization, 2u, tiles.tile_n) ||
+    !set_vulkan_specialization_constant (specialization, 3u, tiles.tile_k) ||
+    !set_vulkan_specialization_constant (specialization, 4u, tiles.thread_m) ||
+    !set_vulkan_specialization_constant (specialization, 5u, tiles.thread_n) ||
+    !create_vulkan_elementwise_pipeline (COMPILED_GEMM_SHADER_PATH, specialization, entry.pipeline))
+  {
+    return false;
+  }
+  s_pipelines.push_back (entry);
+  out_pipeline = entry.pipeline;
+  return true;
+}
+
+// 'num_elements' f32s fit 'buffer' and can be bound
+static bool check_size (vulkan_buffer const& buffer, u64 num_elements, char const* name)
+{
+  VkDeviceSize const size = num_elements * sizeof (f32);
+  return size <= buffer.size && size <= s_limits.maxStorageBufferRange ? true :
+    DBG_ASSERT_MSG (false, "gemm: %llu elements of '%s' don't fit the buffer (or 'maxStorageBufferRange')\n",
+      (unsigned long long)num_elements, name);
+}
+
+static bool record_gemm (VkCommandBuffer command_buffer, VkPipeline pipeline, vulkan_gemm_tiles const& tiles,
+  vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& c,
+  u32 m, u32 n, u32 k)
+{
+  vulkan_descriptor_set desc_set;
+  if (!get_vulkan_elementwise_descriptor_set (a, b, c, desc_set))
+  {
+    return false;
+  }
+
+  VkPipelineLayout const pipeline_layout = get_vulkan_elementwise_pipeline_layout ();
+  gemm_push_constants const push_constants = { .m = m, .n = n, .k = k };
+  vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout,
+    desc_set.set_index, 1u, &desc_set.desc_set, 0u, VK_NULL_HANDLE);
+  vkCmdPushConstants (command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+    0u, sizeof (gemm_push_constants), &push_constants);
+  // one work group per tile of c, x across the columns
+  vkCmdDispatch (command_buffer, ((n - 1u) / tiles.tile_n) + 1u, ((m - 1u) / tiles.tile_m) + 1u, 1u);
+
+  // c is visible to whatever comes next: another kernel, a copy, or the host once the submit completes
+  VkMemoryBarrier const barrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    //.pNext = VK_NULL_HANDLE,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT
+  };
+  VkPipelineStageFlags const dst_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT;
+  vkCmdPipelineBarrier (command_buffer,   // commandBuffer
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+    dst_stages,                           // dstStageMask
+    0u,                                   // dependencyFlags
+    1u,                                   // memoryBarrierCount
+    &barrier,                             // pMemoryBarriers
+    0u,                                   // bufferMemoryBarrierCount
+    VK_NULL_HANDLE,                       // pBufferMemoryBarriers
+    0u,                                   // imageMemoryBarrierCount
+    VK_NULL_HANDLE);                      // pImageMemoryBarriers
+  return true;
+}
+
+
+// CHECK
+
+struct gemm_shape
+{
+  u32 m, n, k;
+};
+// against the default 64x64x16 tiles: inside one tile, exact tiles, one past each, tall, wide, a long k, and no k
+constexpr gemm_shape CHECK_SHAPES [] =
+{
+  { 1u, 1u, 1u }, { 7u, 5u, 3u }, { 64u, 64u, 16u }, { 65u, 63u, 17u }, { 128u, 256u, 64u },
+  { 1000u, 3u, 129u }, { 3u, 1000u, 70u }, { 257u, 129u, 1000u }, { 5u, 6u, 0u }
+};
+constexpr u32 MAX_CHECK_ELEMENTS = 257u * 1000u; // the largest of any one matrix above
+// the gpu sums in a different order (and fused), the error grows with k, an indexing mistake is off by far more
+constexpr f32 F32_GEMM_TOLERANCE = 1e-5f;
+
+// c against the cpu's, returns how many elements differ
+static u64 check_shape (vulkan_buffer const& buffer_a, vulkan_buffer const& buffer_b, vulkan_buffer const& buffer_c,
+  gemm_shape const& shape, std::ranlux24_base& re)
+{
+  std::span <f32> const a = get_mapped_span <f32> (buffer_a).first ((u64)shape.m * shape.k);
+  std::span <f32> const b = get_mapped_span <f32> (buffer_b).first ((u64)shape.k * shape.n);
+  std::span <f32 const> const c = get_mapped_span <f32 const> (buffer_c).first ((u64)shape.m * shape.n);
+  std::uniform_real_distribution <f32> distribution (-1.f, 1.f);
+  for (f32& value : a) value = distribution (re);
+  for (f32& value : b) value = distribution (re);
+
+  if (!flush_vulkan_memory (s_device, buffer_a.allocation) ||
+    !flush_vulkan_memory (s_device, buffer_b.allocation) ||
+    !gemm_vulkan_buffer (buffer_a, buffer_b, buffer_c, shape.m, shape.n, shape.k) ||
+    !invalidate_vulkan_memory (s_device, buffer_c.allocation))
+  {
+    return c.size ();
+  }
+
+  std::vector <f32> expected (c.size ());
+  run_cpu_gemm (a.data (), b.data (), expected.data (), shape.m, shape.n, shape.k);
+  f32 const tolerance = F32_GEMM_TOLERANCE * (f32)(shape.k + 1u);
+  u64 num_mismatches = {};
+  for (u64 i = 0u; i < c.size (); ++i)
+  {
+    num_mismatches += std::fabs (c [i] - expected [i]) <= tolerance ? 0u : 1u;
+  }
+  return num_mismatches;
+}
+#pragma endregion
+
+
+bool create_vulkan_gemm (VkPhysicalDevice physical_device, VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (s_device));
+
+
+  s_physical_device = physical_device;
+  s_device = device;
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+  s_limits = properties.limits;
+  return true;
+}
+
+bool gemm_vulkan_buffer (vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& c,
+  u32 m, u32 n, u32 k, vulkan_gemm_tiles const& tiles,
+  VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_gemm' first\n");
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (a.buffer) && CHECK_VULKAN_HANDLE (b.buffer) && CHECK_VULKAN_HANDLE (c.buffer));
+
+
+  if (c.buffer == a.buffer || c.buffer == b.buffer)
+  {
+    return DBG_ASSERT_MSG (false, "gemm: c must not be a or b, other tiles still read what it would overwrite\n");
+  }
+  if (m == 0u || n == 0u)
+  {
+    return true;
+  }
+  if (!check_tiles (tiles) ||
+    !check_size (a, (u64)m * k, "a") || !check_size (b, (u64)k * n, "b") || !check_size (c, (u64)m * n, "c"))
+  {
+    return false;
+  }
+  if (((n - 1u) / tiles.tile_n) + 1u > s_limits.maxComputeWorkGroupCount [0] ||
+    ((m - 1u) / tiles.tile_m) + 1u > s_limits.maxComputeWorkGroupCount [1])
+  {
+    return DBG_ASSERT_MSG (false, "gemm: %ux%u needs more work groups than 'maxComputeWorkGroupCount'\n", m, n);
+  }
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (!get_pipeline (tiles, pipeline))
+  {
+    return false;
+  }
+
+  if (CHECK_VULKAN_HANDLE (command_buffer))
+  {
+    return record_gemm (command_buffer, pipeline, tiles, a, b, c, m, n, k);
+  }
+  bool is_recorded = false;
+  return submit_vulkan_elementwise_commands ([&](VkCommandBuffer submit_command_buffer)
+    {
+      is_recorded = record_gemm (submit_command_buffer, pipeline, tiles, a, b, c, m, n, k);
+    }) && is_recorded;
+}
+
+bool check_vulkan_gemm ()
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_gemm' first\n");
+
+
+  vulkan_buffer buffer_a, buffer_b, buffer_c;
+  for (vulkan_buffer* buffer : { &buffer_a, &buffer_b, &buffer_c })
+  {
+    if (!create_vulkan_buffer (s_physical_device, s_device,
+      MAX_CHECK_ELEMENTS * sizeof (f32),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      *buffer))
+    {
+      return false;
+    }
+  }
+
+  // a fixed seed, so a failure happens again
+  std::ranlux24_base re (1u);
+  u32 num_failed = {};
+  for (gemm_shape const& shape : CHECK_SHAPES)
+  {
+    u64 const num_mismatches = check_shape (buffer_a, buffer_b, buffer_c, shape, re);
+    if (num_mismatches != 0u)
+    {
+      dprintf ("gemm: %ux%ux%u, %llu of %llu elements differ from the cpu\n", shape.m, shape.n, shape.k,
+        (unsigned long long)num_mismatches, (unsigned long long)shape.m * shape.n);
+      ++num_failed;
+    }
+  }
+
+  release_vulkan_buffer (s_device, buffer_a);
+  release_vulkan_buffer (s_device, buffer_b);
+  release_vulkan_buffer (s_device, buffer_c);
+
+  u32 const num_checks = (u32)std::size (CHECK_SHAPES);
+  dprintf ("gemm: %u of %u shapes match the cpu\n", num_checks - num_failed, num_checks);
+  return num_failed == 0u;
+}
+
+void release_vulkan_gemm (VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+
+
+  for (gemm_pipeline& entry : s_pipelines)
+  {
+    release_vulkan_pipeline (device, entry.pipeline);
+  }
+  s_pipelines.clear ();
+
+  s_limits = {};
+  s_device = VK_NULL_HANDLE;
+  s_physical_device = VK_NULL_HANDLE;
+}
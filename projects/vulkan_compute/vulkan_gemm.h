@@ -0,0 +1,68 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+struct vulkan_buffer;
+
+
+// dense matrix multiply:
+// c = a * b over f32 storage buffers, row major, a is m x k, b is k x n, c is m x n, any dimensions
+//
+//   gemm_vulkan_buffer (buffer_a, buffer_b, buffer_c, m, n, k);
+//
+// each work group computes a tile of c from slices of a and b staged in shared memory, each invocation a
+// block of the tile in registers (see vulkan_gemm.comp), the tile sizes are specialization constants
+// so a pipeline is created per 'vulkan_gemm_tiles', on first use
+// the kernel shares the element-wise library's layouts and descriptor set cache (vulkan_elementwise.h)
+// 'run_cpu_gemm' (cpu_compute.h) is the same on the cpu
+
+
+/// <summary>
+/// the shape of the work: a work group computes tile_m x tile_n of c, reading k tile_k at a time,
+/// each of its (tile_m / thread_m) * (tile_n / thread_n) invocations computes thread_m x thread_n of that
+/// the defaults are a safe middle for desktop gpus, not tuned, time others with 'vulkan_compute_bench kernels=gemm'
+/// </summary>
+struct vulkan_gemm_tiles
+{
+  u32 tile_m = 64u;
+  u32 tile_n = 64u;
+  u32 tile_k = 16u;
+  u32 thread_m = 4u;
+  u32 thread_n = 4u;
+};
+
+
+/// <summary>
+/// keep the device's limits, pipelines are created on first use
+/// call after 'create_vulkan_elementwise', it shares its layouts
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_gemm (VkPhysicalDevice physical_device, VkDevice device);
+
+/// <summary>
+/// c = a * b, 'c' must not be 'a' or 'b', a 'k' of 0 clears 'c'
+/// records in to 'command_buffer', or if it is VK_NULL_HANDLE, submits to the compute queue and waits
+/// fails if 'tiles' don't fit the device (work group size, shared memory) or don't divide up
+/// </summary>
+/// <returns>true, if successful</returns>
+bool gemm_vulkan_buffer (vulkan_buffer const& a, vulkan_buffer const& b, vulkan_buffer const& c,
+  u32 m, u32 n, u32 k, vulkan_gemm_tiles const& tiles = {},
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE);
+
+/// <summary>
+/// run a range of shapes (smaller than a tile, exact multiples, one past, tall, wide, a long k)
+/// against 'run_cpu_gemm' and print what differs
+/// </summary>
+/// <returns>true, if everything matches</returns>
+bool check_vulkan_gemm ();
+
+/// <summary>
+/// release the pipelines
+/// call before 'release_vulkan_elementwise'
+/// </summary>
+void release_vulkan_gemm (VkDevice device);
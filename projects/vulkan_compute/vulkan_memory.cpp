@@ -0,0 +1,500 @@
+#include "vulkan_memory.h"
+
+#include "utility.h" // for dprintf, DBG_ASSERT, DBG_ASSERT_...
+
+#include <algorithm> // for std::max, std::min
+#include <array>     // for std::array
+#include <bit>       // for std::bit_width
+#include <map>       // for std::map
+#include <memory>    // for std::unique_ptr
+#include <set>       // for std::set
+#include <vector>    // for std::vector
+
+
+constexpr VkDeviceSize MEMORY_BLOCK_SIZE = 64ull << 20;     // 64MB, preferred size of a block
+constexpr VkDeviceSize SMALL_HEAP_SIZE = 1ull << 30;        // heaps up to 1GB use smaller blocks (heap size / 8)
+constexpr u32 NUM_SIZE_CLASSES = sizeof (VkDeviceSize) * 8u; // one free list per power of 2
+
+
+struct vulkan_memory_block
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size = {};
+  u32 memory_type_index = ~0u;
+  bool is_linear = true;
+  bool is_dedicated = false; // holds a single allocation, too big to share a block
+  bool is_coherent = true;   // false if host visible memory needs explicit flush/invalidate
+
+  void* mapped = nullptr;    // whole block stays mapped for its lifetime, if host visible
+
+  u32 num_allocations = {};
+  VkDeviceSize bytes_used = {};
+
+  // free ranges ordered by offset (offset -> size), so neighbouring ranges can be merged on free
+  std::map <VkDeviceSize, VkDeviceSize> free_ranges;
+  // offsets of free ranges, bucketed by size class (floor (log2 (size)))
+  // allocation only searches the classes that could satisfy the request
+  std::array <std::set <VkDeviceSize>, NUM_SIZE_CLASSES> size_classes;
+};
+
+
+static std::vector <std::unique_ptr <vulkan_memory_block>> s_memory_blocks;
+static VkDeviceSize s_non_coherent_atom_size = 1u; // flush/invalidate ranges must be multiples of this
+
+
+#pragma region vulkan_memory_support
+static u32 find_suitable_memory_type_index (VkPhysicalDeviceMemoryProperties const& memory_properties,
+  VkMemoryPropertyFlags desired_memory_flags, u32 memory_type_bits)
+{
+  // memory_type_bits is a bitfield where if bit n is set, it means that
+  // the VkMemoryType n of the VkPhysicalDeviceMemoryProperties structure
+  // satisfies the memory requirements.
+
+  for (uint32_t i = 0u; i < memory_properties.memoryTypeCount; ++i)
+  {
+    VkMemoryType memory_type = memory_properties.memoryTypes [i];
+    if (memory_type_bits & 1u)
+    {
+      if ((memory_type.propertyFlags & desired_memory_flags) == desired_memory_flags)
+      {
+        return i; // memory type index
+      }
+    }
+
+    memory_type_bits = memory_type_bits >> 1;
+  }
+
+  DBG_ASSERT_MSG (false, "could not find suitable memory type\n");
+  return ~0u;
+}
+
+static u32 get_size_class (VkDeviceSize size)
+{
+  DBG_ASSERT (size > 0u);
+
+
+  return (u32)std::bit_width (size) - 1u;
+}
+static VkDeviceSize align_up (VkDeviceSize value, VkDeviceSize alignment)
+{
+  DBG_ASSERT (alignment > 0u);
+
+
+  return ((value + alignment - 1u) / alignment) * alignment;
+}
+
+static void remove_free_range (vulkan_memory_block& block,
+  std::map <VkDeviceSize, VkDeviceSize>::iterator range)
+{
+  block.size_classes [get_size_class (range->second)].erase (range->first);
+  block.free_ranges.erase (range);
+}
+static void add_free_range (vulkan_memory_block& block,
+  VkDeviceSize offset, VkDeviceSize size)
+{
+  DBG_ASSERT (size > 0u);
+  DBG_ASSERT (offset + size <= block.size);
+
+
+  // merge with the next range
+  auto next = block.free_ranges.find (offset + size);
+  if (next != block.free_ranges.end ())
+  {
+    size += next->second;
+    remove_free_range (block, next);
+  }
+
+  // merge with the previous range
+  auto prev = block.free_ranges.lower_bound (offset);
+  if (prev != block.free_ranges.begin ())
+  {
+    --prev;
+    DBG_ASSERT_MSG (prev->first + prev->second <= offset, "double free of memory range\n");
+    if (prev->first + prev->second == offset)
+    {
+      offset = prev->first;
+      size += prev->second;
+      remove_free_range (block, prev);
+    }
+  }
+
+  block.free_ranges [offset] = size;
+  block.size_classes [get_size_class (size)].insert (offset);
+}
+
+static bool allocate_from_block (vulkan_memory_block& block,
+  VkDeviceSize size, VkDeviceSize alignment,
+  VkDeviceSize& out_offset)
+{
+  // start at the size class the request falls in to, ranges in that class may still be too small
+  // every range in the classes above is big enough, unless alignment padding pushes it over
+  for (u32 size_class = get_size_class (size); size_class < NUM_SIZE_CLASSES; ++size_class)
+  {
+    for (VkDeviceSize const range_offset : block.size_classes [size_class])
+    {
+      VkDeviceSize const range_size = block.free_ranges [range_offset];
+      VkDeviceSize const aligned_offset = align_up (range_offset, alignment);
+      if (aligned_offset + size > range_offset + range_size) continue;
+
+      // take the range, give back what we don't use either side of the allocation
+      remove_free_range (block, block.free_ranges.find (range_offset));
+      if (aligned_offset > range_offset)
+      {
+        add_free_range (block, range_offset, aligned_offset - range_offset);
+      }
+      if (aligned_offset + size < range_offset + range_size)
+      {
+        add_free_range (block, aligned_offset + size, (range_offset + range_size) - (aligned_offset + size));
+      }
+
+      ++block.num_allocations;
+      block.bytes_used += size;
+
+      out_offset = aligned_offset;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool create_memory_block (VkDevice device,
+  u32 memory_type_index, VkMemoryPropertyFlags memory_flags, VkDeviceSize size, bool is_linear, bool is_dedicated,
+  vulkan_memory_block*& out_block)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (size > 0u);
+
+
+  std::unique_ptr <vulkan_memory_block> block = std::make_unique <vulkan_memory_block> ();
+
+  VkMemoryAllocateInfo const mai =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    .allocationSize = size,
+    .memoryTypeIndex = memory_type_index
+  };
+
+  VkResult const result = vkAllocateMemory (device, // device
+    &mai,                                           // pAllocateInfo
+    nullptr,                                        // pAllocator
+    &block->memory);                                // pMemory
+  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (block->memory))
+  {
+    return DBG_ASSERT_MSG (false, "failed to allocate device memory block\n");
+  }
+
+  block->size = size;
+  block->memory_type_index = memory_type_index;
+  block->is_linear = is_linear;
+  block->is_dedicated = is_dedicated;
+  block->is_coherent = (memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u;
+  add_free_range (*block, 0u, size);
+
+  // map host visible blocks once, rather than every time an allocation in them is accessed
+  // (a 'VkDeviceMemory' can only be mapped once at a time anyway, so sub-allocations have to share the mapping)
+  if (memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+  {
+    VkResult const map_result = vkMapMemory (device, // device
+      block->memory,                                 // memory
+      0u,                                            // offset
+      VK_WHOLE_SIZE,                                 // size
+      0u,                                            // flags
+      &block->mapped);                               // ppData
+    if (!CHECK_VULKAN_RESULT (map_result))
+    {
+      vkFreeMemory (device, block->memory, VK_NULL_HANDLE);
+      return DBG_ASSERT_MSG (false, "failed to map device memory block\n");
+    }
+  }
+
+  out_block = block.get ();
+  s_memory_blocks.push_back (std::move (block));
+
+  return true;
+}
+static void release_memory_block (VkDevice device, vulkan_memory_block* block)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (block != nullptr);
+  DBG_ASSERT_MSG (block->num_allocations == 0u, "releasing memory block with %d live allocations\n", block->num_allocations);
+
+
+  if (block->mapped != nullptr)
+  {
+    vkUnmapMemory (device, block->memory);
+  }
+  vkFreeMemory (device, block->memory, VK_NULL_HANDLE);
+
+  std::erase_if (s_memory_blocks, [block](std::unique_ptr <vulkan_memory_block> const& b) { return b.get () == block; });
+}
+#pragma endregion
+
+
+bool allocate_vulkan_memory (VkPhysicalDevice physical_device, VkDevice device,
+  VkMemoryRequirements const& memory_requirements, VkMemoryPropertyFlags desired_memory_flags, bool is_linear,
+  vulkan_allocation& out_allocation)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (memory_requirements.size > 0u);
+  DBG_ASSERT (out_allocation.block == nullptr);
+
+
+  VkPhysicalDeviceMemoryProperties memory_properties = {};
+  vkGetPhysicalDeviceMemoryProperties (physical_device, // physcalDevice
+    &memory_properties);                                // pMemoryProperties
+
+  u32 const memory_type_index = find_suitable_memory_type_index (memory_properties,
+    desired_memory_flags, memory_requirements.memoryTypeBits);
+  if (memory_type_index == ~0u)
+  {
+    return false;
+  }
+
+  VkPhysicalDeviceProperties device_properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &device_properties);
+  s_non_coherent_atom_size = std::max (device_properties.limits.nonCoherentAtomSize, (VkDeviceSize)1u);
+
+  // flush/invalidate work on whole 'nonCoherentAtomSize' atoms, so non coherent allocations start and end on one
+  // otherwise an invalidate of one allocation could throw away a neighbour's unflushed writes in the same atom
+  VkMemoryPropertyFlags const memory_flags = memory_properties.memoryTypes [memory_type_index].propertyFlags;
+  bool const is_non_coherent = (memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0u &&
+    (memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0u;
+  VkDeviceSize const atom_size = is_non_coherent ? s_non_coherent_atom_size : 1u;
+  VkDeviceSize const size = align_up (memory_requirements.size, atom_size);
+  VkDeviceSize const alignment = std::max ({ memory_requirements.alignment, atom_size, (VkDeviceSize)1u });
+
+  // try the existing blocks first
+  vulkan_memory_block* block = nullptr;
+  VkDeviceSize offset = {};
+  for (std::unique_ptr <vulkan_memory_block> const& b : s_memory_blocks)
+  {
+    if (b->memory_type_index != memory_type_index || b->is_linear != is_linear || b->is_dedicated) continue;
+
+    if (allocate_from_block (*b, size, alignment, offset))
+    {
+      block = b.get ();
+      break;
+    }
+  }
+
+  // otherwise create a new block
+  if (block == nullptr)
+  {
+    if (s_memory_blocks.size () >= device_properties.limits.maxMemoryAllocationCount)
+    {
+      return DBG_ASSERT_MSG (false, "exceeded maxMemoryAllocationCount (%d)\n", device_properties.limits.maxMemoryAllocationCount);
+    }
+
+    VkDeviceSize const heap_size = memory_properties.memoryHeaps [memory_properties.memoryTypes [memory_type_index].heapIndex].size;
+    VkDeviceSize const block_size = heap_size <= SMALL_HEAP_SIZE ? std::min (MEMORY_BLOCK_SIZE, heap_size / 8u) : MEMORY_BLOCK_SIZE;
+
+    // allocations bigger than half a block would waste most of it, so give them their own
+    bool const is_dedicated = size > block_size / 2u;
+    if (!create_memory_block (device,
+      memory_type_index, memory_flags,
+      is_dedicated ? size : block_size, is_linear, is_dedicated,
+      block))
+    {
+      return false;
+    }
+
+    if (!allocate_from_block (*block, size, alignment, offset))
+    {
+      return DBG_ASSERT_MSG (false, "failed to allocate from new memory block\n");
+    }
+  }
+
+  out_allocation.block = block;
+  out_allocation.memory = block->memory;
+  out_allocation.offset = offset;
+  out_allocation.size = size;
+  out_allocation.mapped = block->mapped != nullptr ? (char*)block->mapped + offset : nullptr;
+
+  return true;
+}
+void free_vulkan_memory (VkDevice device, vulkan_allocation& allocation)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (allocation.block != nullptr);
+  DBG_ASSERT (allocation.block->num_allocations > 0u);
+
+
+  vulkan_memory_block* const block = allocation.block;
+
+  add_free_range (*block, allocation.offset, allocation.size);
+  --block->num_allocations;
+  block->bytes_used -= allocation.size;
+
+  // give empty blocks back to the driver, but keep one shared block per memory type around
+  // so a create/release pattern (e.g. staging buffers) doesn't hit 'vkAllocateMemory' each time
+  if (block->num_allocations == 0u)
+  {
+    bool keep_block = !block->is_dedicated;
+    if (keep_block)
+    {
+      for (std::unique_ptr <vulkan_memory_block> const& b : s_memory_blocks)
+      {
+        if (b.get () != block && !b->is_dedicated
+          && b->memory_type_index == block->memory_type_index && b->is_linear == block->is_linear)
+        {
+          keep_block = false;
+          break;
+        }
+      }
+    }
+
+    if (!keep_block)
+    {
+      release_memory_block (device, block);
+    }
+  }
+
+  allocation = {};
+}
+
+static VkMappedMemoryRange get_mapped_memory_range (vulkan_allocation const& allocation,
+  VkDeviceSize offset, VkDeviceSize size)
+{
+  DBG_ASSERT (offset <= allocation.size);
+
+
+  if (size == VK_WHOLE_SIZE)
+  {
+    size = allocation.size - offset;
+  }
+  DBG_ASSERT (offset + size <= allocation.size);
+
+  // non coherent ranges must start and end on 'nonCoherentAtomSize' boundaries (or the end of the block)
+  // the allocator rounds non coherent allocations out to whole atoms, so the range never reaches a neighbour
+  VkDeviceSize const begin = ((allocation.offset + offset) / s_non_coherent_atom_size) * s_non_coherent_atom_size;
+  VkDeviceSize const end = std::min (align_up (allocation.offset + offset + size, s_non_coherent_atom_size), allocation.block->size);
+
+  return VkMappedMemoryRange
+  {
+    .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+    //.pNext = VK_NULL_HANDLE,
+    .memory = allocation.memory,
+    .offset = begin,
+    .size = end - begin
+  };
+}
+bool flush_vulkan_memory (VkDevice device, vulkan_allocation const& allocation,
+  VkDeviceSize offset, VkDeviceSize size)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (allocation.block != nullptr);
+  DBG_ASSERT (allocation.mapped != nullptr);
+
+
+  if (allocation.block->is_coherent)
+  {
+    return true;
+  }
+
+  VkMappedMemoryRange const range = get_mapped_memory_range (allocation, offset, size);
+  VkResult const result = vkFlushMappedMemoryRanges (device, // device
+    1u,                                                      // memoryRangeCount
+    &range);                                                 // pMemoryRanges
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to flush mapped memory\n");
+  }
+
+  return true;
+}
+bool invalidate_vulkan_memory (VkDevice device, vulkan_allocation const& allocation,
+  VkDeviceSize offset, VkDeviceSize size)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (allocation.block != nullptr);
+  DBG_ASSERT (allocation.mapped != nullptr);
+
+
+  if (allocation.block->is_coherent)
+  {
+    return true;
+  }
+
+  VkMappedMemoryRange const range = get_mapped_memory_range (allocation, offset, size);
+  VkResult const result = vkInvalidateMappedMemoryRanges (device, // device
+    1u,                                                           // memoryRangeCount
+    &range);                                                      // pMemoryRanges
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to invalidate mapped memory\n");
+  }
+
+  return true;
+}
+
+void get_vulkan_memory_stats (vulkan_memory_stats& out_stats)
+{
+  out_stats = {};
+
+  for (std::unique_ptr <vulkan_memory_block> const& block : s_memory_blocks)
+  {
+    ++out_stats.num_blocks;
+    out_stats.num_dedicated_blocks += block->is_dedicated ? 1u : 0u;
+    out_stats.num_allocations += block->num_allocations;
+
+    out_stats.bytes_reserved += block->size;
+    out_stats.bytes_used += block->bytes_used;
+
+    for (auto const& [offset, size] : block->free_ranges)
+    {
+      out_stats.bytes_free += size;
+      out_stats.largest_free_range = std::max (out_stats.largest_free_range, size);
+      ++out_stats.num_free_ranges;
+    }
+  }
+
+  out_stats.fragmentation = out_stats.bytes_free > 0u
+    ? 1.f - ((f32)out_stats.largest_free_range / (f32)out_stats.bytes_free)
+    : 0.f;
+}
+void print_vulkan_memory_stats ()
+{
+#ifndef NDEBUG
+  dprintf ("MEMORY BLOCKS:\n");
+  for (std::unique_ptr <vulkan_memory_block> const& block : s_memory_blocks)
+  {
+    VkDeviceSize largest_free_range = {};
+    for (auto const& [offset, size] : block->free_ranges)
+    {
+      largest_free_range = std::max (largest_free_range, size);
+    }
+
+    dprintf ("type %2d %s%s: %8llu KB, %4d allocations, %8llu KB used, %4d free ranges (largest %8llu KB)\n",
+      block->memory_type_index, block->is_linear ? "linear" : "image ", block->is_dedicated ? " (dedicated)" : "",
+      (unsigned long long)(block->size >> 10), block->num_allocations, (unsigned long long)(block->bytes_used >> 10),
+      (u32)block->free_ranges.size (), (unsigned long long)(largest_free_range >> 10));
+  }
+
+  vulkan_memory_stats stats;
+  get_vulkan_memory_stats (stats);
+  dprintf ("total: %d blocks (%d dedicated), %d allocations, %llu KB reserved, %llu KB used, %llu KB free, fragmentation %.2f\n",
+    stats.num_blocks, stats.num_dedicated_blocks, stats.num_allocations,
+    (unsigned long long)(stats.bytes_reserved >> 10), (unsigned long long)(stats.bytes_used >> 10), (unsigned long long)(stats.bytes_free >> 10),
+    stats.fragmentation);
+#endif // NDEBUG
+}
+
+void release_vulkan_memory (VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+
+
+  for (std::unique_ptr <vulkan_memory_block> const& block : s_memory_blocks)
+  {
+    DBG_ASSERT_MSG (block->num_allocations == 0u, "memory block has %d leaked allocations\n", block->num_allocations);
+    if (block->mapped != nullptr)
+    {
+      vkUnmapMemory (device, block->memory);
+    }
+    vkFreeMemory (device, block->memory, VK_NULL_HANDLE);
+  }
+  s_memory_blocks.clear ();
+}
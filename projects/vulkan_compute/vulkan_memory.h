@@ -0,0 +1,94 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+
+/// <summary>
+/// a large 'VkDeviceMemory' allocation that buffers/images are sub-allocated from
+/// owned by the allocator, see vulkan_memory.cpp
+/// </summary>
+struct vulkan_memory_block;
+
+/// <summary>
+/// convenience object to group a sub-allocation of a memory block
+/// the 'VkDeviceMemory' is shared with other allocations, so always bind/map using the offset!
+/// </summary>
+struct vulkan_allocation
+{
+  vulkan_memory_block* block = nullptr; // allocation handle
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+
+  VkDeviceSize offset = {};
+  VkDeviceSize size = {};
+
+  void* mapped = nullptr; // persistent pointer to the start of the allocation, if host visible (nullptr otherwise)
+};
+
+/// <summary>
+/// snapshot of the allocator, to see how many driver allocations we make and how fragmented the blocks are
+/// </summary>
+struct vulkan_memory_stats
+{
+  u32 num_blocks = {};              // number of 'vkAllocateMemory' calls currently alive
+  u32 num_dedicated_blocks = {};    // blocks holding a single, large allocation
+  u32 num_allocations = {};         // number of sub-allocations currently alive
+
+  VkDeviceSize bytes_reserved = {}; // allocated from the driver
+  VkDeviceSize bytes_used = {};     // handed out to buffers/images
+  VkDeviceSize bytes_free = {};     // reserved but not used (includes alignment padding)
+  VkDeviceSize largest_free_range = {};
+  u32 num_free_ranges = {};
+
+  f32 fragmentation = {};           // 0 = all free memory is one range, approaches 1 as free memory is split in to many small ranges
+};
+
+
+/// <summary>
+/// sub-allocate memory suitable for the given requirements from a (possibly new) memory block
+/// linear (buffers) and non-linear (optimal tiling images) resources never share a block,
+/// so 'bufferImageGranularity' does not need to be considered
+/// host visible, non coherent allocations are rounded out to whole 'nonCoherentAtomSize' atoms, so flushes don't overlap
+/// </summary>
+/// <returns>true, if successful</returns>
+bool allocate_vulkan_memory (VkPhysicalDevice physical_device, VkDevice device,
+  VkMemoryRequirements const& memory_requirements, VkMemoryPropertyFlags desired_memory_flags, bool is_linear,
+  vulkan_allocation& out_allocation);
+/// <summary>
+/// return a sub-allocation to its memory block
+/// </summary>
+void free_vulkan_memory (VkDevice device, vulkan_allocation& allocation);
+
+/// <summary>
+/// make host writes to a mapped allocation visible to the device
+/// only does work for non-coherent memory, offset/size are relative to the allocation
+/// </summary>
+/// <returns>true, if successful</returns>
+bool flush_vulkan_memory (VkDevice device, vulkan_allocation const& allocation,
+  VkDeviceSize offset = 0u, VkDeviceSize size = VK_WHOLE_SIZE);
+/// <summary>
+/// make device writes to a mapped allocation visible to the host (after waiting on the device)
+/// only does work for non-coherent memory, offset/size are relative to the allocation
+/// </summary>
+/// <returns>true, if successful</returns>
+bool invalidate_vulkan_memory (VkDevice device, vulkan_allocation const& allocation,
+  VkDeviceSize offset = 0u, VkDeviceSize size = VK_WHOLE_SIZE);
+
+/// <summary>
+/// gather allocator statistics across all memory blocks
+/// </summary>
+void get_vulkan_memory_stats (vulkan_memory_stats& out_stats);
+/// <summary>
+/// print allocator statistics, per memory block and total (debug only)
+/// </summary>
+void print_vulkan_memory_stats ();
+
+/// <summary>
+/// free all memory blocks
+/// MUST be called before 'release_vulkan_device', after all buffers/images have been released
+/// </summary>
+void release_vulkan_memory (VkDevice device);
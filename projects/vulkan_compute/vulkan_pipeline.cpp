@@ -1,10 +1,253 @@
 #include "vulkan_pipeline.h"
 
-#include "utility.h" // DBG_ASSERT, DBG_ASSERT_VULKAN
-
+#include "utility.h"        // DBG_ASSERT, DBG_ASSERT_VULKAN
+#include "vulkan_context.h" // get_vulkan_queue_family_index
+#include "vulkan_trace.h"   // add_vulkan_trace_gpu_scope
+
+#include <algorithm> // for std::min, std::max, std::sort
+#include <chrono>    // for std::chrono
+#include <cstring>   // for std::memcmp, std::memcpy, std::strcmp
+#include <fstream>   // for std::ifstream, std::ofstream
+#include <string>    // for std::string
 #include <vector>    // for std::vector
 
 
+static VkPipelineCache s_pipeline_cache = VK_NULL_HANDLE;
+static std::string s_pipeline_cache_path;
+static bool s_has_creation_feedback = false;
+static vulkan_pipeline_cache_stats s_pipeline_cache_stats;
+
+
+// one per profiled command buffer
+struct profile_slot
+{
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE; // being recorded in to
+  VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_COMPUTE;
+  u32 num_scopes = {};
+  std::array <char const*, MAX_VULKAN_PROFILE_SCOPES> names = {};
+  bool is_scope_open = false;
+  bool is_recorded = false; // has queries that haven't been resolved yet
+};
+// one per scope name, across every slot
+struct profile_history
+{
+  char const* name = nullptr;
+  std::array <f32, NUM_VULKAN_PROFILE_SAMPLES> samples_ms = {}; // ring
+  u32 num_samples = {};
+  u32 next_sample = {};
+  u64 invocations = {};
+};
+
+static VkDevice s_profiler_device = VK_NULL_HANDLE;
+static VkQueryPool s_query_pool_timestamps = VK_NULL_HANDLE;         // 2 per scope
+static VkQueryPool s_query_pool_statistics_compute = VK_NULL_HANDLE; // 1 per scope, compute slots
+static VkQueryPool s_query_pool_statistics_graphics = VK_NULL_HANDLE; // 1 per scope, graphics slots
+static f32 s_timestamp_period_ns = {};
+static u64 s_timestamp_mask = {};
+static std::array <profile_slot, MAX_VULKAN_PROFILE_SLOTS> s_profile_slots;
+static std::vector <profile_history> s_profile_histories;
+
+
+#pragma region vulkan_pipeline_cache_support
+// layout of 'VK_PIPELINE_CACHE_HEADER_VERSION_ONE', at the start of every blob from 'vkGetPipelineCacheData'
+// https://registry.khronos.org/vulkan/specs/1.3-extensions/html/vkspec.html#pipelines-cache-header
+struct pipeline_cache_header
+{
+  u32 header_size;
+  u32 header_version;
+  u32 vendor_id;
+  u32 device_id;
+  u8 pipeline_cache_uuid [VK_UUID_SIZE];
+};
+static_assert (sizeof (pipeline_cache_header) == 16u + VK_UUID_SIZE);
+
+
+static bool is_pipeline_cache_compatible (VkPhysicalDevice physical_device,
+  std::vector <char> const& cache_data)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+
+
+  if (cache_data.size () < sizeof (pipeline_cache_header))
+  {
+    dprintf ("pipeline cache: too small to hold a header, ignoring\n");
+    return false;
+  }
+
+  pipeline_cache_header header = {};
+  std::memcpy (&header, cache_data.data (), sizeof (pipeline_cache_header));
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+
+  // the driver would also reject a mismatched cache, but it is allowed to do so silently
+  // (or badly), so check ourselves and start afresh after a gpu/driver change
+  if (header.header_size < sizeof (pipeline_cache_header) ||
+      header.header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+  {
+    dprintf ("pipeline cache: unknown header version, ignoring\n");
+    return false;
+  }
+  if (header.vendor_id != properties.vendorID || header.device_id != properties.deviceID)
+  {
+    dprintf ("pipeline cache: created on a different device, ignoring\n");
+    return false;
+  }
+  if (std::memcmp (header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    dprintf ("pipeline cache: created by a different driver, ignoring\n");
+    return false;
+  }
+
+  return true;
+}
+static void read_pipeline_cache_file (char const* path,
+  std::vector <char>& out_cache_data)
+{
+  // not 'read_file', a missing cache (first run) is not an error
+  std::ifstream file (path, std::ios::ate | std::ios::binary);
+  if (!file.is_open ())
+  {
+    dprintf ("pipeline cache: no cache found at '%s', pipelines will be compiled\n", path);
+    return;
+  }
+
+  std::size_t const file_size = (std::size_t)file.tellg ();
+  out_cache_data.resize (file_size);
+
+  file.seekg (0);
+  file.read (out_cache_data.data (), file_size);
+}
+static void write_pipeline_cache_file (char const* path,
+  std::vector <char> const& cache_data)
+{
+  std::ofstream file (path, std::ios::trunc | std::ios::binary);
+  if (!file.is_open ())
+  {
+    dprintf ("pipeline cache: unable to write '%s'\n", path);
+    return;
+  }
+
+  file.write (cache_data.data (), cache_data.size ());
+}
+static void record_pipeline_creation (char const* pipeline_type,
+  f32 creation_time_ms, VkPipelineCreationFeedbackEXT const* feedback)
+{
+  ++s_pipeline_cache_stats.num_pipelines;
+  s_pipeline_cache_stats.creation_time_ms += creation_time_ms;
+
+  char const* result = "unknown";
+  if (feedback != nullptr && (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) > 0)
+  {
+    if ((feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) > 0)
+    {
+      ++s_pipeline_cache_stats.num_hits;
+      result = "hit";
+    }
+    else
+    {
+      ++s_pipeline_cache_stats.num_misses;
+      result = "miss";
+    }
+  }
+  else
+  {
+    ++s_pipeline_cache_stats.num_unknown;
+  }
+
+  dprintf ("pipeline cache: %s pipeline created in %.2f ms (cache %s)\n", pipeline_type, creation_time_ms, result);
+}
+#pragma endregion
+
+
+#pragma region vulkan_profiler_support
+static bool is_profiler_enabled ()
+{
+  return CHECK_VULKAN_HANDLE (s_query_pool_timestamps);
+}
+static profile_slot* find_recording_slot (VkCommandBuffer command_buffer)
+{
+  for (profile_slot& slot : s_profile_slots)
+  {
+    if (slot.command_buffer == command_buffer)
+    {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+static VkQueryPool get_statistics_query_pool (VkPipelineBindPoint bind_point)
+{
+  return bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS ? s_query_pool_statistics_graphics : s_query_pool_statistics_compute;
+}
+static void add_profile_sample (char const* name,
+  f32 time_ms, u64 invocations)
+{
+  profile_history* history = nullptr;
+  for (profile_history& h : s_profile_histories)
+  {
+    if (std::strcmp (h.name, name) == 0)
+    {
+      history = &h;
+      break;
+    }
+  }
+  if (history == nullptr)
+  {
+    s_profile_histories.push_back ({ .name = name });
+    history = &s_profile_histories.back ();
+  }
+
+  history->samples_ms [history->next_sample] = time_ms;
+  history->next_sample = (history->next_sample + 1u) % NUM_VULKAN_PROFILE_SAMPLES;
+  history->num_samples = std::min (history->num_samples + 1u, NUM_VULKAN_PROFILE_SAMPLES);
+  history->invocations = invocations;
+}
+#pragma endregion
+
+
+bool create_vulkan_pipeline_cache (VkPhysicalDevice physical_device, VkDevice device,
+  char const* cache_path, bool has_creation_feedback)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (cache_path != nullptr);
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (s_pipeline_cache));
+
+
+  s_pipeline_cache_path = cache_path;
+  s_has_creation_feedback = has_creation_feedback;
+  s_pipeline_cache_stats = {};
+
+  std::vector <char> cache_data;
+  read_pipeline_cache_file (cache_path, cache_data);
+  if (!cache_data.empty () && !is_pipeline_cache_compatible (physical_device, cache_data))
+  {
+    cache_data.clear ();
+  }
+  s_pipeline_cache_stats.loaded_bytes = cache_data.size ();
+
+  VkPipelineCacheCreateInfo const pcci =
+  {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    //.flags = 0u,
+    .initialDataSize = cache_data.size (),
+    .pInitialData = cache_data.empty () ? nullptr : cache_data.data ()
+  };
+
+  VkResult const result = vkCreatePipelineCache (device,  // device
+    &pcci,                                                // pCreateInfo
+    VK_NULL_HANDLE,                                       // pAllocator
+    &s_pipeline_cache);                                   // pPipelineCache
+  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (s_pipeline_cache))
+  {
+    return DBG_ASSERT_MSG (false, "failed to create pipeline cache\n");
+  }
+
+  return true;
+}
+
 bool create_vulkan_descriptor_set_layouts (VkDevice device,
   u32 num_desc_set_layout_binding_spans, std::span <const VkDescriptorSetLayoutBinding> const* desc_set_layout_binding_spans,
   VkDescriptorSetLayout* out_desc_set_layouts)
@@ -111,10 +354,47 @@ bool create_vulkan_shader (VkDevice device,
 
   return true;
 }
+bool set_vulkan_specialization_constant (vulkan_specialization& specialization,
+  u32 constant_id, u32 value)
+{
+  u32 index = 0u;
+  while (index < specialization.num_constants && specialization.entries [index].constantID != constant_id)
+  {
+    ++index;
+  }
+  if (index == specialization.num_constants)
+  {
+    if (specialization.num_constants == MAX_VULKAN_SPECIALIZATION_CONSTANTS)
+    {
+      return DBG_ASSERT_MSG (false, "too many specialization constants (max %u)\n", MAX_VULKAN_SPECIALIZATION_CONSTANTS);
+    }
+    ++specialization.num_constants;
+  }
+
+  specialization.entries [index] =
+  {
+    .constantID = constant_id,
+    .offset = index * (u32)sizeof (u32),
+    .size = sizeof (u32)
+  };
+  specialization.values [index] = value;
+  return true;
+}
+
+bool set_vulkan_specialization_constant (vulkan_specialization& specialization,
+  u32 constant_id, f32 value)
+{
+  static_assert (sizeof (f32) == sizeof (u32));
+  u32 bits = {};
+  std::memcpy (&bits, &value, sizeof (bits));
+  return set_vulkan_specialization_constant (specialization, constant_id, bits);
+}
+
 bool create_vulkan_pipeline_compute (VkDevice device,
   VkShaderModule shader_module, char const* shader_entry_point,
   VkPipelineLayout pipeline_layout,
-  VkPipeline& out_pipeline)
+  VkPipeline& out_pipeline,
+  vulkan_specialization const* specialization)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (shader_module));
@@ -123,6 +403,14 @@ bool create_vulkan_pipeline_compute (VkDevice device,
   DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_pipeline));
 
 
+  VkSpecializationInfo const si =
+  {
+    .mapEntryCount = specialization ? specialization->num_constants : 0u,
+    .pMapEntries = specialization ? specialization->entries.data () : VK_NULL_HANDLE,
+    .dataSize = specialization ? specialization->num_constants * sizeof (u32) : 0u,
+    .pData = specialization ? specialization->values.data () : VK_NULL_HANDLE
+  };
+
   VkPipelineShaderStageCreateInfo const pssci =
   {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -131,13 +419,25 @@ bool create_vulkan_pipeline_compute (VkDevice device,
     .stage = VK_SHADER_STAGE_COMPUTE_BIT,
     .module = shader_module,
     .pName = shader_entry_point,
-    //.pSpecializationInfo = VK_NULL_HANDLE
+    .pSpecializationInfo = specialization ? &si : VK_NULL_HANDLE
+  };
+
+  // ask the driver if the pipeline came from the cache (only valid if the extension is enabled)
+  VkPipelineCreationFeedbackEXT feedback = {};
+  VkPipelineCreationFeedbackEXT feedback_stage = {};
+  VkPipelineCreationFeedbackCreateInfoEXT const pcfci =
+  {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+    //.pNext = VK_NULL_HANDLE,
+    .pPipelineCreationFeedback = &feedback,
+    .pipelineStageCreationFeedbackCount = 1u,
+    .pPipelineStageCreationFeedbacks = &feedback_stage
   };
 
   VkComputePipelineCreateInfo const cpci =
   {
     .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-    //.pNext = VK_NULL_HANDLE,
+    .pNext = s_has_creation_feedback ? &pcfci : VK_NULL_HANDLE,
     //.flags = 0u,
     .stage = pssci,
     .layout = pipeline_layout
@@ -145,18 +445,22 @@ bool create_vulkan_pipeline_compute (VkDevice device,
     //.basePipelineIndex = 0u
   };
 
+  auto const start = std::chrono::high_resolution_clock::now ();
   VkResult const result = vkCreateComputePipelines(device,  // device
-      VK_NULL_HANDLE,                                       // pipeline
+      s_pipeline_cache,                                     // pipelineCache
       1u,                                                   // createInfoCount
       &cpci,                                                // pCreateInfo
       VK_NULL_HANDLE,                                       // pAllocator
       &out_pipeline);                                       // pPipelines
+  std::chrono::duration <f32, std::milli> const creation_time = std::chrono::high_resolution_clock::now () - start;
 
   if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (out_pipeline))
   {
     return DBG_ASSERT_MSG (false, "failed to create compute pipeline\n");
   }
 
+  record_pipeline_creation ("compute", creation_time.count (), s_has_creation_feedback ? &feedback : nullptr);
+
   return true;
 }
 bool create_vulkan_pipeline_graphics(VkDevice device,
@@ -226,10 +530,22 @@ bool create_vulkan_pipeline_graphics(VkDevice device,
     };
 
 
+    // ask the driver if the pipeline came from the cache (only valid if the extension is enabled)
+    VkPipelineCreationFeedbackEXT feedback = {};
+    VkPipelineCreationFeedbackEXT feedback_stages[2] = {};
+    VkPipelineCreationFeedbackCreateInfoEXT const pcfci =
+    {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+      //.pNext = VK_NULL_HANDLE,
+      .pPipelineCreationFeedback = &feedback,
+      .pipelineStageCreationFeedbackCount = 2u,
+      .pPipelineStageCreationFeedbacks = feedback_stages
+    };
+
     VkGraphicsPipelineCreateInfo const gpci =
     {
       .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-      //.pNext = VK_NULL_HANDLE,
+      .pNext = s_has_creation_feedback ? &pcfci : VK_NULL_HANDLE,
       //.flags = 0u,
       .stageCount = 2u,
       .pStages = pssci,
@@ -249,17 +565,21 @@ bool create_vulkan_pipeline_graphics(VkDevice device,
       //.basePipelineIndex = {}
     };
 
+    auto const start = std::chrono::high_resolution_clock::now();
     VkResult const result = vkCreateGraphicsPipelines(device, // device
-        VK_NULL_HANDLE,                                          // pipelineCache
+        s_pipeline_cache,                                        // pipelineCache
         1u,                                                      // createInfoCount
         &gpci,                                                   // pCreateInfo
         nullptr,                                                 // pAllocator
         &out_pipeline);                                          // pPipelines
+    std::chrono::duration<f32, std::milli> const creation_time = std::chrono::high_resolution_clock::now() - start;
     if (!CHECK_VULKAN_RESULT(result) || !CHECK_VULKAN_HANDLE(out_pipeline))
     {
         return DBG_ASSERT_MSG(false, "failed to create graphics pipeline\n");
     }
 
+    record_pipeline_creation("graphics", creation_time.count(), s_has_creation_feedback ? &feedback : nullptr);
+
     return true;
 }
 
@@ -386,6 +706,413 @@ bool end_command_buffer (VkCommandBuffer command_buffer)
 
   return true;
 }
+void fold_vulkan_dispatch (u32 num_groups, u32 max_groups_x,
+  u32& out_groups_x, u32& out_groups_y)
+{
+  DBG_ASSERT (num_groups > 0u && max_groups_x > 0u);
+
+
+  out_groups_y = ((num_groups - 1u) / max_groups_x) + 1u;
+  out_groups_x = ((num_groups - 1u) / out_groups_y) + 1u;
+}
+
+
+bool create_vulkan_query_pool (VkDevice device,
+  VkQueryType query_type, u32 num_queries, VkQueryPipelineStatisticFlags statistics,
+  VkQueryPool& out_query_pool)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (num_queries > 0u);
+
+
+  VkQueryPoolCreateInfo const qpci =
+  {
+    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    //.flags = 0u,
+    .queryType = query_type,
+    .queryCount = num_queries,
+    .pipelineStatistics = statistics
+  };
+
+  VkResult const result = vkCreateQueryPool (device,  // device
+    &qpci,                                            // pCreateInfo
+    VK_NULL_HANDLE,                                   // pAllocator
+    &out_query_pool);                                 // pQueryPool
+  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (out_query_pool))
+  {
+    return DBG_ASSERT_MSG (false, "failed to create query pool\n");
+  }
+
+  return true;
+}
+bool get_vulkan_timestamp_mask (VkPhysicalDevice physical_device, VkQueue queue,
+  u64& out_mask)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+
+
+  u32 family_index = {};
+  if (CHECK_VULKAN_HANDLE (queue) && !get_vulkan_queue_family_index (queue, family_index))
+  {
+    return false;
+  }
+  u32 num_families = {};
+  vkGetPhysicalDeviceQueueFamilyProperties (physical_device, &num_families, VK_NULL_HANDLE);
+  std::vector <VkQueueFamilyProperties> families (num_families);
+  vkGetPhysicalDeviceQueueFamilyProperties (physical_device, &num_families, families.data ());
+
+  // 0 bits means no timestamps
+  u32 timestamp_valid_bits = 64u;
+  bool has_timestamps = false;
+  for (u32 i = 0u; i < num_families; ++i)
+  {
+    bool const is_covered = CHECK_VULKAN_HANDLE (queue) ?
+      i == family_index :
+      (families [i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) > 0;
+    if (is_covered && families [i].timestampValidBits > 0u)
+    {
+      timestamp_valid_bits = std::min (timestamp_valid_bits, families [i].timestampValidBits);
+      has_timestamps = true;
+    }
+  }
+  if (!has_timestamps)
+  {
+    return false;
+  }
+
+  out_mask = timestamp_valid_bits >= 64u ? ~0ull : (1ull << timestamp_valid_bits) - 1ull;
+  return true;
+}
+u64 get_vulkan_timestamp_ticks (u64 begin, u64 end, u64 mask)
+{
+  return ((end & mask) - (begin & mask)) & mask;
+}
+
+
+void get_vulkan_pipeline_cache_stats (vulkan_pipeline_cache_stats& out_stats)
+{
+  out_stats = s_pipeline_cache_stats;
+}
+void print_vulkan_pipeline_cache_stats ()
+{
+#ifndef NDEBUG
+  vulkan_pipeline_cache_stats const& stats = s_pipeline_cache_stats;
+
+  dprintf ("PIPELINE CACHE:\n");
+  dprintf ("loaded %llu KB, %d pipelines created in %.2f ms, %d hits, %d misses, %d unknown\n",
+    (unsigned long long)(stats.loaded_bytes / 1024u),
+    stats.num_pipelines, stats.creation_time_ms,
+    stats.num_hits, stats.num_misses, stats.num_unknown);
+#endif // NDEBUG
+}
+
+
+bool create_vulkan_profiler (VkPhysicalDevice physical_device, VkDevice device,
+  bool has_pipeline_statistics)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (!is_profiler_enabled ());
+
+
+  s_profiler_device = device;
+  s_profile_slots.fill ({});
+  s_profile_histories.clear ();
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+  if (properties.limits.timestampComputeAndGraphics == VK_FALSE)
+  {
+    dprintf ("profiler: device can't time every graphics/compute queue, profiling disabled\n");
+    return true;
+  }
+  s_timestamp_period_ns = properties.limits.timestampPeriod;
+
+  // timestamps only have 'timestampValidBits' meaningful bits, which may differ per queue family, so wrap at the fewest
+  if (!get_vulkan_timestamp_mask (physical_device, VK_NULL_HANDLE, s_timestamp_mask))
+  {
+    dprintf ("profiler: no graphics/compute queue family supports timestamps, profiling disabled\n");
+    return true;
+  }
+
+  constexpr u32 NUM_SCOPES = MAX_VULKAN_PROFILE_SLOTS * MAX_VULKAN_PROFILE_SCOPES;
+  if (!create_vulkan_query_pool (device,
+    VK_QUERY_TYPE_TIMESTAMP, NUM_SCOPES * 2u, 0u,
+    s_query_pool_timestamps))
+  {
+    return false;
+  }
+  if (has_pipeline_statistics)
+  {
+    // separate pools, graphics statistics can't be queried on a compute only queue
+    if (!create_vulkan_query_pool (device,
+      VK_QUERY_TYPE_PIPELINE_STATISTICS, NUM_SCOPES, VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT,
+      s_query_pool_statistics_compute) ||
+      !create_vulkan_query_pool (device,
+      VK_QUERY_TYPE_PIPELINE_STATISTICS, NUM_SCOPES,
+      VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT,
+      s_query_pool_statistics_graphics))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void begin_vulkan_profile_slot (VkCommandBuffer command_buffer,
+  u32 slot_index, VkPipelineBindPoint bind_point)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (command_buffer));
+  DBG_ASSERT (slot_index < MAX_VULKAN_PROFILE_SLOTS);
+  if (!is_profiler_enabled ())
+  {
+    return;
+  }
+
+
+  // the last recording of this slot has been submitted, and its frame waited on, before it is recorded again
+  resolve_vulkan_profile_slot (slot_index);
+
+  // a command buffer only records one slot at a time
+  profile_slot* const previous = find_recording_slot (command_buffer);
+  if (previous != nullptr)
+  {
+    previous->command_buffer = VK_NULL_HANDLE;
+  }
+
+  profile_slot& slot = s_profile_slots [slot_index];
+  slot.command_buffer = command_buffer;
+  slot.bind_point = bind_point;
+  slot.num_scopes = 0u;
+  slot.is_scope_open = false;
+  slot.is_recorded = true;
+
+  // reset every time the command buffer runs, so recorded once command buffers can be resubmitted
+  vkCmdResetQueryPool (command_buffer, s_query_pool_timestamps,
+    slot_index * MAX_VULKAN_PROFILE_SCOPES * 2u, MAX_VULKAN_PROFILE_SCOPES * 2u);
+  VkQueryPool const query_pool_statistics = get_statistics_query_pool (bind_point);
+  if (CHECK_VULKAN_HANDLE (query_pool_statistics))
+  {
+    vkCmdResetQueryPool (command_buffer, query_pool_statistics,
+      slot_index * MAX_VULKAN_PROFILE_SCOPES, MAX_VULKAN_PROFILE_SCOPES);
+  }
+}
+
+void begin_vulkan_profile_scope (VkCommandBuffer command_buffer,
+  char const* name)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (command_buffer));
+  DBG_ASSERT (name != nullptr);
+  if (!is_profiler_enabled ())
+  {
+    return;
+  }
+
+
+  profile_slot* const slot = find_recording_slot (command_buffer);
+  if (slot == nullptr)
+  {
+    DBG_ASSERT_MSG (false, "must call 'begin_vulkan_profile_slot' before opening scope '%s'!\n", name);
+    return;
+  }
+  DBG_ASSERT_MSG (!slot->is_scope_open, "scope '%s' opened inside another scope, scopes can't be nested!\n", name);
+  if (slot->num_scopes == MAX_VULKAN_PROFILE_SCOPES)
+  {
+    DBG_ASSERT_MSG (false, "too many scopes, '%s' is not profiled (see MAX_VULKAN_PROFILE_SCOPES)\n", name);
+    return;
+  }
+
+  u32 const slot_index = (u32)(slot - s_profile_slots.data ());
+  u32 const scope_index = slot_index * MAX_VULKAN_PROFILE_SCOPES + slot->num_scopes;
+
+  slot->names [slot->num_scopes] = name;
+  slot->is_scope_open = true;
+
+  vkCmdWriteTimestamp (command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, s_query_pool_timestamps, scope_index * 2u);
+  VkQueryPool const query_pool_statistics = get_statistics_query_pool (slot->bind_point);
+  if (CHECK_VULKAN_HANDLE (query_pool_statistics))
+  {
+    vkCmdBeginQuery (command_buffer, query_pool_statistics, scope_index, 0u);
+  }
+}
+void end_vulkan_profile_scope (VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (command_buffer));
+  if (!is_profiler_enabled ())
+  {
+    return;
+  }
+
+
+  profile_slot* const slot = find_recording_slot (command_buffer);
+  if (slot == nullptr || !slot->is_scope_open)
+  {
+    return; // scope wasn't opened (too many scopes)
+  }
+
+  u32 const slot_index = (u32)(slot - s_profile_slots.data ());
+  u32 const scope_index = slot_index * MAX_VULKAN_PROFILE_SCOPES + slot->num_scopes;
+
+  VkQueryPool const query_pool_statistics = get_statistics_query_pool (slot->bind_point);
+  if (CHECK_VULKAN_HANDLE (query_pool_statistics))
+  {
+    vkCmdEndQuery (command_buffer, query_pool_statistics, scope_index);
+  }
+  vkCmdWriteTimestamp (command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, s_query_pool_timestamps, scope_index * 2u + 1u);
+
+  slot->is_scope_open = false;
+  ++slot->num_scopes;
+}
+
+void resolve_vulkan_profile_slot (u32 slot_index)
+{
+  DBG_ASSERT (slot_index < MAX_VULKAN_PROFILE_SLOTS);
+  if (!is_profiler_enabled ())
+  {
+    return;
+  }
+
+
+  profile_slot& slot = s_profile_slots [slot_index];
+  if (!slot.is_recorded || slot.num_scopes == 0u)
+  {
+    return;
+  }
+
+  // no WAIT_BIT, if the gpu hasn't got there yet we get VK_NOT_READY and try again next time
+  std::array <u64, MAX_VULKAN_PROFILE_SCOPES * 2u> timestamps = {};
+  VkResult result = vkGetQueryPoolResults (s_profiler_device, // device
+    s_query_pool_timestamps,                                 // queryPool
+    slot_index * MAX_VULKAN_PROFILE_SCOPES * 2u,             // firstQuery
+    slot.num_scopes * 2u,                                    // queryCount
+    sizeof (timestamps),                                     // dataSize
+    timestamps.data (),                                      // pData
+    sizeof (u64),                                            // stride
+    VK_QUERY_RESULT_64_BIT);                                 // flags
+  if (result == VK_NOT_READY)
+  {
+    return;
+  }
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    DBG_ASSERT (false);
+    return;
+  }
+  slot.is_recorded = false; // read, a second resolve of the same submit would count it twice
+
+  // compute: 1 counter per query, graphics: 2 (vertex, fragment)
+  std::array <u64, MAX_VULKAN_PROFILE_SCOPES * 2u> statistics = {};
+  u32 const num_counters = slot.bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS ? 2u : 1u;
+  VkQueryPool const query_pool_statistics = get_statistics_query_pool (slot.bind_point);
+  if (CHECK_VULKAN_HANDLE (query_pool_statistics))
+  {
+    result = vkGetQueryPoolResults (s_profiler_device,  // device
+      query_pool_statistics,                           // queryPool
+      slot_index * MAX_VULKAN_PROFILE_SCOPES,          // firstQuery
+      slot.num_scopes,                                 // queryCount
+      sizeof (statistics),                             // dataSize
+      statistics.data (),                              // pData
+      sizeof (u64) * num_counters,                     // stride
+      VK_QUERY_RESULT_64_BIT);                         // flags
+    if (!CHECK_VULKAN_RESULT (result))
+    {
+      statistics.fill (0u); // timestamps are in, so don't lose them over the statistics
+    }
+  }
+
+  for (u32 i = 0u; i < slot.num_scopes; ++i)
+  {
+    u64 const ticks = get_vulkan_timestamp_ticks (timestamps [i * 2u], timestamps [i * 2u + 1u], s_timestamp_mask);
+    u64 invocations = {};
+    for (u32 counter = 0u; counter < num_counters; ++counter)
+    {
+      invocations += statistics [i * num_counters + counter];
+    }
+
+    add_profile_sample (slot.names [i], (f32)ticks * s_timestamp_period_ns / 1e6f, invocations);
+
+    if (is_vulkan_trace_recording ())
+    {
+      u64 const begin_timestamp = timestamps [i * 2u] & s_timestamp_mask;
+      add_vulkan_trace_gpu_scope (slot.names [i], slot.bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS ? "graphics" : "compute",
+        begin_timestamp, begin_timestamp + ticks);
+    }
+  }
+}
+
+void mark_vulkan_profile_slot_submitted (u32 slot_index)
+{
+  DBG_ASSERT (slot_index < MAX_VULKAN_PROFILE_SLOTS);
+  if (!is_profiler_enabled ())
+  {
+    return;
+  }
+
+
+  s_profile_slots [slot_index].is_recorded = true;
+}
+
+bool get_vulkan_profile_stats (char const* name,
+  vulkan_profile_stats& out_stats)
+{
+  DBG_ASSERT (name != nullptr);
+
+
+  for (profile_history const& history : s_profile_histories)
+  {
+    if (std::strcmp (history.name, name) != 0 || history.num_samples == 0u)
+    {
+      continue;
+    }
+
+    std::array <f32, NUM_VULKAN_PROFILE_SAMPLES> sorted_ms = history.samples_ms;
+    std::sort (sorted_ms.begin (), sorted_ms.begin () + history.num_samples);
+
+    f32 total_ms = {};
+    for (u32 i = 0u; i < history.num_samples; ++i)
+    {
+      total_ms += sorted_ms [i];
+    }
+
+    u32 const last_sample = (history.next_sample + NUM_VULKAN_PROFILE_SAMPLES - 1u) % NUM_VULKAN_PROFILE_SAMPLES;
+    u32 const p99_sample = std::max ((history.num_samples * 99u + 99u) / 100u, 1u) - 1u; // nearest rank
+    out_stats =
+    {
+      .num_samples = history.num_samples,
+      .last_ms = history.samples_ms [last_sample],
+      .min_ms = sorted_ms [0],
+      .mean_ms = total_ms / history.num_samples,
+      .p99_ms = sorted_ms [p99_sample],
+      .invocations = history.invocations
+    };
+    return true;
+  }
+
+  return false;
+}
+void print_vulkan_profile_stats ()
+{
+#ifndef NDEBUG
+  if (s_profile_histories.empty ())
+  {
+    return;
+  }
+
+  dprintf ("GPU PROFILE (last %u runs):\n", NUM_VULKAN_PROFILE_SAMPLES);
+  for (profile_history const& history : s_profile_histories)
+  {
+    vulkan_profile_stats stats;
+    if (get_vulkan_profile_stats (history.name, stats))
+    {
+      dprintf ("%-20s min %.4f ms, mean %.4f ms, p99 %.4f ms over %u runs, %llu invocations\n",
+        history.name, stats.min_ms, stats.mean_ms, stats.p99_ms, stats.num_samples,
+        (unsigned long long)stats.invocations);
+    }
+  }
+#endif // NDEBUG
+}
 
 
 void release_vulkan_descriptor_sets (VkDevice device,
@@ -451,3 +1178,46 @@ void release_vulkan_descriptor_set_layouts (VkDevice device,
     desc_set_layouts [i] = VK_NULL_HANDLE;
   }
 }
+void release_vulkan_pipeline_cache (VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_pipeline_cache));
+
+
+  // query size, then data
+  std::size_t cache_size = {};
+  VkResult result = vkGetPipelineCacheData (device, s_pipeline_cache, &cache_size, VK_NULL_HANDLE);
+  if (CHECK_VULKAN_RESULT (result) && cache_size > 0u)
+  {
+    std::vector <char> cache_data (cache_size);
+    result = vkGetPipelineCacheData (device, s_pipeline_cache, &cache_size, cache_data.data ());
+    if (CHECK_VULKAN_RESULT (result))
+    {
+      cache_data.resize (cache_size);
+      write_pipeline_cache_file (s_pipeline_cache_path.c_str (), cache_data);
+    }
+  }
+
+  vkDestroyPipelineCache (device, s_pipeline_cache, VK_NULL_HANDLE);
+  s_pipeline_cache = VK_NULL_HANDLE;
+  s_pipeline_cache_path.clear ();
+  s_has_creation_feedback = false;
+}
+void release_vulkan_profiler (VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+
+
+  for (VkQueryPool* query_pool : { &s_query_pool_timestamps, &s_query_pool_statistics_compute, &s_query_pool_statistics_graphics })
+  {
+    if (CHECK_VULKAN_HANDLE (*query_pool))
+    {
+      vkDestroyQueryPool (device, *query_pool, VK_NULL_HANDLE);
+      *query_pool = VK_NULL_HANDLE;
+    }
+  }
+
+  s_profiler_device = VK_NULL_HANDLE;
+  s_profile_slots.fill ({});
+  s_profile_histories.clear ();
+}
@@ -5,7 +5,9 @@
 #include <array>                  // for std::array
 #include <span>                   // for std::span
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
 #include <vulkan/vulkan.h>        // for everything vulkan
 
 
@@ -42,6 +44,58 @@ struct vulkan_descriptor_set_info
 };
 
 
+/// <summary>
+/// specialization constants for a pipeline, baked in when it is created so the driver can fold constants and unroll loops with them
+/// e.g. the workgroup size ('layout (local_size_x_id = 0) in;') or a loop count ('layout (constant_id = 1) const uint N = 1;')
+/// every constant is 4 bytes (uint, int, float or bool in the shader), set with 'set_vulkan_specialization_constant'
+/// the value in the shader is only the default, used when the pipeline does not set that constant_id
+/// </summary>
+constexpr u32 MAX_VULKAN_SPECIALIZATION_CONSTANTS = 8u;
+struct vulkan_specialization
+{
+  u32 num_constants = {};
+  std::array <VkSpecializationMapEntry, MAX_VULKAN_SPECIALIZATION_CONSTANTS> entries = {};
+  std::array <u32, MAX_VULKAN_SPECIALIZATION_CONSTANTS> values = {}; // raw 4 byte values, floats are stored bit for bit
+};
+
+/// <summary>
+/// counters for the pipeline cache, to see if warm starts actually skip driver compilation
+/// hits/misses come from 'VK_EXT_pipeline_creation_feedback', pipelines created without it are counted as unknown
+/// </summary>
+struct vulkan_pipeline_cache_stats
+{
+  u32 num_pipelines = {};
+  u32 num_hits = {};                // driver found the pipeline in the cache
+  u32 num_misses = {};              // driver had to compile the pipeline
+  u32 num_unknown = {};             // feedback not available
+
+  f32 creation_time_ms = {};        // total wall time spent in 'vkCreate*Pipelines'
+  u64 loaded_bytes = {};            // size of the cache read from disk, 0 if missing/rejected
+};
+
+/// <summary>
+/// gpu profiler:
+/// named scopes around dispatches/draws, timed with a pair of timestamps and, if the device supports
+/// 'pipelineStatisticsQuery', counted with a pipeline statistics query (shader invocations)
+/// every profiled command buffer owns a 'slot' of queries, e.g. one per frame in flight, started by 'begin_vulkan_profile_slot'
+/// results are read back without waiting once the gpu is done with them (normally a frame or two later),
+/// and kept per scope name over the last NUM_VULKAN_PROFILE_SAMPLES runs
+/// </summary>
+constexpr u32 MAX_VULKAN_PROFILE_SLOTS = 8u;
+constexpr u32 MAX_VULKAN_PROFILE_SCOPES = 16u;    // per slot
+constexpr u32 NUM_VULKAN_PROFILE_SAMPLES = 256u;  // rolling window the stats are taken over
+struct vulkan_profile_stats
+{
+  u32 num_samples = {};             // in the window
+  f32 last_ms = {};
+  f32 min_ms = {};
+  f32 mean_ms = {};
+  f32 p99_ms = {};
+
+  u64 invocations = {};             // compute (or vertex + fragment) shader invocations of the last run, 0 without pipeline statistics
+};
+
+
 /// <summary>
 /// create n vulkan descriptor set layouts
 /// </summary>
@@ -64,15 +118,36 @@ bool create_vulkan_pipeline_layout (VkDevice device,
 bool create_vulkan_shader (VkDevice device,
   char const* compiled_shader_path,
   VkShaderModule& out_shader_module);
+constexpr char const* VULKAN_PIPELINE_CACHE_PATH = "pipeline_cache.bin"; // the apps' 'cache_path', relative to the working directory
+/// <summary>
+/// create the pipeline cache used by 'create_vulkan_pipeline_compute' and 'create_vulkan_pipeline_graphics'
+/// seeded from 'cache_path' if the file exists and its header matches this device (vendor, device & cache UUID)
+/// call after 'create_vulkan_device', before creating any pipelines
+/// </summary>
+/// <param name="has_creation_feedback">'VK_EXT_pipeline_creation_feedback' is enabled on the device</param>
+/// <returns>true, if successful</returns>
+bool create_vulkan_pipeline_cache (VkPhysicalDevice physical_device, VkDevice device,
+  char const* cache_path, bool has_creation_feedback);
+/// <summary>
+/// set (or overwrite) the value of the specialization constant 'constant_id'
+/// </summary>
+/// <returns>false, if there is no room for another constant</returns>
+bool set_vulkan_specialization_constant (vulkan_specialization& specialization,
+  u32 constant_id, u32 value);
+bool set_vulkan_specialization_constant (vulkan_specialization& specialization,
+  u32 constant_id, f32 value);
 /// <summary>
 /// create a vulkan compute pipeline
 /// will use default options for settings not passed in
+/// 'specialization' is optional, without it the shader's default constants (and workgroup size) are used
+/// a workgroup size only given by id ('local_size_x_id') without a 'local_size_x' defaults to 1
 /// </summary>
 /// <returns>true, if successful</returns>
 bool create_vulkan_pipeline_compute (VkDevice device,
   VkShaderModule shader_module, char const* shader_entry_point,
   VkPipelineLayout pipeline_layout,
-  VkPipeline& out_pipeline);
+  VkPipeline& out_pipeline,
+  vulkan_specialization const* specialization = nullptr);
 /// <summary>
 /// create a vulkan graphics pipeline
 /// will use default options for settings not passed in
@@ -111,8 +186,90 @@ bool create_vulkan_descriptor_sets (VkDevice device,
   u32 num_desc_set_infos, vulkan_descriptor_set_info const* desc_set_infos);
 
 
+/// <summary>
+/// get the pipeline cache counters
+/// </summary>
+void get_vulkan_pipeline_cache_stats (vulkan_pipeline_cache_stats& out_stats);
+/// <summary>
+/// print the pipeline cache counters (debug only)
+/// </summary>
+void print_vulkan_pipeline_cache_stats ();
+
+
+/// <summary>
+/// create the profiler's query pools, profiling is silently disabled if the device can't time every queue
+/// call after 'create_vulkan_device'
+/// </summary>
+/// <param name="has_pipeline_statistics">'pipelineStatisticsQuery' is enabled on the device</param>
+/// <returns>true, if successful</returns>
+bool create_vulkan_profiler (VkPhysicalDevice physical_device, VkDevice device,
+  bool has_pipeline_statistics);
+/// <summary>
+/// start profiling in to 'slot' on this command buffer, MUST be recorded outside of a render pass
+/// reads back the slot's previous results first, if the gpu has finished with them
+/// 'bind_point' is the kind of work the scopes will wrap, graphics scopes need a graphics capable queue
+/// </summary>
+void begin_vulkan_profile_slot (VkCommandBuffer command_buffer,
+  u32 slot, VkPipelineBindPoint bind_point);
+/// <summary>
+/// open a named scope, 'name' MUST outlive the profiler (e.g. a string literal)
+/// scopes can't be nested, close one with 'end_vulkan_profile_scope' before opening the next
+/// </summary>
+void begin_vulkan_profile_scope (VkCommandBuffer command_buffer,
+  char const* name);
+void end_vulkan_profile_scope (VkCommandBuffer command_buffer);
+/// <summary>
+/// read back the results of 'slot' if the gpu has finished with them, never waits
+/// each recording (or submit, see 'mark_vulkan_profile_slot_submitted') is read back once, resolving it again does nothing
+/// for command buffers that are recorded once and resubmitted, call once per submit, after it has completed
+/// (re-recorded command buffers are resolved by 'begin_vulkan_profile_slot')
+/// </summary>
+void resolve_vulkan_profile_slot (u32 slot);
+/// <summary>
+/// the command buffer recorded in to 'slot' has been submitted again, so it has new results to resolve
+/// only for command buffers that are recorded once and resubmitted, 'begin_vulkan_profile_slot' covers the first submit
+/// </summary>
+void mark_vulkan_profile_slot_submitted (u32 slot);
+/// <summary>
+/// get the stats of the scope 'name'
+/// </summary>
+/// <returns>false, if the scope has no results yet</returns>
+bool get_vulkan_profile_stats (char const* name,
+  vulkan_profile_stats& out_stats);
+/// <summary>
+/// print the stats of every scope (debug only)
+/// </summary>
+void print_vulkan_profile_stats ();
+
+
 bool begin_command_buffer (VkCommandBuffer command_buffer, VkCommandBufferUsageFlags flags);
 bool end_command_buffer (VkCommandBuffer command_buffer);
+/// <summary>
+/// vkCmdDispatch is limited to 'maxComputeWorkGroupCount [0]' groups in x, fold the rest in to y
+/// the 1D shaders flatten gl_GlobalInvocationID back to a linear index and skip the overshoot
+/// </summary>
+void fold_vulkan_dispatch (u32 num_groups, u32 max_groups_x,
+  u32& out_groups_x, u32& out_groups_y);
+
+
+/// <summary>
+/// create a query pool, 'statistics' are the counters of a VK_QUERY_TYPE_PIPELINE_STATISTICS pool, otherwise 0
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_query_pool (VkDevice device,
+  VkQueryType query_type, u32 num_queries, VkQueryPipelineStatisticFlags statistics,
+  VkQueryPool& out_query_pool);
+/// <summary>
+/// which bits of a timestamp written on 'queue' are meaningful ('timestampValidBits' of its family)
+/// if 'queue' is VK_NULL_HANDLE, of one written on any graphics/compute queue (the fewest bits of those families)
+/// </summary>
+/// <returns>false, if no queue it covers supports timestamps</returns>
+bool get_vulkan_timestamp_mask (VkPhysicalDevice physical_device, VkQueue queue,
+  u64& out_mask);
+/// <summary>
+/// ticks from 'begin' to 'end', allowing for the counter wrapping past 'mask'
+/// </summary>
+u64 get_vulkan_timestamp_ticks (u64 begin, u64 end, u64 mask);
 
 
 void release_vulkan_descriptor_sets (VkDevice device,
@@ -122,3 +279,13 @@ void release_vulkan_pipeline (VkDevice device, VkPipeline& pipeline);
 void release_vulkan_pipeline_layout (VkDevice device, VkPipelineLayout& pipeline_layout);
 void release_vulkan_descriptor_set_layouts (VkDevice device,
   u32 num_set_layouts, VkDescriptorSetLayout* desc_set_layouts);
+/// <summary>
+/// write the pipeline cache to 'cache_path' (passed to 'create_vulkan_pipeline_cache') and destroy it
+/// call before 'release_vulkan_device'
+/// </summary>
+void release_vulkan_pipeline_cache (VkDevice device);
+/// <summary>
+/// destroy the profiler's query pools
+/// call before 'release_vulkan_device'
+/// </summary>
+void release_vulkan_profiler (VkDevice device);
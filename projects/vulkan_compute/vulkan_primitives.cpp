@@ -0,0 +1,1029 @@
+#include "vulkan_primitives.h"
+
+#include "vulkan_context.h"   // for VkCommandBuffer helpers
+#include "vulkan_memory.h"    // for flush_vulkan_memory, invalidate_vulkan_memory
+#include "vulkan_pipeline.h"  // for vulkan_specialization, vulkan_descriptor_set
+#include "vulkan_resources.h" // for vulkan_buffer
+#include "utility.h"          // DBG_ASSERT
+
+#include <algorithm>          // for std::min, std::max
+#include <array>              // for std::array
+#include <cmath>              // for std::fabs, std::isfinite
+#include <cstring>            // for std::memcpy
+#include <functional>         // for std::function
+#include <initializer_list>   // for std::initializer_list
+#include <numeric>            // for std::iota
+#include <random>             // for std::ranlux24_base, std::uniform_real_distribution
+#include <span>               // for std::span
+#include <type_traits>        // for std::is_same_v
+#include <utility>            // for std::swap
+
+
+constexpr char const* COMPILED_REDUCE_SHADER_PATH = "data/shaders/glsl/vulkan_compute/vulkan_reduce.comp.spv";
+constexpr char const* COMPILED_SCAN_SHADER_PATH = "data/shaders/glsl/vulkan_compute/vulkan_scan.comp.spv";
+constexpr char const* COMPILED_HISTOGRAM_SHADER_PATH = "data/shaders/glsl/vulkan_compute/vulkan_histogram.comp.spv";
+constexpr char const* COMPILED_RADIX_SORT_SHADER_PATH = "data/shaders/glsl/vulkan_compute/vulkan_radix_sort.comp.spv";
+
+// not tuned, the shaders' shared memory is sized from it
+constexpr u32 THREAD_GROUP_SIZE = 256u;
+// MUST match ITEMS_PER_THREAD in the shaders
+constexpr u32 PRIMITIVES_ITEMS_PER_THREAD = 8u;
+constexpr u64 BLOCK_ELEMENTS = THREAD_GROUP_SIZE * PRIMITIVES_ITEMS_PER_THREAD;
+// passes over partials, BLOCK_ELEMENTS ^ 3 is past the largest binding anyway
+constexpr u32 MAX_SCRATCH_LEVELS = 4u;
+// MUST match RADIX_BITS and MIN_SUBGROUP_SIZE in vulkan_radix_sort.comp
+constexpr u32 RADIX_BITS = 4u;
+constexpr u32 RADIX = 1u << RADIX_BITS;
+constexpr u32 MIN_SUBGROUP_SIZE = 4u;
+// the keys ping-pong between the caller's buffer and a temporary one, an even number of passes ends in the caller's
+static_assert ((32u / RADIX_BITS) % 2u == 0u);
+
+constexpr u32 NUM_TYPES = (u32)gpu_type::u32 + 1u;
+constexpr u32 NUM_REDUCE_OPS = (u32)gpu_reduce_op::max + 1u;
+
+// MUST match MODE_ and INCLUSIVE in vulkan_scan.comp
+enum class scan_variant : u32
+{
+  exclusive,
+  inclusive,
+  add_offsets,
+  count
+};
+
+// MUST match MODE_ in vulkan_radix_sort.comp
+enum class sort_pass : u32
+{
+  count_digits,
+  scatter_keys,
+  scatter_indices,
+  permute,
+  count
+};
+
+
+struct primitives_push_constants
+{
+  u32 num_elements;
+  u32 lo;        // histogram only
+  u32 hi;
+  u32 bin_scale;
+};
+static_assert (sizeof (primitives_push_constants) <= MAX_ELEMENTWISE_PUSH_CONSTANTS_SIZE);
+
+struct sort_push_constants
+{
+  u32 num_elements;
+  u32 shift;      // of this pass's digit
+  u32 num_blocks; // the stride between digits in the counts
+};
+static_assert (sizeof (sort_push_constants) <= MAX_ELEMENTWISE_PUSH_CONSTANTS_SIZE);
+
+struct histogram_pipeline
+{
+  gpu_type type = gpu_type::f32;
+  u32 num_bins = {};
+  VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+
+static VkPhysicalDevice s_physical_device = VK_NULL_HANDLE;
+static VkDevice s_device = VK_NULL_HANDLE;
+static u32 s_max_groups_x = {};
+static VkDeviceSize s_max_binding_size = {};
+static bool s_has_subgroup_arithmetic = false;
+static bool s_has_subgroup_ballot = false;
+
+static std::array <VkPipeline, NUM_TYPES * NUM_REDUCE_OPS> s_reduce_pipelines = {};      // by type, then op
+static std::array <VkPipeline, NUM_TYPES * (u32)scan_variant::count> s_scan_pipelines = {}; // by type, then variant
+static std::vector <histogram_pipeline> s_histogram_pipelines;                             // by type and bin count
+static std::array <VkPipeline, NUM_TYPES * (u32)sort_pass::count> s_sort_pipelines = {};    // by type, then pass
+
+static std::array <vulkan_buffer, MAX_SCRATCH_LEVELS> s_scratch; // partials of each pass
+static vulkan_buffer s_readback;                                 // host visible, results of the 'read_' calls
+static vulkan_buffer s_sort_keys;                                // the other half of each sort pass's ping-pong
+static vulkan_buffer s_sort_values;
+static vulkan_buffer s_sort_indices;                             // each key's destination, key/value sorts only
+static vulkan_buffer s_sort_counts;                              // RADIX per block, then where they start
+static bool s_can_grow_buffers = true;                           // false while recording in to the caller's command buffer
+
+
+#pragma region vulkan_primitives_support
+static bool create_pipeline (char const* shader_path, std::array <u32, 3u> const& constants,
+  VkPipeline& out_pipeline)
+{
+  vulkan_specialization specialization;
+  bool is_set = set_vulkan_specialization_constant (specialization, 0u, THREAD_GROUP_SIZE);
+  for (u32 i = 0u; i < constants.size (); ++i)
+  {
+    is_set = is_set && set_vulkan_specialization_constant (specialization, i + 1u, constants [i]);
+  }
+  return is_set && create_vulkan_elementwise_pipeline (shader_path, specialization, out_pipeline);
+}
+
+static bool get_reduce_pipeline (gpu_reduce_op op, gpu_type type,
+  VkPipeline& out_pipeline)
+{
+  VkPipeline& pipeline = s_reduce_pipelines [((u32)type * NUM_REDUCE_OPS) + (u32)op];
+  if (!CHECK_VULKAN_HANDLE (pipeline) &&
+    !create_pipeline (COMPILED_REDUCE_SHADER_PATH, { (u32)type, (u32)op, 0u }, pipeline))
+  {
+    return false;
+  }
+  out_pipeline = pipeline;
+  return true;
+}
+
+static bool get_scan_pipeline (scan_variant variant, gpu_type type,
+  VkPipeline& out_pipeline)
+{
+  VkPipeline& pipeline = s_scan_pipelines [((u32)type * (u32)scan_variant::count) + (u32)variant];
+  u32 const is_inclusive = variant == scan_variant::inclusive ? 1u : 0u;
+  u32 const mode = variant == scan_variant::add_offsets ? 1u : 0u;
+  if (!CHECK_VULKAN_HANDLE (pipeline) &&
+    !create_pipeline (COMPILED_SCAN_SHADER_PATH, { (u32)type, is_inclusive, mode }, pipeline))
+  {
+    return false;
+  }
+  out_pipeline = pipeline;
+  return true;
+}
+
+static bool get_histogram_pipeline (gpu_type type, u32 num_bins,
+  VkPipeline& out_pipeline)
+{
+  for (histogram_pipeline const& entry : s_histogram_pipelines)
+  {
+    if (entry.type == type && entry.num_bins == num_bins)
+    {
+      out_pipeline = entry.pipeline;
+      return true;
+    }
+  }
+
+  histogram_pipeline entry = { .type = type, .num_bins = num_bins };
+  if (!create_pipeline (COMPILED_HISTOGRAM_SHADER_PATH, { (u32)type, num_bins, 0u }, entry.pipeline))
+  {
+    return false;
+  }
+  s_histogram_pipelines.push_back (entry);
+  out_pipeline = entry.pipeline;
+  return true;
+}
+
+static bool get_sort_pipeline (sort_pass pass, gpu_type key_type,
+  VkPipeline& out_pipeline)
+{
+  VkPipeline& pipeline = s_sort_pipelines [((u32)key_type * (u32)sort_pass::count) + (u32)pass];
+  if (!CHECK_VULKAN_HANDLE (pipeline) &&
+    !create_pipeline (COMPILED_RADIX_SORT_SHADER_PATH, { (u32)key_type, (u32)pass, 0u }, pipeline))
+  {
+    return false;
+  }
+  out_pipeline = pipeline;
+  return true;
+}
+
+// a device local buffer, grown (never shrunk) to hold 'num_elements'
+static bool grow_buffer (vulkan_buffer& buffer, u64 num_elements)
+{
+  VkDeviceSize const size = std::max (num_elements, (u64)BLOCK_ELEMENTS) * sizeof (u32);
+  if (buffer.size >= size)
+  {
+    return true;
+  }
+  // a command buffer recorded earlier but not submitted yet may use this one, it can't be swapped from under it
+  if (!s_can_grow_buffers)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: %llu elements don't fit the scratch, call 'reserve_vulkan_primitives' before recording\n",
+      (unsigned long long)num_elements);
+  }
+
+  if (CHECK_VULKAN_HANDLE (buffer.buffer))
+  {
+    vkDeviceWaitIdle (s_device); // it may still be in use by a job in flight
+    release_vulkan_buffer (s_device, buffer);
+  }
+  return create_vulkan_buffer (s_physical_device, s_device,
+    size,
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_SHARING_MODE_EXCLUSIVE,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    buffer);
+}
+
+// scratch for the partials of pass 'level'
+static bool get_scratch (u32 level, u64 num_elements,
+  vulkan_buffer const*& out_buffer)
+{
+  if (level >= MAX_SCRATCH_LEVELS)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: too many passes\n");
+  }
+  if (!grow_buffer (s_scratch [level], num_elements))
+  {
+    return false;
+  }
+  out_buffer = &s_scratch [level];
+  return true;
+}
+
+// the scratch every pass of a reduce or scan of 'num_elements' needs
+static bool grow_scratch (u64 num_elements)
+{
+  for (u32 level = 0u;; ++level)
+  {
+    u64 const num_blocks = ((num_elements - 1u) / BLOCK_ELEMENTS) + 1u;
+    vulkan_buffer const* scratch = nullptr;
+    if (!get_scratch (level, num_blocks, scratch))
+    {
+      return false;
+    }
+    if (num_blocks == 1u)
+    {
+      return true;
+    }
+    num_elements = num_blocks;
+  }
+}
+
+static bool check_lengths (u64 num_elements, std::initializer_list <vulkan_buffer const*> buffers)
+{
+  VkDeviceSize const size = num_elements * sizeof (u32); // every element type is 4 bytes
+  bool fits = size <= s_max_binding_size && num_elements <= UINT32_MAX;
+  for (vulkan_buffer const* buffer : buffers)
+  {
+    fits = fits && size <= buffer->size;
+  }
+  return fits ? true : DBG_ASSERT_MSG (false, "primitives: %llu elements don't fit the buffers (or 'maxStorageBufferRange')\n",
+    (unsigned long long)num_elements);
+}
+
+// compute (or a clear) writes are visible to whatever comes next: another pass, a copy, or the host once the submit completes
+static void record_barrier (VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkAccessFlags src_access)
+{
+  VkMemoryBarrier const barrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    //.pNext = VK_NULL_HANDLE,
+    .srcAccessMask = src_access,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT
+  };
+  VkPipelineStageFlags const dst_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT;
+  vkCmdPipelineBarrier (command_buffer, // commandBuffer
+    src_stages,                         // srcStageMask
+    dst_stages,                         // dstStageMask
+    0u,                                 // dependencyFlags
+    1u,                                 // memoryBarrierCount
+    &barrier,                           // pMemoryBarriers
+    0u,                                 // bufferMemoryBarrierCount
+    VK_NULL_HANDLE,                     // pBufferMemoryBarriers
+    0u,                                 // imageMemoryBarrierCount
+    VK_NULL_HANDLE);                    // pImageMemoryBarriers
+}
+
+// one work group per BLOCK_ELEMENTS elements
+template <class PushConstants> static bool record_dispatch (VkCommandBuffer command_buffer, VkPipeline pipeline,
+  vulkan_buffer const& binding_0, vulkan_buffer const& binding_1, vulkan_buffer const& binding_2,
+  PushConstants const& push_constants)
+{
+  vulkan_descriptor_set desc_set;
+  if (!get_vulkan_elementwise_descriptor_set (binding_0, binding_1, binding_2, desc_set))
+  {
+    return false;
+  }
+
+  VkPipelineLayout const pipeline_layout = get_vulkan_elementwise_pipeline_layout ();
+  vkCmdBindPipeline (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout,
+    desc_set.set_index, 1u, &desc_set.desc_set, 0u, VK_NULL_HANDLE);
+  vkCmdPushConstants (command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+    0u, sizeof (PushConstants), &push_constants);
+
+  // past maxComputeWorkGroupCount [0] groups the dispatch is folded in to y, the shaders flatten it back
+  u32 const num_groups = (u32)(((push_constants.num_elements - 1u) / BLOCK_ELEMENTS) + 1u);
+  u32 groups_x = {}, groups_y = {};
+  fold_vulkan_dispatch (num_groups, s_max_groups_x, groups_x, groups_y);
+  vkCmdDispatch (command_buffer, groups_x, groups_y, 1u);
+
+  record_barrier (command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+  return true;
+}
+
+static bool record_reduce (VkCommandBuffer command_buffer, gpu_reduce_op op, gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, vulkan_buffer const& out)
+{
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (!get_reduce_pipeline (op, type, pipeline))
+  {
+    return false;
+  }
+
+  // each pass leaves one partial per block, until a single block writes the result
+  vulkan_buffer const* src = &in;
+  for (u32 level = 0u;; ++level)
+  {
+    u64 const num_blocks = ((num_elements - 1u) / BLOCK_ELEMENTS) + 1u;
+    vulkan_buffer const* dst = &out;
+    if (num_blocks > 1u && !get_scratch (level, num_blocks, dst))
+    {
+      return false;
+    }
+    if (!record_dispatch (command_buffer, pipeline,
+      *src, *dst, *dst,
+      primitives_push_constants { .num_elements = (u32)num_elements }))
+    {
+      return false;
+    }
+    if (num_blocks == 1u)
+    {
+      return true;
+    }
+    src = dst;
+    num_elements = num_blocks;
+  }
+}
+
+static bool record_scan (VkCommandBuffer command_buffer, gpu_type type, bool is_inclusive,
+  vulkan_buffer const& in, vulkan_buffer const& out, u64 num_elements, u32 level)
+{
+  u64 const num_blocks = ((num_elements - 1u) / BLOCK_ELEMENTS) + 1u;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  vulkan_buffer const* block_sums = nullptr; // a single block writes its total here too, it's just not used
+  if (!get_scan_pipeline (is_inclusive ? scan_variant::inclusive : scan_variant::exclusive, type, pipeline) ||
+    !get_scratch (level, num_blocks, block_sums) ||
+    !record_dispatch (command_buffer, pipeline,
+      in, out, *block_sums,
+      primitives_push_constants { .num_elements = (u32)num_elements }))
+  {
+    return false;
+  }
+  if (num_blocks == 1u)
+  {
+    return true;
+  }
+
+  // the blocks' totals, scanned exclusive in place, are the blocks' offsets
+  return record_scan (command_buffer, type, false,
+    *block_sums, *block_sums, num_blocks, level + 1u) &&
+    get_scan_pipeline (scan_variant::add_offsets, type, pipeline) &&
+    record_dispatch (command_buffer, pipeline,
+      out, out, *block_sums,
+      primitives_push_constants { .num_elements = (u32)num_elements });
+}
+
+// f32: num_bins / (hi - lo), integers: the width of a bin
+static bool get_histogram_bin_scale (gpu_type type, u32 lo_bits, u32 hi_bits, u32 num_bins,
+  u32& out_bin_scale)
+{
+  if (type == gpu_type::f32)
+  {
+    f32 lo = {}, hi = {};
+    std::memcpy (&lo, &lo_bits, sizeof (lo));
+    std::memcpy (&hi, &hi_bits, sizeof (hi));
+    f32 const scale = (f32)num_bins / (hi - lo);
+    if (!(hi > lo) || !std::isfinite (scale))
+    {
+      return DBG_ASSERT_MSG (false, "primitives: histogram range [%f, %f) is empty or too wide\n", lo, hi);
+    }
+    std::memcpy (&out_bin_scale, &scale, sizeof (out_bin_scale));
+    return true;
+  }
+
+  bool const is_empty = type == gpu_type::i32 ? (i32)hi_bits <= (i32)lo_bits : hi_bits <= lo_bits;
+  if (is_empty)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: histogram range is empty\n");
+  }
+  u32 const range = hi_bits - lo_bits; // exact for i32 too, once hi > lo
+  out_bin_scale = ((range - 1u) / num_bins) + 1u;
+  return true;
+}
+
+static bool record_histogram (VkCommandBuffer command_buffer, gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32 lo_bits, u32 hi_bits,
+  u32 num_bins, vulkan_buffer const& out_bins)
+{
+  if (num_bins == 0u || num_bins > MAX_HISTOGRAM_BINS || out_bins.size < num_bins * sizeof (u32))
+  {
+    return DBG_ASSERT_MSG (false, "primitives: %u bins, must be 1 .. %u and fit the output\n", num_bins, MAX_HISTOGRAM_BINS);
+  }
+
+  u32 bin_scale = {};
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (!get_histogram_bin_scale (type, lo_bits, hi_bits, num_bins, bin_scale) ||
+    !get_histogram_pipeline (type, num_bins, pipeline))
+  {
+    return false;
+  }
+
+  // the work groups add their counts to the bins
+  vkCmdFillBuffer (command_buffer, out_bins.buffer, 0u, num_bins * sizeof (u32), 0u);
+  record_barrier (command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+  if (num_elements == 0u)
+  {
+    return true;
+  }
+
+  return record_dispatch (command_buffer, pipeline,
+    in, out_bins, out_bins,
+    primitives_push_constants { .num_elements = (u32)num_elements, .lo = lo_bits, .hi = hi_bits, .bin_scale = bin_scale });
+}
+
+// least significant digit first, each pass counts the blocks' digits, scans the counts in to where each block's
+// keys of each digit start, then scatters the keys there in order, so it is stable and the earlier passes' order survives
+// key/value sorts write each key's destination at its own index instead, then scatter the keys and values to it
+static bool record_sort (VkCommandBuffer command_buffer, gpu_type key_type,
+  vulkan_buffer const& keys, vulkan_buffer const* values, u64 num_elements)
+{
+  bool const has_values = values != nullptr;
+  u64 const num_blocks = ((num_elements - 1u) / BLOCK_ELEMENTS) + 1u;
+  u64 const num_counts = num_blocks * RADIX;
+
+  VkPipeline count_pipeline = VK_NULL_HANDLE, scatter_pipeline = VK_NULL_HANDLE, permute_pipeline = VK_NULL_HANDLE;
+  if (!get_sort_pipeline (sort_pass::count_digits, key_type, count_pipeline) ||
+    !get_sort_pipeline (has_values ? sort_pass::scatter_indices : sort_pass::scatter_keys, key_type, scatter_pipeline) ||
+    (has_values && !get_sort_pipeline (sort_pass::permute, gpu_type::u32, permute_pipeline)) || // moves bits, any type will do
+    !grow_buffer (s_sort_keys, num_elements) ||
+    !grow_buffer (s_sort_counts, num_counts) ||
+    (has_values && (!grow_buffer (s_sort_values, num_elements) || !grow_buffer (s_sort_indices, num_elements))))
+  {
+    return false;
+  }
+
+  vulkan_buffer const* keys_src = &keys;
+  vulkan_buffer const* keys_dst = &s_sort_keys;
+  vulkan_buffer const* values_src = values;
+  vulkan_buffer const* values_dst = &s_sort_values;
+  for (u32 shift = 0u; shift < 32u; shift += RADIX_BITS)
+  {
+    sort_push_constants const push_constants =
+    {
+      .num_elements = (u32)num_elements,
+      .shift = shift,
+      .num_blocks = (u32)num_blocks
+    };
+    if (!record_dispatch (command_buffer, count_pipeline,
+      *keys_src, s_sort_counts, s_sort_counts,
+      push_constants) ||
+      !record_scan (command_buffer, gpu_type::u32, false, s_sort_counts, s_sort_counts, num_counts, 0u))
+    {
+      return false;
+    }
+
+    bool const is_recorded = has_values ?
+      record_dispatch (command_buffer, scatter_pipeline, *keys_src, s_sort_counts, s_sort_indices, push_constants) &&
+      record_dispatch (command_buffer, permute_pipeline, *keys_src, s_sort_indices, *keys_dst, push_constants) &&
+      record_dispatch (command_buffer, permute_pipeline, *values_src, s_sort_indices, *values_dst, push_constants) :
+      record_dispatch (command_buffer, scatter_pipeline, *keys_src, s_sort_counts, *keys_dst, push_constants);
+    if (!is_recorded)
+    {
+      return false;
+    }
+    std::swap (keys_src, keys_dst);
+    std::swap (values_src, values_dst);
+  }
+  return true;
+}
+
+// record with 'record' in to 'command_buffer', or if it is VK_NULL_HANDLE, submit and wait
+static bool record_or_submit (VkCommandBuffer command_buffer, std::function <bool (VkCommandBuffer)> const& record)
+{
+  if (CHECK_VULKAN_HANDLE (command_buffer))
+  {
+    s_can_grow_buffers = false;
+    bool const is_recorded = record (command_buffer);
+    s_can_grow_buffers = true;
+    return is_recorded;
+  }
+
+  bool is_recorded = false;
+  return submit_vulkan_elementwise_commands ([&](VkCommandBuffer submit_command_buffer)
+    {
+      is_recorded = record (submit_command_buffer);
+    }) && is_recorded;
+}
+
+// host visible, sized once for the largest result (the most bins a histogram can have)
+static bool get_readback (u32 num_elements)
+{
+  if (num_elements > MAX_HISTOGRAM_BINS)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: %u results, at most %u can be read back\n", num_elements, MAX_HISTOGRAM_BINS);
+  }
+  if (CHECK_VULKAN_HANDLE (s_readback.buffer))
+  {
+    return true;
+  }
+  return create_vulkan_buffer (s_physical_device, s_device,
+    MAX_HISTOGRAM_BINS * sizeof (u32),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_SHARING_MODE_EXCLUSIVE,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    s_readback);
+}
+
+static u32 get_reduce_identity (gpu_reduce_op op, gpu_type type)
+{
+  if (op == gpu_reduce_op::sum)
+  {
+    return 0u; // every type's 0 is all zero bits
+  }
+  switch (type)
+  {
+  case gpu_type::f32: return op == gpu_reduce_op::min ? 0x7f800000u : 0xff800000u; // +inf, -inf
+  case gpu_type::i32: return op == gpu_reduce_op::min ? 0x7fffffffu : 0x80000000u;
+  default: return op == gpu_reduce_op::min ? 0xffffffffu : 0u;
+  }
+}
+
+
+// CHECK
+
+// lengths that cover part of a block, exactly one, one past, many, and three passes
+constexpr u64 CHECK_LENGTHS [] = { 1u, 1000u, BLOCK_ELEMENTS, BLOCK_ELEMENTS + 1u, 300001u, (BLOCK_ELEMENTS * BLOCK_ELEMENTS) + 5u };
+constexpr u64 MAX_CHECK_LENGTH = (BLOCK_ELEMENTS * BLOCK_ELEMENTS) + 5u;
+// f32 results are summed in a different order to the cpu, relative to the sum of the magnitudes
+constexpr double F32_SUM_TOLERANCE = 1e-5;
+
+template <class T> static void fill_random (std::span <T> data, std::ranlux24_base& re)
+{
+  if constexpr (std::is_same_v <T, f32>)
+  {
+    std::uniform_real_distribution <f32> distribution (-1.25f, 1.25f); // past the histogram's [-1, 1)
+    for (T& value : data) value = distribution (re);
+  }
+  else
+  {
+    // past the histogram's range at both ends, small enough that sums of millions don't overflow
+    std::uniform_int_distribution <i32> distribution (std::is_same_v <T, i32> ? -1200 : 0, 1200);
+    for (T& value : data) value = (T)distribution (re);
+  }
+}
+
+// the bin 'value' falls in, as vulkan_histogram.comp, or num_bins if it is outside [lo, hi)
+template <class T> static u32 find_bin (T value, T lo, T hi, u32 num_bins, u32 bin_scale)
+{
+  if (!(value >= lo && value < hi))
+  {
+    return num_bins;
+  }
+  if constexpr (std::is_same_v <T, f32>)
+  {
+    f32 scale = {};
+    std::memcpy (&scale, &bin_scale, sizeof (scale));
+    return std::min ((u32)((value - lo) * scale), num_bins - 1u);
+  }
+  else
+  {
+    return ((u32)value - (u32)lo) / bin_scale;
+  }
+}
+
+// the key's bits flipped so unsigned order is the type's order, as vulkan_radix_sort.comp
+template <class T> static u32 get_sortable (T key)
+{
+  u32 bits = {};
+  std::memcpy (&bits, &key, sizeof (bits));
+  if constexpr (std::is_same_v <T, f32>)
+  {
+    return bits ^ ((bits & 0x80000000u) != 0u ? 0xffffffffu : 0x80000000u);
+  }
+  else if constexpr (std::is_same_v <T, i32>)
+  {
+    return bits ^ 0x80000000u;
+  }
+  else
+  {
+    return bits;
+  }
+}
+
+template <class T> static bool is_match (T actual, double expected, double magnitude)
+{
+  if constexpr (std::is_same_v <T, f32>)
+  {
+    return std::fabs ((double)actual - expected) <= (magnitude * F32_SUM_TOLERANCE) + 1e-6;
+  }
+  else
+  {
+    return (u32)actual == (u32)(long long)expected; // the gpu wraps, as two's complement
+  }
+}
+
+// reduce, both scans, a histogram and (if the device can) both sorts of the first 'num_elements' of 'buffer_in',
+// returns how many of them differ
+template <class T> static u32 check_type (vulkan_buffer const& buffer_in, vulkan_buffer const& buffer_out,
+  u64 num_elements, T lo, T hi, u32 num_bins, std::ranlux24_base& re)
+{
+  char const* const type_name = std::is_same_v <T, f32> ? "f32" : (std::is_same_v <T, i32> ? "i32" : "u32");
+  std::span <T> const in = get_mapped_span <T> (buffer_in).first (num_elements);
+  std::span <T const> const out = get_mapped_span <T const> (buffer_out).first (num_elements);
+  fill_random (in, re);
+  if (!flush_vulkan_memory (s_device, buffer_in.allocation))
+  {
+    return 1u;
+  }
+
+  // cpu reference, the inputs are small integers so a double holds the integer sums exactly
+  double sum = {}, magnitude = {};
+  T min = in [0], max = in [0];
+  for (T value : in)
+  {
+    sum += value;
+    magnitude += std::fabs ((double)value);
+    min = std::min (min, value);
+    max = std::max (max, value);
+  }
+
+  u32 num_failed = {};
+  auto const report = [&](bool is_passed, char const* check)
+  {
+    if (!is_passed)
+    {
+      dprintf ("primitives: %s %s over %llu elements differs from the cpu\n", type_name, check, (unsigned long long)num_elements);
+      ++num_failed;
+    }
+  };
+
+  T gpu_sum = {}, gpu_min = {}, gpu_max = {};
+  report (gpu_reduce <gpu_reduce_op::sum> (buffer_in, num_elements, gpu_sum) && is_match (gpu_sum, sum, magnitude), "sum");
+  report (gpu_reduce <gpu_reduce_op::min> (buffer_in, num_elements, gpu_min) && gpu_min == min, "min");
+  report (gpu_reduce <gpu_reduce_op::max> (buffer_in, num_elements, gpu_max) && gpu_max == max, "max");
+
+  for (bool const is_inclusive : { false, true })
+  {
+    bool is_passed = gpu_scan <T> (buffer_in, buffer_out, num_elements, is_inclusive) &&
+      invalidate_vulkan_memory (s_device, buffer_out.allocation);
+    double prefix = {}, prefix_magnitude = {};
+    for (u64 i = 0u; is_passed && i < num_elements; ++i)
+    {
+      double const next = prefix + in [i];
+      prefix_magnitude += std::fabs ((double)in [i]);
+      is_passed = is_match (out [i], is_inclusive ? next : prefix, prefix_magnitude);
+      prefix = next;
+    }
+    report (is_passed, is_inclusive ? "inclusive scan" : "exclusive scan");
+  }
+
+  std::vector <u32> counts;
+  u32 lo_bits = {}, hi_bits = {}, bin_scale = {};
+  std::memcpy (&lo_bits, &lo, sizeof (lo_bits));
+  std::memcpy (&hi_bits, &hi, sizeof (hi_bits));
+  bool is_passed = gpu_histogram (buffer_in, num_elements, lo, hi, num_bins, counts) &&
+    get_histogram_bin_scale (get_gpu_type <T> (), lo_bits, hi_bits, num_bins, bin_scale);
+  std::vector <u32> expected_counts (num_bins + 1u); // + 1 for everything outside the range
+  for (T value : in)
+  {
+    ++expected_counts [find_bin (value, lo, hi, num_bins, bin_scale)];
+  }
+  expected_counts.pop_back ();
+  report (is_passed && counts == expected_counts, "histogram");
+
+  if (!s_has_subgroup_ballot)
+  {
+    return num_failed;
+  }
+
+  // the inputs have plenty of equal keys, sorting their indices along shows whether the order of equal keys survives
+  std::vector <T> const keys (in.begin (), in.end ());
+  std::vector <u32> expected_indices (num_elements);
+  std::iota (expected_indices.begin (), expected_indices.end (), 0u);
+  std::stable_sort (expected_indices.begin (), expected_indices.end (), [&](u32 a, u32 b)
+    {
+      return get_sortable (keys [a]) < get_sortable (keys [b]);
+    });
+
+  std::span <u32> const indices = get_mapped_span <u32> (buffer_out).first (num_elements);
+  std::iota (indices.begin (), indices.end (), 0u);
+  is_passed = flush_vulkan_memory (s_device, buffer_out.allocation) &&
+    gpu_sort_by_key <T> (buffer_in, buffer_out, num_elements) &&
+    invalidate_vulkan_memory (s_device, buffer_in.allocation) &&
+    invalidate_vulkan_memory (s_device, buffer_out.allocation);
+  for (u64 i = 0u; is_passed && i < num_elements; ++i)
+  {
+    is_passed = indices [i] == expected_indices [i] && get_sortable (in [i]) == get_sortable (keys [expected_indices [i]]);
+  }
+  report (is_passed, "sort by key");
+
+  std::copy (keys.begin (), keys.end (), in.begin ());
+  is_passed = flush_vulkan_memory (s_device, buffer_in.allocation) &&
+    gpu_sort <T> (buffer_in, num_elements) &&
+    invalidate_vulkan_memory (s_device, buffer_in.allocation);
+  for (u64 i = 0u; is_passed && i < num_elements; ++i)
+  {
+    is_passed = get_sortable (in [i]) == get_sortable (keys [expected_indices [i]]);
+  }
+  report (is_passed, "sort");
+
+  return num_failed;
+}
+#pragma endregion
+
+
+bool create_vulkan_primitives (VkPhysicalDevice physical_device, VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (s_device));
+
+
+  s_physical_device = physical_device;
+  s_device = device;
+
+  // core in vulkan 1.1, which subgroup ops the device has in which stages
+  VkPhysicalDeviceSubgroupProperties subgroup_properties =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+    //.pNext = VK_NULL_HANDLE,
+  };
+  VkPhysicalDeviceProperties2 properties =
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+    .pNext = &subgroup_properties,
+  };
+  vkGetPhysicalDeviceProperties2 (physical_device, &properties);
+  s_max_groups_x = properties.properties.limits.maxComputeWorkGroupCount [0];
+  s_max_binding_size = properties.properties.limits.maxStorageBufferRange;
+
+  VkSubgroupFeatureFlags const required_operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+  bool const is_in_compute = (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0u;
+  s_has_subgroup_arithmetic = is_in_compute &&
+    (subgroup_properties.supportedOperations & required_operations) == required_operations;
+  if (!s_has_subgroup_arithmetic)
+  {
+    dprintf ("primitives: no subgroup arithmetic in compute shaders, reduce, scan and sort are unavailable\n");
+  }
+
+  // the sort also ranks keys with ballots, its shared memory is sized for subgroups of at least MIN_SUBGROUP_SIZE
+  s_has_subgroup_ballot = is_in_compute &&
+    (subgroup_properties.supportedOperations & VK_SUBGROUP_FEATURE_BALLOT_BIT) != 0u &&
+    subgroup_properties.subgroupSize >= MIN_SUBGROUP_SIZE;
+  if (s_has_subgroup_arithmetic && !s_has_subgroup_ballot)
+  {
+    dprintf ("primitives: no subgroup ballot in compute shaders (or subgroups under %u), sort is unavailable\n", MIN_SUBGROUP_SIZE);
+  }
+  return true;
+}
+
+bool is_vulkan_reduce_scan_supported ()
+{
+  return s_has_subgroup_arithmetic;
+}
+
+bool is_vulkan_sort_supported ()
+{
+  return s_has_subgroup_arithmetic && s_has_subgroup_ballot;
+}
+
+bool reserve_vulkan_primitives (u64 max_elements, u64 max_sort_elements, bool has_sort_values)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_primitives' first\n");
+
+
+  // the sort scans its counts, RADIX per block, with the same scratch
+  u64 const num_sort_counts = max_sort_elements > 0u ? (((max_sort_elements - 1u) / BLOCK_ELEMENTS) + 1u) * RADIX : 0u;
+  u64 const num_scratch_elements = std::max (max_elements, num_sort_counts);
+  if (num_scratch_elements > 0u && !grow_scratch (num_scratch_elements))
+  {
+    return false;
+  }
+  if (max_sort_elements == 0u)
+  {
+    return true;
+  }
+  return grow_buffer (s_sort_keys, max_sort_elements) &&
+    grow_buffer (s_sort_counts, num_sort_counts) &&
+    (!has_sort_values || (grow_buffer (s_sort_values, max_sort_elements) && grow_buffer (s_sort_indices, max_sort_elements)));
+}
+
+bool reduce_vulkan_buffer (gpu_reduce_op op, gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, vulkan_buffer const& out,
+  VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_primitives' first\n");
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (in.buffer) && CHECK_VULKAN_HANDLE (out.buffer));
+
+
+  if (!s_has_subgroup_arithmetic)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: reduce needs subgroup arithmetic\n");
+  }
+  if (num_elements == 0u)
+  {
+    return true;
+  }
+  if (!check_lengths (num_elements, { &in }) || !check_lengths (1u, { &out }))
+  {
+    return false;
+  }
+
+  return record_or_submit (command_buffer, [&](VkCommandBuffer record_command_buffer)
+    {
+      return record_reduce (record_command_buffer, op, type, in, num_elements, out);
+    });
+}
+
+bool scan_vulkan_buffer (gpu_type type, bool is_inclusive,
+  vulkan_buffer const& in, vulkan_buffer const& out, u64 num_elements,
+  VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_primitives' first\n");
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (in.buffer) && CHECK_VULKAN_HANDLE (out.buffer));
+
+
+  if (!s_has_subgroup_arithmetic)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: scan needs subgroup arithmetic\n");
+  }
+  if (num_elements == 0u)
+  {
+    return true;
+  }
+  if (!check_lengths (num_elements, { &in, &out }))
+  {
+    return false;
+  }
+
+  return record_or_submit (command_buffer, [&](VkCommandBuffer record_command_buffer)
+    {
+      return record_scan (record_command_buffer, type, is_inclusive, in, out, num_elements, 0u);
+    });
+}
+
+bool histogram_vulkan_buffer (gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32 lo_bits, u32 hi_bits,
+  u32 num_bins, vulkan_buffer const& out_bins,
+  VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_primitives' first\n");
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (in.buffer) && CHECK_VULKAN_HANDLE (out_bins.buffer));
+
+
+  if (!check_lengths (num_elements, { &in }))
+  {
+    return false;
+  }
+
+  return record_or_submit (command_buffer, [&](VkCommandBuffer record_command_buffer)
+    {
+      return record_histogram (record_command_buffer, type, in, num_elements, lo_bits, hi_bits, num_bins, out_bins);
+    });
+}
+
+bool sort_vulkan_buffer (gpu_type key_type,
+  vulkan_buffer const& keys, vulkan_buffer const* values, u64 num_elements,
+  VkCommandBuffer command_buffer)
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_primitives' first\n");
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (keys.buffer) && (values == nullptr || CHECK_VULKAN_HANDLE (values->buffer)));
+
+
+  if (!s_has_subgroup_arithmetic || !s_has_subgroup_ballot)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: sort needs subgroup arithmetic and ballot\n");
+  }
+  if (values != nullptr && values->buffer == keys.buffer)
+  {
+    return DBG_ASSERT_MSG (false, "primitives: sort keys and values must be different buffers\n");
+  }
+  if (num_elements <= 1u)
+  {
+    return true;
+  }
+  if (!check_lengths (num_elements, { &keys }) || (values != nullptr && !check_lengths (num_elements, { values })))
+  {
+    return false;
+  }
+
+  return record_or_submit (command_buffer, [&](VkCommandBuffer record_command_buffer)
+    {
+      return record_sort (record_command_buffer, key_type, keys, values, num_elements);
+    });
+}
+
+bool read_vulkan_reduce (gpu_reduce_op op, gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32& out_bits)
+{
+  if (num_elements == 0u)
+  {
+    out_bits = get_reduce_identity (op, type);
+    return true;
+  }
+
+  if (!get_readback (1u) ||
+    !reduce_vulkan_buffer (op, type, in, num_elements, s_readback) ||
+    !invalidate_vulkan_memory (s_device, s_readback.allocation))
+  {
+    return false;
+  }
+  out_bits = get_mapped_span <u32 const> (s_readback) [0];
+  return true;
+}
+
+bool read_vulkan_histogram (gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32 lo_bits, u32 hi_bits,
+  u32 num_bins, std::vector <u32>& out_counts)
+{
+  if (!get_readback (num_bins) ||
+    !histogram_vulkan_buffer (type, in, num_elements, lo_bits, hi_bits, num_bins, s_readback) ||
+    !invalidate_vulkan_memory (s_device, s_readback.allocation))
+  {
+    return false;
+  }
+  std::span <u32 const> const counts = get_mapped_span <u32 const> (s_readback).first (num_bins);
+  out_counts.assign (counts.begin (), counts.end ());
+  return true;
+}
+
+bool check_vulkan_primitives ()
+{
+  DBG_ASSERT_MSG (CHECK_VULKAN_HANDLE (s_device), "must call 'create_vulkan_primitives' first\n");
+
+
+  if (!s_has_subgroup_arithmetic)
+  {
+    dprintf ("primitives: check skipped, no subgroup arithmetic\n");
+    return true;
+  }
+
+  vulkan_buffer buffer_in, buffer_out;
+  for (vulkan_buffer* buffer : { &buffer_in, &buffer_out })
+  {
+    if (!create_vulkan_buffer (s_physical_device, s_device,
+      MAX_CHECK_LENGTH * sizeof (u32),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      *buffer))
+    {
+      return false;
+    }
+  }
+
+  // a fixed seed, so a failure happens again
+  std::ranlux24_base re (1u);
+  u32 num_failed = {}, num_checks = {};
+  for (u64 const num_elements : CHECK_LENGTHS)
+  {
+    num_failed += check_type <f32> (buffer_in, buffer_out, num_elements, -1.f, 1.f, 64u, re);
+    num_failed += check_type <i32> (buffer_in, buffer_out, num_elements, -1000, 1000, 100u, re);
+    num_failed += check_type <u32> (buffer_in, buffer_out, num_elements, 100u, 1100u, MAX_HISTOGRAM_BINS, re);
+    num_checks += 3u * (s_has_subgroup_ballot ? 8u : 6u); // types * (3 reduces, 2 scans, 1 histogram, 2 sorts)
+  }
+
+  release_vulkan_buffer (s_device, buffer_in);
+  release_vulkan_buffer (s_device, buffer_out);
+
+  dprintf ("primitives: %u of %u checks match the cpu\n", num_checks - num_failed, num_checks);
+  return num_failed == 0u;
+}
+
+void release_vulkan_primitives_buffers ()
+{
+  if (!CHECK_VULKAN_HANDLE (s_device))
+  {
+    return;
+  }
+
+  vkDeviceWaitIdle (s_device);
+  // their descriptor sets are in the element-wise cache, releasing the buffers frees them
+  for (vulkan_buffer& scratch : s_scratch)
+  {
+    if (CHECK_VULKAN_HANDLE (scratch.buffer)) release_vulkan_buffer (s_device, scratch);
+  }
+  for (vulkan_buffer* buffer : { &s_readback, &s_sort_keys, &s_sort_values, &s_sort_indices, &s_sort_counts })
+  {
+    if (CHECK_VULKAN_HANDLE (buffer->buffer)) release_vulkan_buffer (s_device, *buffer);
+  }
+}
+
+void release_vulkan_primitives (VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+
+
+  release_vulkan_primitives_buffers ();
+
+  for (VkPipeline& pipeline : s_reduce_pipelines)
+  {
+    if (CHECK_VULKAN_HANDLE (pipeline)) release_vulkan_pipeline (device, pipeline);
+  }
+  for (VkPipeline& pipeline : s_scan_pipelines)
+  {
+    if (CHECK_VULKAN_HANDLE (pipeline)) release_vulkan_pipeline (device, pipeline);
+  }
+  for (histogram_pipeline& entry : s_histogram_pipelines)
+  {
+    release_vulkan_pipeline (device, entry.pipeline);
+  }
+  s_histogram_pipelines.clear ();
+  for (VkPipeline& pipeline : s_sort_pipelines)
+  {
+    if (CHECK_VULKAN_HANDLE (pipeline)) release_vulkan_pipeline (device, pipeline);
+  }
+
+  s_has_subgroup_arithmetic = false;
+  s_has_subgroup_ballot = false;
+  s_device = VK_NULL_HANDLE;
+  s_physical_device = VK_NULL_HANDLE;
+}
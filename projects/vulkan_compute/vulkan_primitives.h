@@ -0,0 +1,207 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+#include "vulkan_elementwise.h"   // for gpu_type, get_gpu_type
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+#include <cstring>                // for std::memcpy
+#include <vector>                 // for std::vector
+
+struct vulkan_buffer;
+
+
+// parallel primitives over whole storage buffers of any length:
+// - reduce: the sum, min or max of the elements
+// - scan: inclusive or exclusive prefix sums, e.g. the start of each grid cell's particles from the cells' counts
+// - histogram: counts of the elements in equal bins over [lo, hi)
+// - sort: a stable radix sort of 32 bit keys, alone or with 32 bit values, e.g. particle indices by cell hash
+//
+//   f32 total = {};
+//   gpu_reduce <gpu_reduce_op::sum> (buffer, num_elements, total);
+//   gpu_scan (buffer_counts, buffer_offsets, num_cells, false);
+//   gpu_sort_by_key <u32> (buffer_cell_hashes, buffer_particle_indices, num_particles);
+//
+// reduce and scan use subgroup arithmetic within a work group and shared memory across its subgroups,
+// the work groups' partials are reduced/scanned by further passes of the same kernel (multi-pass, no
+// cross-group spinning, so it is safe on any device), a few passes cover the largest buffer
+// the sort takes 4 bits per pass, 8 passes of: count each block's digits, scan the counts, scatter in order
+// the kernels share the element-wise library's layouts and descriptor set cache (vulkan_elementwise.h)
+//
+// the buffer versions record in to the caller's command buffer, or submit and wait if it is VK_NULL_HANDLE
+// the 'gpu_' templates read the result back to the host
+// passes between work groups (and the sort's ping-pong) need scratch buffers, shared by every job:
+// - a submitted job grows them to fit, a recorded one fails if they are too small, 'reserve_vulkan_primitives' first
+// - growing them invalidates command buffers already recorded with them, so reserve for the largest job up front
+// - jobs on one queue run in order (each pass ends in a barrier), don't run recorded jobs at once on different queues
+
+
+// MUST match OP_ in vulkan_reduce.comp
+enum class gpu_reduce_op : u32
+{
+  sum,
+  min,
+  max
+};
+
+// bins are counted in shared memory, this many fit the minimum 16 KB every device has
+constexpr u32 MAX_HISTOGRAM_BINS = 4096u;
+
+
+/// <summary>
+/// check the device supports the subgroup operations the kernels need, pipelines are created on first use
+/// reduce, scan and sort fail without them, the histogram doesn't need them
+/// call after 'create_vulkan_elementwise', it shares its layouts
+/// </summary>
+/// <returns>true, if successful</returns>
+bool create_vulkan_primitives (VkPhysicalDevice physical_device, VkDevice device);
+
+/// <summary>
+/// whether the device has the subgroup operations for reduce and scan, and for the sort
+/// without them those fail, check first where they are optional
+/// </summary>
+bool is_vulkan_reduce_scan_supported ();
+bool is_vulkan_sort_supported ();
+
+/// <summary>
+/// grow the scratch to fit reduces and scans of up to 'max_elements', and sorts of up to 'max_sort_elements'
+/// ('has_sort_values' for key/value sorts), MUST be called before recording jobs in to a command buffer of your own
+/// waits for the device to go idle if anything grows, and invalidates command buffers already recorded with the primitives
+/// </summary>
+/// <returns>true, if successful</returns>
+bool reserve_vulkan_primitives (u64 max_elements, u64 max_sort_elements = 0u, bool has_sort_values = false);
+
+/// <summary>
+/// out [0] = op (in [0], .., in [num_elements - 1])
+/// no elements leaves 'out' as it is ('gpu_reduce' gives the identity of 'op', e.g. +inf for an f32 min)
+/// </summary>
+/// <returns>true, if successful</returns>
+bool reduce_vulkan_buffer (gpu_reduce_op op, gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, vulkan_buffer const& out,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE);
+
+/// <summary>
+/// out [i] = in [0] + .. + in [i] ('is_inclusive'), or in [0] + .. + in [i - 1], 'out' may be 'in'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool scan_vulkan_buffer (gpu_type type, bool is_inclusive,
+  vulkan_buffer const& in, vulkan_buffer const& out, u64 num_elements,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE);
+
+/// <summary>
+/// out_bins [b] = how many elements are in bin b of 'num_bins' equal bins over [lo, hi), the rest aren't counted
+/// integer bins are ceil ((hi - lo) / num_bins) wide, so the last can be short
+/// 'lo_bits'/'hi_bits' are the bounds' bytes as 'type', 'out_bins' needs VK_BUFFER_USAGE_TRANSFER_DST_BIT, it is cleared first
+/// </summary>
+/// <returns>true, if successful</returns>
+bool histogram_vulkan_buffer (gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32 lo_bits, u32 hi_bits,
+  u32 num_bins, vulkan_buffer const& out_bins,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE);
+
+/// <summary>
+/// sort the first 'num_elements' of 'keys' ascending in place, and if 'values' isn't null, its elements with their keys
+/// the sort is stable, f32 keys order -0 before +0 and nans by their bits (negative nans first, the rest last)
+/// values can be any 4 byte type, 'values' must not be 'keys'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool sort_vulkan_buffer (gpu_type key_type,
+  vulkan_buffer const& keys, vulkan_buffer const* values, u64 num_elements,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE);
+
+/// <summary>
+/// as 'reduce_vulkan_buffer'/'histogram_vulkan_buffer', submitted, waited for and read back
+/// use 'gpu_reduce'/'gpu_histogram' rather than these
+/// </summary>
+/// <returns>true, if successful</returns>
+bool read_vulkan_reduce (gpu_reduce_op op, gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32& out_bits);
+bool read_vulkan_histogram (gpu_type type,
+  vulkan_buffer const& in, u64 num_elements, u32 lo_bits, u32 hi_bits,
+  u32 num_bins, std::vector <u32>& out_counts);
+
+/// <summary>
+/// run every primitive over every element type and a range of lengths (one block, many blocks, several
+/// passes), compare against the same on the cpu and print what differs
+/// </summary>
+/// <returns>true, if everything matches</returns>
+bool check_vulkan_primitives ();
+
+/// <summary>
+/// free the scratch, sort and read back buffers, the next job creates them again
+/// e.g. to hand the memory back between jobs, 'release_vulkan_primitives' does it too
+/// </summary>
+void release_vulkan_primitives_buffers ();
+
+/// <summary>
+/// release the buffers and the pipelines
+/// call before 'release_vulkan_elementwise' and 'release_vulkan_memory'
+/// </summary>
+void release_vulkan_primitives (VkDevice device);
+
+
+/// <summary>
+/// out_result = OP over the first 'num_elements' of 'in'
+/// </summary>
+/// <returns>true, if successful</returns>
+template <gpu_reduce_op OP, class T = f32>
+bool gpu_reduce (vulkan_buffer const& in, u64 num_elements, T& out_result)
+{
+  u32 bits = {};
+  if (!read_vulkan_reduce (OP, get_gpu_type <T> (), in, num_elements, bits))
+  {
+    return false;
+  }
+  std::memcpy (&out_result, &bits, sizeof (bits));
+  return true;
+}
+
+/// <summary>
+/// prefix sums of the first 'num_elements' of 'in' in to 'out', see 'scan_vulkan_buffer'
+/// </summary>
+/// <returns>true, if successful</returns>
+template <class T = f32>
+bool gpu_scan (vulkan_buffer const& in, vulkan_buffer const& out, u64 num_elements, bool is_inclusive = true,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE)
+{
+  return scan_vulkan_buffer (get_gpu_type <T> (), is_inclusive, in, out, num_elements, command_buffer);
+}
+
+/// <summary>
+/// out_counts = 'num_bins' counts of the first 'num_elements' of 'in' over [lo, hi), see 'histogram_vulkan_buffer'
+/// </summary>
+/// <returns>true, if successful</returns>
+template <class T = f32>
+bool gpu_histogram (vulkan_buffer const& in, u64 num_elements, T lo, T hi, u32 num_bins,
+  std::vector <u32>& out_counts)
+{
+  u32 lo_bits = {}, hi_bits = {};
+  std::memcpy (&lo_bits, &lo, sizeof (lo_bits));
+  std::memcpy (&hi_bits, &hi, sizeof (hi_bits));
+  return read_vulkan_histogram (get_gpu_type <T> (), in, num_elements, lo_bits, hi_bits, num_bins, out_counts);
+}
+
+/// <summary>
+/// sort the first 'num_elements' of 'keys' in place, see 'sort_vulkan_buffer'
+/// </summary>
+/// <returns>true, if successful</returns>
+template <class T = u32>
+bool gpu_sort (vulkan_buffer const& keys, u64 num_elements,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE)
+{
+  return sort_vulkan_buffer (get_gpu_type <T> (), keys, nullptr, num_elements, command_buffer);
+}
+
+/// <summary>
+/// sort the first 'num_elements' of 'keys' in place and move 'values' with them, see 'sort_vulkan_buffer'
+/// </summary>
+/// <returns>true, if successful</returns>
+template <class T = u32>
+bool gpu_sort_by_key (vulkan_buffer const& keys, vulkan_buffer const& values, u64 num_elements,
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE)
+{
+  return sort_vulkan_buffer (get_gpu_type <T> (), keys, &values, num_elements, command_buffer);
+}
@@ -2,46 +2,21 @@
 
 #include "vulkan_context.h"  // begin_single_time_commands, ...
 #include "vulkan_pipeline.h" // begin_command_buffer, ...
+#include "vulkan_upload.h"   // begin_vulkan_upload_batch, ...
+#include "vulkan_trace.h"    // TRACE_SCOPE
 #include "utility.h"         // DBG_ASSERT, DBG_ASSERT_VULKAN
 
+#include <algorithm> // for std::find
 #include <cstring> // for std::memcpy
+#include <vector>  // for std::vector
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>            // for stbi_load, stbi_image_free
 
 
 #pragma region vulkan_buffer_support
-static u32 find_suitable_memory_type_index (VkPhysicalDevice physical_device,
-  VkMemoryPropertyFlags desired_memory_flags, u32 memory_type_bits)
-{
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
-
-
-  // memory_type_bits is a bitfield where if bit n is set, it means that
-  // the VkMemoryType n of the VkPhysicalDeviceMemoryProperties structure
-  // satisfies the memory requirements.
-
-  VkPhysicalDeviceMemoryProperties memory_properties = {};
-  vkGetPhysicalDeviceMemoryProperties (physical_device, // physcalDevice
-    &memory_properties);                                // pMemoryProperties
-
-  for (uint32_t i = 0u; i < VK_MAX_MEMORY_TYPES; ++i)
-  {
-    VkMemoryType memory_type = memory_properties.memoryTypes [i];
-    if (memory_type_bits & 1u)
-    {
-      if ((memory_type.propertyFlags & desired_memory_flags) == desired_memory_flags)
-      {
-        return i; // memory type index
-      }
-    }
+static std::vector <void (*) (VkBuffer buffer)> s_buffer_release_callbacks;
 
-    memory_type_bits = memory_type_bits >> 1;
-  }
-
-  DBG_ASSERT_MSG (false, "could not find suitable memory type\n");
-  return ~0u;
-}
 
 static bool create_buffer (VkDevice device,
   VkBufferCreateInfo const& bci,
@@ -64,13 +39,13 @@ static bool create_buffer (VkDevice device,
 }
 static bool allocate_buffer_memory (VkPhysicalDevice physical_device, VkDevice device,
   VkBuffer buffer,
-  VkMemoryPropertyFlags desired_memory_flags, void const* extension_settings,
-  VkDeviceMemory& out_memory)
+  VkMemoryPropertyFlags desired_memory_flags,
+  vulkan_allocation& out_allocation)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer));
-  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_memory));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_allocation.memory));
 
 
   VkMemoryRequirements memory_requirements = {};
@@ -78,19 +53,10 @@ static bool allocate_buffer_memory (VkPhysicalDevice physical_device, VkDevice d
     buffer,                              // buffer
     &memory_requirements);               // pMemoryRequirements
 
-  VkMemoryAllocateInfo const mai =
-  {
-    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-    .pNext = extension_settings,
-    .allocationSize = memory_requirements.size,
-    .memoryTypeIndex = find_suitable_memory_type_index (physical_device, desired_memory_flags, memory_requirements.memoryTypeBits)
-  };
-
-  VkResult const result = vkAllocateMemory (device, // device
-    &mai,                                           // pAllocateInfo
-    nullptr,                                        // pAllocator
-    &out_memory);                                   // pMemory
-  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (out_memory))
+  // buffers are always linear resources
+  if (!allocate_vulkan_memory (physical_device, device,
+    memory_requirements, desired_memory_flags, true,
+    out_allocation))
   {
     return DBG_ASSERT_MSG (false, "failed to allocate device memory for buffer\n");
   }
@@ -98,17 +64,17 @@ static bool allocate_buffer_memory (VkPhysicalDevice physical_device, VkDevice d
   return true;
 }
 static bool bind_buffer_to_memory (VkDevice device,
-  VkBuffer buffer, VkDeviceMemory memory)
+  VkBuffer buffer, vulkan_allocation const& allocation)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (memory));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (allocation.memory));
 
 
   VkResult const result = vkBindBufferMemory (device, // device
     buffer,                                           // buffer
-    memory,                                           // memory
-    0u);                                              // memoryOffset
+    allocation.memory,                                // memory
+    allocation.offset);                               // memoryOffset
   if (!CHECK_VULKAN_RESULT (result))
   {
     return DBG_ASSERT_MSG (false, "failed to bind buffer to memory\n");
@@ -117,38 +83,6 @@ static bool bind_buffer_to_memory (VkDevice device,
   return true;
 }
 
-static bool copy_buffer_to_buffer (VkBuffer buffer_a, VkBuffer buffer_b, VkDeviceSize size)
-{
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer_a));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer_b));
-
-
-  VkCommandBuffer cb = VK_NULL_HANDLE;
-  if (!begin_single_time_commands (cb))
-  {
-    return false;
-  }
-  if (!begin_command_buffer (cb, 0u))
-  {
-    return false;
-  }
-
-
-  VkBufferCopy const copy_region =
-  {
-    .srcOffset = 0u, // optional
-    .dstOffset = 0u, // optional
-    .size = size
-  };
-  vkCmdCopyBuffer (cb, buffer_a, buffer_b, 1u, &copy_region);
-
-
-  if (!end_command_buffer (cb))
-  {
-    return false;
-  }
-  return end_single_time_commands ();
-}
 static bool set_device_buffer (VkPhysicalDevice physical_device, VkDevice device,
   VkBuffer device_buffer, VkDeviceSize size, std::function <void (void*)> func)
 {
@@ -159,29 +93,20 @@ static bool set_device_buffer (VkPhysicalDevice physical_device, VkDevice device
 
   // using the 'staging buffer' approach allows us to have our final buffer have the most optimal properties
   // i.e. device accessible only, NOT host visible!
+  // the staging memory comes from the upload batcher's ring, and the copy joins the open batch (if any)
 
-  vulkan_buffer staging_buffer;
-
-  if (!create_vulkan_buffer (physical_device, device,
-    size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    staging_buffer))
+  bool const is_own_batch = !is_vulkan_upload_batch_open ();
+  if (is_own_batch && !begin_vulkan_upload_batch (physical_device, device))
   {
     return false;
   }
 
-  if (!map_and_unmap_memory (device, staging_buffer.memory, func))
+  if (!upload_vulkan_buffer (device_buffer, 0u, size, func))
   {
     return false;
   }
 
-  if (!copy_buffer_to_buffer (staging_buffer.buffer, device_buffer, size))
-  {
-    return false;
-  }
-
-  release_vulkan_buffer (device, staging_buffer);
-
-  return true;
+  return is_own_batch ? submit_vulkan_upload_batch (true) : true;
 }
 #pragma endregion
 
@@ -193,7 +118,7 @@ bool create_vulkan_buffer (VkPhysicalDevice physical_device, VkDevice device,
   DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_buffer.buffer));
-  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_buffer.memory));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_buffer.allocation.memory));
 
 
   VkBufferCreateInfo const bci =
@@ -215,41 +140,40 @@ bool create_vulkan_buffer (VkPhysicalDevice physical_device, VkDevice device,
 
   if (!allocate_buffer_memory (physical_device, device,
     out_buffer.buffer,
-    desired_memory_flags, nullptr,
-    out_buffer.memory))
+    desired_memory_flags,
+    out_buffer.allocation))
   {
     return false;
   }
 
   out_buffer.size = size;
 
-  return bind_buffer_to_memory (device, out_buffer.buffer, out_buffer.memory);
+  return bind_buffer_to_memory (device, out_buffer.buffer, out_buffer.allocation);
 }
 
 bool map_and_unmap_memory (VkDevice device,
-  VkDeviceMemory memory, std::function <void (void*)> func)
+  vulkan_allocation const& allocation, std::function <void (void*)> func)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (memory));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (allocation.memory));
 
 
-  void* mapped_memory = nullptr;
-  VkResult const result = vkMapMemory (device, // device
-    memory,                                    // memory
-    0u,                                        // offset
-    VK_WHOLE_SIZE,                             // size
-    0u,                                        // flags
-    &mapped_memory);                           // ppData
-  if (!CHECK_VULKAN_RESULT (result))
+  // host visible memory blocks are persistently mapped, so there is nothing to map/unmap
+  // just make sure the host and device see each others writes
+  if (allocation.mapped == nullptr)
   {
-    return DBG_ASSERT_MSG (false, "failed to map buffer memory\n");
+    return DBG_ASSERT_MSG (false, "memory is not host visible\n");
   }
 
-  func (mapped_memory);
+  TRACE_SCOPE ("map_and_unmap_memory");
+  if (!invalidate_vulkan_memory (device, allocation))
+  {
+    return false;
+  }
 
-  vkUnmapMemory (device, memory);
+  func (allocation.mapped);
 
-  return true;
+  return flush_vulkan_memory (device, allocation);
 }
 
 
@@ -296,13 +220,13 @@ static bool create_image_2d(VkDevice device,
 }
 
 static bool allocate_image_memory (VkPhysicalDevice physical_device, VkDevice device,
-  VkImage image, VkMemoryPropertyFlags desired_memory_flags,
-  VkDeviceSize& out_size, VkDeviceMemory& out_memory)
+  VkImage image, VkMemoryPropertyFlags desired_memory_flags, VkImageTiling image_tiling,
+  VkDeviceSize& out_size, vulkan_allocation& out_allocation)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (image));
-  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_memory));
+  DBG_ASSERT (!CHECK_VULKAN_HANDLE (out_allocation.memory));
 
 
   VkMemoryRequirements memory_requirements = {};
@@ -310,20 +234,10 @@ static bool allocate_image_memory (VkPhysicalDevice physical_device, VkDevice de
     image,                              // image
     &memory_requirements);              // pMemoryRequirements
 
-  VkMemoryAllocateInfo const memory_allocate_info =
-  {
-    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-    //.pNext = VK_NULL_HANDLE,
-    .allocationSize = memory_requirements.size,
-    .memoryTypeIndex = find_suitable_memory_type_index (physical_device,
-      desired_memory_flags, memory_requirements.memoryTypeBits)
-  };
-
-  VkResult const result = vkAllocateMemory (device, // device
-    &memory_allocate_info,                          // pAllocateInfo
-    nullptr,                                        // pAllocator
-    &out_memory);                                   // pMemory
-  if (!CHECK_VULKAN_RESULT (result) || !CHECK_VULKAN_HANDLE (out_memory))
+  // optimal tiling images are non-linear resources, they must not share a block with buffers
+  if (!allocate_vulkan_memory (physical_device, device,
+    memory_requirements, desired_memory_flags, image_tiling == VK_IMAGE_TILING_LINEAR,
+    out_allocation))
   {
     return DBG_ASSERT_MSG (false, "failed to allocate device memory for image\n");
   }
@@ -333,17 +247,17 @@ static bool allocate_image_memory (VkPhysicalDevice physical_device, VkDevice de
   return true;
 }
 static bool bind_image_to_memory (VkDevice device,
-  VkImage image, VkDeviceMemory memory)
+  VkImage image, vulkan_allocation const& allocation)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (image));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (memory));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (allocation.memory));
 
 
   VkResult const result = vkBindImageMemory (device, // device
     image,                                           // image
-    memory,                                          // memory
-    0u);                                             // memoryOffset
+    allocation.memory,                               // memory
+    allocation.offset);                              // memoryOffset
   if (!CHECK_VULKAN_RESULT (result))
   {
     return DBG_ASSERT_MSG (false, "failed to bind image to memory\n");
@@ -352,48 +266,6 @@ static bool bind_image_to_memory (VkDevice device,
   return true;
 }
 
-static bool copy_buffer_to_image (VkBuffer buffer, VkImage image, VkExtent2D const& size)
-{
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (image));
-
-
-  VkCommandBuffer cb = VK_NULL_HANDLE;
-  if (!begin_single_time_commands (cb))
-  {
-    return false;
-  }
-  if (!begin_command_buffer (cb, 0u))
-  {
-    return false;
-  }
-
-  VkImageSubresourceLayers const image_subresource =
-  {
-    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-    .mipLevel = 0u,
-    .baseArrayLayer = 0u,
-    .layerCount = 1u
-  };
-  VkBufferImageCopy const buffer_image_copy =
-  {
-    .bufferOffset = 0u,
-    .bufferRowLength = 0u,
-    .bufferImageHeight = 0u,
-    .imageSubresource = image_subresource,
-    .imageOffset = { 0u, 0u, 0u },
-    .imageExtent = { size.width, size.height, 1u }
-  };
-  vkCmdCopyBufferToImage (cb, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &buffer_image_copy);
-
-  if (!end_command_buffer (cb))
-  {
-    return false;
-  }
-
-  return end_single_time_commands ();
-}
-
 static bool create_vulkan_image_view (VkDevice device,
   VkImageViewCreateInfo const& ivci,
   VkImageView& out_image_view)
@@ -499,6 +371,7 @@ bool create_vulkan_texture(VkPhysicalDevice physical_device, VkDevice device,
     int texture_width = 0, texture_height = 0;
     VkDeviceSize texture_size = 0u;
     {
+        TRACE_SCOPE("stbi_load");
         int channels;
         // STBI_rgb_alpha: force alpha even if not present in image
         pixels = stbi_load(texture_path, &texture_width, &texture_height, &channels, STBI_rgb_alpha);
@@ -521,71 +394,6 @@ bool create_vulkan_texture(VkPhysicalDevice physical_device, VkDevice device,
     }
 
 
-    // create staging buffer
-    // using the 'staging buffer' approach allows us to have our final buffer have the most optimal properties
-    // i.e. device only, NOT host visible!
-
-    VkBuffer staging_buffer = VK_NULL_HANDLE;
-    {
-        VkBufferCreateInfo const bci =
-        {
-          .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-          //.pNext = VK_NULL_HANDLE,
-          //.flags = 0u,
-          .size = texture_size,
-          .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-          .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-          //.queueFamilyIndexCount = 0u,
-          //.pQueueFamilyIndices = VK_NULL_HANDLE
-        };
-
-        if (!create_buffer(device, bci, staging_buffer))
-        {
-            return false;
-        }
-    }
-
-
-    // allocate memory for staging buffer
-
-    VkDeviceMemory staging_buffer_memory = VK_NULL_HANDLE;
-    {
-        if (!allocate_buffer_memory(physical_device, device,
-            staging_buffer,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, nullptr,
-            staging_buffer_memory))
-        {
-            return false;
-        }
-    }
-
-
-    // bind staging buffer memory to staging buffer object
-
-    if (!bind_buffer_to_memory(device, staging_buffer, staging_buffer_memory))
-    {
-        return false;
-    }
-
-
-    // copy pixels to staging buffer memory
-
-    if (!map_and_unmap_memory(device,
-        staging_buffer_memory, [&](void* mapped_memory)
-        {
-            std::memcpy(mapped_memory, pixels, (size_t)texture_size);
-        }))
-    {
-        return false;
-    }
-
-
-    // release original pixel data
-
-    stbi_image_free(pixels);
-    pixels = nullptr;
-
-
     // create image object
 
     out_texture.dim = { (unsigned)texture_width, (unsigned)texture_height };
@@ -603,8 +411,8 @@ bool create_vulkan_texture(VkPhysicalDevice physical_device, VkDevice device,
     // allocate memory for image object
 
     if (!allocate_image_memory(physical_device, device,
-        out_texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        out_texture.size, out_texture.memory))
+        out_texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL,
+        out_texture.size, out_texture.allocation))
     {
         return false;
     }
@@ -612,7 +420,19 @@ bool create_vulkan_texture(VkPhysicalDevice physical_device, VkDevice device,
 
     // bind image memory to image object
 
-    if (!bind_image_to_memory(device, out_texture.image, out_texture.memory))
+    if (!bind_image_to_memory(device, out_texture.image, out_texture.allocation))
+    {
+        return false;
+    }
+
+
+    // the pixel data goes through the upload batcher's staging ring
+    // using the 'staging buffer' approach allows us to have our final image have the most optimal properties
+    // i.e. device only, NOT host visible!
+    // join the caller's batch if one is open, so many textures share a single submit
+
+    bool const is_own_batch = !is_vulkan_upload_batch_open();
+    if (is_own_batch && !begin_vulkan_upload_batch(physical_device, device))
     {
         return false;
     }
@@ -626,20 +446,22 @@ bool create_vulkan_texture(VkPhysicalDevice physical_device, VkDevice device,
     }
 
 
-    // copy pixel data in staging buffer to image
+    // copy pixels to staging memory, record copy to image
 
-    if (!copy_buffer_to_image(staging_buffer, out_texture.image, { (unsigned)texture_width, (unsigned)texture_height }))
+    if (!upload_vulkan_image(out_texture.image, { (unsigned)texture_width, (unsigned)texture_height }, texture_size,
+        [&](void* mapped_memory)
+        {
+            std::memcpy(mapped_memory, pixels, (size_t)texture_size);
+        }))
     {
         return false;
     }
 
 
-    // destroy staging buffer and memory
+    // release original pixel data
 
-    vkFreeMemory(device, staging_buffer_memory, VK_NULL_HANDLE);
-    staging_buffer_memory = VK_NULL_HANDLE;
-    vkDestroyBuffer(device, staging_buffer, VK_NULL_HANDLE);
-    staging_buffer = VK_NULL_HANDLE;
+    stbi_image_free(pixels);
+    pixels = nullptr;
 
 
     // put image in desired layout ready to be read by shaders
@@ -649,6 +471,11 @@ bool create_vulkan_texture(VkPhysicalDevice physical_device, VkDevice device,
         return false;
     }
 
+    if (is_own_batch && !submit_vulkan_upload_batch(true))
+    {
+        return false;
+    }
+
 
     // create sampler
 
@@ -694,8 +521,8 @@ bool create_vulkan_texture_empty(VkPhysicalDevice physical_device, VkDevice devi
     // allocate memory for image object
 
     if (!allocate_image_memory(physical_device, device,
-        out_texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, // look me up!
-        out_texture.size, out_texture.memory))
+        out_texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, // look me up!
+        out_texture.size, out_texture.allocation))
     {
         return false;
     }
@@ -704,7 +531,7 @@ bool create_vulkan_texture_empty(VkPhysicalDevice physical_device, VkDevice devi
     // bind image memory to image object
 
     if (!bind_image_to_memory(device,
-        out_texture.image, out_texture.memory))
+        out_texture.image, out_texture.allocation))
     {
         return false;
     }
@@ -961,6 +788,20 @@ bool transition_image_layout (VkImageLayout new_layout, vulkan_texture& texture)
   DBG_ASSERT (new_layout != VK_IMAGE_LAYOUT_UNDEFINED);
 
 
+  // record in to the open upload batch, so it stays ordered with any uploads to this texture
+  if (is_vulkan_upload_batch_open ())
+  {
+    if (!transition_image_layout (get_vulkan_upload_command_buffer (),
+      texture.image, texture.layout, new_layout))
+    {
+      return false;
+    }
+
+    texture.layout = new_layout;
+
+    return true;
+  }
+
   VkCommandBuffer cb = VK_NULL_HANDLE;
   if (!begin_single_time_commands (cb))
   {
@@ -1006,9 +847,9 @@ bool create_vulkan_mesh(VkPhysicalDevice physical_device, VkDevice device,
     DBG_ASSERT(num_indices > 0u);
     DBG_ASSERT(index_size > 0u);
     DBG_ASSERT(!CHECK_VULKAN_HANDLE(out_mesh.buffer_vertex));
-    DBG_ASSERT(!CHECK_VULKAN_HANDLE(out_mesh.memory_vertex));
+    DBG_ASSERT(!CHECK_VULKAN_HANDLE(out_mesh.allocation_vertex.memory));
     DBG_ASSERT(!CHECK_VULKAN_HANDLE(out_mesh.buffer_index));
-    DBG_ASSERT(!CHECK_VULKAN_HANDLE(out_mesh.memory_index));
+    DBG_ASSERT(!CHECK_VULKAN_HANDLE(out_mesh.allocation_index.memory));
 
 
     out_mesh.num_vertices = num_vertices;
@@ -1038,13 +879,13 @@ bool create_vulkan_mesh(VkPhysicalDevice physical_device, VkDevice device,
 
         if (!allocate_buffer_memory(physical_device, device,
             out_mesh.buffer_vertex,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, nullptr,
-            out_mesh.memory_vertex))
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            out_mesh.allocation_vertex))
         {
             return false;
         }
 
-        if (!bind_buffer_to_memory(device, out_mesh.buffer_vertex, out_mesh.memory_vertex))
+        if (!bind_buffer_to_memory(device, out_mesh.buffer_vertex, out_mesh.allocation_vertex))
         {
             return false;
         }
@@ -1080,13 +921,13 @@ bool create_vulkan_mesh(VkPhysicalDevice physical_device, VkDevice device,
 
         if (!allocate_buffer_memory(physical_device, device,
             out_mesh.buffer_index,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, nullptr,
-            out_mesh.memory_index))
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            out_mesh.allocation_index))
         {
             return false;
         }
 
-        if (!bind_buffer_to_memory(device, out_mesh.buffer_index, out_mesh.memory_index))
+        if (!bind_buffer_to_memory(device, out_mesh.buffer_index, out_mesh.allocation_index))
         {
             return false;
         }
@@ -1110,19 +951,17 @@ void release_vulkan_mesh (VkDevice device, vulkan_mesh& mesh)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (mesh.buffer_vertex));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (mesh.memory_vertex));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (mesh.allocation_vertex.memory));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (mesh.buffer_index));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (mesh.memory_index));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (mesh.allocation_index.memory));
 
 
-  vkFreeMemory (device, mesh.memory_index, VK_NULL_HANDLE);
-  mesh.memory_index = VK_NULL_HANDLE;
+  free_vulkan_memory (device, mesh.allocation_index);
 
   vkDestroyBuffer (device, mesh.buffer_index, VK_NULL_HANDLE);
   mesh.buffer_index = VK_NULL_HANDLE;
 
-  vkFreeMemory (device, mesh.memory_vertex, VK_NULL_HANDLE);
-  mesh.memory_vertex = VK_NULL_HANDLE;
+  free_vulkan_memory (device, mesh.allocation_vertex);
 
   vkDestroyBuffer (device, mesh.buffer_vertex, VK_NULL_HANDLE);
   mesh.buffer_vertex = VK_NULL_HANDLE;
@@ -1142,7 +981,7 @@ void release_vulkan_texture (VkDevice device, vulkan_texture& texture)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (texture.image));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (texture.memory));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (texture.allocation.memory));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (texture.sampler));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (texture.view));
 
@@ -1153,20 +992,39 @@ void release_vulkan_texture (VkDevice device, vulkan_texture& texture)
   vkDestroyImage (device, texture.image, VK_NULL_HANDLE);
   texture.image = VK_NULL_HANDLE;
 
-  vkFreeMemory (device, texture.memory, VK_NULL_HANDLE);
-  texture.memory = VK_NULL_HANDLE;
+  free_vulkan_memory (device, texture.allocation);
 
   texture = {};
 }
+void add_vulkan_buffer_release_callback (void (*callback) (VkBuffer buffer))
+{
+  DBG_ASSERT (callback != nullptr);
+  DBG_ASSERT (std::find (s_buffer_release_callbacks.begin (), s_buffer_release_callbacks.end (), callback) ==
+    s_buffer_release_callbacks.end ());
+
+
+  s_buffer_release_callbacks.push_back (callback);
+}
+void remove_vulkan_buffer_release_callback (void (*callback) (VkBuffer buffer))
+{
+  auto const found = std::find (s_buffer_release_callbacks.begin (), s_buffer_release_callbacks.end (), callback);
+  DBG_ASSERT (found != s_buffer_release_callbacks.end ());
+
+
+  s_buffer_release_callbacks.erase (found);
+}
 void release_vulkan_buffer (VkDevice device, vulkan_buffer& buffer)
 {
   DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
   DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer.buffer));
-  DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer.memory));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer.allocation.memory));
 
 
-  vkFreeMemory (device, buffer.memory, VK_NULL_HANDLE);
-  buffer.memory = VK_NULL_HANDLE;
+  for (auto callback : s_buffer_release_callbacks)
+  {
+    callback (buffer.buffer);
+  }
+  free_vulkan_memory (device, buffer.allocation);
 
   vkDestroyBuffer (device, buffer.buffer, VK_NULL_HANDLE);
   buffer.buffer = VK_NULL_HANDLE;
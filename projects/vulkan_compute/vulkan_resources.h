@@ -2,10 +2,15 @@
 
 #include "maths.h"                // for standard types
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
 #include <vulkan/vulkan.h>        // for everything vulkan
 
+#include "vulkan_memory.h"        // for vulkan_allocation
+
 #include <functional> // for std::function
+#include <span>       // for std::span
 
 
 /// <summary>
@@ -15,7 +20,7 @@
 struct vulkan_buffer
 {
   VkBuffer buffer = VK_NULL_HANDLE;
-  VkDeviceMemory memory = VK_NULL_HANDLE;
+  vulkan_allocation allocation = {};
 
   VkDeviceSize size = {};
 };
@@ -27,7 +32,7 @@ struct vulkan_buffer
 struct vulkan_texture
 {
   VkImage image = VK_NULL_HANDLE;
-  VkDeviceMemory memory = VK_NULL_HANDLE;
+  vulkan_allocation allocation = {};
   VkSampler sampler = VK_NULL_HANDLE;
   VkImageView view = VK_NULL_HANDLE;
 
@@ -45,11 +50,11 @@ struct vulkan_mesh
 {
   u32 num_vertices = {}, num_triangles = {};
   VkBuffer buffer_vertex = VK_NULL_HANDLE;
-  VkDeviceMemory memory_vertex = VK_NULL_HANDLE;
+  vulkan_allocation allocation_vertex = {};
 
   u32 num_indices = {};
   VkBuffer buffer_index = VK_NULL_HANDLE;
-  VkDeviceMemory memory_index = VK_NULL_HANDLE;
+  vulkan_allocation allocation_index = {};
 };
 
 
@@ -62,11 +67,29 @@ bool create_vulkan_buffer (VkPhysicalDevice physical_device, VkDevice device,
   vulkan_buffer& out_buffer);
 
 /// <summary>
-/// map memory, pass pointer of mapped memory to user defined function, unmap memory
+/// access host visible memory, pass pointer of mapped memory to user defined function
+/// handles invalidate before/flush after for non-coherent memory
+/// for one off access, use 'get_mapped_span' for anything accessed often
 /// </summary>
 /// <returns>true, if successful</returns>
 bool map_and_unmap_memory (VkDevice device,
-  VkDeviceMemory memory, std::function <void (void*)> func);
+  vulkan_allocation const& allocation, std::function <void (void*)> func);
+
+/// <summary>
+/// typed view of a host visible buffer, valid for the lifetime of the buffer
+/// if the memory is non-coherent, 'flush_vulkan_memory' after writing and 'invalidate_vulkan_memory' before reading
+/// </summary>
+/// <returns>empty span, if the buffer is not host visible</returns>
+template <typename T>
+std::span <T> get_mapped_span (vulkan_buffer const& buffer)
+{
+  if (buffer.allocation.mapped == nullptr)
+  {
+    return {};
+  }
+
+  return std::span <T> ((T*)buffer.allocation.mapped, (size_t)(buffer.size / sizeof (T)));
+}
 
 
 /// <summary>
@@ -121,6 +144,14 @@ bool create_vulkan_mesh (VkPhysicalDevice physical_device, VkDevice device,
   vulkan_mesh& out_mesh);
 
 
+/// <summary>
+/// 'callback' is called with every buffer 'release_vulkan_buffer' releases, before the handle is destroyed
+/// for libraries that cache objects per buffer (e.g. descriptor sets), a new buffer could get the same handle
+/// </summary>
+void add_vulkan_buffer_release_callback (void (*callback) (VkBuffer buffer));
+void remove_vulkan_buffer_release_callback (void (*callback) (VkBuffer buffer));
+
+
 void release_vulkan_mesh (VkDevice device, vulkan_mesh& mesh);
 void release_vulkan_image_view (VkDevice device, VkImageView& image_view);
 void release_vulkan_texture (VkDevice device, vulkan_texture& texture);
@@ -0,0 +1,357 @@
+#include "vulkan_trace.h"
+
+#include "vulkan_context.h"  // begin_single_time_commands, ...
+#include "vulkan_pipeline.h" // begin_command_buffer, create_vulkan_query_pool, ...
+#include "utility.h"         // DBG_ASSERT, DBG_ASSERT_VULKAN
+
+#include <array>     // for std::array
+#include <atomic>    // for std::atomic
+#include <chrono>    // for std::chrono
+#include <cstdio>    // for std::fopen, std::fprintf, std::fclose
+#include <mutex>     // for std::mutex, std::lock_guard
+#include <string>    // for std::string
+#include <thread>    // for std::this_thread
+#include <vector>    // for std::vector
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN       // exclude rarely-used content from the Windows headers
+#define NOMINMAX                  // prevent Windows macros defining their own min and max macros
+#include <Windows.h>              // for QueryPerformanceFrequency
+#endif // _WIN32
+
+
+constexpr size_t MAX_TRACE_EVENTS = 1u << 20u; // ~32MB, enough for minutes of frames, later events are dropped
+
+
+struct trace_event
+{
+  char const* name = nullptr;
+  char const* track = nullptr; // gpu scopes only, nullptr for cpu scopes
+  u32 thread_index = {};       // cpu scopes only
+  u64 begin_ns = {};
+  u64 end_ns = {};
+};
+
+
+// scopes can end on any thread (e.g. the cpu compute workers), 's_trace_mutex' guards the events and threads
+static std::atomic <bool> s_is_recording = false;
+static std::mutex s_trace_mutex;
+static std::string s_trace_path;
+static std::vector <trace_event> s_trace_events;
+static std::vector <std::thread::id> s_trace_threads; // index in here is the 'tid' of the thread's scopes
+static size_t s_num_dropped_events = {};
+
+// gpu timestamp 's_calibration_timestamp' was taken at cpu time 's_calibration_ns'
+static u64 s_calibration_timestamp = {};
+static u64 s_calibration_ns = {};
+static f32 s_timestamp_period_ns = {};
+
+
+#pragma region vulkan_trace_support
+static u64 get_cpu_time_ns ()
+{
+  return (u64)std::chrono::duration_cast <std::chrono::nanoseconds> (
+    std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+// caller holds 's_trace_mutex'
+static u32 get_thread_index ()
+{
+  std::thread::id const id = std::this_thread::get_id ();
+  for (u32 i = 0u; i < (u32)s_trace_threads.size (); ++i)
+  {
+    if (s_trace_threads [i] == id)
+    {
+      return i;
+    }
+  }
+  s_trace_threads.push_back (id);
+  return (u32)s_trace_threads.size () - 1u;
+}
+// caller holds 's_trace_mutex'
+static void add_event (trace_event const& event)
+{
+  if (s_trace_events.size () == MAX_TRACE_EVENTS)
+  {
+    ++s_num_dropped_events;
+    return;
+  }
+  s_trace_events.push_back (event);
+}
+static u64 timestamp_to_cpu_ns (u64 timestamp)
+{
+  double const delta_ns = ((double)timestamp - (double)s_calibration_timestamp) * s_timestamp_period_ns;
+  return (u64)((double)s_calibration_ns + delta_ns);
+}
+
+#ifdef _WIN32
+static VkTimeDomainEXT const HOST_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else // _WIN32
+static VkTimeDomainEXT const HOST_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif // _WIN32
+
+// read the gpu and cpu clocks at the same moment, the cpu clock must be the one behind 'std::chrono::steady_clock'
+static bool calibrate_with_extension (VkDevice device)
+{
+  // nullptr if 'create_vulkan_device' did not enable the extension
+  auto const vkGetCalibratedTimestampsEXT_ = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr (
+    device, "vkGetCalibratedTimestampsEXT");
+  if (vkGetCalibratedTimestampsEXT_ == nullptr)
+  {
+    return false;
+  }
+
+  std::array <VkCalibratedTimestampInfoEXT, 2u> const infos =
+  {{
+    {
+      .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+      //.pNext = VK_NULL_HANDLE,
+      .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+      //.pNext = VK_NULL_HANDLE,
+      .timeDomain = HOST_TIME_DOMAIN
+    }
+  }};
+  std::array <u64, 2u> timestamps = {};
+  u64 max_deviation = {};
+  VkResult const result = vkGetCalibratedTimestampsEXT_ (device, // device
+    (u32)infos.size (),                                         // timestampCount
+    infos.data (),                                              // pTimestampInfos
+    timestamps.data (),                                         // pTimestamps
+    &max_deviation);                                            // pMaxDeviation
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return false;
+  }
+
+  s_calibration_timestamp = timestamps [0];
+#ifdef _WIN32
+  LARGE_INTEGER frequency = {};
+  QueryPerformanceFrequency (&frequency);
+  s_calibration_ns = (u64)((double)timestamps [1] * 1e9 / (double)frequency.QuadPart);
+#else // _WIN32
+  s_calibration_ns = timestamps [1];
+#endif // _WIN32
+
+  dprintf ("trace: gpu clock calibrated with VK_EXT_calibrated_timestamps (max deviation %llu ns)\n",
+    (unsigned long long)max_deviation);
+  return true;
+}
+// no extension: write a timestamp in a one off submit, and take the middle of the cpu time either side of it
+static bool calibrate_with_submit (VkDevice device)
+{
+  VkQueryPool query_pool = VK_NULL_HANDLE;
+  if (!create_vulkan_query_pool (device, VK_QUERY_TYPE_TIMESTAMP, 1u, 0u, query_pool))
+  {
+    return false;
+  }
+
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  if (!begin_single_time_commands (command_buffer) ||
+    !begin_command_buffer (command_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+  {
+    vkDestroyQueryPool (device, query_pool, VK_NULL_HANDLE);
+    return false;
+  }
+  vkCmdResetQueryPool (command_buffer, query_pool, 0u, 1u);
+  vkCmdWriteTimestamp (command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 0u);
+  if (!end_command_buffer (command_buffer))
+  {
+    vkDestroyQueryPool (device, query_pool, VK_NULL_HANDLE);
+    return false;
+  }
+
+  u64 const submit_ns = get_cpu_time_ns ();
+  bool const is_submitted = end_single_time_commands ();
+  u64 const complete_ns = get_cpu_time_ns ();
+
+  u64 timestamp = {};
+  bool const is_read = is_submitted && CHECK_VULKAN_RESULT (vkGetQueryPoolResults (device,
+    query_pool, 0u, 1u, sizeof (timestamp), &timestamp, sizeof (u64),
+    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  vkDestroyQueryPool (device, query_pool, VK_NULL_HANDLE);
+  if (!is_read)
+  {
+    return false;
+  }
+
+  s_calibration_timestamp = timestamp;
+  s_calibration_ns = submit_ns + (complete_ns - submit_ns) / 2u;
+
+  dprintf ("trace: gpu clock calibrated with a submit (+/- %.3f ms)\n", (complete_ns - submit_ns) / 2e6);
+  return true;
+}
+#pragma endregion
+
+
+bool can_calibrate_vulkan_trace_clock (VkInstance instance, VkPhysicalDevice physical_device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (instance));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+
+
+  auto const vkGetPhysicalDeviceCalibrateableTimeDomainsEXT_ = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr (
+    instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+  if (vkGetPhysicalDeviceCalibrateableTimeDomainsEXT_ == nullptr)
+  {
+    return false;
+  }
+
+  u32 num_domains = {};
+  if (!CHECK_VULKAN_RESULT (vkGetPhysicalDeviceCalibrateableTimeDomainsEXT_ (physical_device, &num_domains, VK_NULL_HANDLE)))
+  {
+    return false;
+  }
+  std::vector <VkTimeDomainEXT> domains (num_domains);
+  if (!CHECK_VULKAN_RESULT (vkGetPhysicalDeviceCalibrateableTimeDomainsEXT_ (physical_device, &num_domains, domains.data ())))
+  {
+    return false;
+  }
+
+  bool has_device_domain = false, has_host_domain = false;
+  for (VkTimeDomainEXT const domain : domains)
+  {
+    has_device_domain = has_device_domain || domain == VK_TIME_DOMAIN_DEVICE_EXT;
+    has_host_domain = has_host_domain || domain == HOST_TIME_DOMAIN;
+  }
+  return has_device_domain && has_host_domain;
+}
+
+vulkan_trace_scope::vulkan_trace_scope (char const* name)
+  : name (name), begin_ns (s_is_recording ? get_cpu_time_ns () : 0u)
+{
+}
+vulkan_trace_scope::~vulkan_trace_scope ()
+{
+  // recording may have started/stopped inside the scope
+  if (s_is_recording && begin_ns != 0u)
+  {
+    u64 const end_ns = get_cpu_time_ns ();
+    std::lock_guard <std::mutex> const lock (s_trace_mutex);
+    if (s_is_recording)
+    {
+      add_event ({ .name = name, .thread_index = get_thread_index (), .begin_ns = begin_ns, .end_ns = end_ns });
+    }
+  }
+}
+
+
+bool begin_vulkan_trace (VkPhysicalDevice physical_device, VkDevice device,
+  char const* trace_path)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT (trace_path != nullptr);
+  DBG_ASSERT_MSG (!s_is_recording, "must call 'end_vulkan_trace' before calling 'begin_vulkan_trace' again!\n");
+
+
+  VkPhysicalDeviceProperties properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &properties);
+  s_timestamp_period_ns = properties.limits.timestampPeriod;
+
+  if (!calibrate_with_extension (device) &&
+    !calibrate_with_submit (device))
+  {
+    return DBG_ASSERT_MSG (false, "trace: unable to calibrate the gpu clock\n");
+  }
+
+  std::lock_guard <std::mutex> const lock (s_trace_mutex);
+  s_trace_path = trace_path;
+  s_trace_events.clear ();
+  s_trace_events.reserve (MAX_TRACE_EVENTS / 16u);
+  s_trace_threads.clear ();
+  s_num_dropped_events = 0u;
+  s_is_recording = true;
+
+  return true;
+}
+
+bool is_vulkan_trace_recording ()
+{
+  return s_is_recording;
+}
+
+void add_vulkan_trace_gpu_scope (char const* name, char const* track,
+  u64 begin_timestamp, u64 end_timestamp)
+{
+  DBG_ASSERT (name != nullptr && track != nullptr);
+  if (!s_is_recording)
+  {
+    return;
+  }
+
+
+  u64 const begin_ns = timestamp_to_cpu_ns (begin_timestamp);
+  u64 const end_ns = timestamp_to_cpu_ns (end_timestamp);
+  std::lock_guard <std::mutex> const lock (s_trace_mutex);
+  if (s_is_recording)
+  {
+    add_event ({ .name = name, .track = track, .begin_ns = begin_ns, .end_ns = end_ns > begin_ns ? end_ns : begin_ns });
+  }
+}
+
+void end_vulkan_trace ()
+{
+  if (!s_is_recording)
+  {
+    return;
+  }
+  std::lock_guard <std::mutex> const lock (s_trace_mutex);
+  s_is_recording = false;
+
+
+  FILE* fp = std::fopen (s_trace_path.c_str (), "w");
+  if (fp == nullptr)
+  {
+    dprintf ("trace: unable to write '%s'\n", s_trace_path.c_str ());
+    return;
+  }
+
+  // 'X' = complete event, times in microseconds relative to the first event
+  // cpu scopes in process 1 (one row per thread), gpu scopes in process 2 (one row per track)
+  u64 origin_ns = ~0ull;
+  for (trace_event const& event : s_trace_events)
+  {
+    origin_ns = event.begin_ns < origin_ns ? event.begin_ns : origin_ns;
+  }
+
+  std::vector <char const*> tracks;
+  auto const get_track_index = [&tracks](char const* track) -> u32
+  {
+    for (u32 i = 0u; i < (u32)tracks.size (); ++i)
+    {
+      if (std::string (tracks [i]) == track)
+      {
+        return i;
+      }
+    }
+    tracks.push_back (track);
+    return (u32)tracks.size () - 1u;
+  };
+
+  std::fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  std::fprintf (fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+  std::fprintf (fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+  for (trace_event const& event : s_trace_events)
+  {
+    bool const is_gpu = event.track != nullptr;
+    std::fprintf (fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+      event.name, is_gpu ? "gpu" : "cpu", is_gpu ? 2u : 1u, is_gpu ? get_track_index (event.track) : event.thread_index,
+      (event.begin_ns - origin_ns) / 1e3, (event.end_ns - event.begin_ns) / 1e3);
+  }
+  for (u32 i = 0u; i < (u32)tracks.size (); ++i)
+  {
+    std::fprintf (fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", i, tracks [i]);
+  }
+  std::fprintf (fp, "\n]}\n");
+  std::fclose (fp);
+
+  dprintf ("trace: %llu events written to '%s'%s\n", (unsigned long long)s_trace_events.size (), s_trace_path.c_str (),
+    s_num_dropped_events > 0u ? " (later events were dropped, see MAX_TRACE_EVENTS)" : "");
+
+  s_trace_events.clear ();
+  s_trace_events.shrink_to_fit ();
+  s_trace_threads.clear ();
+  s_trace_path.clear ();
+}
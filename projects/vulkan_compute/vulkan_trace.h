@@ -0,0 +1,69 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+
+// trace recorder:
+// cpu scopes ('TRACE_SCOPE') and gpu scopes (the profiler's timestamps, see 'begin_vulkan_profile_scope') on one timeline,
+// written as a chrome trace (json) to open in https://ui.perfetto.dev or chrome://tracing
+// shows where the cpu waits on the gpu (submit/wait scopes) and where the gpu sits idle (gaps between gpu scopes)
+//
+// gpu timestamps are moved on to the cpu clock ('std::chrono::steady_clock') with 'VK_EXT_calibrated_timestamps'
+// when the device has it, otherwise by timing a one off timestamp submit, which is only good to ~the submit latency
+//
+// recording is off until 'begin_vulkan_trace', so the scopes cost next to nothing in normal runs
+// scopes may end on any thread, each thread gets its own row
+
+
+/// <summary>
+/// times a cpu scope, from construction to destruction
+/// 'name' MUST outlive the trace (e.g. a string literal)
+/// </summary>
+struct vulkan_trace_scope
+{
+  explicit vulkan_trace_scope (char const* name);
+  ~vulkan_trace_scope ();
+
+  vulkan_trace_scope (vulkan_trace_scope const&) = delete;
+  vulkan_trace_scope& operator= (vulkan_trace_scope const&) = delete;
+
+  char const* name = nullptr;
+  u64 begin_ns = {};
+};
+#define TRACE_SCOPE_CONCAT_IMPL(a, b) a##b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT_IMPL (a, b)
+#define TRACE_SCOPE(name) vulkan_trace_scope const TRACE_SCOPE_CONCAT (trace_scope_, __LINE__) (name)
+
+
+/// <summary>
+/// true, if 'VK_EXT_calibrated_timestamps' can read the gpu clock and the clock behind 'std::chrono::steady_clock' together
+/// called by 'create_vulkan_device' to decide whether to enable the extension
+/// </summary>
+bool can_calibrate_vulkan_trace_clock (VkInstance instance, VkPhysicalDevice physical_device);
+/// <summary>
+/// start recording, calibrates the gpu clock against the cpu clock
+/// uses 'VK_EXT_calibrated_timestamps' if 'create_vulkan_device' enabled it
+/// </summary>
+/// <returns>true, if successful</returns>
+bool begin_vulkan_trace (VkPhysicalDevice physical_device, VkDevice device,
+  char const* trace_path);
+/// <summary>
+/// true between 'begin_vulkan_trace' and 'end_vulkan_trace'
+/// </summary>
+bool is_vulkan_trace_recording ();
+/// <summary>
+/// record a gpu scope, 'begin'/'end' are raw timestamp query values
+/// 'track' groups the scopes in to rows, e.g. by queue ("compute", "graphics")
+/// called by the profiler as it resolves its queries
+/// </summary>
+void add_vulkan_trace_gpu_scope (char const* name, char const* track,
+  u64 begin_timestamp, u64 end_timestamp);
+/// <summary>
+/// stop recording and write the trace to 'trace_path' (passed to 'begin_vulkan_trace')
+/// </summary>
+void end_vulkan_trace ();
@@ -0,0 +1,434 @@
+#include "vulkan_upload.h"
+
+#include "vulkan_context.h"   // create_vulkan_command_pool, ...
+#include "vulkan_pipeline.h"  // begin_command_buffer, ...
+#include "vulkan_resources.h" // create_vulkan_buffer, ...
+#include "utility.h"          // DBG_ASSERT, DBG_ASSERT_VULKAN
+
+#include <algorithm> // for std::max
+#include <array>     // for std::array
+#include <vector>    // for std::vector
+
+
+constexpr VkDeviceSize STAGING_RING_SIZE = 32ull << 20; // 32MB, bigger uploads get a temporary staging buffer
+constexpr u32 NUM_UPLOAD_SLOTS = 2u;                    // batches that can be in flight while the next is recorded
+
+
+struct upload_slot
+{
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+
+  bool is_in_flight = false;
+  u64 submit_index = {};                          // staging memory has to be recycled in submission order
+  VkDeviceSize ring_bytes = {};                   // staging ring space used by this batch (includes padding)
+  std::vector <vulkan_buffer> overflow_buffers;   // uploads too big for the ring, released with the batch
+};
+
+
+static VkPhysicalDevice s_physical_device = VK_NULL_HANDLE;
+static VkDevice s_device = VK_NULL_HANDLE;
+static VkQueue s_queue = VK_NULL_HANDLE;
+static VkCommandPool s_command_pool = VK_NULL_HANDLE;
+
+static vulkan_buffer s_staging_ring;
+static VkDeviceSize s_staging_alignment = 16u;
+static VkDeviceSize s_ring_head = {}; // next free byte
+static VkDeviceSize s_ring_used = {}; // bytes between the oldest in flight batch and the head
+
+static std::array <upload_slot, NUM_UPLOAD_SLOTS> s_slots;
+static u32 s_current_slot = 0u;
+static u64 s_num_submits = {};
+static bool s_is_batch_open = false;
+
+
+#pragma region vulkan_upload_support
+static VkDeviceSize align_up (VkDeviceSize value, VkDeviceSize alignment)
+{
+  return ((value + alignment - 1u) / alignment) * alignment;
+}
+
+static bool create_upload_resources (VkPhysicalDevice physical_device, VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+
+
+  s_physical_device = physical_device;
+  s_device = device;
+
+  // copies are recorded on the compute queue, same as 'begin_single_time_commands'
+  if (!get_vulkan_queue_compute (s_queue))
+  {
+    return false;
+  }
+  if (!create_vulkan_command_pool (VK_QUEUE_COMPUTE_BIT, s_command_pool))
+  {
+    return false;
+  }
+  for (upload_slot& slot : s_slots)
+  {
+    if (!create_vulkan_command_buffers (1u, s_command_pool, &slot.command_buffer))
+    {
+      return false;
+    }
+    if (!create_vulkan_fences (1u, 0u, &slot.fence))
+    {
+      return false;
+    }
+  }
+
+  // buffer -> image copies need offsets aligned to the texel size, 16 covers every format we use
+  VkPhysicalDeviceProperties device_properties = {};
+  vkGetPhysicalDeviceProperties (physical_device, &device_properties);
+  s_staging_alignment = std::max (device_properties.limits.optimalBufferCopyOffsetAlignment, (VkDeviceSize)16u);
+
+  return create_vulkan_buffer (physical_device, device,
+    STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    s_staging_ring);
+}
+
+static bool retire_oldest_batch ()
+{
+  upload_slot* oldest = nullptr;
+  for (upload_slot& slot : s_slots)
+  {
+    if (slot.is_in_flight && (oldest == nullptr || slot.submit_index < oldest->submit_index))
+    {
+      oldest = &slot;
+    }
+  }
+  if (oldest == nullptr)
+  {
+    return false; // nothing in flight
+  }
+
+  VkResult const result = vkWaitForFences (s_device, // device
+    1u,                                              // fenceCount
+    &oldest->fence,                                  // pFences
+    VK_TRUE,                                         // waitAll
+    UINT64_MAX);                                     // timeout
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "failed to wait for upload batch\n");
+  }
+
+  // batches are recycled in submission order, so the space this batch used is at the tail of the ring
+  s_ring_used -= oldest->ring_bytes;
+  if (s_ring_used == 0u)
+  {
+    s_ring_head = 0u; // empty, start again from the beginning to avoid wrapping
+  }
+
+  for (vulkan_buffer& buffer : oldest->overflow_buffers)
+  {
+    release_vulkan_buffer (s_device, buffer);
+  }
+  oldest->overflow_buffers.clear ();
+
+  oldest->ring_bytes = {};
+  oldest->is_in_flight = false;
+
+  return true;
+}
+
+static bool allocate_from_ring (VkDeviceSize size,
+  VkDeviceSize& out_offset)
+{
+  // the used part of the ring runs from the tail (oldest batch) to the head,
+  // new allocations are always taken contiguously at the head, wrapping to the start if they don't fit before the end
+  VkDeviceSize offset = align_up (s_ring_head, s_staging_alignment);
+  if (offset + size > STAGING_RING_SIZE)
+  {
+    offset = 0u;
+  }
+  VkDeviceSize const consumed = (offset >= s_ring_head ? offset - s_ring_head : STAGING_RING_SIZE - s_ring_head) + size;
+  if (s_ring_used + consumed > STAGING_RING_SIZE)
+  {
+    return false;
+  }
+
+  s_ring_head = offset + size;
+  s_ring_used += consumed;
+  s_slots [s_current_slot].ring_bytes += consumed;
+
+  out_offset = offset;
+  return true;
+}
+
+static bool stage (VkDeviceSize size, std::function <void (void*)> const& func,
+  VkBuffer& out_staging_buffer, VkDeviceSize& out_staging_offset)
+{
+  DBG_ASSERT_MSG (s_is_batch_open, "must call 'begin_vulkan_upload_batch' before uploading\n");
+  DBG_ASSERT (size > 0u);
+
+
+  // try the ring, make room by recycling finished batches, then by flushing the batch being recorded
+  VkDeviceSize offset = {};
+  bool is_staged = allocate_from_ring (size, offset);
+  while (!is_staged && retire_oldest_batch ())
+  {
+    is_staged = allocate_from_ring (size, offset);
+  }
+  if (!is_staged && s_slots [s_current_slot].ring_bytes > 0u)
+  {
+    if (!submit_vulkan_upload_batch (true) || !begin_vulkan_upload_batch (s_physical_device, s_device))
+    {
+      return false;
+    }
+    is_staged = allocate_from_ring (size, offset);
+  }
+
+  if (is_staged)
+  {
+    func ((char*)s_staging_ring.allocation.mapped + offset);
+    if (!flush_vulkan_memory (s_device, s_staging_ring.allocation, offset, size))
+    {
+      return false;
+    }
+
+    out_staging_buffer = s_staging_ring.buffer;
+    out_staging_offset = offset;
+    return true;
+  }
+
+  // bigger than the whole ring, give it a staging buffer of its own
+  vulkan_buffer overflow_buffer;
+  if (!create_vulkan_buffer (s_physical_device, s_device,
+    size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    overflow_buffer))
+  {
+    return false;
+  }
+  if (!map_and_unmap_memory (s_device, overflow_buffer.allocation, func))
+  {
+    return false;
+  }
+
+  out_staging_buffer = overflow_buffer.buffer;
+  out_staging_offset = 0u;
+  s_slots [s_current_slot].overflow_buffers.push_back (overflow_buffer);
+
+  return true;
+}
+#pragma endregion
+
+
+bool begin_vulkan_upload_batch (VkPhysicalDevice physical_device, VkDevice device)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (physical_device));
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (device));
+  DBG_ASSERT_MSG (!s_is_batch_open, "must call 'submit_vulkan_upload_batch' before calling 'begin_vulkan_upload_batch' again!\n");
+
+
+  if (!CHECK_VULKAN_HANDLE (s_command_pool))
+  {
+    if (!create_upload_resources (physical_device, device))
+    {
+      return false;
+    }
+  }
+
+  // slots are reused round robin, so if the next one is still in flight it is also the oldest
+  upload_slot& slot = s_slots [s_current_slot];
+  if (slot.is_in_flight && !retire_oldest_batch ())
+  {
+    return false;
+  }
+
+  if (!CHECK_VULKAN_RESULT (vkResetFences (s_device, 1u, &slot.fence)))
+  {
+    return DBG_ASSERT (false);
+  }
+  if (!begin_command_buffer (slot.command_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+  {
+    return false;
+  }
+
+  s_is_batch_open = true;
+
+  return true;
+}
+bool is_vulkan_upload_batch_open ()
+{
+  return s_is_batch_open;
+}
+VkCommandBuffer get_vulkan_upload_command_buffer ()
+{
+  DBG_ASSERT (s_is_batch_open);
+
+
+  return s_slots [s_current_slot].command_buffer;
+}
+
+bool upload_vulkan_buffer (VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+  std::function <void (void*)> func)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (buffer));
+
+
+  VkBuffer staging_buffer = VK_NULL_HANDLE;
+  VkDeviceSize staging_offset = {};
+  if (!stage (size, func, staging_buffer, staging_offset))
+  {
+    return false;
+  }
+
+  VkBufferCopy const copy_region =
+  {
+    .srcOffset = staging_offset,
+    .dstOffset = offset,
+    .size = size
+  };
+  vkCmdCopyBuffer (get_vulkan_upload_command_buffer (), // commandBuffer
+    staging_buffer,                                     // srcBuffer
+    buffer,                                             // dstBuffer
+    1u,                                                 // regionCount
+    &copy_region);                                      // pRegions
+
+  return true;
+}
+bool upload_vulkan_image (VkImage image, VkExtent2D const& extent, VkDeviceSize size,
+  std::function <void (void*)> func)
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (image));
+
+
+  VkBuffer staging_buffer = VK_NULL_HANDLE;
+  VkDeviceSize staging_offset = {};
+  if (!stage (size, func, staging_buffer, staging_offset))
+  {
+    return false;
+  }
+
+  VkBufferImageCopy const copy_region =
+  {
+    .bufferOffset = staging_offset,
+    .bufferRowLength = 0u,   // tightly packed
+    .bufferImageHeight = 0u, // tightly packed
+    .imageSubresource =
+    {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .mipLevel = 0u,
+      .baseArrayLayer = 0u,
+      .layerCount = 1u
+    },
+    .imageOffset = { 0, 0, 0 },
+    .imageExtent = { extent.width, extent.height, 1u }
+  };
+  vkCmdCopyBufferToImage (get_vulkan_upload_command_buffer (), // commandBuffer
+    staging_buffer,                                            // srcBuffer
+    image,                                                     // dstImage
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,                      // dstImageLayout
+    1u,                                                        // regionCount
+    &copy_region);                                             // pRegions
+
+  return true;
+}
+
+bool submit_vulkan_upload_batch (bool wait)
+{
+  DBG_ASSERT_MSG (s_is_batch_open, "must call 'begin_vulkan_upload_batch' before calling 'submit_vulkan_upload_batch'!\n");
+
+
+  upload_slot& slot = s_slots [s_current_slot];
+
+  // make the copies visible to whatever is submitted to this queue next
+  VkMemoryBarrier const memory_barrier =
+  {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    //.pNext = VK_NULL_HANDLE,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT
+  };
+  vkCmdPipelineBarrier (slot.command_buffer, // commandBuffer
+    VK_PIPELINE_STAGE_TRANSFER_BIT,          // srcStageMask
+    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,      // dstStageMask
+    0u,                                      // dependencyFlags
+    1u,                                      // memoryBarrierCount
+    &memory_barrier,                         // pMemoryBarriers
+    0u,                                      // bufferMemoryBarrierCount
+    VK_NULL_HANDLE,                          // pBufferMemoryBarriers
+    0u,                                      // imageMemoryBarrierCount
+    VK_NULL_HANDLE);                         // pImageMemoryBarriers
+
+  if (!end_command_buffer (slot.command_buffer))
+  {
+    return false;
+  }
+
+  VkSubmitInfo const submit_info =
+  {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    //.pNext = VK_NULL_HANDLE,
+    //.waitSemaphoreCount = {},
+    //.pWaitSemaphores = VK_NULL_HANDLE,
+    //.pWaitDstStageMask = VK_NULL_HANDLE,
+    .commandBufferCount = 1u,
+    .pCommandBuffers = &slot.command_buffer,
+    //.signalSemaphoreCount = {},
+    //.pSignalSemaphores = VK_NULL_HANDLE
+  };
+  VkResult const result = vkQueueSubmit (s_queue, 1u, &submit_info, slot.fence);
+  if (!CHECK_VULKAN_RESULT (result))
+  {
+    return DBG_ASSERT_MSG (false, "upload submit failed\n");
+  }
+
+  slot.is_in_flight = true;
+  slot.submit_index = s_num_submits++;
+  s_current_slot = (s_current_slot + 1u) % NUM_UPLOAD_SLOTS;
+  s_is_batch_open = false;
+
+  return wait ? wait_vulkan_uploads () : true;
+}
+bool wait_vulkan_uploads ()
+{
+  DBG_ASSERT (CHECK_VULKAN_HANDLE (s_device));
+
+
+  u32 num_in_flight = 0u;
+  for (upload_slot const& slot : s_slots)
+  {
+    num_in_flight += slot.is_in_flight ? 1u : 0u;
+  }
+
+  for (u32 i = 0u; i < num_in_flight; ++i)
+  {
+    if (!retire_oldest_batch ())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void release_vulkan_uploads ()
+{
+  DBG_ASSERT_MSG (!s_is_batch_open, "releasing upload batcher with an open batch\n");
+
+
+  if (!CHECK_VULKAN_HANDLE (s_command_pool))
+  {
+    return; // never used
+  }
+
+  wait_vulkan_uploads ();
+
+  release_vulkan_buffer (s_device, s_staging_ring);
+  for (upload_slot& slot : s_slots)
+  {
+    release_vulkan_fences (1u, &slot.fence);
+    release_vulkan_command_buffers (1u, s_command_pool, &slot.command_buffer);
+    slot = {};
+  }
+  release_vulkan_command_pool (s_command_pool);
+
+  s_queue = VK_NULL_HANDLE;
+  s_device = VK_NULL_HANDLE;
+  s_physical_device = VK_NULL_HANDLE;
+  s_ring_head = s_ring_used = {};
+  s_current_slot = 0u;
+  s_num_submits = {};
+}
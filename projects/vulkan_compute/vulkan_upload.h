@@ -0,0 +1,70 @@
+#pragma once
+
+#include "maths.h"                // for standard types
+
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR // tell vulkan we are on Windows platform
+#endif // _WIN32
+#include <vulkan/vulkan.h>        // for everything vulkan
+
+#include <functional> // for std::function
+
+
+// upload batcher:
+// copies host data to device local buffers/images through a persistently mapped staging ring
+// every upload recorded between 'begin_vulkan_upload_batch' and 'submit_vulkan_upload_batch'
+// shares ONE command buffer, ONE submit and ONE fence, instead of a staging buffer + round trip each
+//
+// 'create_vulkan_texture', 'create_vulkan_mesh' and 'transition_image_layout' (one off version)
+// record in to the open batch if there is one, otherwise they open (and wait on) a batch of their own
+// NOTE: resources uploaded in a batch are not ready to use until the batch has been submitted!
+
+
+/// <summary>
+/// start recording uploads
+/// the staging ring, command buffers and fences are created on first use
+/// </summary>
+/// <returns>true, if successful</returns>
+bool begin_vulkan_upload_batch (VkPhysicalDevice physical_device, VkDevice device);
+/// <summary>
+/// true between 'begin_vulkan_upload_batch' and 'submit_vulkan_upload_batch'
+/// </summary>
+bool is_vulkan_upload_batch_open ();
+/// <summary>
+/// command buffer of the open batch, to record extra commands (e.g. layout transitions) alongside the copies
+/// fetch it again after each upload, a full staging ring submits the batch and carries on in a fresh command buffer
+/// </summary>
+VkCommandBuffer get_vulkan_upload_command_buffer ();
+
+/// <summary>
+/// stage 'size' bytes, written by the user defined function, and record a copy to 'buffer' at 'offset'
+/// </summary>
+/// <returns>true, if successful</returns>
+bool upload_vulkan_buffer (VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+  std::function <void (void*)> func);
+/// <summary>
+/// stage 'size' bytes of tightly packed texels, written by the user defined function, and record a copy to 'image'
+/// image must be in 'VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL' at this point in the batch
+/// </summary>
+/// <returns>true, if successful</returns>
+bool upload_vulkan_image (VkImage image, VkExtent2D const& extent, VkDeviceSize size,
+  std::function <void (void*)> func);
+
+/// <summary>
+/// submit all uploads recorded since 'begin_vulkan_upload_batch'
+/// later submits on the compute queue are ordered after the copies, so waiting is only needed
+/// for other queues or before the host touches the resources
+/// </summary>
+/// <returns>true, if successful</returns>
+bool submit_vulkan_upload_batch (bool wait);
+/// <summary>
+/// block until every submitted batch has completed, and recycle their staging memory
+/// </summary>
+/// <returns>true, if successful</returns>
+bool wait_vulkan_uploads ();
+
+/// <summary>
+/// waits for outstanding uploads, then frees the staging ring, command buffers and fences
+/// MUST be called before 'release_vulkan_memory'
+/// </summary>
+void release_vulkan_uploads ();